@@ -0,0 +1,763 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <random>
+#include <string>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <welib3d/acquisition.h>
+#include <welib3d/create_mesh.h>
+#include <welib3d/hole_filling.h>
+#include <welib3d/parallel_mesh.h>
+#include <welib3d/point_kernels.h>
+#include <welib3d/sensor3d_sim.h>
+#include <welib3d/transform.h>
+#include <welib3d/welib3d.h>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+// windows.h first
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+using namespace we;
+
+constexpr float focal{2000.0f};
+constexpr int command_count{2000};
+constexpr int frame_count{60};
+
+struct Options {
+  std::string filter_;
+  int repeats_{3};
+  std::string out_;
+};
+
+struct Config {
+  size_t width_;
+  size_t height_;
+  float holes_;
+};
+
+struct Result {
+  std::string name_;
+  Config config_;
+  size_t points_;
+  size_t bytes_;
+  double seconds_;
+  size_t peak_memory_;
+};
+
+struct Latency {
+  std::string name_;
+  double p50_;
+  double p90_;
+  double p99_;
+};
+
+// peak resident memory of the process so far, in bytes
+[[nodiscard]] size_t peak_memory() {
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS pmc{};
+  GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+  return pmc.PeakWorkingSetSize;
+#elif defined(__APPLE__)
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<size_t>(usage.ru_maxrss);
+#else
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+[[nodiscard]] double seconds(std::chrono::steady_clock::duration d) {
+  return std::chrono::duration<double>(d).count();
+}
+
+// seconds taken by f, throws if f returns false
+template <typename F> [[nodiscard]] double timed(F &&f) {
+  const auto start{std::chrono::steady_clock::now()};
+
+  if constexpr (std::is_same_v<std::invoke_result_t<F>, bool>) {
+    if (not f()) {
+      throw std::runtime_error{"benchmark run failed"};
+    }
+  } else {
+    f();
+  }
+
+  return seconds(std::chrono::steady_clock::now() - start);
+}
+
+[[nodiscard]] Matrix3f intrinsic(const Config &config) {
+  return Matrix3f{focal, 0.0f,  0.5f * static_cast<float>(config.width_),
+                  0.0f,  focal, 0.5f * static_cast<float>(config.height_),
+                  0.0f,  0.0f,  1.0f};
+}
+
+[[nodiscard]] Matrix4f extrinsic() {
+  return Matrix4f{1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+                  0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+}
+
+// pinhole view of a tilted plane with a bump at 500 mm, holes_ of the pixels empty
+[[nodiscard]] StructuredPointCloud3f synthetic_cloud(const Config &config) {
+  StructuredPointCloud3f pcd;
+  pcd.create(config.width_, config.height_, Point3f{0.0f, 0.0f, 0.0f});
+
+  std::mt19937 rng{42};
+  std::normal_distribution<float> noise{0.0f, 0.05f};
+  std::uniform_real_distribution<float> uniform{0.0f, 1.0f};
+  const float cx{0.5f * static_cast<float>(config.width_)};
+  const float cy{0.5f * static_cast<float>(config.height_)};
+
+  for (size_t i{0}; i < config.height_; ++i) {
+    for (size_t j{0}; j < config.width_; ++j) {
+      if (uniform(rng) < config.holes_) {
+        continue;
+      }
+
+      const float u{(static_cast<float>(j) - cx) / focal};
+      const float v{(static_cast<float>(i) - cy) / focal};
+      const float z{500.0f + 50.0f * u + 20.0f * std::exp(-(u * u + v * v) * 100.0f) +
+                    noise(rng)};
+      pcd(i, j) = Point3f{u * z, v * z, z};
+    }
+  }
+
+  return pcd;
+}
+
+struct TxtCase {
+  const char *name_;
+  TxtFileFormat format_;
+};
+
+constexpr TxtCase txt_cases[]{{"XYZ", TxtFileFormat::XYZ},
+                              {"XYZI", TxtFileFormat::XYZI},
+                              {"XYZRGB", TxtFileFormat::XYZRGB},
+                              {"XYZNxNyNz", TxtFileFormat::XYZNxNyNz},
+                              {"XYZINxNyNz", TxtFileFormat::XYZINxNyNz},
+                              {"XYZIRGBNxNyNz", TxtFileFormat::XYZIRGBNxNyNz}};
+
+// one line per pixel with the columns named by columns, e.g. "XYZINxNyNz"
+void write_txt(const StructuredPointCloud3f &pcd, const std::filesystem::path &path,
+               std::string_view columns) {
+  std::ofstream f{path, std::ios_base::binary};
+  const auto points{pcd.points()};
+  char line[256];
+
+  for (size_t i{0}; i < points.size(); ++i) {
+    const auto &p{points[i]};
+    int len{std::snprintf(line, sizeof(line), "%.4f %.4f %.4f", static_cast<double>(p.x()),
+                          static_cast<double>(p.y()), static_cast<double>(p.z()))};
+
+    for (auto rest{columns.substr(3)}; not rest.empty();) {
+      const auto room{sizeof(line) - static_cast<size_t>(len)};
+
+      if (rest.starts_with("I")) {
+        len += std::snprintf(line + len, room, " %d", static_cast<int>(i % 4096));
+        rest.remove_prefix(1);
+      } else if (rest.starts_with("RGB")) {
+        len += std::snprintf(line + len, room, " %d %d %d", static_cast<int>(i % 256), 128, 64);
+        rest.remove_prefix(3);
+      } else {
+        len += std::snprintf(line + len, room, " %.5f %.5f %.5f", 0.0, -0.19612, 0.98058);
+        rest.remove_prefix(6);
+      }
+    }
+
+    line[len++] = '\n';
+    f.write(line, len);
+  }
+}
+
+class Suite {
+public:
+  explicit Suite(const Options &options) : options_{options} {}
+
+  [[nodiscard]] bool selected(std::string_view name) const {
+    return options_.filter_.empty() or name.find(options_.filter_) != std::string_view::npos;
+  }
+
+  [[nodiscard]] bool failed() const { return failed_; }
+
+  // best of repeats of f(), which returns the seconds of its timed part. A run that throws
+  // fails the case, the suite goes on with the next one
+  template <typename F>
+  void run(std::string_view name, const Config &config, size_t points, F &&f) {
+    run(name, config, points, {}, std::forward<F>(f));
+  }
+
+  // as run() for I/O cases, which also report the bytes/s of the file at path once f() is done
+  template <typename F>
+  void run(std::string_view name, const Config &config, size_t points,
+           const std::filesystem::path &path, F &&f) {
+    if (not selected(name)) {
+      return;
+    }
+
+    double best{std::numeric_limits<double>::max()};
+
+    try {
+      for (int i{0}; i < options_.repeats_; ++i) {
+        best = std::min(best, f());
+      }
+    } catch (const std::exception &ex) {
+      failed_ = true;
+      std::fprintf(stderr, "%-34s %5zux%-5zu holes %.2f FAILED: %s\n", name.data(),
+                   config.width_, config.height_, static_cast<double>(config.holes_), ex.what());
+      return;
+    }
+
+    std::error_code ec;
+    const auto bytes{path.empty() ? uintmax_t{0} : std::filesystem::file_size(path, ec)};
+
+    results_.push_back({std::string{name}, config, points,
+                        ec ? size_t{0} : static_cast<size_t>(bytes), best, peak_memory()});
+
+    const auto &r{results_.back()};
+    std::fprintf(stderr, "%-34s %5zux%-5zu holes %.2f %12.0f points/s", r.name_.c_str(),
+                 config.width_, config.height_, static_cast<double>(config.holes_),
+                 static_cast<double>(points) / best);
+
+    if (r.bytes_ != 0) {
+      std::fprintf(stderr, " %9.1f MB/s", static_cast<double>(r.bytes_) / best / 1e6);
+    }
+
+    std::fputc('\n', stderr);
+  }
+
+  void add_latency(std::string_view name, std::vector<double> &samples) {
+    std::ranges::sort(samples);
+
+    const auto at{[&](double q) {
+      return samples[static_cast<size_t>(q * static_cast<double>(samples.size() - 1))] * 1e6;
+    }};
+
+    latencies_.push_back({std::string{name}, at(0.5), at(0.9), at(0.99)});
+    std::fprintf(stderr, "%-34s p50 %9.1f us  p90 %9.1f us  p99 %9.1f us\n", name.data(),
+                 at(0.5), at(0.9), at(0.99));
+  }
+
+  void write_json(std::FILE *out) const {
+    std::fputs("{\n  \"benchmarks\": [", out);
+
+    for (size_t i{0}; i < results_.size(); ++i) {
+      const auto &r{results_[i]};
+      std::fprintf(out,
+                   "%s\n    {\"name\": \"%s\", \"width\": %zu, \"height\": %zu, \"holes\": %.2f, "
+                   "\"points\": %zu, \"bytes\": %zu, \"seconds\": %.6f, "
+                   "\"points_per_second\": %.1f, \"bytes_per_second\": %.1f, "
+                   "\"peak_memory_bytes\": %zu}",
+                   i == 0 ? "" : ",", r.name_.c_str(), r.config_.width_, r.config_.height_,
+                   static_cast<double>(r.config_.holes_), r.points_, r.bytes_, r.seconds_,
+                   static_cast<double>(r.points_) / r.seconds_,
+                   static_cast<double>(r.bytes_) / r.seconds_, r.peak_memory_);
+    }
+
+    std::fputs("\n  ],\n  \"latency\": [", out);
+
+    for (size_t i{0}; i < latencies_.size(); ++i) {
+      const auto &l{latencies_[i]};
+      std::fprintf(out,
+                   "%s\n    {\"name\": \"%s\", \"p50_us\": %.1f, \"p90_us\": %.1f, "
+                   "\"p99_us\": %.1f}",
+                   i == 0 ? "" : ",", l.name_.c_str(), l.p50_, l.p90_, l.p99_);
+    }
+
+    std::fprintf(out, "\n  ],\n  \"peak_memory_bytes\": %zu\n}\n", peak_memory());
+  }
+
+private:
+  Options options_;
+  std::vector<Result> results_;
+  std::vector<Latency> latencies_;
+  bool failed_{false};
+};
+
+[[nodiscard]] NormalsEstimatorSettings normals_settings(const Config &config) {
+  return NormalsEstimatorSettings{.image_width_ = config.width_,
+                                  .image_height_ = config.height_,
+                                  .window_size_ = 11,
+                                  .max_angle_ = 80.0f,
+                                  .filter_by_angle_ = false};
+}
+
+void bench_filters(Suite &suite, const Config &config, const StructuredPointCloud3f &input) {
+  const size_t n{input.size()};
+
+  suite.run("StructuredPointCloud::pointcloud", config, n, [&]() {
+    return timed([&]() { static_cast<void>(input.pointcloud()); });
+  });
+
+  suite.run("SORFilter", config, n, [&]() {
+    auto pcd{input};
+    SORFilter filter{SORFilterSettings{.image_width_ = config.width_,
+                                       .image_height_ = config.height_,
+                                       .minimum_neighbours_ = 5,
+                                       .sigma_multiplier_ = 1.0f}};
+    return timed([&]() { filter.apply(pcd); });
+  });
+
+  // a centred ROI of a quarter of the frame
+  suite.run("SORFilter/roi", config, n / 4, [&]() {
+    auto pcd{input};
+    FilterPipeline pipeline;
+    pipeline.add(sor_stage(SORFilterSettings{.image_width_ = config.width_,
+                                             .image_height_ = config.height_,
+                                             .minimum_neighbours_ = 5,
+                                             .sigma_multiplier_ = 1.0f}));
+    const Roi2ui roi{static_cast<uint32_t>(config.width_ / 4),
+                     static_cast<uint32_t>(config.height_ / 4),
+                     static_cast<uint32_t>(config.width_ / 2),
+                     static_cast<uint32_t>(config.height_ / 2)};
+    return timed([&]() { pipeline.apply(pcd, roi); });
+  });
+
+  suite.run("SlidingSORFilter", config, n, [&]() {
+    auto pcd{input};
+    SlidingSORFilter filter{SlidingSORFilterSettings{.image_width_ = config.width_,
+                                                     .image_height_ = config.height_,
+                                                     .minimum_neighbours_ = 5,
+                                                     .sigma_multiplier_ = 1.0f}};
+    return timed([&]() { filter.apply(pcd); });
+  });
+
+  suite.run("MagicSORFilter", config, n, [&]() {
+    auto pcd{input};
+    MagicSORFilter filter{MagicSORFilterSettings{.image_width_ = config.width_,
+                                                 .image_height_ = config.height_,
+                                                 .minimal_cluster_size_ = 100,
+                                                 .sigma_multiplier_ = 0.1f}};
+    return timed([&]() { filter.apply(pcd); });
+  });
+
+  suite.run("MagicFilter", config, n, [&]() {
+    auto pcd{input};
+    MagicFilter filter{MagicFilterSetting{}
+                           .set_width(static_cast<int>(config.width_))
+                           .set_height(static_cast<int>(config.height_))};
+    return timed([&]() { filter.apply(pcd); });
+  });
+
+  for (const int bins : {100, 400}) {
+    suite.run("ParallelMagicFilter/" + std::to_string(bins), config, n, [&]() {
+      auto pcd{input};
+      ParallelMagicFilter filter{
+          ParallelMagicFilterSettings{.magic_ = MagicFilterSetting{}
+                                                    .set_width(static_cast<int>(config.width_))
+                                                    .set_height(static_cast<int>(config.height_))
+                                                    .set_num_bins(bins)}};
+      return timed([&]() { filter.apply(pcd); });
+    });
+  }
+
+  suite.run("NormalsEstimator", config, n, [&]() {
+    auto pcd{input};
+    NormalsEstimator estimator{normals_settings(config)};
+    return timed([&]() { estimator.estimate(pcd); });
+  });
+
+  for (const uint8_t window : {uint8_t{11}, uint8_t{31}}) {
+    auto set{normals_settings(config)};
+    set.window_size_ = window;
+
+    suite.run("IntegralNormalsEstimator/" + std::to_string(window), config, n, [&]() {
+      auto pcd{input};
+      IntegralNormalsEstimator estimator{IntegralNormalsEstimatorSettings{.normals_ = set}};
+      return timed([&]() { estimator.estimate(pcd); });
+    });
+  }
+
+  if (suite.selected("VoxelGrid/centroid") or suite.selected("VoxelGrid/first")) {
+    const auto cloud{input.pointcloud()};
+
+    for (const auto &[name, mode] : {std::pair{"centroid", VoxelMode::CENTROID},
+                                     std::pair{"first", VoxelMode::FIRST_POINT}}) {
+      suite.run(std::string{"VoxelGrid/"} + name, config, cloud.size(), [&]() {
+        VoxelGrid grid{VoxelGridSettings{.leaf_size_ = 2.0f, .mode_ = mode}};
+        return timed([&]() { static_cast<void>(grid.apply(cloud)); });
+      });
+    }
+  }
+
+  if (suite.selected("KdTree/build") or suite.selected("KdTree/knn8") or
+      suite.selected("KdTree/radius")) {
+    const auto cloud{input.pointcloud()};
+    const auto pts{cloud.points()};
+    const KdTree tree{pts};
+
+    suite.run("KdTree/build", config, pts.size(),
+              [&]() { return timed([&]() { static_cast<void>(KdTree{pts}); }); });
+
+    suite.run("KdTree/knn8", config, pts.size(),
+              [&]() { return timed([&]() { static_cast<void>(tree.knn(pts, 8)); }); });
+
+    suite.run("KdTree/radius", config, pts.size(),
+              [&]() { return timed([&]() { static_cast<void>(tree.radius(pts, 1.0f)); }); });
+  }
+
+  if (suite.selected("KnnSORFilter") or suite.selected("KnnNormalsEstimator")) {
+    const auto cloud{input.pointcloud()};
+
+    suite.run("KnnSORFilter", config, cloud.size(), [&]() {
+      auto pcd{cloud};
+      KnnSORFilter filter{KnnSORFilterSettings{.neighbours_ = 8, .sigma_multiplier_ = 1.0f}};
+      return timed([&]() { filter.apply(pcd); });
+    });
+
+    suite.run("KnnNormalsEstimator", config, cloud.size(), [&]() {
+      auto pcd{cloud};
+      KnnNormalsEstimator estimator{KnnNormalsEstimatorSettings{.neighbours_ = 16}};
+      return timed([&]() { estimator.estimate(pcd); });
+    });
+  }
+
+  suite.run("PonintCloudHoleFiller", config, n, [&]() {
+    auto pcd{input};
+    PonintCloudHoleFiller filler{
+        PointCloudHoleFillerSettings{.image_width_ = static_cast<int>(config.width_),
+                                     .image_height_ = static_cast<int>(config.height_),
+                                     .intrinsic_ = intrinsic(config),
+                                     .extrinsic_ = extrinsic()}};
+    return timed([&]() { filler.fill(pcd, 50.0f); });
+  });
+
+  if (suite.selected("create_mesh")) {
+    auto pcd{input};
+    NormalsEstimator{normals_settings(config)}.estimate(pcd);
+    const auto cloud{pcd.pointcloud()};
+    const MeshRecSettings mesh_settings{
+        .resolution_ = 1.0f, .samples_per_node_ = 1.5f, .max_hole_radius_ = std::nullopt};
+
+    suite.run("create_mesh", config, cloud.size(), [&]() {
+      return timed([&]() { static_cast<void>(create_mesh(cloud, mesh_settings)); });
+    });
+
+    suite.run("create_mesh_parallel", config, cloud.size(), [&]() {
+      return timed([&]() {
+        static_cast<void>(
+            create_mesh_parallel(cloud, ParallelMeshSettings{.mesh_ = mesh_settings}));
+      });
+    });
+  }
+
+  suite.run("create_organized_mesh", config, n, [&]() {
+    return timed([&]() {
+      static_cast<void>(create_organized_mesh(
+          input, OrganizedMeshSettings{.max_edge_length_ = 5.0f, .max_depth_jump_ = 0.02f}));
+    });
+  });
+
+  if (suite.selected("optimize_mesh")) {
+    const auto mesh{create_organized_mesh(
+        input, OrganizedMeshSettings{.max_edge_length_ = 5.0f, .max_depth_jump_ = 0.02f})};
+
+    suite.run("optimize_mesh", config, mesh.size(), [&]() {
+      return timed([&]() {
+        static_cast<void>(optimize_mesh(mesh, MeshOptimizeSettings{.weld_distance_ = 0.01f}));
+      });
+    });
+  }
+
+  if (suite.selected("QuadricDecimator")) {
+    const auto mesh{create_organized_mesh(
+        input, OrganizedMeshSettings{.max_edge_length_ = 5.0f, .max_depth_jump_ = 0.02f})};
+    const DecimationSettings decimation{.target_faces_ = mesh.n_faces() / 10};
+
+    suite.run("QuadricDecimator", config, mesh.n_faces(), [&]() {
+      return timed([&]() { static_cast<void>(QuadricDecimator{decimation}.apply(mesh)); });
+    });
+  }
+}
+
+void bench_kernels(Suite &suite, const Config &config, const StructuredPointCloud3f &input) {
+  const auto src{input.points()};
+  const Matrix4f m{0.0f, -1.0f, 0.0f, 10.0f, 1.0f, 0.0f, 0.0f, 20.0f,
+                   0.0f, 0.0f,  1.0f, 30.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+  std::vector<Point3f> dst(src.size());
+  std::vector<float> out(src.size());
+  const char *levels[]{"scalar", "avx2", "avx512"};
+
+  for (auto level : {SimdLevel::SCALAR, SimdLevel::AVX2, SimdLevel::AVX512}) {
+    if (level > supported_simd_level()) {
+      continue;
+    }
+
+    set_simd_level(level);
+    const std::string suffix{std::string{"/"} + levels[static_cast<int>(level)]};
+
+    suite.run("transform_points" + suffix, config, src.size(),
+              [&]() { return timed([&]() { transform_points(src, dst, m); }); });
+
+    suite.run("normalize" + suffix, config, src.size(),
+              [&]() { return timed([&]() { normalize(src, dst); }); });
+
+    suite.run("norms" + suffix, config, src.size(),
+              [&]() { return timed([&]() { norms(src, out); }); });
+  }
+
+  set_simd_level(supported_simd_level());
+
+  if (suite.selected("transform") or suite.selected("transform_fused")) {
+    auto cloud{input};
+    StructuredPointCloud3f transformed;
+    NormalsEstimator{normals_settings(config)}.estimate(cloud);
+
+    suite.run("transform", config, cloud.size(),
+              [&]() { return timed([&]() { transform(cloud, m); }); });
+
+    suite.run("transform_fused", config, cloud.size(),
+              [&]() { return timed([&]() { transform(cloud, transformed, m); }); });
+  }
+}
+
+void bench_io(Suite &suite, const Config &config, const StructuredPointCloud3f &input) {
+  const auto dir{std::filesystem::temp_directory_path()};
+  const auto ply{(dir / "welib3d_bench.ply").string()};
+  const auto e57{(dir / "welib3d_bench.e57").string()};
+  const auto e57_stream{(dir / "welib3d_bench_stream.e57").string()};
+  const auto we3d{(dir / "welib3d_bench.we3d").string()};
+  const auto txt{dir / "welib3d_bench.txt"};
+  const size_t n{input.size()};
+
+  if (suite.selected("save_ply") or suite.selected("load_ply") or suite.selected("map_ply")) {
+    const auto cloud{input.pointcloud()};
+
+    suite.run("save_ply", config, cloud.size(), ply,
+              [&]() { return timed([&]() { return save_ply(cloud, ply); }); });
+
+    suite.run("load_ply", config, cloud.size(), ply,
+              [&]() { return timed([&]() { return not load_ply(ply).empty(); }); });
+
+    suite.run("map_ply", config, cloud.size(), ply, [&]() {
+      return timed([&]() {
+        const auto mapped{map_ply(ply)};
+        return mapped and mapped->pointcloud().size() == cloud.size();
+      });
+    });
+  }
+
+  suite.run("PlyStreamWriter", config, n, ply, [&]() {
+    return timed([&]() {
+      PlyStreamWriter writer{ply, PlyStreamLayout::of(input)};
+
+      for (size_t row{0}; row < input.height(); row += 64) {
+        writer.write_rows(input, row, std::min(row + 64, input.height()));
+      }
+
+      return writer.finish();
+    });
+  });
+
+  suite.run("save_e57", config, n, e57,
+            [&]() { return timed([&]() { return save_e57(input, e57); }); });
+
+  suite.run("load_e57", config, n, e57, [&]() {
+    StructuredPointCloud3f pcd;
+    return timed([&]() { return load_e57(pcd, e57); });
+  });
+
+  const auto save_e57_stream{[&]() {
+    E57StreamWriter writer{e57_stream};
+    writer.write_scan(input);
+    return writer.finish();
+  }};
+
+  suite.run("E57StreamWriter", config, n, e57_stream,
+            [&]() { return timed(save_e57_stream); });
+
+  // the file of the writer case, written here when that case is filtered out. A failed write
+  // fails the reader case
+  suite.run("E57StreamReader", config, n, e57_stream, [&]() {
+    if (not std::filesystem::exists(e57_stream) and not save_e57_stream()) {
+      throw std::runtime_error{"can not write " + e57_stream};
+    }
+
+    StructuredPointCloud3f pcd;
+    return timed([&]() {
+      E57StreamReader reader{e57_stream};
+      return reader.is_open() and reader.read_scan(0, pcd);
+    });
+  });
+
+  suite.run("save_we3d", config, n, we3d,
+            [&]() { return timed([&]() { return save_we3d(input, we3d); }); });
+
+  suite.run("load_we3d", config, n, we3d, [&]() {
+    if (not std::filesystem::exists(we3d) and not save_we3d(input, we3d)) {
+      throw std::runtime_error{"can not write " + we3d};
+    }
+
+    StructuredPointCloud3f pcd;
+    return timed([&]() { return load_we3d(pcd, we3d); });
+  });
+
+  for (auto &&[name, format] : txt_cases) {
+    const auto stream_case{std::string{"load_txt/"} + name};
+    const auto mapped_case{std::string{"load_txt_mapped/"} + name};
+
+    if (not suite.selected(stream_case) and not suite.selected(mapped_case)) {
+      continue;
+    }
+
+    write_txt(input, txt, name);
+    StructuredPointCloud3f pcd;
+
+    suite.run(stream_case, config, n, txt, [&]() {
+      return timed([&]() {
+        return load_txt(pcd, config.width_, config.height_, input.empty_value(), format,
+                        TxtSeparator::SPACE, txt.string());
+      });
+    });
+
+    suite.run(mapped_case, config, n, txt, [&]() {
+      return timed([&]() {
+        return load_txt_mapped(pcd, config.width_, config.height_, input.empty_value(), format,
+                               TxtSeparator::SPACE, txt.string());
+      });
+    });
+  }
+
+  std::error_code ec;
+  std::filesystem::remove(ply, ec);
+  std::filesystem::remove(e57, ec);
+  std::filesystem::remove(e57_stream, ec);
+  std::filesystem::remove(we3d, ec);
+  std::filesystem::remove(txt, ec);
+}
+
+void bench_sensor(Suite &suite) {
+  if (not suite.selected("sensor")) {
+    return;
+  }
+
+  LoopbackSensorServer server{SimulatedSensorSettings{
+      .width_ = 2448, .height_ = 2048, .frame_rate_ = 30.0, .recorded_ = {}}};
+  LoopbackTransport transport{server};
+  SensorClient sensor{transport};
+  std::vector<double> samples;
+
+  for (int i{0}; i < command_count; ++i) {
+    samples.push_back(timed([&]() { static_cast<void>(sensor.get<cmd::PIXEL_X_MAX>()); }));
+  }
+
+  suite.add_latency("sensor_command_round_trip", samples);
+
+  sensor.set<cmd::TRIGGER_SOURCE>(TriggerSource::SOFTWRARE);
+  sensor.set<cmd::ACQUISITION_START>();
+
+  SensorClientSource source{sensor};
+  AcquisitionStream stream{source, AcquisitionSettings{.pool_size_ = 4,
+                                                       .policy_ = OverflowPolicy::BLOCK}};
+  std::vector<double> capture;
+  std::vector<double> delivery;
+
+  stream.start();
+
+  for (int i{0}; i < frame_count; ++i) {
+    const auto frame{stream.next()};
+    const auto now{std::chrono::steady_clock::now()};
+    capture.push_back(seconds((*frame)->capture_time_ - (*frame)->trigger_time_));
+    delivery.push_back(seconds(now - (*frame)->capture_time_));
+  }
+
+  stream.stop();
+  sensor.set<cmd::ACQUISITION_STOP>();
+
+  suite.add_latency("sensor_trigger_to_capture", capture);
+  suite.add_latency("sensor_capture_to_consumer", delivery);
+}
+
+[[nodiscard]] std::optional<Options> parse_options(int argc, char **argv) {
+  Options options;
+
+  for (int i{1}; i < argc; ++i) {
+    const std::string_view arg{argv[i]};
+
+    if (i + 1 == argc) {
+      return std::nullopt;
+    }
+
+    if (arg == "--filter") {
+      options.filter_ = argv[++i];
+    } else if (arg == "--repeats") {
+      options.repeats_ = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--out") {
+      options.out_ = argv[++i];
+    } else {
+      return std::nullopt;
+    }
+  }
+
+  return options;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+
+  const auto options{parse_options(argc, argv)};
+
+  if (not options) {
+    std::puts("usage: welib3d_bench [--filter <name part>] [--repeats <n>] [--out <file.json>]");
+    return EXIT_FAILURE;
+  }
+
+  const std::pair<size_t, size_t> resolutions[]{{640, 480}, {1280, 1024}, {2448, 2048}};
+  const float hole_densities[]{0.0f, 0.1f, 0.3f};
+
+  try {
+    Suite suite{*options};
+
+    for (auto &&[width, height] : resolutions) {
+      for (float holes : hole_densities) {
+        const Config config{width, height, holes};
+        const auto input{synthetic_cloud(config)};
+
+        bench_filters(suite, config, input);
+        bench_kernels(suite, config, input);
+        bench_io(suite, config, input);
+      }
+    }
+
+    bench_sensor(suite);
+
+    if (options->out_.empty()) {
+      suite.write_json(stdout);
+    } else if (std::FILE *f{std::fopen(options->out_.c_str(), "w")}; f != nullptr) {
+      suite.write_json(f);
+      std::fclose(f);
+    } else {
+      std::fprintf(stderr, "can not write %s\n", options->out_.c_str());
+      return EXIT_FAILURE;
+    }
+
+    if (suite.failed()) {
+      return EXIT_FAILURE;
+    }
+
+  } catch (const std::exception &ex) {
+    std::fputs(ex.what(), stderr);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,298 @@
+#pragma once
+#include "point.h"
+#include "pointcloud.h"
+#include "roi.h"
+#include "sensor3d_connector.h"
+#include "we_assert.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace we {
+
+/// @brief what the producer does when every frame of the pool is taken
+enum class OverflowPolicy {
+    /// reuse the oldest frame nobody has picked up yet, counted in dropped()
+    DROP_OLDEST,
+    /// wait until a consumer returns a frame, the source is not triggered meanwhile
+    BLOCK
+};
+
+struct AcquisitionSettings {
+    size_t pool_size_{4};
+    OverflowPolicy policy_{OverflowPolicy::DROP_OLDEST};
+};
+
+struct Frame {
+    StructuredPointCloud3f pcd_;
+    /// number of the frame since the stream was started, gaps mean dropped frames
+    uint64_t sequence_{0};
+    /// when the source was asked for the frame
+    std::chrono::steady_clock::time_point trigger_time_;
+    /// when the frame was delivered by the source
+    std::chrono::steady_clock::time_point capture_time_;
+};
+
+/// @brief fills a frame in place. grab() may reuse the buffers of the point cloud it is given;
+/// an optional prepare() is called once per pool frame to preallocate them.
+template <typename S>
+concept FrameSource = requires(S &s, StructuredPointCloud3f &pcd) { s.grab(pcd); };
+
+namespace detail {
+
+struct FramePoolState {
+    std::vector<Frame> frames_;
+    std::vector<size_t> free_;
+    std::deque<size_t> ready_;
+    uint64_t dropped_{0};
+    bool stopped_{true};
+    std::exception_ptr error_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+
+    void release(size_t slot) {
+        {
+            std::scoped_lock lock{mutex_};
+            free_.push_back(slot);
+        }
+        cv_.notify_all();
+    }
+};
+
+} // namespace detail
+
+/// @brief exclusive access to a frame of an AcquisitionStream,
+/// the frame goes back to the pool when the lease is destroyed or released
+class FrameLease {
+  public:
+    FrameLease() = default;
+
+    FrameLease(std::shared_ptr<detail::FramePoolState> pool, size_t slot)
+        : pool_{std::move(pool)}
+        , slot_{slot} {}
+
+    FrameLease(const FrameLease &) = delete;
+    FrameLease &operator=(const FrameLease &) = delete;
+
+    FrameLease(FrameLease &&rhs) noexcept
+        : pool_{std::move(rhs.pool_)}
+        , slot_{rhs.slot_} {}
+
+    FrameLease &operator=(FrameLease &&rhs) noexcept {
+        if(&rhs != this) {
+            release();
+            pool_ = std::move(rhs.pool_);
+            slot_ = rhs.slot_;
+        }
+        return *this;
+    }
+
+    ~FrameLease() { release(); }
+
+    void release() {
+        if(pool_) {
+            pool_->release(slot_);
+            pool_.reset();
+        }
+    }
+
+    [[nodiscard]] bool is_valid() const noexcept { return pool_ != nullptr; }
+
+    [[nodiscard]] Frame &operator*() const { return pool_->frames_[slot_]; }
+    [[nodiscard]] Frame *operator->() const { return &pool_->frames_[slot_]; }
+
+  private:
+    std::shared_ptr<detail::FramePoolState> pool_;
+    size_t slot_{0};
+};
+
+/// @brief producer thread grabbing frames from a source into a ring of preallocated frames,
+/// so capturing the next frame overlaps with processing the previous ones.
+/// @example
+/// Sensor3dSource source{sensor};
+/// AcquisitionStream stream{source, AcquisitionSettings{.pool_size_ = 4}};
+/// stream.start();
+/// while(auto frame{stream.next()}) {
+///     process((*frame)->pcd_);
+/// } // the frame returns to the pool here
+template <FrameSource Source> class AcquisitionStream {
+  public:
+    AcquisitionStream(Source &source, const AcquisitionSettings &set)
+        : source_{source}
+        , set_{set}
+        , pool_{std::make_shared<detail::FramePoolState>()} {
+        assert_true([&]() { return set.pool_size_ > 0; }, "empty frame pool");
+
+        pool_->frames_.resize(set.pool_size_);
+
+        for(size_t i{0}; i < set.pool_size_; ++i) {
+            if constexpr(requires { source_.prepare(pool_->frames_[i].pcd_); }) {
+                source_.prepare(pool_->frames_[i].pcd_);
+            }
+            pool_->free_.push_back(set.pool_size_ - 1 - i);
+        }
+    }
+
+    AcquisitionStream(const AcquisitionStream &) = delete;
+    AcquisitionStream(AcquisitionStream &&) = delete;
+    AcquisitionStream &operator=(const AcquisitionStream &) = delete;
+    AcquisitionStream &operator=(AcquisitionStream &&) = delete;
+
+    ~AcquisitionStream() { stop(); }
+
+    void start() {
+        if(producer_.joinable()) {
+            return;
+        }
+
+        {
+            std::scoped_lock lock{pool_->mutex_};
+            pool_->stopped_ = false;
+            pool_->error_ = nullptr;
+        }
+
+        producer_ = std::jthread{[this](std::stop_token st) { produce(st); }};
+    }
+
+    /// @brief stops the producer after the frame being grabbed, ready frames stay available
+    void stop() {
+        if(not producer_.joinable()) {
+            return;
+        }
+
+        producer_.request_stop();
+        {
+            // the producer checks the stop token under the lock, do not notify in between
+            std::scoped_lock lock{pool_->mutex_};
+        }
+        pool_->cv_.notify_all();
+        producer_.join();
+    }
+
+    /// @brief oldest ready frame, waits for one; std::nullopt once the stream is stopped and
+    /// drained. Rethrows an exception thrown by the source.
+    [[nodiscard]] std::optional<FrameLease> next() {
+        std::unique_lock lock{pool_->mutex_};
+        pool_->cv_.wait(lock, [this]() { return not pool_->ready_.empty() or pool_->stopped_; });
+        return pop_ready();
+    }
+
+    /// @brief as next(), std::nullopt if no frame is ready within timeout
+    template <typename Rep, typename Period>
+    [[nodiscard]] std::optional<FrameLease> next(std::chrono::duration<Rep, Period> timeout) {
+        std::unique_lock lock{pool_->mutex_};
+        pool_->cv_.wait_for(lock, timeout,
+                            [this]() { return not pool_->ready_.empty() or pool_->stopped_; });
+        return pop_ready();
+    }
+
+    /// @brief number of frames overwritten before anybody picked them up
+    [[nodiscard]] uint64_t dropped() const {
+        std::scoped_lock lock{pool_->mutex_};
+        return pool_->dropped_;
+    }
+
+  private:
+    [[nodiscard]] std::optional<FrameLease> pop_ready() {
+        if(pool_->ready_.empty()) {
+            if(pool_->error_) {
+                std::rethrow_exception(std::exchange(pool_->error_, nullptr));
+            }
+            return std::nullopt;
+        }
+
+        const size_t slot{pool_->ready_.front()};
+        pool_->ready_.pop_front();
+        return FrameLease{pool_, slot};
+    }
+
+    [[nodiscard]] std::optional<size_t> acquire(std::stop_token &st) {
+        std::unique_lock lock{pool_->mutex_};
+
+        while(not st.stop_requested()) {
+            if(not pool_->free_.empty()) {
+                const size_t slot{pool_->free_.back()};
+                pool_->free_.pop_back();
+                return slot;
+            }
+
+            if(set_.policy_ == OverflowPolicy::DROP_OLDEST and not pool_->ready_.empty()) {
+                const size_t slot{pool_->ready_.front()};
+                pool_->ready_.pop_front();
+                ++pool_->dropped_;
+                return slot;
+            }
+
+            pool_->cv_.wait(lock);
+        }
+
+        return std::nullopt;
+    }
+
+    void produce(std::stop_token st) {
+        uint64_t sequence{0};
+
+        try {
+            while(auto slot{acquire(st)}) {
+                Frame &frame{pool_->frames_[*slot]};
+                frame.trigger_time_ = std::chrono::steady_clock::now();
+                source_.grab(frame.pcd_);
+                frame.capture_time_ = std::chrono::steady_clock::now();
+                frame.sequence_ = sequence++;
+
+                {
+                    std::scoped_lock lock{pool_->mutex_};
+                    pool_->ready_.push_back(*slot);
+                }
+                pool_->cv_.notify_all();
+            }
+        } catch(...) {
+            std::scoped_lock lock{pool_->mutex_};
+            pool_->error_ = std::current_exception();
+        }
+
+        {
+            std::scoped_lock lock{pool_->mutex_};
+            pool_->stopped_ = true;
+        }
+        pool_->cv_.notify_all();
+    }
+
+    Source &source_;
+    AcquisitionSettings set_;
+    std::shared_ptr<detail::FramePoolState> pool_;
+    std::jthread producer_;
+};
+
+/// @brief FrameSource triggering a Sensor3d by software and fetching the point cloud.
+/// Sensor3d::get_pointcloud() returns a new point cloud, which is moved into the pool frame.
+class Sensor3dSource {
+  public:
+    explicit Sensor3dSource(Sensor3d &sensor, Roi2ui roi = Roi2ui{}, bool software_trigger = true)
+        : sensor_{sensor}
+        , roi_{roi}
+        , software_trigger_{software_trigger} {}
+
+    void grab(StructuredPointCloud3f &pcd) {
+        if(software_trigger_) {
+            sensor_.set<cmd::SET_TRIGGER_SOFTWARE>();
+        }
+
+        pcd = sensor_.get_pointcloud(roi_);
+    }
+
+  private:
+    Sensor3d &sensor_;
+    Roi2ui roi_;
+    bool software_trigger_;
+};
+
+} // namespace we
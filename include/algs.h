@@ -1,5 +1,12 @@
 #pragma once
+#include "filter_pipeline.h"
+#include "integral_normals.h"
+#include "knn_normals.h"
+#include "knn_sor.h"
 #include "magic_filter.h"
 #include "magic_sor.h"
 #include "normals_estimation.h"
+#include "parallel_magic_filter.h"
+#include "sliding_sor.h"
 #include "sor.h"
+#include "voxel_grid.h"
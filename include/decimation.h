@@ -0,0 +1,602 @@
+#pragma once
+#include "mesh.h"
+#include "parallel.h"
+#include "point.h"
+#include "we_assert.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace we {
+
+struct DecimationSettings {
+    /// faces the mesh is reduced to, std::nullopt - no count target
+    std::optional<size_t> target_faces_{};
+    /// largest quadric error of a collapse, the summed squared distance of the new vertex to
+    /// the planes of the faces it replaces, std::nullopt - no error bound
+    std::optional<double> max_error_{};
+    /// number of threads, 0 - all hardware threads
+    size_t threads_{0};
+};
+
+namespace detail {
+
+/// @brief symmetric 4x4 quadric of squared distances to planes: a11 a12 a13 a14 a22 a23 a24
+/// a33 a34 a44
+struct Quadric {
+    std::array<double, 10> q_{};
+
+    /// @brief quadric of the plane n . x + d = 0, n of unit length
+    [[nodiscard]] static Quadric plane(const Point3d &n, double d) noexcept {
+        return Quadric{{n.x() * n.x(), n.x() * n.y(), n.x() * n.z(), n.x() * d, n.y() * n.y(),
+                        n.y() * n.z(), n.y() * d, n.z() * n.z(), n.z() * d, d * d}};
+    }
+
+    Quadric &operator+=(const Quadric &rhs) noexcept {
+        for(size_t k{0}; k < q_.size(); ++k) {
+            q_[k] += rhs.q_[k];
+        }
+
+        return *this;
+    }
+
+    [[nodiscard]] double error(const Point3d &p) const noexcept {
+        const double x{p.x()};
+        const double y{p.y()};
+        const double z{p.z()};
+        return q_[0] * x * x + 2.0 * q_[1] * x * y + 2.0 * q_[2] * x * z + 2.0 * q_[3] * x +
+               q_[4] * y * y + 2.0 * q_[5] * y * z + 2.0 * q_[6] * y + q_[7] * z * z +
+               2.0 * q_[8] * z + q_[9];
+    }
+
+    /// @brief point of the smallest error, std::nullopt when it is not unique
+    [[nodiscard]] std::optional<Point3d> minimum() const noexcept {
+        const double c00{q_[4] * q_[7] - q_[5] * q_[5]};
+        const double c01{q_[2] * q_[5] - q_[1] * q_[7]};
+        const double c02{q_[1] * q_[5] - q_[2] * q_[4]};
+        const double det{q_[0] * c00 + q_[1] * c01 + q_[2] * c02};
+        const double scale{q_[0] * q_[0] + q_[4] * q_[4] + q_[7] * q_[7]};
+
+        if(std::abs(det) <= 1e-12 * scale * std::sqrt(scale)) {
+            return std::nullopt;
+        }
+
+        // Cramer's rule on A x = -b
+        const double c11{q_[0] * q_[7] - q_[2] * q_[2]};
+        const double c12{q_[1] * q_[2] - q_[0] * q_[5]};
+        const double c22{q_[0] * q_[4] - q_[1] * q_[1]};
+        const double inv_det{-1.0 / det};
+
+        return Point3d{(c00 * q_[3] + c01 * q_[6] + c02 * q_[8]) * inv_det,
+                       (c01 * q_[3] + c11 * q_[6] + c12 * q_[8]) * inv_det,
+                       (c02 * q_[3] + c12 * q_[6] + c22 * q_[8]) * inv_det};
+    }
+};
+
+} // namespace detail
+
+/// @brief quadric error metric decimation (M. Garland, P. Heckbert, "Surface Simplification
+/// Using Quadric Error Metrics") on all threads. Edges are collapsed cheapest first until
+/// set.target_faces_ is reached or the next collapse would exceed set.max_error_; open mesh
+/// borders are kept in place by planes orthogonal to them.
+/// The vertices are cut into slabs of equal size along the longest axis; every slab collapses
+/// its own edges on its own thread, vertices of faces crossing slabs are locked. Later rounds
+/// shift the slabs by half a slab to free the locked vertices. Collapses that would fold a
+/// face over or join the mesh into a non-manifold are rejected.
+/// A collapsed edge keeps the vertex of the lower index with all its properties at the new
+/// position, the mesh keeps the vertex order of the remaining vertices.
+/// @example
+/// const auto coarse{QuadricDecimator{DecimationSettings{.target_faces_ = 100'000}}.apply(mesh)};
+class QuadricDecimator {
+  public:
+    explicit QuadricDecimator(const DecimationSettings &set)
+        : set_{set} {
+        assert_true([this]() { return set_.target_faces_ or set_.max_error_; },
+                    "no decimation target");
+    }
+
+    [[nodiscard]] Mesh3f apply(const Mesh3f &mesh) const {
+        State s{mesh};
+        const size_t target{set_.target_faces_.value_or(0)};
+        const size_t max_slabs{4 * thread_count(set_.threads_)};
+
+        for(size_t round{0}; round < max_rounds and s.alive_faces_ > target; ++round) {
+            const size_t before{s.alive_faces_};
+            const size_t slabs{std::clamp(before / min_slab_faces, size_t{1}, max_slabs)};
+            run_round(s, slabs, round % 2 == 1);
+
+            if(s.alive_faces_ == before) {
+                break;
+            }
+        }
+
+        return s.result(set_.threads_);
+    }
+
+  private:
+    static constexpr size_t max_rounds{32};
+    /// fewer faces per slab lock too many vertices along the borders
+    static constexpr size_t min_slab_faces{8192};
+
+    struct Candidate {
+        double cost_;
+        uint32_t keep_;
+        uint32_t drop_;
+        uint32_t keep_stamp_;
+        uint32_t drop_stamp_;
+        Point3f position_;
+
+        [[nodiscard]] bool operator<(const Candidate &rhs) const noexcept {
+            return cost_ > rhs.cost_;
+        }
+    };
+
+    /// mesh under decimation, every slab thread writes only its own vertices and faces
+    struct State {
+        explicit State(const Mesh3f &mesh)
+            : mesh_{mesh}
+            , faces_(mesh.faces().begin(), mesh.faces().end())
+            , face_alive_(faces_.size(), 1)
+            , vertex_faces_(mesh.size())
+            , quadrics_(mesh.size())
+            , stamps_(mesh.size(), 0)
+            , vertex_alive_(mesh.size(), 1)
+            , border_(mesh.size(), 0)
+            , alive_faces_{faces_.size()} {
+            assert_true(
+                [&]() { return mesh.size() < size_t{std::numeric_limits<int32_t>::max()}; },
+                "too many vertices");
+
+            const auto pts{mesh_.points()};
+
+            for(size_t f{0}; f < faces_.size(); ++f) {
+                for(size_t k{0}; k < 3; ++k) {
+                    vertex_faces_[static_cast<size_t>(faces_[f][k])].push_back(
+                        static_cast<uint32_t>(f));
+                }
+            }
+
+            // plane quadrics of the faces and border planes along edges with a single face
+            for(size_t v{0}; v < pts.size(); ++v) {
+                for(const uint32_t f : vertex_faces_[v]) {
+                    const auto &face{faces_[f]};
+                    const auto n{face_normal(face)};
+
+                    if(not n) {
+                        continue;
+                    }
+
+                    quadrics_[v] += detail::Quadric::plane(*n, -n->dot(point(face[0])));
+
+                    for(size_t k{0}; k < 3; ++k) {
+                        const auto a{static_cast<uint32_t>(face[k])};
+                        const auto b{static_cast<uint32_t>(face[(k + 1) % 3])};
+
+                        if((a == v or b == v) and shared_faces(a, b) == 1) {
+                            border_[v] = 1;
+                            const Point3d edge{point(b) - point(a)};
+                            const Point3d m{edge.cross(*n)};
+
+                            if(const double len{m.norm()}; len > 0.0) {
+                                const Point3d u{m * (1.0 / len)};
+                                quadrics_[v] += detail::Quadric::plane(u, -u.dot(point(a)));
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        [[nodiscard]] Point3d point(int v) const { return point(static_cast<uint32_t>(v)); }
+
+        [[nodiscard]] Point3d point(uint32_t v) const {
+            const auto &p{mesh_[v]};
+            return Point3d{p.x(), p.y(), p.z()};
+        }
+
+        /// @brief unit normal of a face, std::nullopt when it is degenerate
+        [[nodiscard]] std::optional<Point3d> face_normal(const Point3i &face) const {
+            const Point3d n{
+                (point(face[1]) - point(face[0])).cross(point(face[2]) - point(face[0]))};
+            const double len{n.norm()};
+            return len > 0.0 ? std::optional{n * (1.0 / len)} : std::nullopt;
+        }
+
+        [[nodiscard]] static bool has(const Point3i &face, uint32_t v) noexcept {
+            const auto i{static_cast<int>(v)};
+            return face[0] == i or face[1] == i or face[2] == i;
+        }
+
+        [[nodiscard]] size_t shared_faces(uint32_t a, uint32_t b) const {
+            size_t count{0};
+
+            for(const uint32_t f : vertex_faces_[a]) {
+                count += face_alive_[f] != 0 and has(faces_[f], b) ? 1 : 0;
+            }
+
+            return count;
+        }
+
+        /// @brief the other vertices of the alive faces of v, sorted
+        void neighbours(uint32_t v, std::vector<uint32_t> &out) const {
+            out.clear();
+
+            for(const uint32_t f : vertex_faces_[v]) {
+                if(face_alive_[f] != 0) {
+                    for(size_t k{0}; k < 3; ++k) {
+                        if(const auto w{static_cast<uint32_t>(faces_[f][k])}; w != v) {
+                            out.push_back(w);
+                        }
+                    }
+                }
+            }
+
+            std::ranges::sort(out);
+            out.erase(std::unique(out.begin(), out.end()), out.end());
+        }
+
+        [[nodiscard]] Mesh3f result(size_t threads) {
+            std::vector<uint8_t> used(mesh_.size());
+            Mesh3f::vector_face_type faces;
+            faces.reserve(alive_faces_);
+
+            for(size_t f{0}; f < faces_.size(); ++f) {
+                if(face_alive_[f] != 0) {
+                    faces.push_back(faces_[f]);
+
+                    for(size_t k{0}; k < 3; ++k) {
+                        used[static_cast<size_t>(faces_[f][k])] = 1;
+                    }
+                }
+            }
+
+            std::vector<int> vertex_of(mesh_.size());
+            int vertex{0};
+
+            for(size_t v{0}; v < used.size(); ++v) {
+                vertex_of[v] = vertex;
+                vertex += used[v];
+            }
+
+            for(auto &face : faces) {
+                for(size_t k{0}; k < 3; ++k) {
+                    face[k] = vertex_of[static_cast<size_t>(face[k])];
+                }
+            }
+
+            Mesh3f out;
+            out.assign_compacted(mesh_, used, threads);
+            out.set_faces(std::move(faces));
+            return out;
+        }
+
+        Mesh3f mesh_;
+        std::vector<Point3i> faces_;
+        std::vector<uint8_t> face_alive_;
+        std::vector<std::vector<uint32_t>> vertex_faces_;
+        std::vector<detail::Quadric> quadrics_;
+        std::vector<uint32_t> stamps_;
+        std::vector<uint8_t> vertex_alive_;
+        std::vector<uint8_t> border_;
+        size_t alive_faces_;
+    };
+
+    void run_round(State &s, size_t slabs, bool shifted) const {
+        const auto pts{s.mesh_.points()};
+        const size_t n{pts.size()};
+
+        // slab borders at equal vertex counts along the longest axis
+        std::array<float, 3> low{std::numeric_limits<float>::max(),
+                                 std::numeric_limits<float>::max(),
+                                 std::numeric_limits<float>::max()};
+        std::array<float, 3> high{std::numeric_limits<float>::lowest(),
+                                  std::numeric_limits<float>::lowest(),
+                                  std::numeric_limits<float>::lowest()};
+        std::vector<float> coords;
+        coords.reserve(n);
+
+        for(size_t v{0}; v < n; ++v) {
+            if(s.vertex_alive_[v] != 0) {
+                for(size_t c{0}; c < 3; ++c) {
+                    low[c] = std::min(low[c], pts[v][c]);
+                    high[c] = std::max(high[c], pts[v][c]);
+                }
+            }
+        }
+
+        size_t axis{0};
+
+        for(size_t c{1}; c < 3; ++c) {
+            if(high[c] - low[c] > high[axis] - low[axis]) {
+                axis = c;
+            }
+        }
+
+        for(size_t v{0}; v < n; ++v) {
+            if(s.vertex_alive_[v] != 0) {
+                coords.push_back(pts[v][axis]);
+            }
+        }
+
+        if(coords.empty()) {
+            return;
+        }
+
+        std::vector<float> borders;
+
+        for(size_t t{1}; t < slabs; ++t) {
+            // shifted rounds put the borders into the middle of the previous slabs
+            const double at{(static_cast<double>(t) - (shifted ? 0.5 : 0.0)) /
+                            static_cast<double>(slabs)};
+            const auto nth{coords.begin() +
+                           static_cast<std::ptrdiff_t>(at * static_cast<double>(coords.size()))};
+            std::nth_element(coords.begin(), nth, coords.end());
+            borders.push_back(*nth);
+        }
+
+        std::vector<uint32_t> slab_of(n);
+        std::vector<std::vector<uint32_t>> slab_vertices(slabs);
+
+        for(size_t v{0}; v < n; ++v) {
+            if(s.vertex_alive_[v] != 0) {
+                slab_of[v] = static_cast<uint32_t>(
+                    std::upper_bound(borders.begin(), borders.end(), pts[v][axis]) -
+                    borders.begin());
+                slab_vertices[slab_of[v]].push_back(static_cast<uint32_t>(v));
+            }
+        }
+
+        // vertices of faces crossing slabs are locked, faces within a slab are counted
+        std::vector<uint8_t> locked(n, 0);
+        std::vector<size_t> slab_faces(slabs, 0);
+
+        for(size_t f{0}; f < s.faces_.size(); ++f) {
+            if(s.face_alive_[f] == 0) {
+                continue;
+            }
+
+            const auto &face{s.faces_[f]};
+            const uint32_t slab{slab_of[static_cast<size_t>(face[0])]};
+
+            if(slab_of[static_cast<size_t>(face[1])] != slab or
+               slab_of[static_cast<size_t>(face[2])] != slab) {
+                for(size_t k{0}; k < 3; ++k) {
+                    locked[static_cast<size_t>(face[k])] = 1;
+                }
+            } else {
+                ++slab_faces[slab];
+            }
+        }
+
+        // the faces left to remove are shared by the slabs in proportion to their faces, a round
+        // removes at most half of them so that thin slabs do not collapse into slivers
+        size_t inner{0};
+
+        for(const size_t faces : slab_faces) {
+            inner += faces;
+        }
+
+        const size_t target{set_.target_faces_.value_or(0)};
+        const size_t excess{
+            std::min(s.alive_faces_ > target ? s.alive_faces_ - target : 0, s.alive_faces_ / 2)};
+        std::atomic<size_t> removed{0};
+
+        parallel_for(
+            slabs,
+            [&](size_t first, size_t last) {
+                for(size_t slab{first}; slab < last; ++slab) {
+                    const size_t quota{
+                        set_.target_faces_
+                            ? (excess * slab_faces[slab] + inner - 1) / std::max(inner, size_t{1})
+                            : std::numeric_limits<size_t>::max()};
+                    removed += collapse_slab(s, slab_vertices[slab], locked, quota);
+                }
+            },
+            set_.threads_, 1);
+
+        s.alive_faces_ -= removed;
+    }
+
+    /// @brief collapses the edges between unlocked vertices of a slab until quota faces are
+    /// removed or the error bound is reached, returns the number of removed faces
+    size_t collapse_slab(State &s, const std::vector<uint32_t> &vertices,
+                         const std::vector<uint8_t> &locked, size_t quota) const {
+        std::priority_queue<Candidate> heap;
+        std::vector<uint32_t> around;
+        std::vector<uint32_t> around_drop;
+
+        const auto push_edges{[&](uint32_t v) {
+            s.neighbours(v, around);
+
+            for(const uint32_t w : around) {
+                if(locked[w] == 0) {
+                    heap.push(candidate(s, std::min(v, w), std::max(v, w)));
+                }
+            }
+        }};
+
+        for(const uint32_t v : vertices) {
+            if(locked[v] == 0) {
+                s.neighbours(v, around);
+
+                for(const uint32_t w : around) {
+                    if(w > v and locked[w] == 0) {
+                        heap.push(candidate(s, v, w));
+                    }
+                }
+            }
+        }
+
+        size_t removed{0};
+
+        while(removed < quota and not heap.empty()) {
+            const Candidate c{heap.top()};
+            heap.pop();
+
+            if(s.vertex_alive_[c.keep_] == 0 or s.vertex_alive_[c.drop_] == 0 or
+               s.stamps_[c.keep_] != c.keep_stamp_ or s.stamps_[c.drop_] != c.drop_stamp_) {
+                continue;
+            }
+
+            if(set_.max_error_ and c.cost_ > *set_.max_error_) {
+                break;
+            }
+
+            if(not collapsible(s, c, around, around_drop)) {
+                continue;
+            }
+
+            removed += collapse(s, c);
+            push_edges(c.keep_);
+        }
+
+        return removed;
+    }
+
+    [[nodiscard]] static Candidate candidate(const State &s, uint32_t keep, uint32_t drop) {
+        detail::Quadric q{s.quadrics_[keep]};
+        q += s.quadrics_[drop];
+
+        const Point3d a{s.point(keep)};
+        const Point3d b{s.point(drop)};
+        Point3d best{(a + b) * 0.5};
+
+        if(const auto m{q.minimum()}; m and (*m - best).norm() <= 2.0 * (a - b).norm()) {
+            best = *m;
+        } else {
+            // no unique minimum or one far away, the better of the ends and the middle
+            for(const auto &p : {a, b}) {
+                if(q.error(p) < q.error(best)) {
+                    best = p;
+                }
+            }
+        }
+
+        return Candidate{std::max(q.error(best), 0.0),
+                         keep,
+                         drop,
+                         s.stamps_[keep],
+                         s.stamps_[drop],
+                         Point3f{static_cast<float>(best.x()), static_cast<float>(best.y()),
+                                 static_cast<float>(best.z())}};
+    }
+
+    /// @brief whether collapsing keeps the mesh manifold and folds no face over
+    [[nodiscard]] static bool collapsible(const State &s, const Candidate &c,
+                                         std::vector<uint32_t> &around,
+                                         std::vector<uint32_t> &around_drop) {
+        const size_t edge_faces{s.shared_faces(c.keep_, c.drop_)};
+
+        if(edge_faces == 0 or edge_faces > 2) {
+            return false;
+        }
+
+        // two border vertices joined across the inside pinch the mesh
+        if(s.border_[c.keep_] != 0 and s.border_[c.drop_] != 0 and edge_faces != 1) {
+            return false;
+        }
+
+        // link condition: the ends share exactly the vertices opposite to the edge
+        s.neighbours(c.keep_, around);
+        s.neighbours(c.drop_, around_drop);
+        size_t common{0};
+
+        for(size_t i{0}, j{0}; i < around.size() and j < around_drop.size();) {
+            if(around[i] < around_drop[j]) {
+                ++i;
+            } else if(around[i] > around_drop[j]) {
+                ++j;
+            } else {
+                ++common;
+                ++i;
+                ++j;
+            }
+        }
+
+        if(common != edge_faces) {
+            return false;
+        }
+
+        const Point3d target{c.position_.x(), c.position_.y(), c.position_.z()};
+
+        for(const uint32_t v : {c.keep_, c.drop_}) {
+            for(const uint32_t f : s.vertex_faces_[v]) {
+                const auto &face{s.faces_[f]};
+
+                if(s.face_alive_[f] == 0 or (State::has(face, c.keep_) and
+                                              State::has(face, c.drop_))) {
+                    continue;
+                }
+
+                std::array<Point3d, 3> moved{s.point(face[0]), s.point(face[1]),
+                                             s.point(face[2])};
+
+                for(size_t k{0}; k < 3; ++k) {
+                    if(static_cast<uint32_t>(face[k]) == v) {
+                        moved[k] = target;
+                    }
+                }
+
+                const Point3d before{(s.point(face[1]) - s.point(face[0]))
+                                         .cross(s.point(face[2]) - s.point(face[0]))};
+                const Point3d after{(moved[1] - moved[0]).cross(moved[2] - moved[0])};
+
+                // folded over or turned by more than about 75 degrees
+                if(before.dot(after) <= 0.25 * before.norm() * after.norm()) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    /// @brief collapses drop into keep, returns the number of removed faces
+    static size_t collapse(State &s, const Candidate &c) {
+        size_t removed{0};
+
+        for(const uint32_t f : s.vertex_faces_[c.drop_]) {
+            if(s.face_alive_[f] == 0) {
+                continue;
+            }
+
+            auto &face{s.faces_[f]};
+
+            if(State::has(face, c.keep_)) {
+                s.face_alive_[f] = 0;
+                ++removed;
+                continue;
+            }
+
+            for(size_t k{0}; k < 3; ++k) {
+                if(static_cast<uint32_t>(face[k]) == c.drop_) {
+                    face[k] = static_cast<int>(c.keep_);
+                }
+            }
+
+            s.vertex_faces_[c.keep_].push_back(f);
+        }
+
+        auto &keep_faces{s.vertex_faces_[c.keep_]};
+        std::erase_if(keep_faces, [&](uint32_t f) { return s.face_alive_[f] == 0; });
+
+        s.mesh_[c.keep_] = c.position_;
+        s.quadrics_[c.keep_] += s.quadrics_[c.drop_];
+        s.border_[c.keep_] |= s.border_[c.drop_];
+        s.vertex_alive_[c.drop_] = 0;
+        s.vertex_faces_[c.drop_] = {};
+        ++s.stamps_[c.keep_];
+        return removed;
+    }
+
+    DecimationSettings set_;
+};
+
+} // namespace we
@@ -0,0 +1,479 @@
+#pragma once
+#include "hole_filling.h"
+#include "integral_normals.h"
+#include "magic_filter.h"
+#include "magic_sor.h"
+#include "normals_estimation.h"
+#include "parallel.h"
+#include "point.h"
+#include "pointcloud.h"
+#include "roi.h"
+#include "sliding_sor.h"
+#include "sor.h"
+#include "we_assert.h"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace we {
+
+/// @brief one step of a FilterPipeline
+struct FilterStage {
+    /// rows and columns around a pixel the stage reads to compute it, std::nullopt - the stage
+    /// needs the whole frame (global statistics, clustering, unbounded search)
+    std::optional<size_t> halo_;
+    /// runs the stage in place on a frame, a crop or a tile of rows of it
+    std::function<void(StructuredPointCloud3f &)> run_;
+    /// as run_ on a crop whose first pixel is pixel (x, y) of the sensor frame, for stages that
+    /// depend on pixel coordinates; empty - run_ works on crops as is
+    std::function<void(StructuredPointCloud3f &, size_t x, size_t y)> run_at_{};
+
+    void operator()(StructuredPointCloud3f &pcd, size_t x = 0, size_t y = 0) const {
+        if(run_at_) {
+            run_at_(pcd, x, y);
+        } else {
+            run_(pcd);
+        }
+    }
+};
+
+/// @brief SORFilter::apply(), the distance statistics come from the whole frame
+[[nodiscard]] inline FilterStage sor_stage(SORFilterSettings set) {
+    return {std::nullopt, [set](StructuredPointCloud3f &pcd) {
+                auto frame_set{set};
+                frame_set.image_width_ = pcd.width();
+                frame_set.image_height_ = pcd.height();
+                SORFilter{frame_set}.apply(pcd);
+            }};
+}
+
+/// @brief MagicFilter::apply(), the Z slices span the whole frame
+[[nodiscard]] inline FilterStage magic_filter_stage(MagicFilterSetting set) {
+    return {std::nullopt, [set](StructuredPointCloud3f &pcd) {
+                auto frame_set{set};
+                frame_set.set_width(static_cast<int>(pcd.width()))
+                    .set_height(static_cast<int>(pcd.height()));
+                MagicFilter{frame_set}.apply(pcd);
+            }};
+}
+
+/// @brief MagicSORFilter::apply(), clusters span the whole frame
+[[nodiscard]] inline FilterStage magic_sor_stage(MagicSORFilterSettings set) {
+    return {std::nullopt, [set](StructuredPointCloud3f &pcd) {
+                auto frame_set{set};
+                frame_set.image_width_ = pcd.width();
+                frame_set.image_height_ = pcd.height();
+                MagicSORFilter{frame_set}.apply(pcd);
+            }};
+}
+
+/// @brief SlidingSORFilter::apply(), the score threshold comes from the whole frame
+[[nodiscard]] inline FilterStage sliding_sor_stage(SlidingSORFilterSettings set) {
+    return {std::nullopt, [set](StructuredPointCloud3f &pcd) {
+                auto frame_set{set};
+                frame_set.image_width_ = pcd.width();
+                frame_set.image_height_ = pcd.height();
+                SlidingSORFilter{frame_set}.apply(pcd);
+            }};
+}
+
+/// @brief NormalsEstimator::estimate(), a normal depends on the window around its point only
+[[nodiscard]] inline FilterStage normals_stage(NormalsEstimatorSettings set) {
+    return {size_t{set.window_size_} / 2, [set](StructuredPointCloud3f &pcd) {
+                auto frame_set{set};
+                frame_set.image_width_ = pcd.width();
+                frame_set.image_height_ = pcd.height();
+                NormalsEstimator{frame_set}.estimate(pcd);
+            }};
+}
+
+/// @brief IntegralNormalsEstimator::estimate(), the same window bound as normals_stage(). The
+/// window sums of a tile are accumulated from its first row, so normals match the whole frame
+/// up to rounding rather than bit for bit.
+[[nodiscard]] inline FilterStage integral_normals_stage(NormalsEstimatorSettings set) {
+    return {size_t{set.window_size_} / 2, [set](StructuredPointCloud3f &pcd) {
+                auto frame_set{set};
+                frame_set.image_width_ = pcd.width();
+                frame_set.image_height_ = pcd.height();
+                // tiles already run in parallel
+                IntegralNormalsEstimator{IntegralNormalsEstimatorSettings{.normals_ = frame_set,
+                                                                          .threads_ = 1}}
+                    .estimate(pcd);
+            }};
+}
+
+/// @brief PonintCloudHoleFiller::fill(), the hole radius is metric and not bound in rows
+[[nodiscard]] inline FilterStage hole_filling_stage(const PointCloudHoleFillerSettings &set,
+                                                    float max_hole_radius) {
+    const auto fill{[set, max_hole_radius](StructuredPointCloud3f &pcd, size_t x, size_t y) {
+        auto crop_set{set};
+        crop_set.image_width_ = static_cast<int>(pcd.width());
+        crop_set.image_height_ = static_cast<int>(pcd.height());
+        // the principal point moves with the crop
+        crop_set.intrinsic_(0, 2) -= static_cast<float>(x);
+        crop_set.intrinsic_(1, 2) -= static_cast<float>(y);
+        PonintCloudHoleFiller{crop_set}.fill(pcd, max_hole_radius);
+    }};
+
+    return {std::nullopt, [fill](StructuredPointCloud3f &pcd) { fill(pcd, 0, 0); }, fill};
+}
+
+struct FilterPipelineSettings {
+    /// input bytes of a tile without the halo, sized to stay in the per-core cache
+    size_t tile_bytes_{1 << 20};
+    /// number of threads, 0 - all hardware threads
+    size_t threads_{0};
+};
+
+/// @brief chains filter stages over a structured point cloud. Consecutive stages with a bounded
+/// halo are fused: the frame is cut into row tiles, every tile is extracted together with the
+/// halo rows of all fused stages, runs through them while it is hot in cache and its own rows
+/// are written back into the frame. Tiles are processed in parallel; the halo rows they read
+/// are kept from the input before any tile is written, so the result is bit-identical to
+/// running the stages one after another on the whole frame unless a stage says otherwise.
+/// Properties a stage adds to any tile are added to the frame.
+/// Stages without a halo are barriers and run on the whole frame. Of the stages above only
+/// normals_stage() and integral_normals_stage() are bounded, the SOR, MagicFilter and hole
+/// filling stages need statistics or searches over the whole frame, so fusion pays off for runs
+/// of normals stages and of user stages that state their halo.
+/// The pipeline may be restricted to ROIs or a mask of the frame, then only their pixels and the
+/// halo around them are read and only their pixels are written.
+/// @example
+/// FilterPipeline{}
+///     .add(magic_sor_stage(sor_settings))
+///     .add(normals_stage(normals_settings))
+///     .add(hole_filling_stage(hole_settings, 50.0f))
+///     .apply(pcd);
+///
+/// FilterPipeline{}.add(sor_stage(sor_settings)).apply(pcd, Roi2ui{100, 200, 640, 480});
+class FilterPipeline {
+  public:
+    explicit FilterPipeline(const FilterPipelineSettings &set = FilterPipelineSettings{})
+        : set_{set} {}
+
+    FilterPipeline &add(FilterStage stage) {
+        assert_true([&]() { return static_cast<bool>(stage.run_); }, "empty filter stage");
+        stages_.push_back(std::move(stage));
+        return *this;
+    }
+
+    void apply(StructuredPointCloud3f &pcd) const { apply_at(pcd, 0, 0); }
+
+    /// @brief runs the stages on the pixels of roi only, pixels outside it are not written.
+    /// Barrier stages see the crop of roi and its halo as the whole frame: the statistics of
+    /// sor_stage() or sliding_sor_stage() come from that crop only, not from the full frame, so
+    /// a point may be kept or removed differently than by the same pipeline on the full frame.
+    void apply(StructuredPointCloud3f &pcd, const Roi2ui &roi) const {
+        apply(pcd, std::span<const Roi2ui>{&roi, 1});
+    }
+
+    /// @brief runs the stages on the pixels of rois only, pixels outside them are not written.
+    /// Every ROI is cropped from the input frame with the halo of all bounded stages around it
+    /// and runs through the stages on its own. Barrier stages see each crop as the whole frame,
+    /// e.g. the SOR statistics are computed over the crop of one ROI. Where ROIs overlap the
+    /// later one wins.
+    void apply(StructuredPointCloud3f &pcd, std::span<const Roi2ui> rois) const {
+        apply_regions(pcd, rois, {});
+    }
+
+    /// @brief runs the stages on the pixels with a non-zero mask value only, mask holds a value
+    /// per pixel. Bounded stages run on crops of the runs of mask_block x mask_block pixel blocks
+    /// the mask touches, a pipeline with a barrier on the bounding box of the mask, so that the
+    /// barrier sees all masked pixels at once. That box is the whole frame of the barrier: its
+    /// statistics include the unmasked pixels inside the box and none outside it. Only masked
+    /// pixels are written.
+    void apply(StructuredPointCloud3f &pcd, std::span<const uint8_t> mask) const {
+        assert_true([&]() { return mask.size() == pcd.size(); }, "wrong mask size");
+
+        auto regions{mask_blocks(mask, pcd.width(), pcd.height())};
+        const bool barrier{std::ranges::any_of(stages_, [](const FilterStage &stage) {
+            return not stage.halo_.has_value();
+        })};
+
+        if(barrier and not regions.empty()) {
+            size_t x_first{pcd.width()};
+            size_t y_first{pcd.height()};
+            size_t x_last{0};
+            size_t y_last{0};
+
+            for(const auto &r : regions) {
+                x_first = std::min<size_t>(x_first, r.x());
+                y_first = std::min<size_t>(y_first, r.y());
+                x_last = std::max<size_t>(x_last, r.x() + r.width());
+                y_last = std::max<size_t>(y_last, r.y() + r.height());
+            }
+
+            regions = {roi(x_first, y_first, x_last - x_first, y_last - y_first)};
+        }
+
+        apply_regions(pcd, regions, mask);
+    }
+
+    /// side of the pixel blocks a mask is covered with
+    static constexpr size_t mask_block{64};
+
+  private:
+    [[nodiscard]] static Roi2ui roi(size_t x, size_t y, size_t width, size_t height) {
+        return Roi2ui{static_cast<uint32_t>(x), static_cast<uint32_t>(y),
+                      static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
+    }
+
+    /// @brief horizontal runs of mask_block x mask_block blocks with masked pixels
+    [[nodiscard]] static std::vector<Roi2ui> mask_blocks(std::span<const uint8_t> mask,
+                                                         size_t width, size_t height) {
+        std::vector<Roi2ui> regions;
+        std::vector<uint8_t> touched((width + mask_block - 1) / mask_block);
+
+        for(size_t y{0}; y < height; y += mask_block) {
+            const size_t rows{std::min(mask_block, height - y)};
+            std::ranges::fill(touched, 0);
+
+            for(size_t i{y}; i < y + rows; ++i) {
+                for(size_t j{0}; j < width; ++j) {
+                    touched[j / mask_block] |=
+                        static_cast<uint8_t>(mask[i * width + j] != 0 ? 1 : 0);
+                }
+            }
+
+            for(size_t b{0}; b < touched.size();) {
+                if(touched[b] == 0) {
+                    ++b;
+                    continue;
+                }
+
+                const size_t b_first{b};
+
+                while(b < touched.size() and touched[b] != 0) {
+                    ++b;
+                }
+
+                const size_t x{b_first * mask_block};
+                regions.push_back(roi(x, y, std::min(b * mask_block, width) - x, rows));
+            }
+        }
+
+        return regions;
+    }
+
+    void apply_regions(StructuredPointCloud3f &pcd, std::span<const Roi2ui> rois,
+                       std::span<const uint8_t> mask) const {
+        const size_t width{pcd.width()};
+        const size_t height{pcd.height()};
+        size_t halo{0};
+
+        for(const auto &stage : stages_) {
+            halo += stage.halo_.value_or(0);
+        }
+
+        struct Crop {
+            /// pixels written back and the pixels read around them
+            size_t x_first_, x_last_, y_first_, y_last_;
+            size_t read_x_, read_y_;
+            StructuredPointCloud3f pcd_;
+        };
+
+        // all crops are taken before anything is written back, so every ROI reads the input
+        std::vector<Crop> crops;
+
+        for(const auto &r : rois) {
+            Crop crop{.x_first_ = std::min<size_t>(r.x(), width),
+                      .x_last_ = std::min<size_t>(size_t{r.x()} + r.width(), width),
+                      .y_first_ = std::min<size_t>(r.y(), height),
+                      .y_last_ = std::min<size_t>(size_t{r.y()} + r.height(), height),
+                      .read_x_ = 0,
+                      .read_y_ = 0,
+                      .pcd_ = {}};
+
+            if(crop.x_first_ == crop.x_last_ or crop.y_first_ == crop.y_last_) {
+                continue;
+            }
+
+            crop.read_x_ = crop.x_first_ - std::min(crop.x_first_, halo);
+            crop.read_y_ = crop.y_first_ - std::min(crop.y_first_, halo);
+            const size_t read_width{std::min(crop.x_last_ + halo, width) - crop.read_x_};
+            const size_t read_height{std::min(crop.y_last_ + halo, height) - crop.read_y_};
+
+            crop.pcd_.create(read_width, read_height, pcd.empty_value());
+            crop.pcd_.add_properties_of(pcd);
+
+            for(size_t i{0}; i < read_height; ++i) {
+                const size_t src{(crop.read_y_ + i) * width + crop.read_x_};
+                crop.pcd_.copy_range(pcd, src, src + read_width, i * read_width);
+            }
+
+            crops.push_back(std::move(crop));
+        }
+
+        for(auto &&crop : crops) {
+            const size_t crop_width{crop.pcd_.width()};
+            const size_t crop_height{crop.pcd_.height()};
+            apply_at(crop.pcd_, crop.read_x_, crop.read_y_);
+
+            assert_true(
+                [&]() {
+                    return crop.pcd_.width() == crop_width and crop.pcd_.height() == crop_height;
+                },
+                "filter stage changed the crop size");
+
+            pcd.add_properties_of(crop.pcd_);
+        }
+
+        for(const auto &crop : crops) {
+            const size_t crop_width{crop.pcd_.width()};
+
+            // pixel (i, j) of the frame is pixel (i - read_y_, j - read_x_) of the crop
+            const auto write{[&](size_t i, size_t j_first, size_t j_last) {
+                const size_t src{(i - crop.read_y_) * crop_width + j_first - crop.read_x_};
+                pcd.copy_range(crop.pcd_, src, src + j_last - j_first, i * width + j_first);
+            }};
+
+            for(size_t i{crop.y_first_}; i < crop.y_last_; ++i) {
+                if(mask.empty()) {
+                    write(i, crop.x_first_, crop.x_last_);
+                    continue;
+                }
+
+                // runs of masked pixels
+                for(size_t j{crop.x_first_}; j < crop.x_last_;) {
+                    if(mask[i * width + j] == 0) {
+                        ++j;
+                        continue;
+                    }
+
+                    const size_t j_first{j};
+
+                    while(j < crop.x_last_ and mask[i * width + j] != 0) {
+                        ++j;
+                    }
+
+                    write(i, j_first, j);
+                }
+            }
+        }
+    }
+
+    void apply_at(StructuredPointCloud3f &pcd, size_t x, size_t y) const {
+        size_t first{0};
+
+        while(first < stages_.size()) {
+            if(not stages_[first].halo_) {
+                stages_[first++](pcd, x, y);
+                continue;
+            }
+
+            size_t last{first};
+            size_t halo{0};
+
+            while(last < stages_.size() and stages_[last].halo_) {
+                halo += *stages_[last++].halo_;
+            }
+
+            apply_tiled(pcd, first, last, halo, x, y);
+            first = last;
+        }
+    }
+
+    void apply_tiled(StructuredPointCloud3f &pcd, size_t first, size_t last, size_t halo, size_t x,
+                     size_t y) const {
+        const size_t width{pcd.width()};
+        const size_t height{pcd.height()};
+
+        if(width == 0 or height == 0) {
+            return;
+        }
+
+        const size_t row_bytes{width * sizeof(Point3f)};
+        const size_t tile_rows{std::max({set_.tile_bytes_ / row_bytes, 2 * halo, size_t{1}})};
+        const size_t tiles{(height + tile_rows - 1) / tile_rows};
+
+        const auto check_size{[&](const StructuredPointCloud3f &tile, size_t rows) {
+            assert_true([&]() { return tile.width() == width and tile.height() == rows; },
+                        "filter stage changed the tile size");
+        }};
+
+        if(tiles == 1) {
+            for(size_t i{first}; i < last; ++i) {
+                stages_[i](pcd, x, y);
+            }
+
+            check_size(pcd, height);
+            return;
+        }
+
+        // tiles write their rows back into pcd as they finish, so the halo rows around every tile
+        // boundary are kept as they are in the input: rows [b - halo, b + halo) of boundary b
+        const size_t edge_rows{2 * halo};
+        StructuredPointCloud3f edges;
+        edges.create(width, (tiles - 1) * edge_rows, pcd.empty_value());
+        edges.add_properties_of(pcd);
+
+        for(size_t t{1}; t < tiles and halo != 0; ++t) {
+            const size_t row_first{t * tile_rows - halo};
+            const size_t row_last{std::min(t * tile_rows + halo, height)};
+            edges.copy_range(pcd, row_first * width, row_last * width, (t - 1) * edge_rows * width);
+        }
+
+        // properties the stages add are added to pcd under the unique lock as the first tile
+        // producing them finishes, reads and writes of rows only share it
+        std::shared_mutex mutex;
+
+        parallel_for(
+            tiles,
+            [&](size_t t_first, size_t t_last) {
+                StructuredPointCloud3f tile;
+
+                for(size_t t{t_first}; t < t_last; ++t) {
+                    const size_t row_first{t * tile_rows};
+                    const size_t row_last{std::min(row_first + tile_rows, height)};
+                    const size_t above{t == 0 ? 0 : halo};
+                    const size_t below{t + 1 == tiles ? 0 : std::min(row_last + halo, height) -
+                                                                row_last};
+                    const size_t rows{row_last - row_first};
+
+                    tile.create(width, above + rows + below, pcd.empty_value());
+
+                    {
+                        std::shared_lock lock{mutex};
+                        tile.add_properties_of(pcd);
+                        tile.copy_range(pcd, row_first * width, row_last * width, above * width);
+                    }
+
+                    if(above != 0) {
+                        const size_t src{((t - 1) * edge_rows) * width};
+                        tile.copy_range(edges, src, src + above * width, 0);
+                    }
+
+                    if(below != 0) {
+                        const size_t src{(t * edge_rows + halo) * width};
+                        tile.copy_range(edges, src, src + below * width, (above + rows) * width);
+                    }
+
+                    for(size_t i{first}; i < last; ++i) {
+                        stages_[i](tile, x, y + row_first - above);
+                    }
+
+                    check_size(tile, above + rows + below);
+
+                    {
+                        std::unique_lock lock{mutex};
+                        pcd.add_properties_of(tile);
+                    }
+
+                    std::shared_lock lock{mutex};
+                    pcd.copy_range(tile, above * width, (above + rows) * width, row_first * width);
+                }
+            },
+            set_.threads_, 1);
+    }
+
+    FilterPipelineSettings set_;
+    std::vector<FilterStage> stages_;
+};
+
+} // namespace we
@@ -0,0 +1,279 @@
+#pragma once
+#include "normals_estimation.h"
+#include "parallel.h"
+#include "point.h"
+#include "pointcloud.h"
+#include "we_assert.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace we {
+
+namespace detail {
+
+/// sums over the valid points of a window: count, x, y, z, xx, xy, xz, yy, yz, zz
+using Moments = std::array<double, 10>;
+
+/// @brief unit eigenvector of the smallest eigenvalue of the symmetric matrix
+/// {c[0] c[1] c[2]; c[1] c[3] c[4]; c[2] c[4] c[5]}, std::nullopt when it is not unique
+[[nodiscard]] inline std::optional<Point3d> smallest_eigenvector(std::array<double, 6> c) {
+    double scale{0.0};
+
+    for(const double v : c) {
+        scale = std::max(scale, std::abs(v));
+    }
+
+    if(scale == 0.0) {
+        return std::nullopt;
+    }
+
+    // conditioning, the eigenvectors do not depend on the scale. Divisions are hoisted into
+    // reciprocals throughout, their latency dominates the solver
+    const double inv_scale{1.0 / scale};
+
+    for(auto &&v : c) {
+        v *= inv_scale;
+    }
+
+    // closed form eigenvalues of a symmetric 3x3 matrix, see D. Eberly, "A Robust
+    // Eigensolver for 3x3 Symmetric Matrices"
+    const double q{(c[0] + c[3] + c[5]) * (1.0 / 3.0)};
+    const double b00{c[0] - q};
+    const double b11{c[3] - q};
+    const double b22{c[5] - q};
+    const double off{c[1] * c[1] + c[2] * c[2] + c[4] * c[4]};
+    const double p{std::sqrt((b00 * b00 + b11 * b11 + b22 * b22 + 2.0 * off) * (1.0 / 6.0))};
+
+    if(p == 0.0) {
+        return std::nullopt;
+    }
+
+    const double det{b00 * (b11 * b22 - c[4] * c[4]) - c[1] * (c[1] * b22 - c[4] * c[2]) +
+                     c[2] * (c[1] * c[4] - b11 * c[2])};
+    const double half_det{std::clamp(det / (2.0 * p * p * p), -1.0, 1.0)};
+    const double angle{std::acos(half_det) * (1.0 / 3.0)};
+    const double lambda{q + 2.0 * p * std::cos(angle + 2.0 * std::numbers::pi / 3.0)};
+
+    // the eigenvector is orthogonal to the rows of c - lambda * I, the longest cross product of
+    // two rows is the best conditioned
+    const Point3d r0{c[0] - lambda, c[1], c[2]};
+    const Point3d r1{c[1], c[3] - lambda, c[4]};
+    const Point3d r2{c[2], c[4], c[5] - lambda};
+    Point3d best{r0.cross(r1)};
+    double best_len{best.squared_norm()};
+
+    for(const auto &v : {r0.cross(r2), r1.cross(r2)}) {
+        if(const double len{v.squared_norm()}; len > best_len) {
+            best = v;
+            best_len = len;
+        }
+    }
+
+    if(best_len == 0.0) {
+        return std::nullopt;
+    }
+
+    return best * (1.0 / std::sqrt(best_len));
+}
+
+} // namespace detail
+
+struct IntegralNormalsEstimatorSettings {
+    NormalsEstimatorSettings normals_;
+    /// number of threads, 0 - all hardware threads
+    size_t threads_{0};
+};
+
+/// @brief NormalsEstimator with a cost per point independent of the window size. Every band of
+/// rows keeps a rolling summed-area table of the point sums and outer products of valid points;
+/// the covariance of a window comes from four lookups and its normal from a closed form
+/// eigensolver. Normals look to the sensor origin, points without a normal (fewer than three
+/// valid neighbours, degenerate window, non-finite coordinates) get a zero normal. Points with a
+/// non-finite coordinate are no neighbours of any point.
+/// set.normals_.window_size_ / 2 rows and columns around a point form its window. With
+/// set.normals_.filter_by_angle_ points whose normal deviates from the direction to the sensor
+/// by more than set.normals_.max_angle_ degrees are removed.
+/// @example
+/// IntegralNormalsEstimator{IntegralNormalsEstimatorSettings{
+///                              .normals_ = NormalsEstimatorSettings{.image_width_ = pcd.width(),
+///                                                                   .image_height_ = pcd.height(),
+///                                                                   .window_size_ = 31,
+///                                                                   .max_angle_ = 80.0f,
+///                                                                   .filter_by_angle_ = false}}}
+///     .estimate(pcd);
+class IntegralNormalsEstimator {
+  public:
+    explicit IntegralNormalsEstimator(const IntegralNormalsEstimatorSettings &set)
+        : set_{set.normals_}, threads_{set.threads_} {}
+
+    void estimate(StructuredPointCloud<Point3f> &pcd) const {
+        assert_true(
+            [&, this]() {
+                return pcd.width() == set_.image_width_ and pcd.height() == set_.image_height_;
+            },
+            "wrong image size");
+
+        if(not pcd.property<Prop::NORMALS>()) {
+            pcd.add_property<Prop::NORMALS>();
+        }
+
+        const auto pts{pcd.points()};
+        const auto normals{*pcd.property<Prop::NORMALS>()};
+        std::vector<uint8_t> rejected(set_.filter_by_angle_ ? pts.size() : 0);
+        const size_t half{size_t{set_.window_size_} / 2};
+
+        // a band recomputes half rows above it, keep that below a half of the band
+        parallel_for(
+            pcd.height(),
+            [&](size_t first, size_t last) {
+                estimate_rows(pcd, normals, rejected, first, last);
+            },
+            threads_, std::max(4 * half, size_t{16}));
+
+        if(set_.filter_by_angle_) {
+            parallel_for(
+                pts.size(),
+                [&](size_t first, size_t last) {
+                    for(size_t i{first}; i < last; ++i) {
+                        if(rejected[i] != 0) {
+                            pts[i] = pcd.empty_value();
+                        }
+                    }
+                },
+                threads_);
+        }
+    }
+
+  private:
+    void estimate_rows(const StructuredPointCloud<Point3f> &pcd, std::span<Point3f> normals,
+                       std::span<uint8_t> rejected, size_t first, size_t last) const {
+        const auto pts{pcd.points()};
+        const auto empty{pcd.empty_value()};
+        const size_t width{pcd.width()};
+        const size_t height{pcd.height()};
+        const size_t half{size_t{set_.window_size_} / 2};
+        const size_t row_start{first - std::min(first, half)};
+        const size_t row_end{std::min(last + half, height)};
+        const double cos_max{
+            std::cos(static_cast<double>(set_.max_angle_) * std::numbers::pi / 180.0)};
+
+        // a single NaN or infinity would poison the table for the rest of the band
+        const auto valid{[&](const Point3f &p) {
+            return p != empty and std::isfinite(p.x()) and std::isfinite(p.y()) and
+                   std::isfinite(p.z());
+        }};
+
+        // sums are taken relative to a point of the band, which keeps them small
+        Point3d origin{};
+
+        if(const auto it{std::find_if(pts.begin() + static_cast<std::ptrdiff_t>(row_start * width),
+                                      pts.begin() + static_cast<std::ptrdiff_t>(row_end * width),
+                                      valid)};
+           it != pts.begin() + static_cast<std::ptrdiff_t>(row_end * width)) {
+            origin = Point3d{it->x(), it->y(), it->z()};
+        }
+
+        // table row k holds the sums over rows [row_start, k) and columns [0, j) at j, a window
+        // needs two rows at most 2 * half + 1 apart
+        const size_t ring{2 * half + 2};
+        std::vector<detail::Moments> table(ring * (width + 1));
+        const auto table_row{[&](size_t k) {
+            return table.data() + (k - row_start) % ring * (width + 1);
+        }};
+        size_t built{row_start};
+
+        for(size_t i{first}; i < last; ++i) {
+            const size_t i0{i - std::min(i, half)};
+            const size_t i1{std::min(i + half + 1, height)};
+
+            for(; built < i1; ++built) {
+                const detail::Moments *above{table_row(built)};
+                detail::Moments *row{table_row(built + 1)};
+                const Point3f *src{pts.data() + built * width};
+                detail::Moments sum{};
+
+                for(size_t j{0}; j < width; ++j) {
+                    if(valid(src[j])) {
+                        const double x{src[j].x() - origin.x()};
+                        const double y{src[j].y() - origin.y()};
+                        const double z{src[j].z() - origin.z()};
+                        const detail::Moments m{1.0,   x,     y,     z,     x * x,
+                                                x * y, x * z, y * y, y * z, z * z};
+
+                        for(size_t k{0}; k < m.size(); ++k) {
+                            sum[k] += m[k];
+                        }
+                    }
+
+                    for(size_t k{0}; k < sum.size(); ++k) {
+                        row[j + 1][k] = above[j + 1][k] + sum[k];
+                    }
+                }
+            }
+
+            const detail::Moments *top{table_row(i0)};
+            const detail::Moments *bottom{table_row(i1)};
+
+            for(size_t j{0}; j < width; ++j) {
+                const size_t idx{i * width + j};
+                const Point3f &p{pts[idx]};
+                normals[idx] = Point3f{0.0f, 0.0f, 0.0f};
+
+                if(not valid(p)) {
+                    continue;
+                }
+
+                const size_t j0{j - std::min(j, half)};
+                const size_t j1{std::min(j + half + 1, width)};
+                detail::Moments s;
+
+                for(size_t k{0}; k < s.size(); ++k) {
+                    s[k] = bottom[j1][k] - bottom[j0][k] - top[j1][k] + top[j0][k];
+                }
+
+                if(s[0] < 3.0) {
+                    continue;
+                }
+
+                // covariance times the count, the scale does not change the normal
+                const double inv_n{1.0 / s[0]};
+                const double mx{s[1] * inv_n};
+                const double my{s[2] * inv_n};
+                const double mz{s[3] * inv_n};
+                const auto n{detail::smallest_eigenvector(
+                    {s[4] - s[1] * mx, s[5] - s[1] * my, s[6] - s[1] * mz, s[7] - s[2] * my,
+                     s[8] - s[2] * mz, s[9] - s[3] * mz})};
+
+                if(not n) {
+                    continue;
+                }
+
+                // orientation and angle against the ray from the point to the sensor
+                const Point3d view{-p.x(), -p.y(), -p.z()};
+                const double view_len{view.norm()};
+                double cos_view{view_len > 0.0 ? n->dot(view) / view_len : 1.0};
+                const double sign{cos_view < 0.0 ? -1.0 : 1.0};
+                cos_view *= sign;
+
+                normals[idx] = Point3f{static_cast<float>(sign * n->x()),
+                                       static_cast<float>(sign * n->y()),
+                                       static_cast<float>(sign * n->z())};
+
+                if(set_.filter_by_angle_ and cos_view < cos_max) {
+                    rejected[idx] = 1;
+                }
+            }
+        }
+    }
+
+    NormalsEstimatorSettings set_;
+    size_t threads_;
+};
+
+} // namespace we
@@ -1,4 +1,7 @@
 #pragma once
 #include "io_e57.h"
 #include "io_ply.h"
-#include "io_txt.h"
\ No newline at end of file
+#include "io_ply_mapped.h"
+#include "io_ply_stream.h"
+#include "io_txt.h"
+#include "io_txt_mapped.h"
\ No newline at end of file
@@ -0,0 +1,1793 @@
+#pragma once
+#include "parallel.h"
+#include "point.h"
+#include "pointcloud.h"
+#include "we_assert.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <format>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace we {
+
+struct E57StreamSettings {
+    /// records encoded or decoded at once, bounds the record buffers
+    size_t block_records_{1 << 18};
+    /// number of threads, 0 - all hardware threads
+    size_t threads_{0};
+    /// checks the CRC of every page read
+    bool verify_checksums_{true};
+};
+
+/// @brief grid and per-point fields of a scan written by E57StreamWriter besides the cartesian
+/// coordinates and the row and column index
+struct E57ScanLayout {
+    size_t width_;
+    size_t height_;
+    bool intensity_{false};
+    bool rgb_{false};
+    /// written as the nor:normalX, nor:normalY, nor:normalZ extension of libE57
+    bool normals_{false};
+    std::string name_{};
+
+    [[nodiscard]] static E57ScanLayout of(const StructuredPointCloud3f &pcd,
+                                          std::string_view name = {}) {
+        return {.width_ = pcd.width(),
+                .height_ = pcd.height(),
+                .intensity_ = pcd.property<Prop::INTENSITY>().has_value(),
+                .rgb_ = pcd.property<Prop::RGB>().has_value(),
+                .normals_ = pcd.property<Prop::NORMALS>().has_value(),
+                .name_ = std::string{name}};
+    }
+};
+
+/// @brief a scan of an E57 file as listed by E57StreamReader
+struct E57ScanInfo {
+    std::string name_;
+    size_t records_;
+    /// grid of the row and column indices, records_ x 1 for scans without them
+    size_t width_;
+    size_t height_;
+    bool indexed_;
+    bool intensity_;
+    bool rgb_;
+    bool normals_;
+};
+
+/// @brief valid records read by E57StreamReader::read(), fields the scan lacks stay empty
+struct E57Block {
+    std::vector<Point3f> points_;
+    std::vector<uint32_t> rows_;
+    std::vector<uint32_t> columns_;
+    std::vector<uint16_t> intensity_;
+    std::vector<Point3ub> rgb_;
+    std::vector<Point3f> normals_;
+};
+
+namespace detail {
+
+inline constexpr size_t e57_page_size{1024};
+/// page bytes besides the checksum
+inline constexpr size_t e57_page_payload{1020};
+inline constexpr size_t e57_header_size{48};
+inline constexpr size_t e57_section_header_size{32};
+inline constexpr size_t e57_max_packet{65536};
+inline constexpr uint8_t e57_data_packet{1};
+inline constexpr std::string_view e57_nor_uri{"http://www.libe57.org/E57_NOR_surface_normals.txt"};
+
+[[nodiscard]] constexpr std::array<uint32_t, 256> crc32c_table() noexcept {
+    std::array<uint32_t, 256> table{};
+
+    for(uint32_t i{0}; i < 256; ++i) {
+        uint32_t crc{i};
+
+        for(int bit{0}; bit < 8; ++bit) {
+            crc = (crc & 1) != 0 ? (crc >> 1) ^ 0x82f63b78 : crc >> 1;
+        }
+
+        table[i] = crc;
+    }
+
+    return table;
+}
+
+inline constexpr auto crc32c_lut{crc32c_table()};
+
+[[nodiscard]] inline uint32_t crc32c(const std::byte *data, size_t size) noexcept {
+    uint32_t crc{0xffffffff};
+
+    for(size_t i{0}; i < size; ++i) {
+        crc = crc32c_lut[(crc ^ static_cast<uint32_t>(data[i])) & 0xff] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+/// @brief puts the CRC-32C of the payload of a page at its end, big-endian as libE57 does
+inline void seal_e57_page(std::byte *page) noexcept {
+    const uint32_t crc{crc32c(page, e57_page_payload)};
+
+    for(size_t k{0}; k < 4; ++k) {
+        page[e57_page_payload + k] = static_cast<std::byte>(crc >> (24 - 8 * k));
+    }
+}
+
+[[nodiscard]] inline bool e57_page_sealed(const std::byte *page) noexcept {
+    const uint32_t crc{crc32c(page, e57_page_payload)};
+
+    for(size_t k{0}; k < 4; ++k) {
+        if(page[e57_page_payload + k] != static_cast<std::byte>(crc >> (24 - 8 * k))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+[[nodiscard]] constexpr uint64_t e57_physical(uint64_t logical) noexcept {
+    return logical / e57_page_payload * e57_page_size + logical % e57_page_payload;
+}
+
+[[nodiscard]] constexpr uint64_t e57_logical(uint64_t physical) noexcept {
+    return physical / e57_page_size * e57_page_payload + physical % e57_page_size;
+}
+
+/// @brief bits of a bit-packed integer of [minimum, maximum]
+[[nodiscard]] constexpr size_t e57_bits(int64_t minimum, int64_t maximum) noexcept {
+    return maximum > minimum
+               ? static_cast<size_t>(std::bit_width(static_cast<uint64_t>(maximum) -
+                                                    static_cast<uint64_t>(minimum)))
+               : 0;
+}
+
+template <typename T> void put_le(std::byte *dst, T val) noexcept {
+    static_assert(std::endian::native == std::endian::little);
+    std::memcpy(dst, &val, sizeof(T));
+}
+
+template <typename T> [[nodiscard]] T get_le(const std::byte *src) noexcept {
+    static_assert(std::endian::native == std::endian::little);
+    T val;
+    std::memcpy(&val, src, sizeof(T));
+    return val;
+}
+
+/// @brief what a prototype field of a scan holds
+enum class E57Source : uint8_t {
+    NONE,
+    X,
+    Y,
+    Z,
+    RANGE,
+    AZIMUTH,
+    ELEVATION,
+    CARTESIAN_INVALID,
+    SPHERICAL_INVALID,
+    ROW,
+    COLUMN,
+    INTENSITY,
+    RED,
+    GREEN,
+    BLUE,
+    NX,
+    NY,
+    NZ
+};
+
+[[nodiscard]] inline E57Source e57_source(std::string_view name) noexcept {
+    constexpr std::array<std::pair<std::string_view, E57Source>, 17> names{{
+        {"cartesianX", E57Source::X},
+        {"cartesianY", E57Source::Y},
+        {"cartesianZ", E57Source::Z},
+        {"sphericalRange", E57Source::RANGE},
+        {"sphericalAzimuth", E57Source::AZIMUTH},
+        {"sphericalElevation", E57Source::ELEVATION},
+        {"cartesianInvalidState", E57Source::CARTESIAN_INVALID},
+        {"sphericalInvalidState", E57Source::SPHERICAL_INVALID},
+        {"rowIndex", E57Source::ROW},
+        {"columnIndex", E57Source::COLUMN},
+        {"intensity", E57Source::INTENSITY},
+        {"colorRed", E57Source::RED},
+        {"colorGreen", E57Source::GREEN},
+        {"colorBlue", E57Source::BLUE},
+        {"nor:normalX", E57Source::NX},
+        {"nor:normalY", E57Source::NY},
+        {"nor:normalZ", E57Source::NZ},
+    }};
+
+    const auto it{std::ranges::find(names, name, &std::pair<std::string_view, E57Source>::first)};
+    return it == names.end() ? E57Source::NONE : it->second;
+}
+
+/// @brief a field of the prototype of a compressed vector, one bytestream in every packet
+struct E57Field {
+    enum class Kind : uint8_t { FLOAT, INTEGER, SCALED_INTEGER, UNSUPPORTED };
+
+    std::string name_;
+    E57Source source_{E57Source::NONE};
+    Kind kind_{Kind::UNSUPPORTED};
+    /// bits per value, 32 or 64 for floats
+    size_t bits_{0};
+    int64_t minimum_{0};
+    int64_t maximum_{0};
+    double scale_{1.0};
+    double offset_{0.0};
+    /// range mapped to the full range of intensity and color values
+    double low_{0.0};
+    double high_{1.0};
+
+    /// @brief value i of a bytestream starting at bit first, the stream has 8 bytes of slack
+    [[nodiscard]] double value(const std::byte *stream, uint64_t first,
+                               size_t i) const noexcept {
+        if(kind_ == Kind::FLOAT) {
+            const std::byte *at{stream + first / 8 + i * bits_ / 8};
+            return bits_ == 32 ? double{get_le<float>(at)} : get_le<double>(at);
+        }
+
+        uint64_t raw{0};
+
+        if(bits_ > 0) {
+            const uint64_t bit{first + i * bits_};
+            const std::byte *at{stream + bit / 8};
+            const auto shift{static_cast<unsigned>(bit % 8)};
+            raw = get_le<uint64_t>(at) >> shift;
+
+            if(shift + bits_ > 64) {
+                raw |= static_cast<uint64_t>(at[8]) << (64 - shift);
+            }
+
+            if(bits_ < 64) {
+                raw &= (uint64_t{1} << bits_) - 1;
+            }
+        }
+
+        const auto integer{static_cast<int64_t>(static_cast<uint64_t>(minimum_) + raw)};
+        return kind_ == Kind::SCALED_INTEGER
+                   ? static_cast<double>(integer) * scale_ + offset_
+                   : static_cast<double>(integer);
+    }
+};
+
+/// @brief element of the XML section: attributes, text with CDATA and entities resolved,
+/// child elements
+struct XmlNode {
+    std::string name_;
+    std::vector<std::pair<std::string, std::string>> attributes_;
+    std::string text_;
+    std::vector<XmlNode> children_;
+
+    [[nodiscard]] const XmlNode *child(std::string_view name) const noexcept {
+        const auto it{std::ranges::find(children_, name, &XmlNode::name_)};
+        return it == children_.end() ? nullptr : &*it;
+    }
+
+    [[nodiscard]] std::optional<std::string_view>
+    attribute(std::string_view name) const noexcept {
+        for(const auto &[key, val] : attributes_) {
+            if(key == name) {
+                return val;
+            }
+        }
+
+        return std::nullopt;
+    }
+};
+
+template <typename T> [[nodiscard]] std::optional<T> parse_number(std::string_view str) {
+    while(not str.empty() and std::isspace(static_cast<unsigned char>(str.front())) != 0) {
+        str.remove_prefix(1);
+    }
+
+    T val{};
+    const auto [end, ec]{std::from_chars(str.data(), str.data() + str.size(), val)};
+    return ec == std::errc{} ? std::optional{val} : std::nullopt;
+}
+
+/// @brief the subset of XML E57 files use: elements, attributes, text, CDATA, comments,
+/// processing instructions and the predefined entities
+class XmlParser {
+  public:
+    explicit XmlParser(std::string_view xml)
+        : s_{xml} {}
+
+    [[nodiscard]] std::optional<XmlNode> parse() {
+        skip_misc();
+        return element(0);
+    }
+
+  private:
+    static constexpr size_t max_depth{64};
+
+    [[nodiscard]] bool starts(std::string_view str) const noexcept {
+        return s_.substr(pos_).starts_with(str);
+    }
+
+    [[nodiscard]] bool skip_past(std::string_view str) noexcept {
+        const size_t at{s_.find(str, pos_)};
+        pos_ = at == std::string_view::npos ? s_.size() : at + str.size();
+        return at != std::string_view::npos;
+    }
+
+    void skip_space() noexcept {
+        while(pos_ < s_.size() and std::isspace(static_cast<unsigned char>(s_[pos_])) != 0) {
+            ++pos_;
+        }
+    }
+
+    void skip_misc() noexcept {
+        while(true) {
+            skip_space();
+
+            if(starts("<?")) {
+                static_cast<void>(skip_past("?>"));
+            } else if(starts("<!--")) {
+                static_cast<void>(skip_past("-->"));
+            } else if(starts("<!DOCTYPE")) {
+                static_cast<void>(skip_past(">"));
+            } else {
+                return;
+            }
+        }
+    }
+
+    [[nodiscard]] std::string_view name() noexcept {
+        const size_t first{pos_};
+
+        while(pos_ < s_.size() and std::isspace(static_cast<unsigned char>(s_[pos_])) == 0 and
+              s_[pos_] != '/' and s_[pos_] != '>' and s_[pos_] != '=') {
+            ++pos_;
+        }
+
+        return s_.substr(first, pos_ - first);
+    }
+
+    static void decode(std::string_view str, std::string &out) {
+        constexpr std::array<std::pair<std::string_view, char>, 5> entities{
+            {{"&lt;", '<'}, {"&gt;", '>'}, {"&amp;", '&'}, {"&quot;", '"'}, {"&apos;", '\''}}};
+
+        for(size_t i{0}; i < str.size(); ++i) {
+            const auto it{std::ranges::find_if(entities, [&](const auto &entity) {
+                return str.substr(i).starts_with(entity.first);
+            })};
+
+            if(str[i] == '&' and it != entities.end()) {
+                out += it->second;
+                i += it->first.size() - 1;
+            } else {
+                out += str[i];
+            }
+        }
+    }
+
+    [[nodiscard]] std::optional<XmlNode> element(size_t depth) {
+        if(depth > max_depth or not starts("<")) {
+            return std::nullopt;
+        }
+
+        ++pos_;
+        XmlNode node;
+        node.name_ = name();
+
+        while(true) {
+            skip_space();
+
+            if(starts("/>")) {
+                pos_ += 2;
+                return node;
+            }
+
+            if(starts(">")) {
+                ++pos_;
+                break;
+            }
+
+            const auto key{name()};
+            skip_space();
+
+            if(key.empty() or not starts("=")) {
+                return std::nullopt;
+            }
+
+            ++pos_;
+            skip_space();
+
+            if(pos_ >= s_.size() or (s_[pos_] != '"' and s_[pos_] != '\'')) {
+                return std::nullopt;
+            }
+
+            const char quote{s_[pos_++]};
+            const size_t end{s_.find(quote, pos_)};
+
+            if(end == std::string_view::npos) {
+                return std::nullopt;
+            }
+
+            std::string val;
+            decode(s_.substr(pos_, end - pos_), val);
+            node.attributes_.emplace_back(std::string{key}, std::move(val));
+            pos_ = end + 1;
+        }
+
+        while(pos_ < s_.size()) {
+            if(starts("</")) {
+                pos_ += 2;
+
+                if(name() != node.name_) {
+                    return std::nullopt;
+                }
+
+                skip_space();
+                return starts(">") ? (++pos_, std::optional{std::move(node)}) : std::nullopt;
+            }
+
+            if(starts("<![CDATA[")) {
+                pos_ += 9;
+                const size_t end{s_.find("]]>", pos_)};
+
+                if(end == std::string_view::npos) {
+                    return std::nullopt;
+                }
+
+                node.text_ += s_.substr(pos_, end - pos_);
+                pos_ = end + 3;
+            } else if(starts("<!--")) {
+                static_cast<void>(skip_past("-->"));
+            } else if(starts("<?")) {
+                static_cast<void>(skip_past("?>"));
+            } else if(starts("<")) {
+                auto child{element(depth + 1)};
+
+                if(not child) {
+                    return std::nullopt;
+                }
+
+                node.children_.push_back(std::move(*child));
+            } else {
+                const size_t end{std::min(s_.find('<', pos_), s_.size())};
+                decode(s_.substr(pos_, end - pos_), node.text_);
+                pos_ = end;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    std::string_view s_;
+    size_t pos_{0};
+};
+
+[[nodiscard]] inline std::string xml_escape(std::string_view str) {
+    std::string out;
+
+    for(const char c : str) {
+        switch(c) {
+        case '<':
+            out += "&lt;";
+            break;
+        case '>':
+            out += "&gt;";
+            break;
+        case '&':
+            out += "&amp;";
+            break;
+        case '"':
+            out += "&quot;";
+            break;
+        default:
+            out += c;
+        }
+    }
+
+    return out;
+}
+
+[[nodiscard]] inline std::string e57_guid() {
+    std::random_device device;
+    std::mt19937_64 gen{(uint64_t{device()} << 32) | device()};
+    const uint64_t a{gen()};
+    const uint64_t b{gen()};
+    return std::format("{{{:08x}-{:04x}-{:04x}-{:04x}-{:012x}}}", a >> 32, (a >> 16) & 0xffff,
+                       a & 0xffff, b >> 48, b & 0xffffffffffff);
+}
+
+/// @brief logical byte stream of an E57 file cut into checksummed pages. Pages are collected in
+/// a buffer and sealed on all threads when it is full; pages registered by hold() are kept to
+/// patch bytes written earlier, e.g. headers whose content is known at the end only
+class E57PagedWriter {
+  public:
+    E57PagedWriter(std::ostream &out, size_t threads, size_t buffer_pages = 1024)
+        : out_{&out}
+        , threads_{threads}
+        , buffer_(buffer_pages * e57_page_size) {}
+
+    [[nodiscard]] uint64_t position() const noexcept { return logical_; }
+
+    void write(std::span<const std::byte> data) {
+        while(not data.empty()) {
+            const uint64_t page{logical_ / e57_page_payload};
+            const size_t offset{static_cast<size_t>(logical_ % e57_page_payload)};
+
+            if((page - first_page_) * e57_page_size == buffer_.size()) {
+                flush(buffer_.size() / e57_page_size);
+                continue;
+            }
+
+            const size_t n{std::min(data.size(), e57_page_payload - offset)};
+            std::memcpy(buffer_.data() + (page - first_page_) * e57_page_size + offset,
+                        data.data(), n);
+            data = data.subspan(n);
+            logical_ += n;
+        }
+    }
+
+    void write_zeros(size_t n) {
+        constexpr std::array<std::byte, 64> zeros{};
+
+        while(n > 0) {
+            const size_t k{std::min(n, zeros.size())};
+            write(std::span{zeros}.first(k));
+            n -= k;
+        }
+    }
+
+    /// @brief keeps the pages of [logical, logical + n) for patch(), has to come before the
+    /// bytes are written: a page flushed before it is held can not be patched any more
+    void hold(uint64_t logical, size_t n) {
+        assert_true([&, this]() { return logical / e57_page_payload >= first_page_; },
+                    "hold of a written page");
+
+        for(uint64_t page{logical / e57_page_payload};
+            page <= (logical + n - 1) / e57_page_payload; ++page) {
+            static_cast<void>(held_.try_emplace(page));
+        }
+    }
+
+    /// @brief overwrites bytes written before, their pages are still buffered or held
+    void patch(uint64_t logical, std::span<const std::byte> data) {
+        for(const std::byte b : data) {
+            const uint64_t page{logical / e57_page_payload};
+            const size_t offset{static_cast<size_t>(logical % e57_page_payload)};
+
+            if(page >= first_page_) {
+                buffer_[(page - first_page_) * e57_page_size + offset] = b;
+            } else {
+                const auto it{held_.find(page)};
+                assert_true([&]() { return it != held_.end(); }, "patch of a written page");
+                it->second.page_[offset] = b;
+                it->second.dirty_ = true;
+            }
+
+            ++logical;
+        }
+    }
+
+    /// @brief zero pads the last page, writes all pages and the patched held ones, returns the
+    /// physical length of the file
+    uint64_t finish() {
+        if(const size_t rest{static_cast<size_t>(logical_ % e57_page_payload)}; rest != 0) {
+            write_zeros(e57_page_payload - rest);
+        }
+
+        flush(static_cast<size_t>(logical_ / e57_page_payload - first_page_));
+
+        for(auto &[page, held] : held_) {
+            if(held.dirty_) {
+                seal_e57_page(held.page_.data());
+                out_->seekp(static_cast<std::streamoff>(page * e57_page_size));
+                out_->write(reinterpret_cast<const char *>(held.page_.data()),
+                            static_cast<std::streamsize>(e57_page_size));
+            }
+        }
+
+        out_->seekp(0, std::ios_base::end);
+        return logical_ / e57_page_payload * e57_page_size;
+    }
+
+  private:
+    struct HeldPage {
+        std::array<std::byte, e57_page_size> page_{};
+        bool dirty_{false};
+    };
+
+    void flush(size_t pages) {
+        parallel_for(
+            pages,
+            [&](size_t first, size_t last) {
+                for(size_t p{first}; p < last; ++p) {
+                    seal_e57_page(buffer_.data() + p * e57_page_size);
+                }
+            },
+            threads_, 16);
+
+        for(auto it{held_.lower_bound(first_page_)};
+            it != held_.end() and it->first < first_page_ + pages; ++it) {
+            std::memcpy(it->second.page_.data(),
+                        buffer_.data() + (it->first - first_page_) * e57_page_size,
+                        e57_page_size);
+        }
+
+        out_->write(reinterpret_cast<const char *>(buffer_.data()),
+                    static_cast<std::streamsize>(pages * e57_page_size));
+        first_page_ += pages;
+    }
+
+    std::ostream *out_;
+    size_t threads_;
+    std::vector<std::byte> buffer_;
+    uint64_t first_page_{0};
+    uint64_t logical_{0};
+    std::map<uint64_t, HeldPage> held_;
+};
+
+/// @brief logical reads from an E57 file through a cache of whole pages, checksums of a loaded
+/// run of pages are verified on all threads
+class E57PagedReader {
+  public:
+    E57PagedReader(std::istream &in, bool verify, size_t threads, size_t cache_pages = 256)
+        : in_{&in}
+        , verify_{verify}
+        , threads_{threads}
+        , cache_(cache_pages * e57_page_size) {
+        in_->seekg(0, std::ios_base::end);
+        const auto size{in_->tellg()};
+        pages_ = size > 0 ? static_cast<uint64_t>(size) / e57_page_size : 0;
+    }
+
+    [[nodiscard]] uint64_t pages() const noexcept { return pages_; }
+
+    /// @brief false on a read error, a checksum mismatch or a read past the file end
+    [[nodiscard]] bool read(uint64_t logical, std::span<std::byte> out) {
+        while(not out.empty()) {
+            const uint64_t page{logical / e57_page_payload};
+            const size_t offset{static_cast<size_t>(logical % e57_page_payload)};
+
+            if((page < first_page_ or page >= first_page_ + cached_) and not load(page)) {
+                return false;
+            }
+
+            const size_t n{std::min(out.size(), e57_page_payload - offset)};
+            std::memcpy(out.data(), cache_.data() + (page - first_page_) * e57_page_size + offset,
+                        n);
+            out = out.subspan(n);
+            logical += n;
+        }
+
+        return true;
+    }
+
+  private:
+    [[nodiscard]] bool load(uint64_t page) {
+        cached_ = 0;
+
+        if(page >= pages_) {
+            return false;
+        }
+
+        const size_t n{static_cast<size_t>(
+            std::min<uint64_t>(pages_ - page, cache_.size() / e57_page_size))};
+        in_->clear();
+        in_->seekg(static_cast<std::streamoff>(page * e57_page_size));
+        in_->read(reinterpret_cast<char *>(cache_.data()),
+                  static_cast<std::streamsize>(n * e57_page_size));
+
+        if(not in_->good()) {
+            return false;
+        }
+
+        if(verify_) {
+            std::atomic<bool> sealed{true};
+
+            parallel_for(
+                n,
+                [&](size_t first, size_t last) {
+                    for(size_t p{first}; p < last; ++p) {
+                        if(not e57_page_sealed(cache_.data() + p * e57_page_size)) {
+                            sealed = false;
+                        }
+                    }
+                },
+                threads_, 16);
+
+            if(not sealed) {
+                return false;
+            }
+        }
+
+        first_page_ = page;
+        cached_ = n;
+        return true;
+    }
+
+    std::istream *in_;
+    bool verify_;
+    size_t threads_;
+    std::vector<std::byte> cache_;
+    uint64_t pages_{0};
+    uint64_t first_page_{0};
+    size_t cached_{0};
+};
+
+} // namespace detail
+
+/// @brief E57 writer taking scans row block by row block with bounded memory. Valid points of a
+/// structured cloud are written as records of single precision cartesianX/Y/Z, rowIndex and
+/// columnIndex, with intensity, colorRed/Green/Blue and the nor:normalX/Y/Z extension as the
+/// layout asks, into one compressed vector per scan; any number of scans goes into one file.
+/// Records are staged up to set.block_records_, packets of them are bit-packed on all threads
+/// and written in order, and pages are checksummed on all threads. finish() writes the XML
+/// section and back-patches the headers, the stream has to be seekable. The file is complete
+/// only after finish(), which reports any failed write.
+/// @example
+/// E57StreamWriter writer{"frames.e57"};
+/// writer.begin_scan(E57ScanLayout::of(pcd, "frame 0"));
+/// for(size_t row{0}; row < pcd.height(); row += 64) {
+///     writer.write_rows(pcd, row, std::min(row + 64, pcd.height()));
+/// }
+/// writer.end_scan();
+/// const bool ok{writer.finish()};
+class E57StreamWriter {
+  public:
+    explicit E57StreamWriter(std::ostream &out, const E57StreamSettings &set = {})
+        : out_{&out}
+        , set_{set}
+        , pages_{out, set.threads_} {
+        start();
+    }
+
+    explicit E57StreamWriter(const std::string_view path, const E57StreamSettings &set = {})
+        : file_{std::make_unique<std::ofstream>(std::string{path}, std::ios_base::binary)}
+        , out_{file_.get()}
+        , set_{set}
+        , pages_{*file_, set.threads_} {
+        start();
+    }
+
+    E57StreamWriter(const E57StreamWriter &) = delete;
+    E57StreamWriter(E57StreamWriter &&) = delete;
+    E57StreamWriter &operator=(const E57StreamWriter &) = delete;
+    E57StreamWriter &operator=(E57StreamWriter &&) = delete;
+
+    /// @brief does not finish the file: its failures could not be reported. A writer destroyed
+    /// unfinished other than by an exception is a bug, caught by an assert in debug builds
+    ~E57StreamWriter() {
+        assert((finished_ or std::uncaught_exceptions() > uncaught_) and
+               "E57StreamWriter destroyed without finish()");
+    }
+
+    /// @brief starts a scan, its rows follow through write_rows()
+    void begin_scan(const E57ScanLayout &layout) {
+        assert_true([this]() { return not finished_ and not scan_open_; }, "scan already open");
+        assert_true(
+            [&]() {
+                return layout.width_ > 0 and layout.height_ > 0 and
+                       layout.width_ <= std::numeric_limits<uint32_t>::max() and
+                       layout.height_ <= std::numeric_limits<uint32_t>::max();
+            },
+            "wrong scan size");
+
+        layout_ = layout;
+        fields_ = fields(layout);
+        record_bits_ = 0;
+
+        for(const auto &f : fields_) {
+            record_bits_ += f.bits_;
+        }
+
+        // packets of a multiple of 8 records keep every bytestream byte aligned
+        const size_t payload{detail::e57_max_packet - 16 - 3 * fields_.size()};
+        packet_records_ = std::max<size_t>(payload * 8 / record_bits_ / 8 * 8, 8);
+
+        // compressed vector sections start 4 byte aligned
+        pages_.write_zeros(static_cast<size_t>((4 - pages_.position() % 4) % 4));
+        section_ = pages_.position();
+        pages_.hold(section_, detail::e57_section_header_size);
+        pages_.write_zeros(detail::e57_section_header_size);
+        records_ = 0;
+        scan_open_ = true;
+    }
+
+    /// @brief appends the valid points of rows [row_first, row_last) of pcd to the open scan,
+    /// pcd has the grid of its layout and at least its properties
+    void write_rows(const StructuredPointCloud3f &pcd, size_t row_first, size_t row_last) {
+        assert_true([this]() { return scan_open_; }, "no open scan");
+        assert_true(
+            [&, this]() {
+                return pcd.width() == layout_.width_ and pcd.height() == layout_.height_ and
+                       row_first <= row_last and row_last <= pcd.height();
+            },
+            "rows do not match the scan");
+
+        const auto pts{pcd.points()};
+        const auto intensity{pcd.property<Prop::INTENSITY>()};
+        const auto rgb{pcd.property<Prop::RGB>()};
+        const auto normals{pcd.property<Prop::NORMALS>()};
+        const auto empty_value{pcd.empty_value()};
+
+        assert_true(
+            [&, this]() {
+                return (not layout_.intensity_ or intensity) and (not layout_.rgb_ or rgb) and
+                       (not layout_.normals_ or normals);
+            },
+            "cloud lacks a field of the layout");
+
+        for(size_t row{row_first}; row < row_last; ++row) {
+            for(size_t col{0}; col < pcd.width(); ++col) {
+                const size_t i{row * pcd.width() + col};
+
+                if(pts[i] == empty_value) {
+                    continue;
+                }
+
+                points_.push_back(pts[i]);
+                rows_.push_back(static_cast<uint32_t>(row));
+                columns_.push_back(static_cast<uint32_t>(col));
+
+                if(layout_.intensity_) {
+                    intensity_.push_back((*intensity)[i]);
+                }
+
+                if(layout_.rgb_) {
+                    rgb_.push_back((*rgb)[i]);
+                }
+
+                if(layout_.normals_) {
+                    normals_.push_back((*normals)[i]);
+                }
+            }
+
+            if(points_.size() >= set_.block_records_) {
+                write_packets(points_.size() / packet_records_);
+            }
+        }
+    }
+
+    /// @brief writes the staged records and closes the scan
+    void end_scan() {
+        assert_true([this]() { return scan_open_; }, "no open scan");
+
+        write_packets((points_.size() + packet_records_ - 1) / packet_records_);
+
+        const uint64_t length{pages_.position() - section_};
+        std::array<std::byte, detail::e57_section_header_size> header{};
+        header[0] = std::byte{1};
+        detail::put_le<uint64_t>(header.data() + 8, length);
+        detail::put_le<uint64_t>(header.data() + 16, detail::e57_physical(
+                                                         section_ + header.size()));
+        // no index packet: it only speeds up seeking, and libE57 writes none either
+        detail::put_le<uint64_t>(header.data() + 24, 0);
+        pages_.patch(section_, header);
+
+        scans_.push_back(Scan{.layout_ = layout_,
+                              .guid_ = detail::e57_guid(),
+                              .offset_ = detail::e57_physical(section_),
+                              .records_ = records_});
+        scan_open_ = false;
+    }
+
+    /// @brief a whole scan in blocks of rows
+    void write_scan(const StructuredPointCloud3f &pcd, std::string_view name = {}) {
+        begin_scan(E57ScanLayout::of(pcd, name));
+        const size_t rows{std::max<size_t>(set_.block_records_ / std::max<size_t>(pcd.width(), 1),
+                                           1)};
+
+        for(size_t row{0}; row < pcd.height(); row += rows) {
+            write_rows(pcd, row, std::min(row + rows, pcd.height()));
+        }
+
+        end_scan();
+    }
+
+    /// @brief closes an open scan, writes the XML section and the file header. Returns false if
+    /// any write failed
+    [[nodiscard]] bool finish() {
+        if(finished_) {
+            return out_->good();
+        }
+
+        if(scan_open_) {
+            end_scan();
+        }
+
+        finished_ = true;
+
+        const std::string xml{xml_section()};
+        const uint64_t xml_offset{pages_.position()};
+        pages_.write(std::as_bytes(std::span{xml}));
+
+        const uint64_t length{(pages_.position() + detail::e57_page_payload - 1) /
+                              detail::e57_page_payload * detail::e57_page_size};
+        std::array<std::byte, detail::e57_header_size> header{};
+        std::memcpy(header.data(), "ASTM-E57", 8);
+        detail::put_le<uint32_t>(header.data() + 8, 1);
+        detail::put_le<uint32_t>(header.data() + 12, 0);
+        detail::put_le<uint64_t>(header.data() + 16, length);
+        detail::put_le<uint64_t>(header.data() + 24, detail::e57_physical(xml_offset));
+        detail::put_le<uint64_t>(header.data() + 32, xml.size());
+        detail::put_le<uint64_t>(header.data() + 40, detail::e57_page_size);
+        pages_.patch(0, header);
+
+        static_cast<void>(pages_.finish());
+        out_->flush();
+        return out_->good();
+    }
+
+    [[nodiscard]] size_t scan_count() const noexcept { return scans_.size(); }
+
+  private:
+    struct Scan {
+        E57ScanLayout layout_;
+        std::string guid_;
+        uint64_t offset_;
+        size_t records_;
+    };
+
+    void start() {
+        pages_.hold(0, detail::e57_header_size);
+        pages_.write_zeros(detail::e57_header_size);
+    }
+
+    [[nodiscard]] static std::vector<detail::E57Field> fields(const E57ScanLayout &layout) {
+        using Kind = detail::E57Field::Kind;
+        using detail::E57Source;
+
+        std::vector<detail::E57Field> res;
+        const auto add_float{[&](std::string_view name, E57Source source) {
+            res.push_back({.name_ = std::string{name},
+                           .source_ = source,
+                           .kind_ = Kind::FLOAT,
+                           .bits_ = 32});
+        }};
+        const auto add_integer{[&](std::string_view name, E57Source source, int64_t maximum) {
+            res.push_back({.name_ = std::string{name},
+                           .source_ = source,
+                           .kind_ = Kind::INTEGER,
+                           .bits_ = detail::e57_bits(0, maximum),
+                           .maximum_ = maximum});
+        }};
+
+        add_float("cartesianX", E57Source::X);
+        add_float("cartesianY", E57Source::Y);
+        add_float("cartesianZ", E57Source::Z);
+        add_integer("rowIndex", E57Source::ROW, static_cast<int64_t>(layout.height_) - 1);
+        add_integer("columnIndex", E57Source::COLUMN, static_cast<int64_t>(layout.width_) - 1);
+
+        if(layout.intensity_) {
+            add_integer("intensity", E57Source::INTENSITY, std::numeric_limits<uint16_t>::max());
+        }
+
+        if(layout.rgb_) {
+            add_integer("colorRed", E57Source::RED, std::numeric_limits<uint8_t>::max());
+            add_integer("colorGreen", E57Source::GREEN, std::numeric_limits<uint8_t>::max());
+            add_integer("colorBlue", E57Source::BLUE, std::numeric_limits<uint8_t>::max());
+        }
+
+        if(layout.normals_) {
+            add_float("nor:normalX", E57Source::NX);
+            add_float("nor:normalY", E57Source::NY);
+            add_float("nor:normalZ", E57Source::NZ);
+        }
+
+        return res;
+    }
+
+    /// @brief value of record i for a field, floats as their bits
+    [[nodiscard]] uint64_t raw(const detail::E57Field &f, size_t i) const noexcept {
+        using detail::E57Source;
+
+        switch(f.source_) {
+        case E57Source::X:
+            return std::bit_cast<uint32_t>(points_[i].x());
+        case E57Source::Y:
+            return std::bit_cast<uint32_t>(points_[i].y());
+        case E57Source::Z:
+            return std::bit_cast<uint32_t>(points_[i].z());
+        case E57Source::ROW:
+            return rows_[i];
+        case E57Source::COLUMN:
+            return columns_[i];
+        case E57Source::INTENSITY:
+            return intensity_[i];
+        case E57Source::RED:
+            return rgb_[i].x();
+        case E57Source::GREEN:
+            return rgb_[i].y();
+        case E57Source::BLUE:
+            return rgb_[i].z();
+        case E57Source::NX:
+            return std::bit_cast<uint32_t>(normals_[i].x());
+        case E57Source::NY:
+            return std::bit_cast<uint32_t>(normals_[i].y());
+        case E57Source::NZ:
+            return std::bit_cast<uint32_t>(normals_[i].z());
+        default:
+            return 0;
+        }
+    }
+
+    /// @brief data packet of records [first, last): header, bytestream lengths, bytestreams
+    /// LSB first, zero padded to 4 bytes
+    void encode_packet(size_t first, size_t last, std::vector<std::byte> &packet) const {
+        const size_t n{last - first};
+        std::vector<size_t> lengths(fields_.size());
+        size_t size{6 + 2 * fields_.size()};
+
+        for(size_t f{0}; f < fields_.size(); ++f) {
+            lengths[f] = (n * fields_[f].bits_ + 7) / 8;
+            size += lengths[f];
+        }
+
+        size = (size + 3) / 4 * 4;
+        packet.assign(size + 8, std::byte{0});
+        packet[0] = std::byte{detail::e57_data_packet};
+        detail::put_le<uint16_t>(packet.data() + 2, static_cast<uint16_t>(size - 1));
+        detail::put_le<uint16_t>(packet.data() + 4, static_cast<uint16_t>(fields_.size()));
+        std::byte *out{packet.data() + 6 + 2 * fields_.size()};
+
+        for(size_t f{0}; f < fields_.size(); ++f) {
+            const auto &field{fields_[f]};
+            detail::put_le<uint16_t>(packet.data() + 6 + 2 * f, static_cast<uint16_t>(lengths[f]));
+
+            uint64_t bits{0};
+            size_t filled{0};
+            std::byte *dst{out};
+
+            for(size_t i{first}; i < last; ++i) {
+                // values of up to 32 bits fit next to the less than 32 bits left over
+                bits |= raw(field, i) << filled;
+                filled += field.bits_;
+
+                while(filled >= 32) {
+                    detail::put_le<uint32_t>(dst, static_cast<uint32_t>(bits));
+                    dst += 4;
+                    bits >>= 32;
+                    filled -= 32;
+                }
+            }
+
+            detail::put_le<uint64_t>(dst, bits);
+            out += lengths[f];
+        }
+
+        packet.resize(size);
+    }
+
+    /// @brief encodes up to packets packets of staged records on all threads, writes them and
+    /// keeps the rest staged
+    void write_packets(size_t packets) {
+        const size_t staged{points_.size()};
+        packets = std::min(packets, (staged + packet_records_ - 1) / packet_records_);
+
+        if(packets == 0) {
+            return;
+        }
+
+        std::vector<std::vector<std::byte>> encoded(packets);
+
+        parallel_for(
+            packets,
+            [&](size_t first, size_t last) {
+                for(size_t p{first}; p < last; ++p) {
+                    encode_packet(p * packet_records_,
+                                  std::min((p + 1) * packet_records_, staged), encoded[p]);
+                }
+            },
+            set_.threads_, 1);
+
+        for(const auto &packet : encoded) {
+            pages_.write(packet);
+        }
+
+        const size_t done{std::min(packets * packet_records_, staged)};
+        records_ += done;
+
+        const auto drop{[done](auto &vec) {
+            vec.erase(vec.begin(), vec.begin() + static_cast<std::ptrdiff_t>(
+                                                     std::min(done, vec.size())));
+        }};
+        drop(points_);
+        drop(rows_);
+        drop(columns_);
+        drop(intensity_);
+        drop(rgb_);
+        drop(normals_);
+    }
+
+    [[nodiscard]] std::string xml_section() const {
+        std::string xml{"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"};
+        xml += std::format("<e57Root type=\"Structure\" "
+                           "xmlns=\"http://www.astm.org/COMMIT/E57/2010-e57-v1.0\" "
+                           "xmlns:nor=\"{}\">\n",
+                           detail::e57_nor_uri);
+        xml += "<formatName type=\"String\">ASTM E57 3D Imaging Data File</formatName>\n";
+        xml += std::format("<guid type=\"String\">{}</guid>\n", detail::e57_guid());
+        xml += "<versionMajor type=\"Integer\">1</versionMajor>\n";
+        xml += "<versionMinor type=\"Integer\">0</versionMinor>\n";
+        xml += "<coordinateMetadata type=\"String\"></coordinateMetadata>\n";
+        xml += "<data3D type=\"Vector\" allowHeterogeneousChildren=\"1\">\n";
+
+        for(const auto &scan : scans_) {
+            const auto &layout{scan.layout_};
+            xml += "<vectorChild type=\"Structure\">\n";
+            xml += std::format("<guid type=\"String\">{}</guid>\n", scan.guid_);
+            xml += std::format("<name type=\"String\">{}</name>\n", detail::xml_escape(
+                                                                        layout.name_));
+            xml += std::format("<points type=\"CompressedVector\" fileOffset=\"{}\" "
+                               "recordCount=\"{}\">\n<prototype type=\"Structure\">\n",
+                               scan.offset_, scan.records_);
+
+            for(const auto &f : fields(layout)) {
+                xml += f.kind_ == detail::E57Field::Kind::FLOAT
+                           ? std::format("<{} type=\"Float\" precision=\"single\"/>\n", f.name_)
+                           : std::format("<{} type=\"Integer\" minimum=\"0\" maximum=\"{}\"/>\n",
+                                         f.name_, f.maximum_);
+            }
+
+            xml += "</prototype>\n<codecs type=\"Vector\" allowHeterogeneousChildren=\"1\"/>\n";
+            xml += "</points>\n";
+            xml += std::format("<indexBounds type=\"Structure\">"
+                               "<rowMinimum type=\"Integer\">0</rowMinimum>"
+                               "<rowMaximum type=\"Integer\">{}</rowMaximum>"
+                               "<columnMinimum type=\"Integer\">0</columnMinimum>"
+                               "<columnMaximum type=\"Integer\">{}</columnMaximum>"
+                               "<returnMinimum type=\"Integer\">0</returnMinimum>"
+                               "<returnMaximum type=\"Integer\">0</returnMaximum>"
+                               "</indexBounds>\n",
+                               layout.height_ - 1, layout.width_ - 1);
+
+            if(layout.intensity_) {
+                xml += "<intensityLimits type=\"Structure\">"
+                       "<intensityMinimum type=\"Integer\">0</intensityMinimum>"
+                       "<intensityMaximum type=\"Integer\">65535</intensityMaximum>"
+                       "</intensityLimits>\n";
+            }
+
+            if(layout.rgb_) {
+                xml += "<colorLimits type=\"Structure\">";
+
+                for(const std::string_view c : {"Red", "Green", "Blue"}) {
+                    xml += std::format("<color{0}Minimum type=\"Integer\">0</color{0}Minimum>"
+                                       "<color{0}Maximum type=\"Integer\">255</color{0}Maximum>",
+                                       c);
+                }
+
+                xml += "</colorLimits>\n";
+            }
+
+            xml += "</vectorChild>\n";
+        }
+
+        xml += "</data3D>\n<images2D type=\"Vector\" allowHeterogeneousChildren=\"1\"/>\n";
+        xml += "</e57Root>\n";
+        return xml;
+    }
+
+    std::unique_ptr<std::ofstream> file_;
+    std::ostream *out_;
+    E57StreamSettings set_;
+    detail::E57PagedWriter pages_;
+    std::vector<Scan> scans_;
+    bool finished_{false};
+    bool scan_open_{false};
+    int uncaught_{std::uncaught_exceptions()};
+
+    E57ScanLayout layout_{};
+    std::vector<detail::E57Field> fields_;
+    size_t record_bits_{0};
+    size_t packet_records_{0};
+    uint64_t section_{0};
+    size_t records_{0};
+
+    std::vector<Point3f> points_;
+    std::vector<uint32_t> rows_;
+    std::vector<uint32_t> columns_;
+    std::vector<uint16_t> intensity_;
+    std::vector<Point3ub> rgb_;
+    std::vector<Point3f> normals_;
+};
+
+/// @brief E57 reader listing the scans of a file from its XML section and reading any one of
+/// them record block by record block with bounded memory. Cartesian or spherical coordinates,
+/// the invalid states, row and column indices, intensity, colors and the nor:normalX/Y/Z
+/// extension are read from float, integer and scaled integer fields, other fields are skipped.
+/// Packets are read in order into per-field bytestreams up to the next block, whose records
+/// are then decoded on all threads, as are the page checksums.
+/// @example
+/// E57StreamReader reader{"frames.e57"};
+/// for(size_t s{0}; s < reader.scans().size(); ++s) {
+///     StructuredPointCloud3f pcd;
+///     if(reader.read_scan(s, pcd)) { ... }
+/// }
+class E57StreamReader {
+  public:
+    explicit E57StreamReader(const std::string_view path, const E57StreamSettings &set = {})
+        : file_{std::string{path}, std::ios_base::binary}
+        , set_{set}
+        , pages_{file_, set.verify_checksums_, set.threads_} {
+        open_ = file_.is_open() and open();
+    }
+
+    E57StreamReader(const E57StreamReader &) = delete;
+    E57StreamReader(E57StreamReader &&) = delete;
+    E57StreamReader &operator=(const E57StreamReader &) = delete;
+    E57StreamReader &operator=(E57StreamReader &&) = delete;
+
+    ~E57StreamReader() = default;
+
+    [[nodiscard]] bool is_open() const noexcept { return open_; }
+
+    [[nodiscard]] std::span<const E57ScanInfo> scans() const noexcept { return infos_; }
+
+    /// @brief starts reading scan s from its first record, false if its section is corrupt
+    [[nodiscard]] bool open_scan(size_t s) {
+        assert_true([&, this]() { return s < infos_.size(); }, "no such scan");
+
+        scan_ = s;
+        consumed_ = 0;
+        const auto &format{formats_[s]};
+        streams_.assign(format.fields_.size(), Stream{});
+
+        std::array<std::byte, detail::e57_section_header_size> header;
+
+        if(not pages_.read(format.section_, header) or header[0] != std::byte{1}) {
+            scan_.reset();
+            return false;
+        }
+
+        section_end_ = format.section_ + detail::get_le<uint64_t>(header.data() + 8);
+        packet_ = detail::e57_logical(detail::get_le<uint64_t>(header.data() + 16));
+
+        if(infos_[s].records_ > 0 and (packet_ < format.section_ or packet_ > section_end_)) {
+            scan_.reset();
+            return false;
+        }
+
+        return true;
+    }
+
+    /// @brief reads up to max_records next records of the open scan, block keeps the valid
+    /// ones. Returns the number of records read, 0 at the end of the scan, std::nullopt if the
+    /// file is corrupt.
+    [[nodiscard]] std::optional<size_t> read(E57Block &block, size_t max_records) {
+        assert_true([this]() { return scan_.has_value(); }, "no open scan");
+
+        const auto &info{infos_[*scan_]};
+        const auto &format{formats_[*scan_]};
+        const size_t n{std::min(max_records, info.records_ - consumed_)};
+
+        block = E57Block{};
+
+        if(n == 0) {
+            return 0;
+        }
+
+        // drop the consumed bytes, then read packets until every used field holds n values
+        for(auto &stream : streams_) {
+            const auto bytes{static_cast<std::ptrdiff_t>(stream.bit_ / 8)};
+            stream.data_.erase(stream.data_.begin(), stream.data_.begin() + bytes);
+            stream.bit_ %= 8;
+        }
+
+        while(available(format) < n) {
+            if(not next_packet(format)) {
+                return std::nullopt;
+            }
+        }
+
+        decode(info, format, n, block);
+
+        for(size_t f{0}; f < format.fields_.size(); ++f) {
+            streams_[f].bit_ += n * format.fields_[f].bits_;
+        }
+
+        consumed_ += n;
+        return n;
+    }
+
+    /// @brief reads scan s block by block into a structured cloud of its grid, cells without a
+    /// valid record hold (0, 0, 0). Intensity, colors and normals become properties.
+    [[nodiscard]] bool read_scan(size_t s, StructuredPointCloud3f &pcd) {
+        if(not open_scan(s)) {
+            return false;
+        }
+
+        const auto &info{infos_[s]};
+        pcd.create(info.width_, info.height_, Point3f{0.0f, 0.0f, 0.0f});
+
+        if(info.intensity_) {
+            static_cast<void>(pcd.add_property<Prop::INTENSITY>());
+        }
+
+        if(info.rgb_) {
+            static_cast<void>(pcd.add_property<Prop::RGB>());
+        }
+
+        if(info.normals_) {
+            static_cast<void>(pcd.add_property<Prop::NORMALS>());
+        }
+
+        auto pts{pcd.points()};
+        E57Block block;
+
+        while(true) {
+            const auto n{read(block, set_.block_records_)};
+
+            if(not n) {
+                return false;
+            }
+
+            if(*n == 0) {
+                return true;
+            }
+
+            for(size_t i{0}; i < block.points_.size(); ++i) {
+                const size_t row{block.rows_[i]};
+                const size_t col{block.columns_[i]};
+
+                if(row >= info.height_ or col >= info.width_) {
+                    continue;
+                }
+
+                const size_t at{row * info.width_ + col};
+                pts[at] = block.points_[i];
+
+                if(info.intensity_) {
+                    (*pcd.property<Prop::INTENSITY>())[at] = block.intensity_[i];
+                }
+
+                if(info.rgb_) {
+                    (*pcd.property<Prop::RGB>())[at] = block.rgb_[i];
+                }
+
+                if(info.normals_) {
+                    (*pcd.property<Prop::NORMALS>())[at] = block.normals_[i];
+                }
+            }
+        }
+    }
+
+  private:
+    struct ScanFormat {
+        uint64_t section_;
+        std::vector<detail::E57Field> fields_;
+    };
+
+    struct Stream {
+        std::vector<std::byte> data_;
+        /// first unconsumed bit of data_
+        uint64_t bit_{0};
+    };
+
+    [[nodiscard]] bool open() {
+        std::array<std::byte, detail::e57_header_size> header;
+
+        if(not pages_.read(0, header) or std::memcmp(header.data(), "ASTM-E57", 8) != 0 or
+           detail::get_le<uint32_t>(header.data() + 8) != 1 or
+           detail::get_le<uint64_t>(header.data() + 40) != detail::e57_page_size) {
+            return false;
+        }
+
+        const uint64_t xml_offset{detail::get_le<uint64_t>(header.data() + 24)};
+        const uint64_t xml_length{detail::get_le<uint64_t>(header.data() + 32)};
+
+        if(xml_offset + xml_length > pages_.pages() * detail::e57_page_size) {
+            return false;
+        }
+
+        std::string xml(static_cast<size_t>(xml_length), '\0');
+
+        if(not pages_.read(detail::e57_logical(xml_offset),
+                           std::as_writable_bytes(std::span{xml}))) {
+            return false;
+        }
+
+        const auto root{detail::XmlParser{xml}.parse()};
+        const auto *data3d{root ? root->child("data3D") : nullptr};
+
+        if(not data3d) {
+            return false;
+        }
+
+        for(const auto &scan : data3d->children_) {
+            if(not add_scan(scan)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /// @brief the first of the integer child elements of node present, std::nullopt if none is
+    [[nodiscard]] static std::optional<double> number(const detail::XmlNode *node,
+                                                      std::string_view name) {
+        const auto *child{node ? node->child(name) : nullptr};
+
+        if(not child) {
+            return std::nullopt;
+        }
+
+        // elements of value 0 may be empty
+        return child->text_.find_first_not_of(" \t\r\n") == std::string::npos
+                   ? 0.0
+                   : detail::parse_number<double>(child->text_);
+    }
+
+    [[nodiscard]] bool add_scan(const detail::XmlNode &scan) {
+        using Kind = detail::E57Field::Kind;
+        using detail::E57Source;
+
+        const auto *points{scan.child("points")};
+        const auto *prototype{points ? points->child("prototype") : nullptr};
+
+        if(not prototype) {
+            return false;
+        }
+
+        const auto section{
+            detail::parse_number<uint64_t>(points->attribute("fileOffset").value_or(""))};
+        const auto records{
+            detail::parse_number<uint64_t>(points->attribute("recordCount").value_or(""))};
+
+        if(not section or not records) {
+            return false;
+        }
+
+        ScanFormat format{.section_ = detail::e57_logical(*section), .fields_ = {}};
+        std::array<bool, static_cast<size_t>(E57Source::NZ) + 1> has{};
+
+        for(const auto &node : prototype->children_) {
+            detail::E57Field f{.name_ = node.name_, .source_ = detail::e57_source(node.name_)};
+            const auto type{node.attribute("type").value_or("")};
+            const auto integer{[&](std::string_view name, int64_t fallback) {
+                const auto val{node.attribute(name)};
+                return val ? detail::parse_number<int64_t>(*val).value_or(fallback) : fallback;
+            }};
+            const auto real{[&](std::string_view name, double fallback) {
+                const auto val{node.attribute(name)};
+                return val ? detail::parse_number<double>(*val).value_or(fallback) : fallback;
+            }};
+
+            if(type == "Float") {
+                f.kind_ = Kind::FLOAT;
+                f.bits_ = node.attribute("precision").value_or("double") == "single" ? 32 : 64;
+                f.low_ = real("minimum", 0.0);
+                f.high_ = real("maximum", 1.0);
+            } else if(type == "Integer" or type == "ScaledInteger") {
+                f.kind_ = type == "Integer" ? Kind::INTEGER : Kind::SCALED_INTEGER;
+                f.minimum_ = integer("minimum", std::numeric_limits<int64_t>::min());
+                f.maximum_ = integer("maximum", std::numeric_limits<int64_t>::max());
+                f.scale_ = real("scale", 1.0);
+                f.offset_ = real("offset", 0.0);
+                f.bits_ = detail::e57_bits(f.minimum_, f.maximum_);
+                f.low_ = static_cast<double>(f.minimum_) * f.scale_ + f.offset_;
+                f.high_ = static_cast<double>(f.maximum_) * f.scale_ + f.offset_;
+            } else {
+                f.source_ = E57Source::NONE;
+            }
+
+            has[static_cast<size_t>(f.source_)] = true;
+            format.fields_.push_back(std::move(f));
+        }
+
+        // intensity and color limits of the scan override those of the fields
+        const auto limits{[&](std::string_view group, std::string_view field, E57Source source) {
+            const auto *node{scan.child(group)};
+            const auto low{number(node, std::string{field} + "Minimum")};
+            const auto high{number(node, std::string{field} + "Maximum")};
+
+            for(auto &f : format.fields_) {
+                if(f.source_ == source and low and high and *high > *low) {
+                    f.low_ = *low;
+                    f.high_ = *high;
+                }
+            }
+        }};
+        limits("intensityLimits", "intensity", E57Source::INTENSITY);
+        limits("colorLimits", "colorRed", E57Source::RED);
+        limits("colorLimits", "colorGreen", E57Source::GREEN);
+        limits("colorLimits", "colorBlue", E57Source::BLUE);
+
+        const auto all{[&](std::initializer_list<E57Source> sources) {
+            return std::ranges::all_of(
+                sources, [&](E57Source source) { return has[static_cast<size_t>(source)]; });
+        }};
+
+        if(not all({E57Source::X, E57Source::Y, E57Source::Z}) and
+           not all({E57Source::RANGE, E57Source::AZIMUTH, E57Source::ELEVATION})) {
+            return false;
+        }
+
+        E57ScanInfo info{.name_ = scan.child("name") ? scan.child("name")->text_ : std::string{},
+                         .records_ = static_cast<size_t>(*records),
+                         .width_ = static_cast<size_t>(*records),
+                         .height_ = 1,
+                         .indexed_ = all({E57Source::ROW, E57Source::COLUMN}),
+                         .intensity_ = all({E57Source::INTENSITY}),
+                         .rgb_ = all({E57Source::RED, E57Source::GREEN, E57Source::BLUE}),
+                         .normals_ = all({E57Source::NX, E57Source::NY, E57Source::NZ})};
+
+        if(info.indexed_) {
+            // the index bounds, else the largest index the fields allow
+            const auto *bounds{scan.child("indexBounds")};
+            const auto field_max{[&](E57Source source) {
+                const auto it{
+                    std::ranges::find(format.fields_, source, &detail::E57Field::source_)};
+                return static_cast<double>(it->maximum_);
+            }};
+            const double rows{number(bounds, "rowMaximum").value_or(field_max(E57Source::ROW))};
+            const double cols{
+                number(bounds, "columnMaximum").value_or(field_max(E57Source::COLUMN))};
+
+            if(rows < 0.0 or cols < 0.0 or rows >= 1 << 24 or cols >= 1 << 24) {
+                return false;
+            }
+
+            info.height_ = static_cast<size_t>(rows) + 1;
+            info.width_ = static_cast<size_t>(cols) + 1;
+        }
+
+        infos_.push_back(std::move(info));
+        formats_.push_back(std::move(format));
+        return true;
+    }
+
+    /// @brief values every used field holds
+    [[nodiscard]] size_t available(const ScanFormat &format) const noexcept {
+        size_t n{std::numeric_limits<size_t>::max()};
+
+        for(size_t f{0}; f < format.fields_.size(); ++f) {
+            const auto &field{format.fields_[f]};
+
+            if(field.source_ != detail::E57Source::NONE and field.bits_ > 0) {
+                const auto &stream{streams_[f]};
+                n = std::min(n, static_cast<size_t>((stream.data_.size() * 8 - stream.bit_) /
+                                                    field.bits_));
+            }
+        }
+
+        return n;
+    }
+
+    /// @brief appends the bytestreams of the next data packet, false at the section end or on
+    /// a corrupt packet
+    [[nodiscard]] bool next_packet(const ScanFormat &format) {
+        while(packet_ + 4 <= section_end_) {
+            std::array<std::byte, 6> header;
+
+            if(not pages_.read(packet_, std::span{header}.first(4))) {
+                return false;
+            }
+
+            const size_t length{size_t{detail::get_le<uint16_t>(header.data() + 2)} + 1};
+
+            if(packet_ + length > section_end_) {
+                return false;
+            }
+
+            const uint64_t at{packet_};
+            packet_ += length;
+
+            if(header[0] != std::byte{detail::e57_data_packet}) {
+                continue;
+            }
+
+            buffer_.resize(length);
+
+            if(not pages_.read(at, buffer_)) {
+                return false;
+            }
+
+            const size_t streams{detail::get_le<uint16_t>(buffer_.data() + 4)};
+            size_t offset{6 + 2 * streams};
+
+            if(streams != format.fields_.size() or offset > length) {
+                return false;
+            }
+
+            for(size_t f{0}; f < streams; ++f) {
+                const size_t size{detail::get_le<uint16_t>(buffer_.data() + 6 + 2 * f)};
+
+                if(offset + size > length) {
+                    return false;
+                }
+
+                if(format.fields_[f].source_ != detail::E57Source::NONE) {
+                    auto &data{streams_[f].data_};
+                    data.insert(data.end(), buffer_.begin() + static_cast<std::ptrdiff_t>(offset),
+                                buffer_.begin() + static_cast<std::ptrdiff_t>(offset + size));
+                }
+
+                offset += size;
+            }
+
+            return true;
+        }
+
+        return false;
+    }
+
+    /// @brief decodes the next n records of the streams on all threads, keeps the valid ones
+    void decode(const E57ScanInfo &info, const ScanFormat &format, size_t n, E57Block &block) {
+        using detail::E57Source;
+
+        for(auto &stream : streams_) {
+            stream.data_.resize(stream.data_.size() + 16);
+        }
+
+        std::vector<uint8_t> valid(n, 1);
+        block.points_.resize(n);
+        block.rows_.resize(n);
+        block.columns_.resize(n);
+        block.intensity_.resize(info.intensity_ ? n : 0);
+        block.rgb_.resize(info.rgb_ ? n : 0);
+        block.normals_.resize(info.normals_ ? n : 0);
+
+        const bool cartesian{has_cartesian(format)};
+        const auto to_range{[](const detail::E57Field &f, double v, double top) {
+            const double span{f.high_ - f.low_};
+            const double t{span > 0.0 ? (v - f.low_) / span : v};
+            return std::clamp(std::round(t * top), 0.0, top);
+        }};
+
+        parallel_for(
+            n,
+            [&](size_t first, size_t last) {
+                for(size_t i{first}; i < last; ++i) {
+                    std::array<double, 3> xyz{};
+                    std::array<double, 3> spherical{};
+
+                    for(size_t f{0}; f < format.fields_.size(); ++f) {
+                        const auto &field{format.fields_[f]};
+
+                        if(field.source_ == E57Source::NONE) {
+                            continue;
+                        }
+
+                        const double v{
+                            field.value(streams_[f].data_.data(), streams_[f].bit_, i)};
+
+                        switch(field.source_) {
+                        case E57Source::X:
+                        case E57Source::Y:
+                        case E57Source::Z:
+                            xyz[static_cast<size_t>(field.source_) -
+                                static_cast<size_t>(E57Source::X)] = v;
+                            break;
+                        case E57Source::RANGE:
+                        case E57Source::AZIMUTH:
+                        case E57Source::ELEVATION:
+                            spherical[static_cast<size_t>(field.source_) -
+                                      static_cast<size_t>(E57Source::RANGE)] = v;
+                            break;
+                        case E57Source::CARTESIAN_INVALID:
+                        case E57Source::SPHERICAL_INVALID:
+                            valid[i] = v == 2.0 ? 0 : valid[i];
+                            break;
+                        case E57Source::ROW:
+                            block.rows_[i] = static_cast<uint32_t>(std::max(v, 0.0));
+                            break;
+                        case E57Source::COLUMN:
+                            block.columns_[i] = static_cast<uint32_t>(std::max(v, 0.0));
+                            break;
+                        case E57Source::INTENSITY:
+                            block.intensity_[i] = static_cast<uint16_t>(to_range(
+                                field, v, double{std::numeric_limits<uint16_t>::max()}));
+                            break;
+                        case E57Source::RED:
+                        case E57Source::GREEN:
+                        case E57Source::BLUE:
+                            block.rgb_[i][static_cast<size_t>(field.source_) -
+                                          static_cast<size_t>(E57Source::RED)] =
+                                static_cast<uint8_t>(to_range(field, v, 255.0));
+                            break;
+                        case E57Source::NX:
+                        case E57Source::NY:
+                        case E57Source::NZ:
+                            block.normals_[i][static_cast<size_t>(field.source_) -
+                                              static_cast<size_t>(E57Source::NX)] =
+                                static_cast<float>(v);
+                            break;
+                        default:
+                            break;
+                        }
+                    }
+
+                    if(not cartesian) {
+                        const double r{spherical[0]};
+                        const double ce{std::cos(spherical[2])};
+                        xyz = {r * ce * std::cos(spherical[1]), r * ce * std::sin(spherical[1]),
+                               r * std::sin(spherical[2])};
+                    }
+
+                    block.points_[i] = Point3f{static_cast<float>(xyz[0]),
+                                               static_cast<float>(xyz[1]),
+                                               static_cast<float>(xyz[2])};
+
+                    if(not info.indexed_) {
+                        block.rows_[i] = 0;
+                        block.columns_[i] = static_cast<uint32_t>(consumed_ + i);
+                    }
+                }
+            },
+            set_.threads_);
+
+        for(auto &stream : streams_) {
+            stream.data_.resize(stream.data_.size() - 16);
+        }
+
+        // keep the valid records in order
+        size_t kept{0};
+
+        for(size_t i{0}; i < n; ++i) {
+            if(valid[i] == 0) {
+                continue;
+            }
+
+            block.points_[kept] = block.points_[i];
+            block.rows_[kept] = block.rows_[i];
+            block.columns_[kept] = block.columns_[i];
+
+            if(info.intensity_) {
+                block.intensity_[kept] = block.intensity_[i];
+            }
+
+            if(info.rgb_) {
+                block.rgb_[kept] = block.rgb_[i];
+            }
+
+            if(info.normals_) {
+                block.normals_[kept] = block.normals_[i];
+            }
+
+            ++kept;
+        }
+
+        block.points_.resize(kept);
+        block.rows_.resize(kept);
+        block.columns_.resize(kept);
+        block.intensity_.resize(info.intensity_ ? kept : 0);
+        block.rgb_.resize(info.rgb_ ? kept : 0);
+        block.normals_.resize(info.normals_ ? kept : 0);
+    }
+
+    [[nodiscard]] static bool has_cartesian(const ScanFormat &format) noexcept {
+        return std::ranges::any_of(format.fields_, [](const detail::E57Field &f) {
+            return f.source_ == detail::E57Source::X;
+        });
+    }
+
+    std::ifstream file_;
+    E57StreamSettings set_;
+    detail::E57PagedReader pages_;
+    bool open_{false};
+    std::vector<E57ScanInfo> infos_;
+    std::vector<ScanFormat> formats_;
+
+    std::optional<size_t> scan_;
+    size_t consumed_{0};
+    uint64_t packet_{0};
+    uint64_t section_end_{0};
+    std::vector<Stream> streams_;
+    std::vector<std::byte> buffer_;
+};
+
+} // namespace we
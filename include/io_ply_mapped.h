@@ -0,0 +1,486 @@
+#pragma once
+#include "mapped_file.h"
+#include "parallel.h"
+#include "point.h"
+#include "pointcloud.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace we {
+
+namespace detail {
+
+enum class PlyType { INT8, UINT8, INT16, UINT16, INT32, UINT32, FLOAT32, FLOAT64 };
+
+[[nodiscard]] inline std::optional<PlyType> ply_type(const std::string_view name) noexcept {
+    constexpr std::array<std::pair<std::string_view, PlyType>, 16> types{{
+        {"char", PlyType::INT8},      {"int8", PlyType::INT8},       {"uchar", PlyType::UINT8},
+        {"uint8", PlyType::UINT8},    {"short", PlyType::INT16},     {"int16", PlyType::INT16},
+        {"ushort", PlyType::UINT16},  {"uint16", PlyType::UINT16},   {"int", PlyType::INT32},
+        {"int32", PlyType::INT32},    {"uint", PlyType::UINT32},     {"uint32", PlyType::UINT32},
+        {"float", PlyType::FLOAT32},  {"float32", PlyType::FLOAT32}, {"double", PlyType::FLOAT64},
+        {"float64", PlyType::FLOAT64},
+    }};
+
+    const auto it{std::ranges::find(types, name, [](auto &&val) { return val.first; })};
+
+    if(it == types.end()) {
+        return std::nullopt;
+    }
+
+    return it->second;
+}
+
+[[nodiscard]] constexpr size_t ply_type_size(const PlyType type) noexcept {
+    switch(type) {
+    case PlyType::INT8:
+    case PlyType::UINT8:
+        return 1;
+    case PlyType::INT16:
+    case PlyType::UINT16:
+        return 2;
+    case PlyType::INT32:
+    case PlyType::UINT32:
+    case PlyType::FLOAT32:
+        return 4;
+    case PlyType::FLOAT64:
+        return 8;
+    }
+    return 0;
+}
+
+template <typename Src> [[nodiscard]] inline Src ply_load(const std::byte *ptr) noexcept {
+    Src val;
+    std::memcpy(&val, ptr, sizeof(Src));
+    return val;
+}
+
+/// @brief reads a little-endian value of the given PLY type and converts it to T
+template <typename T>
+[[nodiscard]] inline T ply_read(const std::byte *ptr, const PlyType type) noexcept {
+    switch(type) {
+    case PlyType::INT8:
+        return static_cast<T>(ply_load<int8_t>(ptr));
+    case PlyType::UINT8:
+        return static_cast<T>(ply_load<uint8_t>(ptr));
+    case PlyType::INT16:
+        return static_cast<T>(ply_load<int16_t>(ptr));
+    case PlyType::UINT16:
+        return static_cast<T>(ply_load<uint16_t>(ptr));
+    case PlyType::INT32:
+        return static_cast<T>(ply_load<int32_t>(ptr));
+    case PlyType::UINT32:
+        return static_cast<T>(ply_load<uint32_t>(ptr));
+    case PlyType::FLOAT32:
+        return static_cast<T>(ply_load<float>(ptr));
+    case PlyType::FLOAT64:
+        return static_cast<T>(ply_load<double>(ptr));
+    }
+    return T{};
+}
+
+struct PlyProperty {
+    std::string name_;
+    PlyType type_;
+    std::optional<PlyType> list_count_type_;
+    size_t offset_{0};
+};
+
+struct PlyElement {
+    std::string name_;
+    size_t count_{0};
+    std::vector<PlyProperty> properties_;
+    /// size of one item in bytes, std::nullopt if the element has list properties
+    std::optional<size_t> stride_;
+
+    [[nodiscard]] const PlyProperty *property(const std::string_view name) const noexcept {
+        const auto it{std::ranges::find(properties_, name, &PlyProperty::name_)};
+        return it == properties_.end() ? nullptr : &*it;
+    }
+};
+
+struct PlyHeader {
+    bool binary_little_endian_{false};
+    std::vector<PlyElement> elements_;
+    /// offset of the first data byte from the beginning of the file
+    size_t data_offset_{0};
+};
+
+[[nodiscard]] inline std::vector<std::string_view> split_words(const std::string_view line) {
+    std::vector<std::string_view> words;
+    size_t pos{0};
+
+    while(pos < line.size()) {
+        const size_t first{line.find_first_not_of(" \t", pos)};
+
+        if(first == std::string_view::npos) {
+            break;
+        }
+
+        const size_t last{std::min(line.find_first_of(" \t", first), line.size())};
+        words.push_back(line.substr(first, last - first));
+        pos = last;
+    }
+
+    return words;
+}
+
+[[nodiscard]] inline std::optional<PlyHeader> parse_ply_header(const std::string_view text) {
+    PlyHeader header;
+    size_t pos{0};
+    bool magic{true};
+
+    while(pos < text.size()) {
+        const size_t eol{text.find('\n', pos)};
+
+        if(eol == std::string_view::npos) {
+            return std::nullopt;
+        }
+
+        auto line{text.substr(pos, eol - pos)};
+        pos = eol + 1;
+
+        if(not line.empty() and line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+
+        const auto words{split_words(line)};
+
+        if(magic) {
+            if(words.size() != 1 or words[0] != "ply") {
+                return std::nullopt;
+            }
+            magic = false;
+            continue;
+        }
+
+        if(words.empty() or words[0] == "comment" or words[0] == "obj_info") {
+            continue;
+        }
+
+        if(words[0] == "format") {
+            if(words.size() < 2) {
+                return std::nullopt;
+            }
+            header.binary_little_endian_ = words[1] == "binary_little_endian";
+        } else if(words[0] == "element") {
+            if(words.size() != 3) {
+                return std::nullopt;
+            }
+
+            PlyElement element;
+            element.name_ = words[1];
+            const auto [ptr, ec]{std::from_chars(words[2].data(),
+                                                 words[2].data() + words[2].size(),
+                                                 element.count_)};
+
+            if(ec != std::errc{}) {
+                return std::nullopt;
+            }
+
+            header.elements_.push_back(std::move(element));
+        } else if(words[0] == "property") {
+            if(header.elements_.empty()) {
+                return std::nullopt;
+            }
+
+            PlyProperty prop;
+
+            if(words.size() == 5 and words[1] == "list") {
+                const auto count_type{ply_type(words[2])};
+                const auto type{ply_type(words[3])};
+
+                if(not count_type or not type) {
+                    return std::nullopt;
+                }
+
+                prop = {std::string{words[4]}, *type, *count_type};
+            } else if(words.size() == 3) {
+                const auto type{ply_type(words[1])};
+
+                if(not type) {
+                    return std::nullopt;
+                }
+
+                prop = {std::string{words[2]}, *type, std::nullopt};
+            } else {
+                return std::nullopt;
+            }
+
+            header.elements_.back().properties_.push_back(std::move(prop));
+        } else if(words[0] == "end_header") {
+            header.data_offset_ = pos;
+
+            for(auto &&element : header.elements_) {
+                size_t offset{0};
+
+                for(auto &&prop : element.properties_) {
+                    if(prop.list_count_type_) {
+                        offset = std::numeric_limits<size_t>::max();
+                        break;
+                    }
+
+                    prop.offset_ = offset;
+                    offset += ply_type_size(prop.type_);
+                }
+
+                if(offset != std::numeric_limits<size_t>::max()) {
+                    element.stride_ = offset;
+                }
+            }
+
+            return header;
+        } else {
+            return std::nullopt;
+        }
+    }
+
+    return std::nullopt;
+}
+
+/// @brief number of bytes taken by the element data starting at data, std::nullopt if it
+/// does not fit into size bytes
+[[nodiscard]] inline std::optional<size_t> ply_element_size(const PlyElement &element,
+                                                            const std::byte *data, size_t size) {
+    // counts come from the header, products are checked before they can wrap
+    if(element.stride_) {
+        const size_t stride{*element.stride_};
+
+        if(stride != 0 and element.count_ > size / stride) {
+            return std::nullopt;
+        }
+
+        return stride * element.count_;
+    }
+
+    size_t pos{0};
+
+    for(size_t i{0}; i < element.count_; ++i) {
+        for(auto &&prop : element.properties_) {
+            if(prop.list_count_type_) {
+                const size_t count_size{ply_type_size(*prop.list_count_type_)};
+
+                if(pos + count_size > size) {
+                    return std::nullopt;
+                }
+
+                const auto count{ply_read<size_t>(data + pos, *prop.list_count_type_)};
+                const size_t type_size{ply_type_size(prop.type_)};
+                pos += count_size;
+
+                if(count > (size - pos) / type_size) {
+                    return std::nullopt;
+                }
+
+                pos += count * type_size;
+            } else {
+                pos += ply_type_size(prop.type_);
+            }
+
+            if(pos > size) {
+                return std::nullopt;
+            }
+        }
+    }
+
+    return pos;
+}
+
+/// @brief fills dst[i] with N scalar properties of the i-th item of a fixed-size element
+template <typename T, int N>
+void ply_gather(std::span<Matrix<T, N, 1>> dst, const std::byte *data, const size_t stride,
+                const std::array<const PlyProperty *, N> &props, size_t threads) {
+    parallel_for(
+        dst.size(),
+        [&](size_t first, size_t last) {
+            for(size_t i{first}; i < last; ++i) {
+                const std::byte *item{data + i * stride};
+
+                for(int k{0}; k < N; ++k) {
+                    dst[i].d_[k] = ply_read<T>(item + props[k]->offset_, props[k]->type_);
+                }
+            }
+        },
+        threads);
+}
+
+/// @brief fills dst[i] with a scalar property of the i-th item of a fixed-size element
+template <typename T>
+void ply_gather(std::span<T> dst, const std::byte *data, const size_t stride,
+                const PlyProperty &prop, size_t threads) {
+    parallel_for(
+        dst.size(),
+        [&](size_t first, size_t last) {
+            for(size_t i{first}; i < last; ++i) {
+                dst[i] = ply_read<T>(data + i * stride + prop.offset_, prop.type_);
+            }
+        },
+        threads);
+}
+
+} // namespace detail
+
+/// @brief binary little-endian PLY file mapped into memory.
+/// If the vertex element holds only float x, y, z, packed at offsets 0, 4 and 8, and its data
+/// starts 4-byte aligned in the mapping, the points of pointcloud() alias the mapping and
+/// nothing is parsed, see zero_copy(). Otherwise, e.g. after a header of odd length, the
+/// vertices are gathered straight from the mapping in parallel. nx/ny/nz, intensity and
+/// red/green/blue are read into the NORMALS, INTENSITY and RGB properties. The mapping is
+/// copy-on-write: modifying the points never touches the file. The point cloud is only valid
+/// while this object is alive.
+/// @example
+/// if(auto ply{we::map_ply("scan.ply")}; ply) {
+///     SORFilter{...}.apply(ply->pointcloud());
+/// }
+class MappedPointCloud {
+  public:
+    MappedPointCloud() = default;
+
+    MappedPointCloud(const MappedPointCloud &) = delete;
+    MappedPointCloud &operator=(const MappedPointCloud &) = delete;
+
+    MappedPointCloud(MappedPointCloud &&) noexcept = default;
+    MappedPointCloud &operator=(MappedPointCloud &&) noexcept = default;
+
+    ~MappedPointCloud() = default;
+
+    [[nodiscard]] bool open(const std::string_view path, size_t threads = 0) {
+        pcd_ = {};
+        zero_copy_ = false;
+
+        if constexpr(std::endian::native != std::endian::little) {
+            return false;
+        }
+
+        if(not file_.open(path)) {
+            return false;
+        }
+
+        if(not map(threads)) {
+            pcd_ = {};
+            file_.close();
+            return false;
+        }
+
+        return true;
+    }
+
+    [[nodiscard]] PointCloud3f &pointcloud() noexcept { return pcd_; }
+    [[nodiscard]] const PointCloud3f &pointcloud() const noexcept { return pcd_; }
+
+    /// @brief true if the points alias the mapped file
+    [[nodiscard]] bool zero_copy() const noexcept { return zero_copy_; }
+
+  private:
+    [[nodiscard]] bool map(size_t threads) {
+        const auto header{detail::parse_ply_header(file_.view())};
+
+        if(not header or not header->binary_little_endian_) {
+            return false;
+        }
+
+        std::byte *data{file_.data() + header->data_offset_};
+        size_t remaining{file_.size() - header->data_offset_};
+        const detail::PlyElement *vertex{nullptr};
+
+        for(auto &&element : header->elements_) {
+            if(element.name_ == "vertex") {
+                vertex = &element;
+                break;
+            }
+
+            const auto bytes{detail::ply_element_size(element, data, remaining)};
+
+            if(not bytes) {
+                return false;
+            }
+
+            data += *bytes;
+            remaining -= *bytes;
+        }
+
+        if(vertex == nullptr or not vertex->stride_ or *vertex->stride_ == 0 or
+           vertex->count_ > remaining / *vertex->stride_) {
+            return false;
+        }
+
+        const std::array<const detail::PlyProperty *, 3> xyz{
+            vertex->property("x"), vertex->property("y"), vertex->property("z")};
+
+        if(std::ranges::find(xyz, nullptr) != xyz.end()) {
+            return false;
+        }
+
+        const size_t stride{*vertex->stride_};
+        const bool packed{stride == sizeof(Point3f) and
+                          std::ranges::all_of(xyz, [](auto &&p) {
+                              return p->type_ == detail::PlyType::FLOAT32;
+                          }) and
+                          xyz[0]->offset_ == 0 and xyz[1]->offset_ == 4 and xyz[2]->offset_ == 8};
+
+        // unaligned packed data falls back to the gather below
+        if(packed and reinterpret_cast<uintptr_t>(data) % alignof(Point3f) == 0) {
+            pcd_ = PointCloud3f{std::span{reinterpret_cast<Point3f *>(data), vertex->count_}};
+            zero_copy_ = true;
+        } else {
+            std::vector<Point3f> pts(vertex->count_);
+            detail::ply_gather<float, 3>(pts, data, stride, xyz, threads);
+            pcd_ = PointCloud3f{std::move(pts)};
+        }
+
+        const std::array<const detail::PlyProperty *, 3> normals{
+            vertex->property("nx"), vertex->property("ny"), vertex->property("nz")};
+
+        if(std::ranges::find(normals, nullptr) == normals.end()) {
+            std::vector<Point3f> vals(vertex->count_);
+            detail::ply_gather<float, 3>(vals, data, stride, normals, threads);
+            pcd_.add_property<Prop::NORMALS>(std::move(vals));
+        }
+
+        if(const auto intensity{vertex->property("intensity")}; intensity) {
+            std::vector<uint16_t> vals(vertex->count_);
+            detail::ply_gather<uint16_t>(vals, data, stride, *intensity, threads);
+            pcd_.add_property<Prop::INTENSITY>(std::move(vals));
+        }
+
+        const std::array<const detail::PlyProperty *, 3> rgb{
+            vertex->property("red"), vertex->property("green"), vertex->property("blue")};
+
+        if(std::ranges::find(rgb, nullptr) == rgb.end()) {
+            std::vector<Point3ub> vals(vertex->count_);
+            detail::ply_gather<uint8_t, 3>(vals, data, stride, rgb, threads);
+            pcd_.add_property<Prop::RGB>(std::move(vals));
+        }
+
+        return true;
+    }
+
+    MappedFile file_;
+    PointCloud3f pcd_;
+    bool zero_copy_{false};
+};
+
+/// @brief maps a binary little-endian PLY file, std::nullopt if it can not be mapped
+/// (e.g. ASCII or big-endian files, which load_ply() still handles)
+[[nodiscard]] inline std::optional<MappedPointCloud> map_ply(const std::string_view path,
+                                                             size_t threads = 0) {
+    MappedPointCloud res;
+
+    if(not res.open(path, threads)) {
+        return std::nullopt;
+    }
+
+    return res;
+}
+
+} // namespace we
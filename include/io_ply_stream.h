@@ -0,0 +1,332 @@
+#pragma once
+#include "point.h"
+#include "pointcloud.h"
+#include "we_assert.h"
+#include <algorithm>
+#include <bit>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+namespace we {
+
+/// @brief per-vertex properties written by PlyStreamWriter besides x, y, z
+struct PlyStreamLayout {
+    bool normals_{false};
+    bool intensity_{false};
+    bool rgb_{false};
+
+    template <typename Cloud> [[nodiscard]] static PlyStreamLayout of(const Cloud &pcd) {
+        return {.normals_ = pcd.template property<Prop::NORMALS>().has_value(),
+                .intensity_ = pcd.template property<Prop::INTENSITY>().has_value(),
+                .rgb_ = pcd.template property<Prop::RGB>().has_value()};
+    }
+
+    [[nodiscard]] size_t vertex_size() const noexcept {
+        return sizeof(Point3f) + (normals_ ? sizeof(Point3f) : 0) +
+               (intensity_ ? sizeof(uint16_t) : 0) + (rgb_ ? sizeof(Point3ub) : 0);
+    }
+};
+
+/// @brief binary little-endian PLY writer taking vertices chunk by chunk, e.g. row bands of a
+/// structured point cloud while the rest of the frame is still being processed.
+/// Vertex properties are interleaved into one of two bounded buffers; a full buffer is written
+/// to the stream by a background thread while the other one is being filled. finish() back-patches
+/// the vertex count into the header, so the stream has to be seekable.
+/// @example
+/// PlyStreamWriter writer{"frame.ply", PlyStreamLayout::of(pcd)};
+/// for(size_t row{0}; row < pcd.height(); row += 64) {
+///     writer.write_rows(pcd, row, std::min(row + 64, pcd.height()));
+/// }
+/// const bool ok{writer.finish()};
+class PlyStreamWriter {
+  public:
+    constexpr static size_t default_buffer_size{4 << 20};
+
+    PlyStreamWriter(std::ostream &out, const PlyStreamLayout &layout,
+                    size_t buffer_size = default_buffer_size)
+        : out_{&out}
+        , layout_{layout} {
+        start(buffer_size);
+    }
+
+    PlyStreamWriter(const std::string_view path, const PlyStreamLayout &layout,
+                    size_t buffer_size = default_buffer_size)
+        : file_{std::make_unique<std::ofstream>(std::string{path}, std::ios_base::binary)}
+        , out_{file_.get()}
+        , layout_{layout} {
+        start(buffer_size);
+    }
+
+    PlyStreamWriter(const PlyStreamWriter &) = delete;
+    PlyStreamWriter(PlyStreamWriter &&) = delete;
+    PlyStreamWriter &operator=(const PlyStreamWriter &) = delete;
+    PlyStreamWriter &operator=(PlyStreamWriter &&) = delete;
+
+    ~PlyStreamWriter() {
+        try {
+            static_cast<void>(finish());
+        } catch(...) {
+        }
+    }
+
+    /// @brief appends vertices, every property of the layout has to be given for each point
+    void write(std::span<const Point3f> points, std::span<const Point3f> normals = {},
+               std::span<const uint16_t> intensity = {}, std::span<const Point3ub> rgb = {}) {
+        check_layout(points.size(), normals, intensity, rgb);
+        append(points.size(), [](size_t) { return true; }, points, normals, intensity, rgb, 0);
+    }
+
+    /// @brief appends all points of pcd with the properties of the layout
+    void write(const PointCloudBase<Point3f> &pcd) {
+        write(pcd.points(), property<Prop::NORMALS>(pcd), property<Prop::INTENSITY>(pcd),
+              property<Prop::RGB>(pcd));
+    }
+
+    /// @brief appends the valid points of rows [row_first, row_last) of pcd, which has to hold
+    /// every property of the layout
+    void write_rows(const StructuredPointCloud3f &pcd, size_t row_first, size_t row_last) {
+        assert_true([&]() { return row_first <= row_last and row_last <= pcd.height(); },
+                    "wrong row range");
+
+        const auto normals{property<Prop::NORMALS>(pcd)};
+        const auto intensity{property<Prop::INTENSITY>(pcd)};
+        const auto rgb{property<Prop::RGB>(pcd)};
+        check_layout(pcd.size(), normals, intensity, rgb);
+
+        const size_t first{row_first * pcd.width()};
+        const size_t count{(row_last - row_first) * pcd.width()};
+        const auto pts{pcd.points().subspan(first, count)};
+        const auto empty_value{pcd.empty_value()};
+
+        append(count, [&](size_t i) { return pts[i] != empty_value; }, pts, normals, intensity,
+               rgb, first);
+    }
+
+    /// @brief writes the buffered vertices, stops the flush thread and back-patches the vertex
+    /// count. Called by the destructor. Returns false if any write failed or the position of
+    /// the header could not be told, the count is not patched then.
+    [[nodiscard]] bool finish() {
+        if(finished_) {
+            return not failed_;
+        }
+
+        finished_ = true;
+        submit();
+
+        {
+            std::unique_lock lock{mutex_};
+            cv_.wait(lock, [this]() { return not has_pending_; });
+        }
+
+        flusher_.request_stop();
+        flusher_.join();
+
+        // without a header position there is nowhere to seek to
+        if(not header_ok_) {
+            failed_ = true;
+            return false;
+        }
+
+        if(out_->good()) {
+            const auto end_pos{out_->tellp()};
+            out_->seekp(count_pos_);
+            *out_ << std::format("{:<20}", count_);
+            out_->seekp(end_pos);
+            out_->flush();
+        }
+
+        failed_ = failed_ or not out_->good();
+        return not failed_;
+    }
+
+    [[nodiscard]] size_t vertex_count() const noexcept { return count_; }
+
+  private:
+    template <Prop name>
+    [[nodiscard]] static std::span<const detail::prop_traits_t<name>>
+    property(const PointCloudBase<Point3f> &pcd) {
+        if(auto val{pcd.property<name>()}; val) {
+            return *val;
+        }
+        return {};
+    }
+
+    /// @brief every property of the layout has to be given for each of the n points
+    void check_layout(size_t n, std::span<const Point3f> normals,
+                      std::span<const uint16_t> intensity, std::span<const Point3ub> rgb) const {
+        assert_true(
+            [&, this]() {
+                return (not layout_.normals_ or normals.size() == n) and
+                       (not layout_.intensity_ or intensity.size() == n) and
+                       (not layout_.rgb_ or rgb.size() == n);
+            },
+            "chunk does not match the layout");
+    }
+
+    void start(size_t buffer_size) {
+        static_assert(std::endian::native == std::endian::little);
+
+        capacity_ = std::max(buffer_size, layout_.vertex_size());
+        active_ = std::make_unique_for_overwrite<std::byte[]>(capacity_);
+        pending_ = std::make_unique_for_overwrite<std::byte[]>(capacity_);
+
+        std::string header{"ply\nformat binary_little_endian 1.0\nelement vertex "};
+        const size_t count_offset{header.size()};
+        header += std::format("{:<20}\n", 0);
+        header += "property float x\nproperty float y\nproperty float z\n";
+
+        if(layout_.normals_) {
+            header += "property float nx\nproperty float ny\nproperty float nz\n";
+        }
+
+        if(layout_.intensity_) {
+            header += "property ushort intensity\n";
+        }
+
+        if(layout_.rgb_) {
+            header += "property uchar red\nproperty uchar green\nproperty uchar blue\n";
+        }
+
+        // pad the header to 16 bytes so mapped readers can alias the vertex data
+        constexpr std::string_view comment{"comment "};
+        constexpr std::string_view end{"end_header\n"};
+        const size_t unpadded{header.size() + comment.size() + 1 + end.size()};
+        header += comment;
+        header.append((16 - unpadded % 16) % 16, ' ');
+        header += '\n';
+        header += end;
+
+        const auto header_pos{out_->tellp()};
+        out_->write(header.data(), static_cast<std::streamsize>(header.size()));
+
+        header_ok_ = header_pos != std::streampos{-1};
+        failed_ = not header_ok_ or not out_->good();
+        count_pos_ = header_pos + static_cast<std::streamoff>(count_offset);
+
+        flusher_ = std::jthread{[this](std::stop_token st) { flush_loop(st); }};
+    }
+
+    template <typename Valid>
+    void append(size_t n, Valid &&valid, std::span<const Point3f> points,
+                std::span<const Point3f> normals, std::span<const uint16_t> intensity,
+                std::span<const Point3ub> rgb, size_t prop_offset) {
+        assert_true([this]() { return not finished_; }, "writer is finished");
+
+        const size_t vertex_size{layout_.vertex_size()};
+        size_t i{0};
+
+        while(i < n) {
+            const size_t free_vertices{(capacity_ - active_size_) / vertex_size};
+
+            if(free_vertices == 0) {
+                submit();
+                continue;
+            }
+
+            std::byte *dst{active_.get() + active_size_};
+            size_t written{0};
+
+            for(; i < n and written < free_vertices; ++i) {
+                if(not valid(i)) {
+                    continue;
+                }
+
+                const size_t j{prop_offset + i};
+                dst = put(dst, points[i]);
+
+                if(layout_.normals_) {
+                    dst = put(dst, normals[j]);
+                }
+
+                if(layout_.intensity_) {
+                    dst = put(dst, intensity[j]);
+                }
+
+                if(layout_.rgb_) {
+                    dst = put(dst, rgb[j]);
+                }
+
+                ++written;
+            }
+
+            active_size_ += written * vertex_size;
+            count_ += written;
+        }
+    }
+
+    template <typename T> [[nodiscard]] static std::byte *put(std::byte *dst, const T &val) {
+        std::memcpy(dst, &val, sizeof(T));
+        return dst + sizeof(T);
+    }
+
+    /// @brief hands the active buffer to the flush thread, waits while the previous one is
+    /// still being written
+    void submit() {
+        if(active_size_ == 0) {
+            return;
+        }
+
+        std::unique_lock lock{mutex_};
+        cv_.wait(lock, [this]() { return not has_pending_; });
+        std::swap(active_, pending_);
+        pending_size_ = std::exchange(active_size_, 0);
+        has_pending_ = true;
+        cv_.notify_all();
+    }
+
+    void flush_loop(std::stop_token st) {
+        std::unique_lock lock{mutex_};
+
+        while(true) {
+            cv_.wait(lock, st, [this]() { return has_pending_; });
+
+            if(not has_pending_) {
+                return;
+            }
+
+            lock.unlock();
+            out_->write(reinterpret_cast<const char *>(pending_.get()),
+                        static_cast<std::streamsize>(pending_size_));
+            const bool good{out_->good()};
+            lock.lock();
+
+            failed_ = failed_ or not good;
+            pending_size_ = 0;
+            has_pending_ = false;
+            cv_.notify_all();
+        }
+    }
+
+    std::unique_ptr<std::ofstream> file_;
+    std::ostream *out_;
+    PlyStreamLayout layout_;
+    size_t capacity_{0};
+    size_t count_{0};
+    std::streampos count_pos_{};
+    /// the header position was told, count_pos_ is valid
+    bool header_ok_{false};
+    bool finished_{false};
+    bool failed_{false};
+
+    std::unique_ptr<std::byte[]> active_;
+    std::unique_ptr<std::byte[]> pending_;
+    size_t active_size_{0};
+    size_t pending_size_{0};
+    bool has_pending_{false};
+    std::mutex mutex_;
+    std::condition_variable_any cv_;
+    std::jthread flusher_;
+};
+
+} // namespace we
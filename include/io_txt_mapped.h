@@ -0,0 +1,314 @@
+#pragma once
+#include "io_txt.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include "point.h"
+#include "pointcloud.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace we {
+
+namespace detail {
+
+enum class TxtColumn : uint8_t { X, Y, Z, I, R, G, B, NX, NY, NZ };
+
+#define TXT_FORMAT_INFO(F)                                                                         \
+    F(XYZ, X, Y, Z)                                                                                \
+    F(XYZI, X, Y, Z, I)                                                                            \
+    F(XYZIRGB, X, Y, Z, I, R, G, B)                                                                \
+    F(XYZINxNyNz, X, Y, Z, I, NX, NY, NZ)                                                          \
+    F(XYZIRGBNxNyNz, X, Y, Z, I, R, G, B, NX, NY, NZ)                                              \
+    F(XYZINxNyNzRGB, X, Y, Z, I, NX, NY, NZ, R, G, B)                                              \
+    F(XYZRGB, X, Y, Z, R, G, B)                                                                    \
+    F(XYZRGBI, X, Y, Z, R, G, B, I)                                                                \
+    F(XYZRGBINxNyNz, X, Y, Z, R, G, B, I, NX, NY, NZ)                                              \
+    F(XYZRGBNxNyNzI, X, Y, Z, R, G, B, NX, NY, NZ, I)                                              \
+    F(XYZNxNyNz, X, Y, Z, NX, NY, NZ)                                                              \
+    F(XYZNxNyNzRGBI, X, Y, Z, NX, NY, NZ, R, G, B, I)                                              \
+    F(XYZNxNyNzIRGB, X, Y, Z, NX, NY, NZ, I, R, G, B)
+
+template <TxtFileFormat format> struct txt_format_traits {};
+
+#define DECLARE_TXT_FORMAT_TRAITS_(name, ...)                                                      \
+    template <> struct txt_format_traits<TxtFileFormat::name> {                                    \
+        using enum TxtColumn;                                                                      \
+        static constexpr std::array columns{__VA_ARGS__};                                          \
+    };
+
+TXT_FORMAT_INFO(DECLARE_TXT_FORMAT_TRAITS_)
+
+template <TxtFileFormat format>
+constexpr inline auto txt_columns_v = txt_format_traits<format>::columns;
+
+template <TxtFileFormat format>
+[[nodiscard]] constexpr bool txt_has_column(const TxtColumn column) noexcept {
+    return std::ranges::find(txt_columns_v<format>, column) != txt_columns_v<format>.end();
+}
+
+/// @brief values of one line, every column is parsed as float
+struct TxtRecord {
+    Point3f point_;
+    Point3f normal_;
+    Point3f rgb_;
+    float intensity_;
+};
+
+template <TxtColumn column> [[nodiscard]] constexpr float &txt_field(TxtRecord &rec) noexcept {
+    using enum TxtColumn;
+
+    if constexpr(column == X) {
+        return rec.point_.x();
+    } else if constexpr(column == Y) {
+        return rec.point_.y();
+    } else if constexpr(column == Z) {
+        return rec.point_.z();
+    } else if constexpr(column == NX) {
+        return rec.normal_.x();
+    } else if constexpr(column == NY) {
+        return rec.normal_.y();
+    } else if constexpr(column == NZ) {
+        return rec.normal_.z();
+    } else if constexpr(column == R) {
+        return rec.rgb_.x();
+    } else if constexpr(column == G) {
+        return rec.rgb_.y();
+    } else if constexpr(column == B) {
+        return rec.rgb_.z();
+    } else {
+        return rec.intensity_;
+    }
+}
+
+[[nodiscard]] constexpr char txt_separator_char(const TxtSeparator sep) noexcept {
+    switch(sep) {
+    case TxtSeparator::COMMA:
+        return ',';
+    case TxtSeparator::SEMICOLON:
+        return ';';
+    default:
+        return ' ';
+    }
+}
+
+[[nodiscard]] inline const char *skip_blanks(const char *ptr, const char *last) noexcept {
+    while(ptr != last and (*ptr == ' ' or *ptr == '\t')) {
+        ++ptr;
+    }
+    return ptr;
+}
+
+[[nodiscard]] inline bool parse_txt_value(const char *&ptr, const char *last, const char sep,
+                                          const bool first_column, float &val) noexcept {
+    ptr = skip_blanks(ptr, last);
+
+    if(not first_column and sep != ' ') {
+        if(ptr == last or *ptr != sep) {
+            return false;
+        }
+        ptr = skip_blanks(ptr + 1, last);
+    }
+
+    // from_chars takes nan and inf, but no plus sign
+    if(ptr != last and *ptr == '+') {
+        ++ptr;
+    }
+
+    const auto [end, ec]{std::from_chars(ptr, last, val)};
+
+    if(ec != std::errc{}) {
+        return false;
+    }
+
+    ptr = end;
+    return true;
+}
+
+/// @brief v clamped to the range of T. Non-finite values, e.g. on the line of an empty pixel,
+/// give 0: std::clamp passes nan through and casting it is undefined
+template <typename T> [[nodiscard]] inline T txt_channel(const float v) noexcept {
+    constexpr auto max{static_cast<float>(std::numeric_limits<T>::max())};
+    return std::isfinite(v) ? static_cast<T>(std::clamp(v, 0.0f, max)) : T{0};
+}
+
+/// @brief parses the columns of format from [first, last), trailing columns are ignored
+template <TxtFileFormat format>
+[[nodiscard]] inline bool parse_txt_line(const char *first, const char *last, const char sep,
+                                         TxtRecord &rec) noexcept {
+    return [&]<size_t... I>(std::index_sequence<I...>) {
+        return (parse_txt_value(first, last, sep, I == 0,
+                                txt_field<txt_columns_v<format>[I]>(rec)) and
+                ...);
+    }(std::make_index_sequence<txt_columns_v<format>.size()>{});
+}
+
+/// @brief blank lines and comments starting with '#' or "//" hold no point, every other line
+/// does. Lines of empty pixels may start with nan or inf, they keep their place in the grid
+[[nodiscard]] inline bool is_txt_data_line(const char *first, const char *last) noexcept {
+    while(first != last and (*first == ' ' or *first == '\t' or *first == '\r')) {
+        ++first;
+    }
+
+    return first != last and *first != '#' and
+           not(*first == '/' and last - first > 1 and first[1] == '/');
+}
+
+/// @brief first line start at or after pos
+[[nodiscard]] inline size_t txt_line_start(const std::string_view text, const size_t pos) noexcept {
+    if(pos == 0) {
+        return 0;
+    }
+
+    const size_t eol{text.find('\n', pos - 1)};
+    return eol == std::string_view::npos ? text.size() : eol + 1;
+}
+
+/// @brief calls f(first, last) for every line of [first, last)
+template <typename F> void for_each_txt_line(const char *first, const char *last, F &&f) {
+    while(first != last) {
+        const auto eol{static_cast<const char *>(
+            std::memchr(first, '\n', static_cast<size_t>(last - first)))};
+        const char *line_end{eol == nullptr ? last : eol};
+        f(first, line_end);
+        first = eol == nullptr ? last : eol + 1;
+    }
+}
+
+template <TxtFileFormat format>
+[[nodiscard]] bool load_txt(StructuredPointCloud<Point3f> &pcd, size_t width, size_t height,
+                            Point3f empty_value, TxtSeparator sep, const std::string_view text,
+                            size_t threads) {
+    using enum TxtColumn;
+
+    const size_t n{width * height};
+    const size_t bands{band_count(text.size(), threads, 1 << 20)};
+    std::vector<size_t> offsets(bands + 1, 0);
+
+    parallel_for_bands(text.size(), bands, [&](size_t band, size_t first, size_t last) {
+        first = txt_line_start(text, first);
+        last = txt_line_start(text, last);
+        size_t count{0};
+
+        for_each_txt_line(text.data() + first, text.data() + last,
+                          [&count](const char *line, const char *line_end) {
+                              count += is_txt_data_line(line, line_end) ? 1 : 0;
+                          });
+
+        offsets[band + 1] = count;
+    });
+
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    if(offsets.back() > n) {
+        return false;
+    }
+
+    pcd.create(width, height, empty_value);
+
+    const auto pts{pcd.points()};
+    std::span<Point3f> normals;
+    std::span<uint16_t> intensity;
+    std::span<Point3ub> rgb;
+
+    if constexpr(txt_has_column<format>(NX)) {
+        normals = pcd.property(pcd.add_property<Prop::NORMALS>());
+    }
+
+    if constexpr(txt_has_column<format>(I)) {
+        intensity = pcd.property(pcd.add_property<Prop::INTENSITY>());
+    }
+
+    if constexpr(txt_has_column<format>(R)) {
+        rgb = pcd.property(pcd.add_property<Prop::RGB>());
+    }
+
+    const char sep_char{txt_separator_char(sep)};
+    std::atomic<bool> failed{false};
+
+    parallel_for_bands(text.size(), bands, [&](size_t band, size_t first, size_t last) {
+        first = txt_line_start(text, first);
+        last = txt_line_start(text, last);
+        size_t idx{offsets[band]};
+        TxtRecord rec{};
+
+        for_each_txt_line(
+            text.data() + first, text.data() + last, [&](const char *line, const char *line_end) {
+                if(not is_txt_data_line(line, line_end)) {
+                    return;
+                }
+
+                if(not parse_txt_line<format>(line, line_end, sep_char, rec)) {
+                    failed.store(true, std::memory_order_relaxed);
+                    return;
+                }
+
+                pts[idx] = rec.point_;
+
+                if constexpr(txt_has_column<format>(NX)) {
+                    normals[idx] = rec.normal_;
+                }
+
+                if constexpr(txt_has_column<format>(I)) {
+                    intensity[idx] = txt_channel<uint16_t>(rec.intensity_);
+                }
+
+                if constexpr(txt_has_column<format>(R)) {
+                    for(int k{0}; k < 3; ++k) {
+                        rgb[idx].d_[k] = txt_channel<uint8_t>(rec.rgb_.d_[k]);
+                    }
+                }
+
+                ++idx;
+            });
+    });
+
+    std::fill(pts.begin() + static_cast<std::ptrdiff_t>(offsets.back()), pts.end(), empty_value);
+    return not failed.load();
+}
+
+} // namespace detail
+
+/// @brief load_txt() on a memory-mapped file: the file is split at line boundaries across
+/// threads and parsed with std::from_chars by a parser specialized for the column order.
+/// Lines fill the grid row by row, blank lines and comments ('#' or "//") are skipped and
+/// missing trailing points are set to empty_value. Values may be nan or inf.
+/// @param threads number of threads, 0 - all hardware threads
+/// @return false if the file can not be read, a line can not be parsed or there are more than
+/// width * height points
+[[nodiscard]] inline bool load_txt_mapped(StructuredPointCloud<Point3f> &pcd, size_t width,
+                                          size_t height, Point3f empty_value,
+                                          TxtFileFormat format, TxtSeparator sep,
+                                          const std::string_view path, size_t threads = 0) {
+    MappedFile file;
+
+    if(not file.open(path)) {
+        return false;
+    }
+
+    const auto text{file.view()};
+
+#define LOAD_TXT_CASE_(name, ...)                                                                  \
+    case TxtFileFormat::name:                                                                      \
+        return detail::load_txt<TxtFileFormat::name>(pcd, width, height, empty_value, sep, text,   \
+                                                     threads);
+
+    switch(format) {
+        TXT_FORMAT_INFO(LOAD_TXT_CASE_)
+    }
+
+#undef LOAD_TXT_CASE_
+
+    return false;
+}
+
+} // namespace we
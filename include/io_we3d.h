@@ -0,0 +1,1031 @@
+#pragma once
+#include "mapped_file.h"
+#include "mesh.h"
+#include "parallel.h"
+#include "point.h"
+#include "pointcloud.h"
+#include "we_assert.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace we {
+
+struct We3dSettings {
+    /// bytes of values coded as one block, blocks are compressed and decompressed independently
+    size_t block_bytes_{1 << 20};
+    /// stores the values of a block byte plane by byte plane, which brings the alike high bytes
+    /// of coordinates together and helps the compression of floating point data
+    bool shuffle_{true};
+    /// number of threads, 0 - all hardware threads
+    size_t threads_{0};
+    /// checks the checksum of every block read
+    bool verify_checksums_{true};
+};
+
+enum class We3dKind : uint32_t { POINTCLOUD, STRUCTURED, MESH };
+
+enum class We3dRole : uint8_t { POINTS, FACES, PROPERTY };
+
+/// @brief on-disk tag of the value type T of a chunk. The tag of an arithmetic type and of a
+/// Matrix of them is built from the kind of the scalar ('u', 'i' or 'f'), its size and the
+/// rows and columns, so it does not depend on the compiler or on the name of the type.
+/// Specialize it with a tag of your own to read properties of other types
+template <typename T> struct We3dType {};
+
+namespace detail {
+
+[[nodiscard]] constexpr uint32_t we3d_tag(char kind, size_t size, int rows, int cols) noexcept {
+    return static_cast<uint32_t>(static_cast<uint8_t>(kind)) |
+           static_cast<uint32_t>(size) << 8 | static_cast<uint32_t>(rows) << 16 |
+           static_cast<uint32_t>(cols) << 24;
+}
+
+template <typename T> constexpr inline char we3d_kind{
+    std::is_floating_point_v<T> ? 'f' : (std::is_signed_v<T> ? 'i' : 'u')};
+
+} // namespace detail
+
+template <typename T>
+    requires std::is_arithmetic_v<T>
+struct We3dType<T> {
+    static constexpr uint32_t tag{detail::we3d_tag(detail::we3d_kind<T>, sizeof(T), 1, 1)};
+};
+
+template <typename T, int Rows, int Cols>
+    requires std::is_arithmetic_v<T>
+struct We3dType<Matrix<T, Rows, Cols>> {
+    static constexpr uint32_t tag{detail::we3d_tag(detail::we3d_kind<T>, sizeof(T), Rows, Cols)};
+};
+
+/// @brief a chunk of a .we3d file: the points, the faces or one property
+struct We3dChunkInfo {
+    We3dRole role_{We3dRole::PROPERTY};
+    /// property name, "points" and "faces" for the other roles
+    std::string name_;
+    /// value type, see We3dType
+    uint32_t type_tag_{0};
+    size_t value_size_{0};
+    size_t count_{0};
+    /// values per block, the last block may hold less
+    size_t block_values_{0};
+    bool shuffled_{false};
+    /// bytes of the chunk in the file
+    size_t stored_bytes_{0};
+};
+
+namespace detail {
+
+inline constexpr std::array<char, 8> we3d_magic{'W', 'E', '3', 'D', '\r', '\n', '\x1a', '\n'};
+inline constexpr uint32_t we3d_version{2};
+inline constexpr size_t we3d_header_size{64};
+inline constexpr size_t we3d_trailer_size{16};
+// bytes of a chunk table entry without its name, and of a block entry
+inline constexpr size_t we3d_chunk_entry_size{32};
+inline constexpr size_t we3d_block_entry_size{20};
+// an LZ4 block decodes to at most 255 bytes per stored byte, which bounds the values a file of
+// a given size can claim
+inline constexpr size_t we3d_max_ratio{256};
+inline constexpr size_t we3d_max_block_bytes{size_t{1} << 30};
+
+enum class We3dCodec : uint32_t { RAW, LZ4 };
+
+inline constexpr size_t lz4_min_match{4};
+// the last 5 bytes of a block are literals and the last match starts 12 bytes before its end
+inline constexpr size_t lz4_last_literals{5};
+inline constexpr size_t lz4_match_margin{12};
+inline constexpr size_t lz4_max_offset{65535};
+inline constexpr int lz4_hash_log{16};
+
+/// @brief size an LZ4 block of n bytes can take in the worst case
+[[nodiscard]] constexpr size_t lz4_bound(size_t n) noexcept { return n + n / 255 + 16; }
+
+template <typename T> [[nodiscard]] inline T we3d_load(const void *ptr) noexcept {
+    T value;
+    std::memcpy(&value, ptr, sizeof(T));
+    return value;
+}
+
+/// @brief checksum of the stored bytes of a block: four 64-bit lanes mixed by multiplication
+[[nodiscard]] inline uint32_t we3d_checksum(std::span<const std::byte> bytes) noexcept {
+    constexpr uint64_t prime{0x9e3779b97f4a7c15ull};
+    const size_t n{bytes.size()};
+    std::array<uint64_t, 4> lanes{1, 2, 3, 4};
+    size_t i{0};
+
+    for(; i + 32 <= n; i += 32) {
+        for(size_t k{0}; k < lanes.size(); ++k) {
+            lanes[k] = std::rotl((lanes[k] ^ we3d_load<uint64_t>(bytes.data() + i + 8 * k)) * prime,
+                                 31);
+        }
+    }
+
+    uint64_t hash{n};
+
+    for(const uint64_t lane : lanes) {
+        hash = (hash ^ lane) * prime;
+    }
+
+    for(; i < n; ++i) {
+        hash = (hash ^ static_cast<uint64_t>(bytes[i])) * prime;
+    }
+
+    return static_cast<uint32_t>(hash ^ hash >> 32);
+}
+
+[[nodiscard]] inline uint32_t lz4_hash(uint32_t sequence) noexcept {
+    return (sequence * 2654435761u) >> (32 - lz4_hash_log);
+}
+
+/// @brief compresses src into dst in the LZ4 block format, returns the compressed size. dst has
+/// to hold lz4_bound(src.size()) bytes, table 1 << lz4_hash_log entries. Matches are found
+/// greedily through a hash of the next 4 bytes, runs without a match are skipped faster the
+/// longer they get
+[[nodiscard]] inline size_t lz4_compress(std::span<const std::byte> src, std::byte *dst,
+                                         std::vector<uint32_t> &table) noexcept {
+    const size_t n{src.size()};
+    const auto *in{reinterpret_cast<const uint8_t *>(src.data())};
+    auto *out{reinterpret_cast<uint8_t *>(dst)};
+    size_t anchor{0};
+
+    const auto put_length{[&](size_t len) {
+        for(; len >= 255; len -= 255) {
+            *out++ = 255;
+        }
+
+        *out++ = static_cast<uint8_t>(len);
+    }};
+
+    // token and the literals [anchor, last)
+    const auto put_literals{[&](size_t last, size_t match_nibble) {
+        const size_t len{last - anchor};
+        *out++ = static_cast<uint8_t>(std::min<size_t>(len, 15) << 4 | match_nibble);
+
+        if(len >= 15) {
+            put_length(len - 15);
+        }
+
+        // an empty src may have no data, which memcpy must not get even for 0 bytes
+        if(len > 0) {
+            std::memcpy(out, in + anchor, len);
+            out += len;
+        }
+    }};
+
+    if(n > lz4_match_margin) {
+        std::fill(table.begin(), table.end(), 0);
+        const size_t match_limit{n - lz4_match_margin};
+        const size_t match_end{n - lz4_last_literals};
+        size_t misses{0};
+
+        for(size_t i{0}; i < match_limit;) {
+            const auto sequence{we3d_load<uint32_t>(in + i)};
+            uint32_t &slot{table[lz4_hash(sequence)]};
+            const size_t candidate{slot};
+            slot = static_cast<uint32_t>(i);
+
+            // candidate < i, offsets of 1 to lz4_max_offset
+            if(i - candidate - 1 >= lz4_max_offset or
+               we3d_load<uint32_t>(in + candidate) != sequence) {
+                i += 1 + (misses++ >> 6);
+                continue;
+            }
+
+            misses = 0;
+            const size_t offset{i - candidate};
+            size_t first{i};
+
+            while(first > anchor and first > offset and in[first - 1] == in[first - 1 - offset]) {
+                --first;
+            }
+
+            size_t last{i + lz4_min_match};
+
+            while(last < match_end) {
+                if(last + 8 <= match_end) {
+                    const uint64_t diff{we3d_load<uint64_t>(in + last) ^
+                                        we3d_load<uint64_t>(in + last - offset)};
+
+                    if(diff != 0) {
+                        last += static_cast<size_t>(std::countr_zero(diff)) / 8;
+                        break;
+                    }
+
+                    last += 8;
+                } else if(in[last] == in[last - offset]) {
+                    ++last;
+                } else {
+                    break;
+                }
+            }
+
+            const size_t match{last - first - lz4_min_match};
+            put_literals(first, std::min<size_t>(match, 15));
+            *out++ = static_cast<uint8_t>(offset & 0xff);
+            *out++ = static_cast<uint8_t>(offset >> 8);
+
+            if(match >= 15) {
+                put_length(match - 15);
+            }
+
+            anchor = i = last;
+            table[lz4_hash(we3d_load<uint32_t>(in + last - 2))] = static_cast<uint32_t>(last - 2);
+        }
+    }
+
+    put_literals(n, 0);
+    return static_cast<size_t>(out - reinterpret_cast<uint8_t *>(dst));
+}
+
+/// @brief decompresses the LZ4 block src into dst, false unless src is a valid block of exactly
+/// dst.size() bytes. Every length and offset is checked against src and dst
+[[nodiscard]] inline bool lz4_decompress(std::span<const std::byte> src,
+                                         std::span<std::byte> dst) noexcept {
+    const auto *ip{reinterpret_cast<const uint8_t *>(src.data())};
+    const auto *const ip_end{ip + src.size()};
+    auto *const op_begin{reinterpret_cast<uint8_t *>(dst.data())};
+    auto *op{op_begin};
+    auto *const op_end{op + dst.size()};
+
+    const auto get_length{[&](size_t &len) {
+        for(uint8_t b{255}; b == 255; len += b) {
+            if(ip == ip_end) {
+                return false;
+            }
+
+            b = *ip++;
+        }
+
+        return true;
+    }};
+
+    while(ip < ip_end) {
+        const uint8_t token{*ip++};
+        size_t literals{size_t{token} >> 4};
+
+        if(literals == 15 and not get_length(literals)) {
+            return false;
+        }
+
+        if(literals > static_cast<size_t>(ip_end - ip) or
+           literals > static_cast<size_t>(op_end - op)) {
+            return false;
+        }
+
+        if(literals > 0) {
+            std::memcpy(op, ip, literals);
+            op += literals;
+            ip += literals;
+        }
+
+        // the last sequence has no match
+        if(ip == ip_end) {
+            break;
+        }
+
+        if(ip_end - ip < 2) {
+            return false;
+        }
+
+        const size_t offset{size_t{ip[0]} | size_t{ip[1]} << 8};
+        ip += 2;
+
+        if(offset == 0 or offset > static_cast<size_t>(op - op_begin)) {
+            return false;
+        }
+
+        size_t len{size_t{token} & 15};
+
+        if(len == 15 and not get_length(len)) {
+            return false;
+        }
+
+        len += lz4_min_match;
+
+        if(len > static_cast<size_t>(op_end - op)) {
+            return false;
+        }
+
+        // overlapping matches repeat [match, op), which doubles with every copy
+        const uint8_t *match{op - offset};
+
+        while(len > 0) {
+            const size_t step{std::min(len, static_cast<size_t>(op - match))};
+            std::memcpy(op, match, step);
+            op += step;
+            len -= step;
+        }
+    }
+
+    return op == op_end;
+}
+
+/// @brief byte b of value i goes to dst[b * n + i], n values of value_size bytes
+inline void shuffle_bytes(std::span<const std::byte> src, std::span<std::byte> dst,
+                          size_t value_size) noexcept {
+    const size_t n{src.size() / value_size};
+
+    for(size_t i{0}; i < n; ++i) {
+        for(size_t b{0}; b < value_size; ++b) {
+            dst[b * n + i] = src[i * value_size + b];
+        }
+    }
+}
+
+/// @brief inverse of shuffle_bytes()
+inline void unshuffle_bytes(std::span<const std::byte> src, std::span<std::byte> dst,
+                            size_t value_size) noexcept {
+    const size_t n{src.size() / value_size};
+
+    for(size_t i{0}; i < n; ++i) {
+        for(size_t b{0}; b < value_size; ++b) {
+            dst[i * value_size + b] = src[b * n + i];
+        }
+    }
+}
+
+template <typename T> void we3d_put(std::vector<std::byte> &out, T value) {
+    const auto bytes{std::as_bytes(std::span{&value, 1})};
+    out.insert(out.end(), bytes.begin(), bytes.end());
+}
+
+inline void we3d_put(std::vector<std::byte> &out, std::string_view text) {
+    const auto bytes{std::as_bytes(std::span{text})};
+    out.insert(out.end(), bytes.begin(), bytes.end());
+}
+
+/// @brief bounds-checked reader over the bytes of the chunk table
+class We3dCursor {
+  public:
+    explicit We3dCursor(std::span<const std::byte> bytes)
+        : bytes_{bytes} {}
+
+    template <typename T> [[nodiscard]] std::optional<T> get() noexcept {
+        if(bytes_.size() - pos_ < sizeof(T)) {
+            return std::nullopt;
+        }
+
+        pos_ += sizeof(T);
+        return we3d_load<T>(bytes_.data() + pos_ - sizeof(T));
+    }
+
+    [[nodiscard]] std::optional<std::string> text(size_t n) {
+        if(bytes_.size() - pos_ < n) {
+            return std::nullopt;
+        }
+
+        pos_ += n;
+        return std::string{reinterpret_cast<const char *>(bytes_.data() + pos_ - n), n};
+    }
+
+    [[nodiscard]] bool done() const noexcept { return pos_ == bytes_.size(); }
+    [[nodiscard]] size_t remaining() const noexcept { return bytes_.size() - pos_; }
+
+  private:
+    std::span<const std::byte> bytes_;
+    size_t pos_{0};
+};
+
+struct We3dHeader {
+    We3dKind kind_{We3dKind::POINTCLOUD};
+    uint64_t points_{0};
+    uint64_t faces_{0};
+    uint64_t width_{0};
+    uint64_t height_{0};
+    Point3f empty_value_{0.0f, 0.0f, 0.0f};
+};
+
+/// @brief values of a chunk to be written
+struct We3dSource {
+    We3dRole role_;
+    std::string_view name_;
+    uint32_t type_tag_;
+    size_t value_size_;
+    std::span<const std::byte> bytes_;
+};
+
+struct We3dBlock {
+    uint64_t offset_;
+    uint32_t stored_;
+    We3dCodec codec_;
+    uint32_t checksum_;
+};
+
+/// @brief the points and the trivially copyable properties of pcd
+[[nodiscard]] inline std::vector<We3dSource> we3d_sources(const PointCloudBase<Point3f> &pcd) {
+    std::vector<We3dSource> sources{{We3dRole::POINTS, "points", We3dType<Point3f>::tag,
+                                     sizeof(Point3f), std::as_bytes(pcd.points())}};
+
+    pcd.properties().for_each([&](const BaseProperty &p) {
+        static_cast<void>(detail::visit_property(p, [&]<typename T>(const Property<T> &prop) {
+            if(prop.data().size() == pcd.size()) {
+                sources.push_back({We3dRole::PROPERTY, p.name_, We3dType<T>::tag, sizeof(T),
+                                   std::as_bytes(prop.data())});
+            }
+        }));
+    });
+
+    return sources;
+}
+
+/// @brief writes the header, the blocks of all sources and the chunk table to out. Blocks are
+/// compressed in batches on all threads and written in order, so the stream need not seek
+[[nodiscard]] inline bool write_we3d(std::ostream &out, const We3dHeader &header,
+                                     std::span<const We3dSource> sources,
+                                     const We3dSettings &set) {
+    assert_true(
+        [&]() { return set.block_bytes_ > 0 and set.block_bytes_ <= we3d_max_block_bytes; },
+        "wrong block size");
+
+    if constexpr(std::endian::native != std::endian::little) {
+        return false;
+    }
+
+    std::vector<std::byte> head;
+    head.reserve(we3d_header_size);
+    we3d_put(head, std::string_view{we3d_magic.data(), we3d_magic.size()});
+    we3d_put(head, we3d_version);
+    we3d_put(head, header.kind_);
+    we3d_put(head, header.points_);
+    we3d_put(head, header.faces_);
+    we3d_put(head, header.width_);
+    we3d_put(head, header.height_);
+
+    for(size_t c{0}; c < 3; ++c) {
+        we3d_put(head, header.empty_value_[c]);
+    }
+
+    we3d_put(head, static_cast<uint32_t>(sources.size()));
+    out.write(reinterpret_cast<const char *>(head.data()),
+              static_cast<std::streamsize>(head.size()));
+
+    // blocks of all chunks as (chunk, first byte)
+    std::vector<std::pair<size_t, size_t>> jobs;
+    std::vector<size_t> block_bytes(sources.size());
+    std::vector<std::vector<We3dBlock>> blocks(sources.size());
+
+    for(size_t s{0}; s < sources.size(); ++s) {
+        const auto &src{sources[s]};
+        assert_true(
+            [&]() {
+                return src.value_size_ > 0 and src.value_size_ <= set.block_bytes_ and
+                       src.name_.size() <= std::numeric_limits<uint16_t>::max();
+            },
+            "wrong chunk");
+
+        block_bytes[s] = set.block_bytes_ / src.value_size_ * src.value_size_;
+
+        for(size_t first{0}; first < src.bytes_.size(); first += block_bytes[s]) {
+            jobs.emplace_back(s, first);
+        }
+    }
+
+    const size_t batch{4 * thread_count(set.threads_)};
+    std::vector<std::vector<std::byte>> stored(batch);
+    std::vector<We3dCodec> codecs(batch);
+    std::vector<uint32_t> checksums(batch);
+    uint64_t offset{we3d_header_size};
+
+    for(size_t first{0}; first < jobs.size(); first += batch) {
+        const size_t count{std::min(batch, jobs.size() - first)};
+
+        parallel_for(
+            count,
+            [&](size_t job_first, size_t job_last) {
+                std::vector<uint32_t> table(size_t{1} << lz4_hash_log);
+                std::vector<std::byte> planes;
+
+                for(size_t j{job_first}; j < job_last; ++j) {
+                    const auto [s, at]{jobs[first + j]};
+                    const auto &src{sources[s]};
+                    const size_t size{std::min(block_bytes[s], src.bytes_.size() - at)};
+                    auto raw{src.bytes_.subspan(at, size)};
+
+                    if(set.shuffle_ and src.value_size_ > 1) {
+                        planes.resize(raw.size());
+                        shuffle_bytes(raw, planes, src.value_size_);
+                        raw = planes;
+                    }
+
+                    auto &block{stored[j]};
+                    block.resize(lz4_bound(raw.size()));
+                    const size_t packed{lz4_compress(raw, block.data(), table)};
+
+                    if(packed < raw.size()) {
+                        block.resize(packed);
+                        codecs[j] = We3dCodec::LZ4;
+                    } else {
+                        block.assign(raw.begin(), raw.end());
+                        codecs[j] = We3dCodec::RAW;
+                    }
+
+                    checksums[j] = we3d_checksum(block);
+                }
+            },
+            set.threads_, 1);
+
+        for(size_t j{0}; j < count; ++j) {
+            out.write(reinterpret_cast<const char *>(stored[j].data()),
+                      static_cast<std::streamsize>(stored[j].size()));
+            blocks[jobs[first + j].first].push_back(
+                {offset, static_cast<uint32_t>(stored[j].size()), codecs[j], checksums[j]});
+            offset += stored[j].size();
+        }
+
+        if(not out.good()) {
+            return false;
+        }
+    }
+
+    std::vector<std::byte> table;
+
+    for(size_t s{0}; s < sources.size(); ++s) {
+        const auto &src{sources[s]};
+        we3d_put(table, src.role_);
+        we3d_put(table, static_cast<uint8_t>(set.shuffle_ and src.value_size_ > 1 ? 1 : 0));
+        we3d_put(table, static_cast<uint16_t>(src.name_.size()));
+        we3d_put(table, src.type_tag_);
+        we3d_put(table, static_cast<uint32_t>(src.value_size_));
+        we3d_put(table, static_cast<uint32_t>(blocks[s].size()));
+        we3d_put(table, static_cast<uint64_t>(src.bytes_.size() / src.value_size_));
+        we3d_put(table, static_cast<uint64_t>(block_bytes[s] / src.value_size_));
+        we3d_put(table, src.name_);
+
+        for(const auto &b : blocks[s]) {
+            we3d_put(table, b.offset_);
+            we3d_put(table, b.stored_);
+            we3d_put(table, b.codec_);
+            we3d_put(table, b.checksum_);
+        }
+    }
+
+    we3d_put(table, offset);
+    we3d_put(table, static_cast<uint64_t>(table.size() - sizeof(uint64_t)));
+    out.write(reinterpret_cast<const char *>(table.data()),
+              static_cast<std::streamsize>(table.size()));
+    out.flush();
+    return out.good();
+}
+
+[[nodiscard]] inline bool write_we3d(const std::string_view path, const We3dHeader &header,
+                                     std::span<const We3dSource> sources,
+                                     const We3dSettings &set) {
+    std::ofstream out{std::string{path}, std::ios_base::binary};
+    return out.is_open() and write_we3d(out, header, sources, set);
+}
+
+} // namespace detail
+
+/// @brief reader of .we3d files, the native format written by save_we3d(). The file is mapped
+/// and its chunk table parsed on open; any chunk can then be read on its own, its blocks are
+/// checksummed and decompressed on all threads straight into the values. Chunks are matched to
+/// value types by their We3dType tag, so files are portable between compilers.
+/// @example
+/// We3dReader reader{"frame.we3d"};
+/// StructuredPointCloud3f pcd;
+/// if(reader.is_open() and reader.read(pcd)) {
+///     ...
+/// }
+/// const auto intensity{reader.read_property<uint16_t>("intensity")};
+class We3dReader {
+  public:
+    explicit We3dReader(const std::string_view path, const We3dSettings &set = {})
+        : set_{set} {
+        if constexpr(std::endian::native == std::endian::little) {
+            open_ = file_.open(path) and parse();
+        }
+    }
+
+    [[nodiscard]] bool is_open() const noexcept { return open_; }
+    [[nodiscard]] We3dKind kind() const noexcept { return header_.kind_; }
+    [[nodiscard]] size_t size() const noexcept { return header_.points_; }
+    [[nodiscard]] size_t n_faces() const noexcept { return header_.faces_; }
+    [[nodiscard]] size_t width() const noexcept { return header_.width_; }
+    [[nodiscard]] size_t height() const noexcept { return header_.height_; }
+    [[nodiscard]] Point3f empty_value() const noexcept { return header_.empty_value_; }
+    [[nodiscard]] std::span<const We3dChunkInfo> chunks() const noexcept { return chunks_; }
+
+    /// @brief names of the properties the last read() did not know the type of
+    [[nodiscard]] std::span<const std::string> skipped() const noexcept { return skipped_; }
+
+    /// @brief values of chunk c, std::nullopt if T is not its type or its blocks are corrupt.
+    /// The values take at most we3d_max_ratio times the bytes the chunk is stored in
+    template <typename T> [[nodiscard]] std::optional<std::vector<T>> read_chunk(size_t c) {
+        static_assert(std::is_trivially_copyable_v<T>, "values have to be trivially copyable");
+
+        if(not open_ or c >= chunks_.size() or chunks_[c].value_size_ != sizeof(T) or
+           chunks_[c].type_tag_ != We3dType<T>::tag or
+           chunks_[c].count_ > chunks_[c].stored_bytes_ * detail::we3d_max_ratio / sizeof(T)) {
+            return std::nullopt;
+        }
+
+        std::vector<T> values(chunks_[c].count_);
+
+        if(not decode(c, std::as_writable_bytes(std::span{values}))) {
+            return std::nullopt;
+        }
+
+        return values;
+    }
+
+    /// @brief values of the property name of type T, std::nullopt if there is none
+    template <typename T>
+    [[nodiscard]] std::optional<std::vector<T>> read_property(const std::string_view name) {
+        for(size_t c{0}; c < chunks_.size(); ++c) {
+            if(chunks_[c].role_ == We3dRole::PROPERTY and chunks_[c].name_ == name and
+               chunks_[c].type_tag_ == We3dType<T>::tag) {
+                return read_chunk<T>(c);
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    /// @brief the points with their properties of a file of any kind. Properties of the
+    /// arithmetic types, Point3f/d/i, Point3ub and Extra are read, others are skipped. Extra
+    /// types need a specialization of We3dType
+    template <typename... Extra> [[nodiscard]] bool read(PointCloud3f &pcd) {
+        auto points{read_role<Point3f>(We3dRole::POINTS)};
+
+        if(not points) {
+            return false;
+        }
+
+        pcd.create(std::move(*points));
+        return read_properties<Extra...>(pcd);
+    }
+
+    /// @brief as read(PointCloud3f &) for a file of a structured point cloud
+    template <typename... Extra> [[nodiscard]] bool read(StructuredPointCloud3f &pcd) {
+        if(header_.kind_ != We3dKind::STRUCTURED) {
+            return false;
+        }
+
+        auto points{read_role<Point3f>(We3dRole::POINTS)};
+
+        if(not points or points->size() != header_.width_ * header_.height_) {
+            return false;
+        }
+
+        pcd.create(std::move(*points), header_.width_, header_.height_, header_.empty_value_);
+        return read_properties<Extra...>(pcd);
+    }
+
+    /// @brief as read(PointCloud3f &) for a file of a mesh
+    template <typename... Extra> [[nodiscard]] bool read(Mesh3f &mesh) {
+        if(header_.kind_ != We3dKind::MESH) {
+            return false;
+        }
+
+        auto vertices{read_role<Point3f>(We3dRole::POINTS)};
+        auto faces{read_role<Point3i>(We3dRole::FACES)};
+
+        if(not vertices or not faces) {
+            return false;
+        }
+
+        const bool valid{std::ranges::all_of(*faces, [n{vertices->size()}](const Point3i &f) {
+            return f[0] >= 0 and f[1] >= 0 and f[2] >= 0 and static_cast<size_t>(f[0]) < n and
+                   static_cast<size_t>(f[1]) < n and static_cast<size_t>(f[2]) < n;
+        })};
+
+        if(not valid) {
+            return false;
+        }
+
+        mesh.create(std::move(*vertices), std::move(*faces));
+        return read_properties<Extra...>(mesh);
+    }
+
+  private:
+    [[nodiscard]] bool parse() {
+        const auto bytes{file_.bytes()};
+
+        if(bytes.size() < detail::we3d_header_size + detail::we3d_trailer_size or
+           not std::equal(detail::we3d_magic.begin(), detail::we3d_magic.end(),
+                          reinterpret_cast<const char *>(bytes.data()))) {
+            return false;
+        }
+
+        detail::We3dCursor head{bytes.subspan(detail::we3d_magic.size())};
+        const auto version{head.get<uint32_t>()};
+        const auto kind{head.get<uint32_t>()};
+        const auto points{head.get<uint64_t>()};
+        const auto faces{head.get<uint64_t>()};
+        const auto width{head.get<uint64_t>()};
+        const auto height{head.get<uint64_t>()};
+        const auto x{head.get<float>()};
+        const auto y{head.get<float>()};
+        const auto z{head.get<float>()};
+        const auto n_chunks{head.get<uint32_t>()};
+
+        if(version != detail::we3d_version or not n_chunks or
+           kind > static_cast<uint32_t>(We3dKind::MESH)) {
+            return false;
+        }
+
+        header_ = {static_cast<We3dKind>(*kind), *points, *faces, *width, *height, {*x, *y, *z}};
+
+        detail::We3dCursor tail{bytes.last(detail::we3d_trailer_size)};
+        const uint64_t table_offset{*tail.get<uint64_t>()};
+        const uint64_t table_size{*tail.get<uint64_t>()};
+        const size_t data_end{bytes.size() - detail::we3d_trailer_size};
+
+        if(table_offset < detail::we3d_header_size or table_offset > data_end or
+           table_size != data_end - table_offset) {
+            return false;
+        }
+
+        // counts from the file are checked against the table before anything is allocated
+        if(*n_chunks > table_size / detail::we3d_chunk_entry_size) {
+            return false;
+        }
+
+        detail::We3dCursor table{bytes.subspan(table_offset, table_size)};
+        chunks_.resize(*n_chunks);
+        blocks_.resize(*n_chunks);
+
+        for(size_t c{0}; c < chunks_.size(); ++c) {
+            if(not parse_chunk(table, table_offset, chunks_[c], blocks_[c])) {
+                return false;
+            }
+        }
+
+        return table.done();
+    }
+
+    [[nodiscard]] static bool parse_chunk(detail::We3dCursor &table, uint64_t data_end,
+                                          We3dChunkInfo &info,
+                                          std::vector<detail::We3dBlock> &blocks) {
+        const auto role{table.get<uint8_t>()};
+        const auto shuffled{table.get<uint8_t>()};
+        const auto name_size{table.get<uint16_t>()};
+        const auto type_tag{table.get<uint32_t>()};
+        const auto value_size{table.get<uint32_t>()};
+        const auto n_blocks{table.get<uint32_t>()};
+        const auto count{table.get<uint64_t>()};
+        const auto block_values{table.get<uint64_t>()};
+
+        if(not role or not shuffled or not name_size or not type_tag or not value_size or
+           not n_blocks or not count or not block_values) {
+            return false;
+        }
+
+        if(*role > static_cast<uint8_t>(We3dRole::PROPERTY) or *shuffled > 1 or
+           *value_size == 0 or *block_values == 0 or
+           *block_values > detail::we3d_max_block_bytes / *value_size or
+           *count > std::numeric_limits<uint64_t>::max() / *value_size or
+           *n_blocks != (*count + *block_values - 1) / *block_values) {
+            return false;
+        }
+
+        auto name{table.text(*name_size)};
+
+        if(not name or *n_blocks > table.remaining() / detail::we3d_block_entry_size) {
+            return false;
+        }
+
+        info = {static_cast<We3dRole>(*role), std::move(*name), *type_tag, *value_size,
+                *count, *block_values, *shuffled != 0, 0};
+        blocks.resize(*n_blocks);
+
+        for(size_t b{0}; b < blocks.size(); ++b) {
+            const auto offset{table.get<uint64_t>()};
+            const auto stored{table.get<uint32_t>()};
+            const auto codec{table.get<uint32_t>()};
+            const auto checksum{table.get<uint32_t>()};
+
+            if(not offset or not stored or not codec or not checksum) {
+                return false;
+            }
+
+            const size_t values{std::min<size_t>(*block_values, *count - b * *block_values)};
+            const size_t raw{values * *value_size};
+
+            if(*offset < detail::we3d_header_size or *offset > data_end or
+               *stored > data_end - *offset or
+               *codec > static_cast<uint32_t>(detail::We3dCodec::LZ4) or
+               (*codec == static_cast<uint32_t>(detail::We3dCodec::RAW)
+                    ? *stored != raw
+                    : *stored > raw or raw > size_t{*stored} * detail::we3d_max_ratio)) {
+                return false;
+            }
+
+            blocks[b] = {*offset, *stored, static_cast<detail::We3dCodec>(*codec), *checksum};
+            info.stored_bytes_ += *stored;
+        }
+
+        return true;
+    }
+
+    /// @brief decompresses the blocks of chunk c into out on all threads
+    [[nodiscard]] bool decode(size_t c, std::span<std::byte> out) const {
+        const auto &info{chunks_[c]};
+        const auto &blocks{blocks_[c]};
+        const size_t block_bytes{info.block_values_ * info.value_size_};
+        std::atomic<bool> valid{true};
+
+        parallel_for(
+            blocks.size(),
+            [&](size_t first, size_t last) {
+                std::vector<std::byte> planes;
+
+                for(size_t b{first}; b < last; ++b) {
+                    const size_t at{b * block_bytes};
+                    const auto raw{out.subspan(at, std::min(block_bytes, out.size() - at))};
+                    const auto stored{file_.bytes().subspan(blocks[b].offset_, blocks[b].stored_)};
+
+                    if(set_.verify_checksums_ and
+                       detail::we3d_checksum(stored) != blocks[b].checksum_) {
+                        valid = false;
+                        continue;
+                    }
+
+                    if(blocks[b].codec_ == detail::We3dCodec::RAW) {
+                        if(info.shuffled_) {
+                            detail::unshuffle_bytes(stored, raw, info.value_size_);
+                        } else {
+                            std::ranges::copy(stored, raw.begin());
+                        }
+                    } else if(not info.shuffled_) {
+                        if(not detail::lz4_decompress(stored, raw)) {
+                            valid = false;
+                        }
+                    } else {
+                        planes.resize(raw.size());
+
+                        if(detail::lz4_decompress(stored, planes)) {
+                            detail::unshuffle_bytes(planes, raw, info.value_size_);
+                        } else {
+                            valid = false;
+                        }
+                    }
+                }
+            },
+            set_.threads_, 1);
+
+        return valid;
+    }
+
+    template <typename T> [[nodiscard]] std::optional<std::vector<T>> read_role(We3dRole role) {
+        const auto it{std::ranges::find(chunks_, role, &We3dChunkInfo::role_)};
+
+        if(not open_ or it == chunks_.end()) {
+            return std::nullopt;
+        }
+
+        auto values{read_chunk<T>(static_cast<size_t>(it - chunks_.begin()))};
+        const uint64_t expected{role == We3dRole::POINTS ? header_.points_ : header_.faces_};
+        return values and values->size() == expected ? std::move(values) : std::nullopt;
+    }
+
+    template <typename... Extra> [[nodiscard]] bool read_properties(PointCloudBase<Point3f> &pcd) {
+        return read_properties_as<uint8_t, int8_t, uint16_t, int16_t, uint32_t, int32_t, uint64_t,
+                                  int64_t, float, double, Point3f, Point3d, Point3i, Point3ub,
+                                  Extra...>(pcd);
+    }
+
+    template <typename... Types>
+    [[nodiscard]] bool read_properties_as(PointCloudBase<Point3f> &pcd) {
+        skipped_.clear();
+
+        for(size_t c{0}; c < chunks_.size(); ++c) {
+            if(chunks_[c].role_ != We3dRole::PROPERTY) {
+                continue;
+            }
+
+            if(chunks_[c].count_ != pcd.size()) {
+                return false;
+            }
+
+            // true if added, false if corrupt, std::nullopt if of none of the types
+            std::optional<bool> added;
+            static_cast<void>(((added = add_property_as<Types>(c, pcd)).has_value() or ...));
+
+            if(not added) {
+                skipped_.push_back(chunks_[c].name_);
+            } else if(not *added) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    template <typename T>
+    [[nodiscard]] std::optional<bool> add_property_as(size_t c, PointCloudBase<Point3f> &pcd) {
+        if(chunks_[c].value_size_ != sizeof(T) or chunks_[c].type_tag_ != We3dType<T>::tag) {
+            return std::nullopt;
+        }
+
+        auto values{read_chunk<T>(c)};
+
+        if(not values) {
+            return false;
+        }
+
+        static_cast<void>(pcd.add_property(std::move(*values), chunks_[c].name_));
+        return true;
+    }
+
+    We3dSettings set_;
+    MappedFile file_;
+    bool open_{false};
+    detail::We3dHeader header_;
+    std::vector<We3dChunkInfo> chunks_;
+    std::vector<std::vector<detail::We3dBlock>> blocks_;
+    std::vector<std::string> skipped_;
+};
+
+/// @brief saves pcd with all its trivially copyable properties in the native .we3d format: a
+/// header, the points and every property as a chunk of independently LZ4 compressed blocks,
+/// and a table of the chunks and their checksummed blocks for random access. Blocks are byte
+/// shuffled and compressed on all threads, incompressible blocks are stored as they are.
+/// @example
+/// const bool ok{save_we3d(pcd, "frame.we3d")};
+[[nodiscard]] inline bool save_we3d(const PointCloud3f &pcd, const std::string_view path,
+                                    const We3dSettings &set = {}) {
+    return detail::write_we3d(path, {We3dKind::POINTCLOUD, pcd.size()},
+                              detail::we3d_sources(pcd), set);
+}
+
+[[nodiscard]] inline bool save_we3d(const PointCloud3f &pcd, std::ostream &out,
+                                    const We3dSettings &set = {}) {
+    return detail::write_we3d(out, {We3dKind::POINTCLOUD, pcd.size()}, detail::we3d_sources(pcd),
+                              set);
+}
+
+/// @brief as save_we3d(const PointCloud3f &) keeping the grid and the empty value
+[[nodiscard]] inline bool save_we3d(const StructuredPointCloud3f &pcd,
+                                    const std::string_view path, const We3dSettings &set = {}) {
+    return detail::write_we3d(path,
+                              {We3dKind::STRUCTURED, pcd.size(), 0, pcd.width(), pcd.height(),
+                               pcd.empty_value()},
+                              detail::we3d_sources(pcd), set);
+}
+
+[[nodiscard]] inline bool save_we3d(const StructuredPointCloud3f &pcd, std::ostream &out,
+                                    const We3dSettings &set = {}) {
+    return detail::write_we3d(out,
+                              {We3dKind::STRUCTURED, pcd.size(), 0, pcd.width(), pcd.height(),
+                               pcd.empty_value()},
+                              detail::we3d_sources(pcd), set);
+}
+
+/// @brief as save_we3d(const PointCloud3f &) with the faces as one more chunk
+[[nodiscard]] inline bool save_we3d(const Mesh3f &mesh, const std::string_view path,
+                                    const We3dSettings &set = {}) {
+    auto sources{detail::we3d_sources(mesh)};
+    sources.push_back({We3dRole::FACES, "faces", We3dType<Point3i>::tag, sizeof(Point3i),
+                       std::as_bytes(mesh.faces())});
+    return detail::write_we3d(path, {We3dKind::MESH, mesh.size(), mesh.n_faces()}, sources, set);
+}
+
+[[nodiscard]] inline bool save_we3d(const Mesh3f &mesh, std::ostream &out,
+                                    const We3dSettings &set = {}) {
+    auto sources{detail::we3d_sources(mesh)};
+    sources.push_back({We3dRole::FACES, "faces", We3dType<Point3i>::tag, sizeof(Point3i),
+                       std::as_bytes(mesh.faces())});
+    return detail::write_we3d(out, {We3dKind::MESH, mesh.size(), mesh.n_faces()}, sources, set);
+}
+
+/// @brief loads a .we3d file written by save_we3d(), see We3dReader::read()
+/// @example
+/// StructuredPointCloud3f pcd;
+/// const bool ok{load_we3d(pcd, "frame.we3d")};
+template <typename... Extra>
+[[nodiscard]] bool load_we3d(PointCloud3f &pcd, const std::string_view path,
+                             const We3dSettings &set = {}) {
+    We3dReader reader{path, set};
+    return reader.is_open() and reader.template read<Extra...>(pcd);
+}
+
+template <typename... Extra>
+[[nodiscard]] bool load_we3d(StructuredPointCloud3f &pcd, const std::string_view path,
+                             const We3dSettings &set = {}) {
+    We3dReader reader{path, set};
+    return reader.is_open() and reader.template read<Extra...>(pcd);
+}
+
+template <typename... Extra>
+[[nodiscard]] bool load_we3d(Mesh3f &mesh, const std::string_view path,
+                             const We3dSettings &set = {}) {
+    We3dReader reader{path, set};
+    return reader.is_open() and reader.template read<Extra...>(mesh);
+}
+
+} // namespace we
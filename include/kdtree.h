@@ -0,0 +1,384 @@
+#pragma once
+#include "parallel.h"
+#include "point.h"
+#include "we_assert.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace we {
+
+struct Neighbour {
+    /// index of the point in the indexed points
+    uint32_t index_;
+    float squared_distance_;
+};
+
+/// @brief neighbours of a batch of queries in one buffer, neighbours of query q are
+/// neighbours_[offsets_[q], offsets_[q + 1])
+struct Neighbourhoods {
+    std::vector<size_t> offsets_;
+    std::vector<Neighbour> neighbours_;
+
+    /// @brief number of queries
+    [[nodiscard]] size_t size() const noexcept {
+        return offsets_.empty() ? 0 : offsets_.size() - 1;
+    }
+
+    [[nodiscard]] std::span<const Neighbour> operator[](size_t q) const {
+        return std::span{neighbours_}.subspan(offsets_[q], offsets_[q + 1] - offsets_[q]);
+    }
+};
+
+struct KdTreeSettings {
+    /// maximal number of points in a leaf
+    size_t leaf_size_{16};
+    /// number of threads for building and batched queries, 0 - all hardware threads
+    size_t threads_{0};
+};
+
+/// @brief k-d tree over unstructured points for kNN and radius queries.
+/// The tree is balanced and implicit: node k splits its points at the median of their widest
+/// axis and has the children 2k + 1 and 2k + 2, so nodes hold only the split plane. Points are
+/// stored in leaf order, a leaf scan reads contiguous memory. The tree is built level by level,
+/// the nodes of a level on all threads. Points with non-finite coordinates are never returned.
+/// Points added with append() are scanned linearly until they outgrow an eighth of the tree,
+/// which then is rebuilt with them.
+/// @example
+/// const KdTree tree{pcd.points()};
+/// const auto neighbourhoods{tree.knn(pcd.points(), 8)};
+class KdTree {
+  public:
+    explicit KdTree(const KdTreeSettings &set = {})
+        : set_{set} {
+        assert_true([this]() { return set_.leaf_size_ > 0; }, "wrong leaf size");
+    }
+
+    explicit KdTree(std::span<const Point3f> points, const KdTreeSettings &set = {})
+        : KdTree{set} {
+        build(points);
+    }
+
+    /// @brief indexes points, which get the indices [0, points.size())
+    void build(std::span<const Point3f> points) {
+        assert_true([&]() { return points.size() < std::numeric_limits<uint32_t>::max(); },
+                    "too many points");
+
+        points_.clear();
+        indices_.clear();
+        pending_.assign(points.begin(), points.end());
+        size_ = points.size();
+        rebuild();
+    }
+
+    /// @brief adds points with the indices [size(), size() + points.size()), the tree is rebuilt
+    /// once the points not in the tree outgrow an eighth of it
+    void append(std::span<const Point3f> points) {
+        assert_true(
+            [&, this]() { return size_ + points.size() < std::numeric_limits<uint32_t>::max(); },
+            "too many points");
+
+        pending_.insert(pending_.end(), points.begin(), points.end());
+        size_ += points.size();
+
+        if(pending_.size() > std::max(points_.size() / 8, rebuild_threshold)) {
+            rebuild();
+        }
+    }
+
+    /// @brief moves the appended points into the tree
+    void rebuild() {
+        const size_t pending_first{size_ - pending_.size()};
+        std::vector<Entry> entries;
+        entries.reserve(points_.size() + pending_.size());
+
+        for(size_t i{0}; i < points_.size(); ++i) {
+            entries.push_back({points_[i], indices_[i]});
+        }
+
+        for(size_t i{0}; i < pending_.size(); ++i) {
+            if(const auto &p{pending_[i]};
+               std::isfinite(p.x()) and std::isfinite(p.y()) and std::isfinite(p.z())) {
+                entries.push_back({p, static_cast<uint32_t>(pending_first + i)});
+            }
+        }
+
+        pending_.clear();
+        build_tree(entries);
+    }
+
+    /// @brief number of indexed points including non-finite ones
+    [[nodiscard]] size_t size() const noexcept { return size_; }
+
+    /// @brief k nearest neighbours of q into out, nearest first
+    void knn(const Point3f &q, size_t k, std::vector<Neighbour> &out) const {
+        out.clear();
+
+        if(k == 0) {
+            return;
+        }
+
+        const auto insert{[&](const Point3f &p, uint32_t index) {
+            const float d{squared_distance(p, q)};
+
+            if(out.size() == k) {
+                if(not(d < out.back().squared_distance_)) {
+                    return;
+                }
+
+                out.pop_back();
+            }
+
+            // k is small, an insertion into the sorted neighbours beats a heap
+            auto it{out.end()};
+
+            while(it != out.begin() and std::prev(it)->squared_distance_ > d) {
+                --it;
+            }
+
+            out.insert(it, Neighbour{index, d});
+        }};
+
+        search(
+            q,
+            [&]() {
+                return out.size() == k ? out.back().squared_distance_
+                                       : std::numeric_limits<float>::max();
+            },
+            insert);
+    }
+
+    /// @brief neighbours of q not farther than radius into out, in no particular order
+    void radius(const Point3f &q, float radius, std::vector<Neighbour> &out) const {
+        out.clear();
+        const float r2{radius * radius};
+
+        search(
+            q, [r2]() { return r2; },
+            [&](const Point3f &p, uint32_t index) {
+                if(const float d{squared_distance(p, q)}; d <= r2) {
+                    out.push_back(Neighbour{index, d});
+                }
+            });
+    }
+
+    /// @brief k nearest neighbours of every query, nearest first, on all threads. A query gets
+    /// fewer than k neighbours only when fewer points are indexed
+    [[nodiscard]] Neighbourhoods knn(std::span<const Point3f> queries, size_t k) const {
+        return batch(queries, [&](const Point3f &q, std::vector<Neighbour> &out) {
+            knn(q, k, out);
+        });
+    }
+
+    /// @brief neighbours of every query not farther than radius, on all threads
+    [[nodiscard]] Neighbourhoods radius(std::span<const Point3f> queries, float radius) const {
+        return batch(queries, [&](const Point3f &q, std::vector<Neighbour> &out) {
+            this->radius(q, radius, out);
+        });
+    }
+
+  private:
+    struct Entry {
+        Point3f point_;
+        uint32_t index_;
+    };
+
+    /// the split plane of an inner node
+    struct Node {
+        float split_;
+        uint32_t axis_;
+    };
+
+    /// minimal number of appended points that triggers a rebuild
+    static constexpr size_t rebuild_threshold{4096};
+
+    [[nodiscard]] static float squared_distance(const Point3f &a, const Point3f &b) noexcept {
+        const float dx{a.x() - b.x()};
+        const float dy{a.y() - b.y()};
+        const float dz{a.z() - b.z()};
+        return dx * dx + dy * dy + dz * dz;
+    }
+
+    void build_tree(std::vector<Entry> &entries) {
+        const size_t n{entries.size()};
+        size_t depth{0};
+
+        // nodes of a level differ by at most one point, so a level is all inner nodes but the
+        // last one
+        while((n + (size_t{1} << depth) - 1) >> depth > set_.leaf_size_) {
+            ++depth;
+        }
+
+        nodes_.assign((size_t{1} << depth) - 1, Node{});
+        std::vector<std::pair<size_t, size_t>> level{{0, n}};
+
+        for(size_t d{0}; d < depth; ++d) {
+            std::vector<std::pair<size_t, size_t>> next(2 * level.size());
+
+            parallel_for(
+                level.size(),
+                [&](size_t first, size_t last) {
+                    for(size_t k{first}; k < last; ++k) {
+                        const auto [begin, end]{level[k]};
+                        const size_t mid{(begin + end) / 2};
+                        next[2 * k] = {begin, mid};
+                        next[2 * k + 1] = {mid, end};
+
+                        if(end - begin > set_.leaf_size_) {
+                            nodes_[(size_t{1} << d) - 1 + k] = split(entries, begin, mid, end);
+                        }
+                    }
+                },
+                set_.threads_, 1);
+
+            level = std::move(next);
+        }
+
+        points_.resize(n);
+        indices_.resize(n);
+
+        parallel_for(
+            n,
+            [&](size_t first, size_t last) {
+                for(size_t i{first}; i < last; ++i) {
+                    points_[i] = entries[i].point_;
+                    indices_[i] = entries[i].index_;
+                }
+            },
+            set_.threads_);
+    }
+
+    /// @brief partitions [begin, end) at mid along the widest axis of its points
+    [[nodiscard]] static Node split(std::vector<Entry> &entries, size_t begin, size_t mid,
+                                    size_t end) {
+        std::array<float, 3> low{entries[begin].point_.x(), entries[begin].point_.y(),
+                                 entries[begin].point_.z()};
+        auto high{low};
+
+        for(size_t i{begin + 1}; i < end; ++i) {
+            for(size_t c{0}; c < 3; ++c) {
+                low[c] = std::min(low[c], entries[i].point_[c]);
+                high[c] = std::max(high[c], entries[i].point_[c]);
+            }
+        }
+
+        uint32_t axis{0};
+
+        for(uint32_t c{1}; c < 3; ++c) {
+            if(high[c] - low[c] > high[axis] - low[axis]) {
+                axis = c;
+            }
+        }
+
+        const auto at{[&](size_t i) { return entries.begin() + static_cast<std::ptrdiff_t>(i); }};
+        std::nth_element(at(begin), at(mid), at(end), [axis](const Entry &a, const Entry &b) {
+            return a.point_[axis] < b.point_[axis];
+        });
+
+        return Node{entries[mid].point_[axis], axis};
+    }
+
+    /// @brief calls visit(point, index) for all points of the leaves and the appended points
+    /// whose region may hold a point closer than bound()
+    template <typename Bound, typename Visit>
+    void search(const Point3f &q, Bound &&bound, Visit &&visit) const {
+        for(size_t i{0}; i < pending_.size(); ++i) {
+            // rebuild() drops non-finite points, until then they are skipped here
+            if(const auto &p{pending_[i]};
+               std::isfinite(p.x()) and std::isfinite(p.y()) and std::isfinite(p.z())) {
+                visit(p, static_cast<uint32_t>(size_ - pending_.size() + i));
+            }
+        }
+
+        if(points_.empty()) {
+            return;
+        }
+
+        struct StackEntry {
+            size_t node_;
+            size_t first_;
+            size_t last_;
+            /// lower bound of the squared distance to the points of the node
+            float distance_;
+        };
+
+        // one far child is put aside per level
+        std::array<StackEntry, 64> stack;
+        size_t top{0};
+        stack[top++] = StackEntry{0, 0, points_.size(), 0.0f};
+
+        while(top > 0) {
+            StackEntry f{stack[--top]};
+
+            if(f.distance_ > bound()) {
+                continue;
+            }
+
+            while(f.last_ - f.first_ > set_.leaf_size_) {
+                const Node &node{nodes_[f.node_]};
+                const size_t mid{(f.first_ + f.last_) / 2};
+                const float diff{q[node.axis_] - node.split_};
+                const StackEntry left{2 * f.node_ + 1, f.first_, mid, f.distance_};
+                const StackEntry right{2 * f.node_ + 2, mid, f.last_, f.distance_};
+                const bool go_left{diff < 0.0f};
+
+                stack[top] = go_left ? right : left;
+                stack[top++].distance_ = std::max(f.distance_, diff * diff);
+                f = go_left ? left : right;
+            }
+
+            for(size_t i{f.first_}; i < f.last_; ++i) {
+                visit(points_[i], indices_[i]);
+            }
+        }
+    }
+
+    /// @brief query(q, out) for every query on all threads, gathered into one buffer
+    template <typename Query>
+    [[nodiscard]] Neighbourhoods batch(std::span<const Point3f> queries, Query &&query) const {
+        const size_t n{queries.size()};
+        const size_t bands{band_count(n, set_.threads_, 256)};
+        std::vector<std::vector<Neighbour>> found(bands);
+        Neighbourhoods result;
+        result.offsets_.assign(n + 1, 0);
+
+        parallel_for_bands(n, bands, [&](size_t band, size_t first, size_t last) {
+            std::vector<Neighbour> out;
+
+            for(size_t q{first}; q < last; ++q) {
+                query(queries[q], out);
+                found[band].insert(found[band].end(), out.begin(), out.end());
+                result.offsets_[q + 1] = out.size();
+            }
+        });
+
+        std::partial_sum(result.offsets_.begin(), result.offsets_.end(), result.offsets_.begin());
+        result.neighbours_.resize(result.offsets_.back());
+
+        parallel_for_bands(n, bands, [&](size_t band, size_t first, size_t) {
+            std::ranges::copy(found[band],
+                              result.neighbours_.begin() +
+                                  static_cast<std::ptrdiff_t>(result.offsets_[first]));
+            found[band] = {};
+        });
+
+        return result;
+    }
+
+    KdTreeSettings set_;
+    std::vector<Node> nodes_;
+    /// points of the tree in leaf order and their indices
+    std::vector<Point3f> points_;
+    std::vector<uint32_t> indices_;
+    /// appended points not in the tree yet, they have the last indices
+    std::vector<Point3f> pending_;
+    size_t size_{0};
+};
+
+} // namespace we
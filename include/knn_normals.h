@@ -0,0 +1,235 @@
+#pragma once
+#include "kdtree.h"
+#include "parallel.h"
+#include "point.h"
+#include "pointcloud.h"
+#include "we_assert.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace we {
+
+namespace detail {
+
+/// points whose eigenvectors are solved together
+inline constexpr size_t eigen_batch{64};
+
+/// covariances of a batch as structure of arrays: xx, xy, xz, yy, yz, zz
+using CovarianceBatch = std::array<std::array<double, eigen_batch>, 6>;
+/// vectors of a batch as structure of arrays: x, y, z
+using VectorBatch = std::array<std::array<double, eigen_batch>, 3>;
+
+/// @brief unit eigenvectors of the smallest eigenvalues of a batch of symmetric 3x3 matrices,
+/// zero where the matrix is zero or the eigenvector is not unique.
+/// Every step is a branchless loop across the batch the compiler vectorizes. The smallest root
+/// of the characteristic polynomial comes from Newton steps started below it, which converge
+/// monotonically, instead of the trigonometric closed form that does not vectorize.
+inline void smallest_eigenvectors(const CovarianceBatch &c, VectorBatch &out) {
+    constexpr size_t newton_steps{24};
+    std::array<double, eigen_batch> b00, b11, b22, b01, b02, b12, p, det, mu;
+
+    for(size_t l{0}; l < eigen_batch; ++l) {
+        const double scale{std::max({std::abs(c[0][l]), std::abs(c[1][l]), std::abs(c[2][l]),
+                                     std::abs(c[3][l]), std::abs(c[4][l]), std::abs(c[5][l])})};
+        const double inv_scale{scale > 0.0 ? 1.0 / scale : 0.0};
+        const double q{(c[0][l] + c[3][l] + c[5][l]) * inv_scale * (1.0 / 3.0)};
+
+        // the traceless matrix b, its characteristic polynomial is mu^3 - p mu - det
+        b00[l] = c[0][l] * inv_scale - q;
+        b11[l] = c[3][l] * inv_scale - q;
+        b22[l] = c[5][l] * inv_scale - q;
+        b01[l] = c[1][l] * inv_scale;
+        b02[l] = c[2][l] * inv_scale;
+        b12[l] = c[4][l] * inv_scale;
+        p[l] = 0.5 * (b00[l] * b00[l] + b11[l] * b11[l] + b22[l] * b22[l]) + b01[l] * b01[l] +
+               b02[l] * b02[l] + b12[l] * b12[l];
+        det[l] = b00[l] * (b11[l] * b22[l] - b12[l] * b12[l]) -
+                 b01[l] * (b01[l] * b22[l] - b12[l] * b02[l]) +
+                 b02[l] * (b01[l] * b12[l] - b11[l] * b02[l]);
+
+        // the larger of two lower bounds of the smallest eigenvalue: |mu| <= 2 sqrt(p / 3)
+        // <= 1 + p / 3 and the Gershgorin discs
+        const double gershgorin{std::min(
+            {b00[l] - std::abs(b01[l]) - std::abs(b02[l]),
+             b11[l] - std::abs(b01[l]) - std::abs(b12[l]),
+             b22[l] - std::abs(b02[l]) - std::abs(b12[l])})};
+        mu[l] = std::max(-(1.0 + p[l] * (1.0 / 3.0)), gershgorin);
+    }
+
+    for(size_t step{0}; step < newton_steps; ++step) {
+        for(size_t l{0}; l < eigen_batch; ++l) {
+            // the polynomial is concave and increasing left of the smallest root, so steps
+            // never overshoot it but for rounding, which the clamp catches
+            const double h{mu[l] * (mu[l] * mu[l] - p[l]) - det[l]};
+            const double dh{std::max(3.0 * mu[l] * mu[l] - p[l], 1e-30)};
+            mu[l] = std::min(mu[l] - std::min(h, 0.0) / dh, 0.0);
+        }
+    }
+
+    for(size_t l{0}; l < eigen_batch; ++l) {
+        // the eigenvector is orthogonal to the rows of b - mu * I, the longest cross product of
+        // two rows is the best conditioned
+        const double r00{b00[l] - mu[l]};
+        const double r11{b11[l] - mu[l]};
+        const double r22{b22[l] - mu[l]};
+        const double ax{b01[l] * b12[l] - b02[l] * r11};
+        const double ay{b02[l] * b01[l] - r00 * b12[l]};
+        const double az{r00 * r11 - b01[l] * b01[l]};
+        const double bx{b01[l] * r22 - b02[l] * b12[l]};
+        const double by{b02[l] * b02[l] - r00 * r22};
+        const double bz{r00 * b12[l] - b01[l] * b02[l]};
+        const double cx{r11 * r22 - b12[l] * b12[l]};
+        const double cy{b12[l] * b02[l] - b01[l] * r22};
+        const double cz{b01[l] * b12[l] - r11 * b02[l]};
+        const double a_len{ax * ax + ay * ay + az * az};
+        const double b_len{bx * bx + by * by + bz * bz};
+        const double c_len{cx * cx + cy * cy + cz * cz};
+        const bool use_b{b_len > a_len};
+        double x{use_b ? bx : ax};
+        double y{use_b ? by : ay};
+        double z{use_b ? bz : az};
+        double len{use_b ? b_len : a_len};
+        const bool use_c{c_len > len};
+        x = use_c ? cx : x;
+        y = use_c ? cy : y;
+        z = use_c ? cz : z;
+        len = use_c ? c_len : len;
+
+        const double inv_len{len > 1e-24 ? 1.0 / std::sqrt(len) : 0.0};
+        out[0][l] = x * inv_len;
+        out[1][l] = y * inv_len;
+        out[2][l] = z * inv_len;
+    }
+}
+
+} // namespace detail
+
+struct KnnNormalsEstimatorSettings {
+    /// number of nearest points a normal is fitted to, the point itself included
+    size_t neighbours_{16};
+    /// normals are turned to look to this point, the sensor origin by default
+    Point3f viewpoint_{0.0f, 0.0f, 0.0f};
+    /// number of threads, 0 - all hardware threads
+    size_t threads_{0};
+};
+
+/// @brief normals of an unstructured point cloud from the covariance of the k nearest
+/// neighbours of every point. Covariances are gathered per batch of points and their smallest
+/// eigenvectors solved across the batch at once. The points and their order do not change,
+/// normals go to Prop::NORMALS; points with fewer than three neighbours, a degenerate
+/// neighbourhood or a non-finite coordinate get a zero normal. Points with a non-finite
+/// coordinate are no neighbours of any point.
+/// @example
+/// KnnNormalsEstimator{KnnNormalsEstimatorSettings{.neighbours_ = 16}}.estimate(merged);
+class KnnNormalsEstimator {
+  public:
+    explicit KnnNormalsEstimator(const KnnNormalsEstimatorSettings &set)
+        : set_{set} {}
+
+    void estimate(PointCloud3f &pcd) const {
+        estimate(pcd, KdTree{pcd.points(), KdTreeSettings{.threads_ = set_.threads_}});
+    }
+
+    /// @param tree index of pcd.points()
+    void estimate(PointCloud3f &pcd, const KdTree &tree) const {
+        assert_true([&]() { return tree.size() == pcd.size(); }, "tree of another cloud");
+
+        if(not pcd.property<Prop::NORMALS>()) {
+            pcd.add_property<Prop::NORMALS>();
+        }
+
+        const auto pts{pcd.points()};
+        const auto normals{*pcd.property<Prop::NORMALS>()};
+        const auto &view{set_.viewpoint_};
+
+        parallel_for(
+            pts.size(),
+            [&](size_t first, size_t last) {
+                std::vector<Neighbour> neighbours;
+                detail::CovarianceBatch cov;
+                detail::VectorBatch eigen;
+
+                for(size_t batch{first}; batch < last; batch += detail::eigen_batch) {
+                    const size_t count{std::min(detail::eigen_batch, last - batch)};
+
+                    for(size_t l{0}; l < detail::eigen_batch; ++l) {
+                        const auto c{l < count ? covariance(pts, batch + l, tree, neighbours)
+                                               : std::array<double, 6>{}};
+
+                        for(size_t k{0}; k < c.size(); ++k) {
+                            cov[k][l] = c[k];
+                        }
+                    }
+
+                    detail::smallest_eigenvectors(cov, eigen);
+
+                    for(size_t l{0}; l < count; ++l) {
+                        const Point3f &p{pts[batch + l]};
+                        const double dot{eigen[0][l] * (view.x() - p.x()) +
+                                         eigen[1][l] * (view.y() - p.y()) +
+                                         eigen[2][l] * (view.z() - p.z())};
+                        const double sign{dot < 0.0 ? -1.0 : 1.0};
+
+                        normals[batch + l] = Point3f{static_cast<float>(sign * eigen[0][l]),
+                                                     static_cast<float>(sign * eigen[1][l]),
+                                                     static_cast<float>(sign * eigen[2][l])};
+                    }
+                }
+            },
+            set_.threads_, 16 * detail::eigen_batch);
+    }
+
+  private:
+    /// @brief covariance times the count of the neighbours of point i, zero with fewer than
+    /// three of them or a non-finite point i
+    [[nodiscard]] std::array<double, 6> covariance(std::span<const Point3f> pts, size_t i,
+                                                   const KdTree &tree,
+                                                   std::vector<Neighbour> &neighbours) const {
+        // a zero covariance has no unique eigenvector and gives a zero normal
+        if(not std::isfinite(pts[i].x()) or not std::isfinite(pts[i].y()) or
+           not std::isfinite(pts[i].z())) {
+            return {};
+        }
+
+        tree.knn(pts[i], set_.neighbours_, neighbours);
+
+        if(neighbours.size() < 3) {
+            return {};
+        }
+
+        // coordinates relative to the point itself keep the sums small
+        const Point3f &origin{pts[i]};
+        std::array<double, 3> s{};
+        std::array<double, 6> ss{};
+
+        for(const auto &nb : neighbours) {
+            const Point3f &q{pts[nb.index_]};
+            const double x{static_cast<double>(q.x()) - origin.x()};
+            const double y{static_cast<double>(q.y()) - origin.y()};
+            const double z{static_cast<double>(q.z()) - origin.z()};
+            s[0] += x;
+            s[1] += y;
+            s[2] += z;
+            ss[0] += x * x;
+            ss[1] += x * y;
+            ss[2] += x * z;
+            ss[3] += y * y;
+            ss[4] += y * z;
+            ss[5] += z * z;
+        }
+
+        const double inv_n{1.0 / static_cast<double>(neighbours.size())};
+
+        return {ss[0] - s[0] * s[0] * inv_n, ss[1] - s[0] * s[1] * inv_n,
+                ss[2] - s[0] * s[2] * inv_n, ss[3] - s[1] * s[1] * inv_n,
+                ss[4] - s[1] * s[2] * inv_n, ss[5] - s[2] * s[2] * inv_n};
+    }
+
+    KnnNormalsEstimatorSettings set_;
+};
+
+} // namespace we
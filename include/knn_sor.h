@@ -0,0 +1,123 @@
+#pragma once
+#include "kdtree.h"
+#include "parallel.h"
+#include "point.h"
+#include "pointcloud.h"
+#include "we_assert.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace we {
+
+struct KnnSORFilterSettings {
+    /// number of nearest points the mean distance of a point is taken over
+    size_t neighbours_{8};
+    float sigma_multiplier_{1.0f};
+    /// number of threads, 0 - all hardware threads
+    size_t threads_{0};
+};
+
+/// @brief Statistical Outliers Removal for unstructured point clouds. The score of a point is
+/// its mean distance to its set.neighbours_ nearest points; points with a score above
+/// mean + set.sigma_multiplier_ * standard deviation of all scores are removed, as are points
+/// without neighbours or finite coordinates. Scores and their statistics are computed in one
+/// parallel pass over bands of points, the remaining points keep their order and properties.
+/// @example
+/// KnnSORFilter{KnnSORFilterSettings{.neighbours_ = 8, .sigma_multiplier_ = 1.0f}}.apply(merged);
+class KnnSORFilter {
+  public:
+    explicit KnnSORFilter(const KnnSORFilterSettings &set)
+        : set_{set} {
+        assert_true([this]() { return set_.neighbours_ > 0; }, "wrong number of neighbours");
+    }
+
+    void apply(PointCloud3f &pcd) const {
+        apply(pcd, KdTree{pcd.points(), KdTreeSettings{.threads_ = set_.threads_}});
+    }
+
+    /// @param tree index of pcd.points()
+    void apply(PointCloud3f &pcd, const KdTree &tree) const {
+        assert_true([&]() { return tree.size() == pcd.size(); }, "tree of another cloud");
+
+        const auto pts{pcd.points()};
+        const size_t n{pts.size()};
+        const size_t bands{band_count(n, set_.threads_, 1024)};
+
+        // score of every point, negative - no neighbours
+        std::vector<float> scores(n);
+        std::vector<std::array<double, 3>> band_stats(bands);
+
+        parallel_for_bands(n, bands, [&](size_t band, size_t first, size_t last) {
+            std::vector<Neighbour> neighbours;
+            auto &stats{band_stats[band]};
+
+            for(size_t i{first}; i < last; ++i) {
+                scores[i] = -1.0f;
+
+                if(not std::isfinite(pts[i].x()) or not std::isfinite(pts[i].y()) or
+                   not std::isfinite(pts[i].z())) {
+                    continue;
+                }
+
+                // the point finds itself, one more neighbour is asked for
+                tree.knn(pts[i], set_.neighbours_ + 1, neighbours);
+
+                double sum{0.0};
+                size_t count{0};
+
+                for(const auto &nb : neighbours) {
+                    if(nb.index_ != i and count < set_.neighbours_) {
+                        sum += std::sqrt(static_cast<double>(nb.squared_distance_));
+                        ++count;
+                    }
+                }
+
+                const double score{count > 0 ? sum / static_cast<double>(count) : -1.0};
+
+                // a NaN score would poison the statistics of all points
+                if(count > 0 and std::isfinite(score)) {
+                    scores[i] = static_cast<float>(score);
+                    stats[0] += 1.0;
+                    stats[1] += score;
+                    stats[2] += score * score;
+                }
+            }
+        });
+
+        std::array<double, 3> stats{};
+
+        for(const auto &s : band_stats) {
+            for(size_t k{0}; k < s.size(); ++k) {
+                stats[k] += s[k];
+            }
+        }
+
+        const double count{std::max(stats[0], 1.0)};
+        const double mean{stats[1] / count};
+        const double sigma{std::sqrt(std::max(stats[2] / count - mean * mean, 0.0))};
+        const auto max_score{static_cast<float>(mean + set_.sigma_multiplier_ * sigma)};
+        std::vector<uint8_t> keep(n);
+
+        parallel_for(
+            n,
+            [&](size_t first, size_t last) {
+                for(size_t i{first}; i < last; ++i) {
+                    keep[i] = scores[i] >= 0.0f and scores[i] <= max_score ? 1 : 0;
+                }
+            },
+            set_.threads_);
+
+        PointCloud3f filtered;
+        filtered.assign_compacted(pcd, keep, set_.threads_);
+        pcd = std::move(filtered);
+    }
+
+  private:
+    KnnSORFilterSettings set_;
+};
+
+} // namespace we
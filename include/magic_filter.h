@@ -1,3 +1,4 @@
+#pragma once
 #include "point.h"
 #include "pointcloud.h"
 #include "welib3d_export.h"
@@ -0,0 +1,144 @@
+#pragma once
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace we {
+
+/// @brief read-only file mapped into memory copy-on-write:
+/// the contents can be modified in memory, the file itself never changes
+class MappedFile {
+  public:
+    MappedFile() = default;
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&rhs) noexcept
+        : data_{std::exchange(rhs.data_, nullptr)}
+        , size_{std::exchange(rhs.size_, 0)} {}
+
+    MappedFile &operator=(MappedFile &&rhs) noexcept {
+        if(&rhs != this) {
+            close();
+            data_ = std::exchange(rhs.data_, nullptr);
+            size_ = std::exchange(rhs.size_, 0);
+        }
+        return *this;
+    }
+
+    ~MappedFile() { close(); }
+
+    [[nodiscard]] bool open(const std::string_view path) {
+        close();
+        const std::string path_str{path};
+
+#if defined(_WIN32)
+        HANDLE file{CreateFileA(path_str.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr)};
+
+        if(file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        LARGE_INTEGER file_size{};
+
+        if(not GetFileSizeEx(file, &file_size) or file_size.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+
+        HANDLE mapping{CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr)};
+        CloseHandle(file);
+
+        if(mapping == nullptr) {
+            return false;
+        }
+
+        void *ptr{MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0)};
+        CloseHandle(mapping);
+
+        if(ptr == nullptr) {
+            return false;
+        }
+
+        size_ = static_cast<size_t>(file_size.QuadPart);
+#else
+        const int fd{::open(path_str.c_str(), O_RDONLY)};
+
+        if(fd < 0) {
+            return false;
+        }
+
+        struct stat st {};
+
+        if(::fstat(fd, &st) != 0 or st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+
+        void *ptr{::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE, fd, 0)};
+        ::close(fd);
+
+        if(ptr == MAP_FAILED) {
+            return false;
+        }
+
+        ::madvise(ptr, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+        size_ = static_cast<size_t>(st.st_size);
+#endif
+
+        data_ = static_cast<std::byte *>(ptr);
+        return true;
+    }
+
+    void close() noexcept {
+        if(data_ == nullptr) {
+            return;
+        }
+
+#if defined(_WIN32)
+        UnmapViewOfFile(data_);
+#else
+        ::munmap(data_, size_);
+#endif
+
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    [[nodiscard]] bool is_open() const noexcept { return data_ != nullptr; }
+    [[nodiscard]] size_t size() const noexcept { return size_; }
+    [[nodiscard]] std::byte *data() noexcept { return data_; }
+    [[nodiscard]] const std::byte *data() const noexcept { return data_; }
+    [[nodiscard]] std::span<std::byte> bytes() noexcept { return {data_, size_}; }
+    [[nodiscard]] std::span<const std::byte> bytes() const noexcept { return {data_, size_}; }
+
+    [[nodiscard]] std::string_view view() const noexcept {
+        return {reinterpret_cast<const char *>(data_), size_};
+    }
+
+  private:
+    std::byte *data_{nullptr};
+    size_t size_{0};
+};
+
+} // namespace we
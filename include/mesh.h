@@ -34,6 +34,12 @@ class Mesh : public PointCloudBase<VertexType> {
         faces_not_owned_ = {};
     }
 
+    /// @brief replaces the faces, the vertices and their properties are kept
+    void set_faces(vector_face_type &&faces) noexcept {
+        faces_owned_ = std::move(faces);
+        faces_not_owned_ = {};
+    }
+
     Mesh(Mesh &&) = default;
     Mesh(const Mesh &) noexcept = default;
 
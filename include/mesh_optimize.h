@@ -0,0 +1,340 @@
+#pragma once
+#include "mesh.h"
+#include "parallel.h"
+#include "point.h"
+#include "voxel_grid.h"
+#include "we_assert.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+namespace we {
+
+struct MeshOptimizeSettings {
+    /// vertices within this distance of an earlier vertex are welded into it, 0 - vertices of
+    /// equal positions only
+    float weld_distance_{0.0f};
+    /// size of the vertex cache the faces are ordered for
+    size_t cache_size_{16};
+    /// number of threads, 0 - all hardware threads
+    size_t threads_{0};
+};
+
+namespace detail {
+
+inline constexpr uint32_t no_vertex{std::numeric_limits<uint32_t>::max()};
+
+/// @brief the vertex every vertex is welded into, itself when it is kept. Kept vertices are
+/// hashed by their cell of size distance, a vertex is welded into the first kept vertex within
+/// distance in its own and the 26 cells around; distance 0 welds equal positions only
+[[nodiscard]] inline std::vector<uint32_t> weld_vertices(std::span<const Point3f> pts,
+                                                         float distance) {
+    const size_t n{pts.size()};
+    std::vector<uint32_t> weld_of(n);
+    std::vector<uint32_t> next(n, no_vertex);
+    std::unordered_map<uint64_t, uint32_t> first;
+    first.reserve(n);
+
+    const float inv{distance > 0.0f ? 1.0f / distance : 0.0f};
+    const float squared{distance * distance};
+    const auto cell{[&](const Point3f &p) {
+        return std::array<int64_t, 3>{static_cast<int64_t>(std::floor(p.x() * inv)),
+                                      static_cast<int64_t>(std::floor(p.y() * inv)),
+                                      static_cast<int64_t>(std::floor(p.z() * inv))};
+    }};
+    // cells far apart may share a key, the distance test sorts them out
+    const auto cell_key{[](const std::array<int64_t, 3> &c) {
+        return morton_key(static_cast<uint32_t>(c[0]), static_cast<uint32_t>(c[1]),
+                          static_cast<uint32_t>(c[2]));
+    }};
+    // + 0.0f turns -0 into 0
+    const auto position_key{[](const Point3f &p) {
+        return uint64_t{std::bit_cast<uint32_t>(p.x() + 0.0f)} * 0x9e3779b97f4a7c15 ^
+               uint64_t{std::bit_cast<uint32_t>(p.y() + 0.0f)} * 0xc2b2ae3d27d4eb4f ^
+               uint64_t{std::bit_cast<uint32_t>(p.z() + 0.0f)};
+    }};
+
+    // the earliest kept vertex of a key within distance of p
+    const auto find{[&](uint64_t key, const Point3f &p) {
+        const auto it{first.find(key)};
+        uint32_t found{no_vertex};
+
+        for(uint32_t j{it == first.end() ? no_vertex : it->second}; j != no_vertex; j = next[j]) {
+            if(distance > 0.0f ? (pts[j] - p).squared_norm() <= squared : pts[j] == p) {
+                found = j;
+            }
+        }
+
+        return found;
+    }};
+
+    for(size_t i{0}; i < n; ++i) {
+        const Point3f &p{pts[i]};
+        const auto index{static_cast<uint32_t>(i)};
+        weld_of[i] = index;
+
+        if(not std::isfinite(p.x()) or not std::isfinite(p.y()) or not std::isfinite(p.z())) {
+            continue;
+        }
+
+        uint64_t own_key{0};
+        uint32_t found{no_vertex};
+
+        if(distance > 0.0f) {
+            const auto c{cell(p)};
+            own_key = cell_key(c);
+
+            for(int64_t dx{-1}; dx <= 1; ++dx) {
+                for(int64_t dy{-1}; dy <= 1; ++dy) {
+                    for(int64_t dz{-1}; dz <= 1; ++dz) {
+                        const uint32_t j{find(cell_key({c[0] + dx, c[1] + dy, c[2] + dz}), p)};
+                        found = std::min(found, j);
+                    }
+                }
+            }
+        } else {
+            own_key = position_key(p);
+            found = find(own_key, p);
+        }
+
+        if(found != no_vertex) {
+            weld_of[i] = found;
+            continue;
+        }
+
+        // kept vertices are prepended, the lists run from the latest to the earliest
+        const auto [it, inserted]{first.try_emplace(own_key, index)};
+
+        if(not inserted) {
+            next[i] = it->second;
+            it->second = index;
+        }
+    }
+
+    return weld_of;
+}
+
+/// @brief the order of n_vertices vertices that are given in a spatially coherent order, the
+/// faces are ordered for a vertex cache of cache_size (P. Sander, D. Nehab, J. Barczak,
+/// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", Tipsify). Faces are
+/// emitted as fans around a vertex, the next one is the vertex still in the cache with faces
+/// left, else the latest vertex with faces left, else the next vertex in input order
+[[nodiscard]] inline std::vector<uint32_t> tipsify(std::span<const Point3i> faces,
+                                                   size_t n_vertices, size_t cache_size) {
+    std::vector<uint32_t> offsets(n_vertices + 1, 0);
+
+    for(const auto &f : faces) {
+        for(size_t k{0}; k < 3; ++k) {
+            ++offsets[static_cast<size_t>(f[k]) + 1];
+        }
+    }
+
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    std::vector<uint32_t> adjacency(offsets.back());
+    std::vector<uint32_t> live(n_vertices);
+
+    for(size_t v{0}; v < n_vertices; ++v) {
+        live[v] = offsets[v + 1] - offsets[v];
+    }
+
+    {
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+
+        for(size_t t{0}; t < faces.size(); ++t) {
+            for(size_t k{0}; k < 3; ++k) {
+                adjacency[fill[static_cast<size_t>(faces[t][k])]++] = static_cast<uint32_t>(t);
+            }
+        }
+    }
+
+    const auto k{static_cast<int64_t>(cache_size)};
+    std::vector<int64_t> cache_time(n_vertices, 0);
+    int64_t time{k + 1};
+    std::vector<uint8_t> emitted(faces.size(), 0);
+    std::vector<uint32_t> dead_end;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> order;
+    order.reserve(faces.size());
+    size_t cursor{1};
+    uint32_t fan{n_vertices > 0 ? 0 : no_vertex};
+
+    while(fan != no_vertex) {
+        candidates.clear();
+
+        for(uint32_t a{offsets[fan]}; a < offsets[fan + 1]; ++a) {
+            const uint32_t t{adjacency[a]};
+
+            if(emitted[t] != 0) {
+                continue;
+            }
+
+            order.push_back(t);
+            emitted[t] = 1;
+
+            for(size_t c{0}; c < 3; ++c) {
+                const auto v{static_cast<uint32_t>(faces[t][c])};
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+
+                if(time - cache_time[v] > k) {
+                    cache_time[v] = time++;
+                }
+            }
+        }
+
+        // the candidate that stays in the cache longest after its remaining faces
+        fan = no_vertex;
+        int64_t best{-1};
+
+        for(const uint32_t v : candidates) {
+            if(live[v] > 0) {
+                const int64_t age{time - cache_time[v]};
+                const int64_t priority{age + 2 * static_cast<int64_t>(live[v]) <= k ? age : 0};
+
+                if(priority > best) {
+                    best = priority;
+                    fan = v;
+                }
+            }
+        }
+
+        while(fan == no_vertex and not dead_end.empty()) {
+            const uint32_t v{dead_end.back()};
+            dead_end.pop_back();
+            fan = live[v] > 0 ? v : no_vertex;
+        }
+
+        for(; fan == no_vertex and cursor < n_vertices; ++cursor) {
+            fan = live[cursor] > 0 ? static_cast<uint32_t>(cursor) : no_vertex;
+        }
+    }
+
+    return order;
+}
+
+} // namespace detail
+
+/// @brief welds, compacts and reorders a mesh for size and locality. Vertices within
+/// set.weld_distance_ of an earlier vertex are welded into it through a spatial hash, faces
+/// collapsing by the weld and vertices used by no face are dropped. The faces are then ordered
+/// for a vertex cache of set.cache_size_ by Tipsify, seeded by the Morton order of the
+/// vertices, and the vertices are ordered by their first use in the faces. Kept vertices keep
+/// all their properties, the orientation of the faces is kept. The Morton sort and the final
+/// vertex gather run on all threads, welding and Tipsify on one.
+/// @example
+/// const auto compact{optimize_mesh(mesh, MeshOptimizeSettings{.weld_distance_ = 0.01f})};
+[[nodiscard]] inline Mesh3f optimize_mesh(const Mesh3f &mesh, const MeshOptimizeSettings &set) {
+    const auto pts{mesh.points()};
+    const size_t n{pts.size()};
+
+    assert_true([&]() { return n < size_t{std::numeric_limits<int32_t>::max()}; },
+                "too many vertices");
+    assert_true([&]() { return set.cache_size_ > 0; }, "empty vertex cache");
+
+    const auto weld_of{detail::weld_vertices(pts, set.weld_distance_)};
+
+    Mesh3f::vector_face_type faces;
+    faces.reserve(mesh.n_faces());
+    std::vector<uint8_t> used(n, 0);
+
+    for(const auto &f : mesh.faces()) {
+        const Point3i w{static_cast<int>(weld_of[static_cast<size_t>(f[0])]),
+                        static_cast<int>(weld_of[static_cast<size_t>(f[1])]),
+                        static_cast<int>(weld_of[static_cast<size_t>(f[2])])};
+
+        if(w[0] != w[1] and w[1] != w[2] and w[2] != w[0]) {
+            faces.push_back(w);
+
+            for(size_t k{0}; k < 3; ++k) {
+                used[static_cast<size_t>(w[k])] = 1;
+            }
+        }
+    }
+
+    // used vertices in Morton order of a grid over their bounding box
+    std::array<float, 3> low{std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+                             std::numeric_limits<float>::max()};
+    std::array<float, 3> high{std::numeric_limits<float>::lowest(),
+                              std::numeric_limits<float>::lowest(),
+                              std::numeric_limits<float>::lowest()};
+    size_t n_used{0};
+
+    for(size_t v{0}; v < n; ++v) {
+        if(used[v] != 0) {
+            ++n_used;
+
+            for(size_t c{0}; c < 3; ++c) {
+                low[c] = std::min(low[c], pts[v][c]);
+                high[c] = std::max(high[c], pts[v][c]);
+            }
+        }
+    }
+
+    const float extent{std::max({high[0] - low[0], high[1] - low[1], high[2] - low[2]})};
+    const double scale{extent > 0.0f ? double{(1u << detail::morton_bits) - 1} / extent : 0.0};
+    std::vector<detail::VoxelEntry> entries;
+    entries.reserve(n_used);
+
+    for(size_t v{0}; v < n; ++v) {
+        if(used[v] != 0) {
+            const auto q{[&](size_t c) {
+                return static_cast<uint32_t>(static_cast<double>(pts[v][c] - low[c]) * scale);
+            }};
+            entries.push_back(
+                detail::VoxelEntry{detail::morton_key(q(0), q(1), q(2)), static_cast<uint32_t>(v)});
+        }
+    }
+
+    parallel_sort(entries.begin(), entries.end(), std::less<>{}, set.threads_);
+
+    std::vector<int> morton_of(n, 0);
+
+    for(size_t i{0}; i < entries.size(); ++i) {
+        morton_of[entries[i].index_] = static_cast<int>(i);
+    }
+
+    for(auto &f : faces) {
+        for(size_t k{0}; k < 3; ++k) {
+            f[k] = morton_of[static_cast<size_t>(f[k])];
+        }
+    }
+
+    const auto face_order{detail::tipsify(faces, n_used, set.cache_size_)};
+
+    // vertices in order of their first use
+    std::vector<uint32_t> vertex_order;
+    vertex_order.reserve(n_used);
+    std::vector<int> final_of(n_used, -1);
+    Mesh3f::vector_face_type ordered(faces.size());
+
+    for(size_t i{0}; i < face_order.size(); ++i) {
+        const auto &f{faces[face_order[i]]};
+
+        for(size_t k{0}; k < 3; ++k) {
+            auto &v{final_of[static_cast<size_t>(f[k])]};
+
+            if(v < 0) {
+                v = static_cast<int>(vertex_order.size());
+                vertex_order.push_back(entries[static_cast<size_t>(f[k])].index_);
+            }
+
+            ordered[i][k] = v;
+        }
+    }
+
+    Mesh3f out;
+    out.assign_gathered(mesh, vertex_order, set.threads_);
+    out.set_faces(std::move(ordered));
+    return out;
+}
+
+} // namespace we
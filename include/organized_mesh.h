@@ -0,0 +1,222 @@
+#pragma once
+#include "mesh.h"
+#include "parallel.h"
+#include "point.h"
+#include "pointcloud.h"
+#include "we_assert.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <vector>
+
+namespace we {
+
+struct OrganizedMeshSettings {
+    /// faces with a longer edge are dropped, std::nullopt - no limit
+    std::optional<float> max_edge_length_;
+    /// faces with an edge whose depth difference exceeds this fraction of the smaller depth
+    /// of its ends are dropped, std::nullopt - no limit
+    std::optional<float> max_depth_jump_;
+    /// number of threads, 0 - all hardware threads
+    size_t threads_{0};
+};
+
+namespace detail {
+
+/// triangles of a 2x2 cell with the corners a b on top and c d below, all counter-clockwise
+/// seen from the sensor: acb, bcd split along bc, acd, adb split along ad
+inline constexpr uint8_t cell_acb{1};
+inline constexpr uint8_t cell_bcd{2};
+inline constexpr uint8_t cell_acd{4};
+inline constexpr uint8_t cell_adb{8};
+
+} // namespace detail
+
+/// @brief triangulates a structured point cloud along its pixel grid in linear time. Every 2x2
+/// cell of valid points gives two triangles split along its shorter diagonal, a cell with three
+/// valid points gives one. Faces failing set.max_edge_length_ or set.max_depth_jump_ are
+/// dropped. The mesh has the points used by a face as vertices in pixel order, with all their
+/// properties; faces face the sensor. Cells are triangulated on row bands in parallel, a second
+/// pass compacts the vertices and a third one writes the faces.
+/// @example
+/// const auto mesh{create_organized_mesh(
+///     pcd, OrganizedMeshSettings{.max_edge_length_ = 5.0f, .max_depth_jump_ = 0.02f})};
+[[nodiscard]] inline Mesh3f create_organized_mesh(const StructuredPointCloud3f &pcd,
+                                                  const OrganizedMeshSettings &set) {
+    const auto pts{pcd.points()};
+    const auto empty{pcd.empty_value()};
+    const size_t width{pcd.width()};
+    const size_t height{pcd.height()};
+
+    assert_true([&]() { return pts.size() < size_t{std::numeric_limits<int>::max()}; },
+                "too many points");
+
+    Mesh3f mesh;
+
+    if(width < 2 or height < 2) {
+        return mesh;
+    }
+
+    const float max_edge{set.max_edge_length_ ? *set.max_edge_length_ * *set.max_edge_length_
+                                              : std::numeric_limits<float>::max()};
+    const auto edge_ok{[&](const Point3f &p, const Point3f &q) {
+        const float dx{p.x() - q.x()};
+        const float dy{p.y() - q.y()};
+        const float dz{p.z() - q.z()};
+
+        const float depth{std::min(std::abs(p.z()), std::abs(q.z()))};
+
+        return dx * dx + dy * dy + dz * dz <= max_edge and
+               (not set.max_depth_jump_ or std::abs(dz) <= *set.max_depth_jump_ * depth);
+    }};
+    const auto face_ok{[&](const Point3f &p, const Point3f &q, const Point3f &r) {
+        return edge_ok(p, q) and edge_ok(q, r) and edge_ok(r, p);
+    }};
+
+    // triangles of every cell and their count per band of cell rows
+    const size_t cells_height{height - 1};
+    const size_t bands{band_count(cells_height, set.threads_, 16)};
+    std::vector<uint8_t> cells((height - 1) * (width - 1));
+    std::vector<size_t> face_offsets(bands + 1, 0);
+
+    parallel_for_bands(cells_height, bands, [&](size_t band, size_t first, size_t last) {
+        size_t faces{0};
+
+        for(size_t i{first}; i < last; ++i) {
+            const Point3f *top{pts.data() + i * width};
+            const Point3f *bottom{top + width};
+
+            for(size_t j{0}; j + 1 < width; ++j) {
+                const Point3f &a{top[j]};
+                const Point3f &b{top[j + 1]};
+                const Point3f &c{bottom[j]};
+                const Point3f &d{bottom[j + 1]};
+                const bool va{a != empty};
+                const bool vb{b != empty};
+                const bool vc{c != empty};
+                const bool vd{d != empty};
+                uint8_t code{0};
+
+                if(va and vb and vc and vd) {
+                    if((b - c).squared_norm() <= (a - d).squared_norm()) {
+                        code = (face_ok(a, c, b) ? detail::cell_acb : 0) |
+                               (face_ok(b, c, d) ? detail::cell_bcd : 0);
+                    } else {
+                        code = (face_ok(a, c, d) ? detail::cell_acd : 0) |
+                               (face_ok(a, d, b) ? detail::cell_adb : 0);
+                    }
+                } else if(va and vb and vc) {
+                    code = face_ok(a, c, b) ? detail::cell_acb : 0;
+                } else if(vb and vc and vd) {
+                    code = face_ok(b, c, d) ? detail::cell_bcd : 0;
+                } else if(va and vc and vd) {
+                    code = face_ok(a, c, d) ? detail::cell_acd : 0;
+                } else if(va and vb and vd) {
+                    code = face_ok(a, d, b) ? detail::cell_adb : 0;
+                }
+
+                cells[i * (width - 1) + j] = code;
+                faces += static_cast<size_t>(std::popcount(code));
+            }
+        }
+
+        face_offsets[band + 1] = faces;
+    });
+
+    std::partial_sum(face_offsets.begin(), face_offsets.end(), face_offsets.begin());
+
+    // a point is a vertex when a face of one of its up to four cells uses it
+    constexpr uint8_t uses_a{detail::cell_acb | detail::cell_acd | detail::cell_adb};
+    constexpr uint8_t uses_b{detail::cell_acb | detail::cell_bcd | detail::cell_adb};
+    constexpr uint8_t uses_c{detail::cell_acb | detail::cell_bcd | detail::cell_acd};
+    constexpr uint8_t uses_d{detail::cell_bcd | detail::cell_acd | detail::cell_adb};
+    const size_t row_bands{band_count(height, set.threads_, 16)};
+    std::vector<uint8_t> used(pts.size());
+    std::vector<size_t> vertex_offsets(row_bands + 1, 0);
+
+    const auto cell{[&](size_t ci, size_t cj) { return cells[ci * (width - 1) + cj]; }};
+
+    parallel_for_bands(height, row_bands, [&](size_t band, size_t first, size_t last) {
+        size_t vertices{0};
+
+        for(size_t i{first}; i < last; ++i) {
+            for(size_t j{0}; j < width; ++j) {
+                const bool up{i > 0};
+                const bool down{i + 1 < height};
+                const bool left{j > 0};
+                const bool right{j + 1 < width};
+                const bool use{(up and left and (cell(i - 1, j - 1) & uses_d) != 0) or
+                               (up and right and (cell(i - 1, j) & uses_c) != 0) or
+                               (down and left and (cell(i, j - 1) & uses_b) != 0) or
+                               (down and right and (cell(i, j) & uses_a) != 0)};
+
+                used[i * width + j] = use ? 1 : 0;
+                vertices += use ? 1 : 0;
+            }
+        }
+
+        vertex_offsets[band + 1] = vertices;
+    });
+
+    std::partial_sum(vertex_offsets.begin(), vertex_offsets.end(), vertex_offsets.begin());
+
+    // vertex index of every used point
+    std::vector<int> vertex_of(pts.size());
+
+    parallel_for_bands(height, row_bands, [&](size_t band, size_t first, size_t last) {
+        auto vertex{static_cast<int>(vertex_offsets[band])};
+
+        for(size_t i{first * width}; i < last * width; ++i) {
+            vertex_of[i] = vertex;
+            vertex += used[i];
+        }
+    });
+
+    mesh.assign_compacted(pcd, used, set.threads_);
+
+    Mesh3f::vector_face_type faces(face_offsets.back());
+
+    parallel_for_bands(cells_height, bands, [&](size_t band, size_t first, size_t last) {
+        Point3i *out{faces.data() + face_offsets[band]};
+
+        for(size_t i{first}; i < last; ++i) {
+            for(size_t j{0}; j + 1 < width; ++j) {
+                const uint8_t code{cells[i * (width - 1) + j]};
+
+                if(code == 0) {
+                    continue;
+                }
+
+                const int a{vertex_of[i * width + j]};
+                const int b{vertex_of[i * width + j + 1]};
+                const int c{vertex_of[(i + 1) * width + j]};
+                const int d{vertex_of[(i + 1) * width + j + 1]};
+
+                if((code & detail::cell_acb) != 0) {
+                    *out++ = Point3i{a, c, b};
+                }
+
+                if((code & detail::cell_bcd) != 0) {
+                    *out++ = Point3i{b, c, d};
+                }
+
+                if((code & detail::cell_acd) != 0) {
+                    *out++ = Point3i{a, c, d};
+                }
+
+                if((code & detail::cell_adb) != 0) {
+                    *out++ = Point3i{a, d, b};
+                }
+            }
+        }
+    });
+
+    mesh.set_faces(std::move(faces));
+    return mesh;
+}
+
+} // namespace we
@@ -0,0 +1,122 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace we {
+
+/// @brief minimal number of elements handled by one thread
+constexpr inline size_t default_grain{1 << 15};
+
+/// @brief number of worker threads, 0 means all hardware threads
+[[nodiscard]] inline size_t thread_count(size_t threads = 0) noexcept {
+    if(threads != 0) {
+        return threads;
+    }
+
+    return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+/// @brief number of bands [0, n) is split into so that every band gets at least grain elements
+[[nodiscard]] inline size_t band_count(size_t n, size_t threads = 0,
+                                       size_t grain = default_grain) noexcept {
+    return std::clamp<size_t>(n / std::max<size_t>(grain, 1), 1, thread_count(threads));
+}
+
+/// @brief [first, last) of the band-th of bands contiguous ranges covering [0, n)
+[[nodiscard]] constexpr std::pair<size_t, size_t> band_range(size_t n, size_t bands,
+                                                             size_t band) noexcept {
+    const size_t step{n / bands};
+    const size_t rest{n % bands};
+    const size_t first{band * step + std::min(band, rest)};
+    return {first, first + step + (band < rest ? 1 : 0)};
+}
+
+/// @brief calls f(band, first, last) for each of bands contiguous ranges covering [0, n),
+/// every band on its own thread. The calling thread runs band 0. The first exception
+/// thrown by f is rethrown on the calling thread once all bands are done.
+template <typename F> void parallel_for_bands(size_t n, size_t bands, F &&f) {
+    bands = std::max<size_t>(bands, 1);
+
+    if(bands == 1) {
+        f(size_t{0}, size_t{0}, n);
+        return;
+    }
+
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto run{[&](size_t band) {
+        try {
+            const auto [first, last]{band_range(n, bands, band)};
+            f(band, first, last);
+        } catch(...) {
+            std::scoped_lock lock{error_mutex};
+            if(not error) {
+                error = std::current_exception();
+            }
+        }
+    }};
+
+    {
+        std::vector<std::jthread> workers;
+        workers.reserve(bands - 1);
+
+        for(size_t band{1}; band < bands; ++band) {
+            workers.emplace_back(run, band);
+        }
+
+        run(0);
+    }
+
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+
+/// @brief calls f(first, last) on contiguous ranges covering [0, n) using up to threads
+/// threads (0 - all hardware threads), each range holding at least grain elements
+template <typename F>
+void parallel_for(size_t n, F &&f, size_t threads = 0, size_t grain = default_grain) {
+    parallel_for_bands(n, band_count(n, threads, grain),
+                       [&f](size_t, size_t first, size_t last) { f(first, last); });
+}
+
+/// @brief sorts [first, last) by comp: every band is sorted on its own thread, then
+/// neighbouring bands are merged pairwise, the merges of a round in parallel
+template <typename It, typename Compare = std::less<>>
+void parallel_sort(It first, It last, Compare comp = {}, size_t threads = 0,
+                   size_t grain = default_grain) {
+    const auto n{static_cast<size_t>(last - first)};
+    const size_t bands{band_count(n, threads, grain)};
+    const auto at{[&](size_t i) { return first + static_cast<std::ptrdiff_t>(i); }};
+
+    parallel_for_bands(n, bands, [&](size_t, size_t band_first, size_t band_last) {
+        std::sort(at(band_first), at(band_last), comp);
+    });
+
+    for(size_t width{1}; width < bands; width *= 2) {
+        const size_t merges{(bands + 2 * width - 1) / (2 * width)};
+
+        parallel_for_bands(merges, merges, [&](size_t, size_t m_first, size_t m_last) {
+            for(size_t m{m_first}; m < m_last; ++m) {
+                const size_t left{2 * width * m};
+                const size_t right{left + width};
+
+                if(right < bands) {
+                    const size_t end{std::min(right + width, bands) - 1};
+                    std::inplace_merge(at(band_range(n, bands, left).first),
+                                       at(band_range(n, bands, right).first),
+                                       at(band_range(n, bands, end).second), comp);
+                }
+            }
+        });
+    }
+}
+
+} // namespace we
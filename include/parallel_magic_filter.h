@@ -0,0 +1,302 @@
+#pragma once
+#include "magic_filter.h"
+#include "parallel.h"
+#include "point.h"
+#include "pointcloud.h"
+#include "we_assert.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace we {
+
+namespace detail {
+
+/// @brief union-find forest over cell indices where every link points to a smaller index, so
+/// concurrent unions can not form cycles and need no locks
+class UnionFind {
+  public:
+    explicit UnionFind(size_t n)
+        : parent_(n) {
+        for(size_t i{0}; i < n; ++i) {
+            parent_[i] = static_cast<uint32_t>(i);
+        }
+    }
+
+    /// @brief root of x with path compression, only while no other thread touches the forest
+    [[nodiscard]] uint32_t find(uint32_t x) noexcept {
+        while(parent_[x] != x) {
+            // path halving
+            parent_[x] = parent_[parent_[x]];
+            x = parent_[x];
+        }
+
+        return x;
+    }
+
+    /// @brief root of x without path compression, safe to call concurrently once no thread
+    /// unites anymore
+    [[nodiscard]] uint32_t root(uint32_t x) const noexcept {
+        while(parent_[x] != x) {
+            x = parent_[x];
+        }
+
+        return x;
+    }
+
+    /// @brief joins the sets of a and b, only while no other thread unites
+    void unite(uint32_t a, uint32_t b) noexcept {
+        a = find(a);
+        b = find(b);
+
+        if(a != b) {
+            parent_[std::max(a, b)] = std::min(a, b);
+        }
+    }
+
+    /// @brief joins the sets of a and b, may run concurrently with other concurrent_unite()
+    void concurrent_unite(uint32_t a, uint32_t b) noexcept {
+        while(true) {
+            a = concurrent_find(a);
+            b = concurrent_find(b);
+
+            if(a == b) {
+                return;
+            }
+
+            if(a < b) {
+                std::swap(a, b);
+            }
+
+            // a is linked only while it is still a root, otherwise retry from its new root
+            uint32_t expected{a};
+
+            if(std::atomic_ref{parent_[a]}.compare_exchange_strong(expected, b)) {
+                return;
+            }
+        }
+    }
+
+  private:
+    [[nodiscard]] uint32_t concurrent_find(uint32_t x) noexcept {
+        while(true) {
+            const uint32_t p{std::atomic_ref{parent_[x]}.load(std::memory_order_acquire)};
+
+            if(p == x) {
+                return x;
+            }
+
+            x = p;
+        }
+    }
+
+    std::vector<uint32_t> parent_;
+};
+
+} // namespace detail
+
+struct ParallelMagicFilterSettings {
+    MagicFilterSetting magic_;
+    /// number of threads, 0 - all hardware threads
+    size_t threads_{0};
+};
+
+/// @brief MagicFilter on set.threads_ threads. Every point goes into one of
+/// set.magic_.num_bins_ Z slices between the lowest and the highest point, 4-connected cells of
+/// the grid reduced by set.magic_.reduce_ that fall into the same slice form a component and
+/// points of components with fewer than set.magic_.min_area_ points are removed. All slices are
+/// labeled in a single pass: row bands are labeled on their own threads and then merged along
+/// the band borders with a lock-free union-find, so the run time depends on the cores and not
+/// on the number of slices.
+/// A reduced cell takes the slice of the mean Z of its points. Points with a nan or inf
+/// coordinate count as empty for the cells; they are kept or removed with their cell, a cell
+/// holding only such points has no area and is removed.
+/// @example
+/// ParallelMagicFilter{ParallelMagicFilterSettings{
+///                         .magic_ = MagicFilterSetting{}.set_width(2448).set_height(2048),
+///                         .threads_ = 8}}
+///     .apply(pcd);
+class ParallelMagicFilter {
+  public:
+    explicit ParallelMagicFilter(const ParallelMagicFilterSettings &set)
+        : set_{set.magic_}, threads_{set.threads_} {
+        assert_true([this]() { return set_.num_bins_ > 0 and set_.reduce_ > 0; },
+                    "wrong magic filter settings");
+    }
+
+    void apply(StructuredPointCloud<Point3f> &pcd) const {
+        assert_true(
+            [&, this]() {
+                return pcd.width() == static_cast<size_t>(set_.width_) and
+                       pcd.height() == static_cast<size_t>(set_.height_);
+            },
+            "wrong image size");
+
+        const auto pts{pcd.points()};
+        const auto empty{pcd.empty_value()};
+        const size_t width{pcd.width()};
+        const size_t height{pcd.height()};
+        const auto reduce{static_cast<size_t>(set_.reduce_)};
+        const size_t cells_width{(width + reduce - 1) / reduce};
+        const size_t cells_height{(height + reduce - 1) / reduce};
+        const size_t cells{cells_width * cells_height};
+
+        if(cells == 0) {
+            return;
+        }
+
+        assert_true([&]() { return cells < std::numeric_limits<uint32_t>::max(); },
+                    "too many cells");
+
+        const auto [z_min, z_max]{z_range(pcd)};
+        const double bin_scale{z_max > z_min ? set_.num_bins_ / (z_max - z_min) : 0.0};
+
+        // slice of every cell, -1 - no points, and its number of points
+        std::vector<int> bins(cells);
+        std::vector<uint32_t> areas(cells);
+        const size_t bands{band_count(cells_height, threads_, 16)};
+
+        parallel_for_bands(cells_height, bands, [&](size_t, size_t first, size_t last) {
+            std::vector<double> z_sums(cells_width);
+
+            for(size_t ci{first}; ci < last; ++ci) {
+                std::ranges::fill(z_sums, 0.0);
+                uint32_t *area{areas.data() + ci * cells_width};
+
+                for(size_t i{ci * reduce}; i < std::min((ci + 1) * reduce, height); ++i) {
+                    for(size_t j{0}; j < width; ++j) {
+                        if(const auto &p{pts[i * width + j]}; valid(p, empty)) {
+                            z_sums[j / reduce] += p.z();
+                            ++area[j / reduce];
+                        }
+                    }
+                }
+
+                for(size_t cj{0}; cj < cells_width; ++cj) {
+                    const size_t c{ci * cells_width + cj};
+                    bins[c] = areas[c] == 0
+                                  ? -1
+                                  : std::min(static_cast<int>((z_sums[cj] / areas[c] - z_min) *
+                                                              bin_scale),
+                                             set_.num_bins_ - 1);
+                }
+            }
+        });
+
+        detail::UnionFind forest{cells};
+        const auto same{[&](size_t a, size_t b) { return bins[a] >= 0 and bins[a] == bins[b]; }};
+
+        // block-local labeling, a band only links its own cells
+        parallel_for_bands(cells_height, bands, [&](size_t, size_t first, size_t last) {
+            for(size_t ci{first}; ci < last; ++ci) {
+                for(size_t cj{0}; cj < cells_width; ++cj) {
+                    const size_t c{ci * cells_width + cj};
+
+                    if(cj > 0 and same(c, c - 1)) {
+                        forest.unite(static_cast<uint32_t>(c), static_cast<uint32_t>(c - 1));
+                    }
+
+                    if(ci > first and same(c, c - cells_width)) {
+                        forest.unite(static_cast<uint32_t>(c),
+                                     static_cast<uint32_t>(c - cells_width));
+                    }
+                }
+            }
+        });
+
+        // merge along the first row of every band but the first one
+        parallel_for(
+            cells_width * (bands - 1),
+            [&](size_t first, size_t last) {
+                for(size_t k{first}; k < last; ++k) {
+                    const size_t ci{band_range(cells_height, bands, k / cells_width + 1).first};
+                    const size_t c{ci * cells_width + k % cells_width};
+
+                    if(same(c, c - cells_width)) {
+                        forest.concurrent_unite(static_cast<uint32_t>(c),
+                                                static_cast<uint32_t>(c - cells_width));
+                    }
+                }
+            },
+            threads_);
+
+        // roots and component areas, no unions run anymore
+        std::vector<uint32_t> roots(cells);
+        std::vector<uint32_t> component_areas(cells);
+
+        parallel_for(
+            cells,
+            [&](size_t first, size_t last) {
+                for(size_t c{first}; c < last; ++c) {
+                    roots[c] = forest.root(static_cast<uint32_t>(c));
+                    std::atomic_ref{component_areas[roots[c]]}.fetch_add(
+                        areas[c], std::memory_order_relaxed);
+                }
+            },
+            threads_);
+
+        const auto min_area{static_cast<uint32_t>(std::max(set_.min_area_, 0))};
+
+        parallel_for(
+            height,
+            [&](size_t first, size_t last) {
+                for(size_t i{first}; i < last; ++i) {
+                    const uint32_t *row_roots{roots.data() + i / reduce * cells_width};
+
+                    for(size_t j{0}; j < width; ++j) {
+                        if(component_areas[row_roots[j / reduce]] < min_area) {
+                            pts[i * width + j] = empty;
+                        }
+                    }
+                }
+            },
+            threads_, 16);
+    }
+
+  private:
+    /// @brief points that are not empty and finite, only they count towards the cells
+    [[nodiscard]] static bool valid(const Point3f &p, const Point3f &empty) noexcept {
+        return p != empty and std::isfinite(p.x()) and std::isfinite(p.y()) and
+               std::isfinite(p.z());
+    }
+
+    [[nodiscard]] std::pair<double, double>
+    z_range(const StructuredPointCloud<Point3f> &pcd) const {
+        const auto pts{pcd.points()};
+        const auto empty{pcd.empty_value()};
+        const size_t bands{band_count(pts.size(), threads_)};
+        std::vector<std::pair<float, float>> ranges(
+            bands, {std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest()});
+
+        parallel_for_bands(pts.size(), bands, [&](size_t band, size_t first, size_t last) {
+            auto &[lo, hi]{ranges[band]};
+
+            for(size_t i{first}; i < last; ++i) {
+                if(valid(pts[i], empty)) {
+                    lo = std::min(lo, pts[i].z());
+                    hi = std::max(hi, pts[i].z());
+                }
+            }
+        });
+
+        float lo{std::numeric_limits<float>::max()};
+        float hi{std::numeric_limits<float>::lowest()};
+
+        for(const auto &[band_lo, band_hi] : ranges) {
+            lo = std::min(lo, band_lo);
+            hi = std::max(hi, band_hi);
+        }
+
+        return {lo, hi};
+    }
+
+    MagicFilterSetting set_;
+    size_t threads_;
+};
+
+} // namespace we
@@ -0,0 +1,389 @@
+#pragma once
+#include "create_mesh.h"
+#include "mesh.h"
+#include "mesh_optimize.h"
+#include "parallel.h"
+#include "point.h"
+#include "pointcloud.h"
+#include "voxel_grid.h"
+#include "we_assert.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <utility>
+#include <vector>
+
+namespace we {
+
+struct ParallelMeshSettings {
+    MeshRecSettings mesh_;
+    /// number of threads, 0 - all hardware threads
+    size_t threads_{0};
+    /// cap of the memory of a reconstruction, in bytes, std::nullopt - no cap. It is held against
+    /// estimated_memory_per_point_ times the points of a slab, not against measured memory, so
+    /// it holds only as far as that estimate does
+    std::optional<size_t> max_memory_{};
+    /// estimate of the memory a reconstruction takes per input point, in bytes, the basis of
+    /// the memory plan. It depends on the resolution, samples_per_node_ and the surface; the
+    /// default is a guess, not a measurement. For a cap to hold, measure the peak memory of
+    /// create_mesh() on a typical cloud, e.g. the peak_memory_bytes of welib3d_bench, and set
+    /// the peak divided by the number of points
+    size_t estimated_memory_per_point_{1024};
+    /// points a tile takes beyond its borders on both sides, std::nullopt - 10 * resolution_
+    std::optional<float> overlap_{};
+    /// vertices near a slab border within this distance of each other are welded,
+    /// std::nullopt - resolution_ / 2, 0 - the slabs are left apart
+    std::optional<float> weld_distance_{};
+    /// called with the done fraction after every tile, from the worker threads one at a time
+    std::function<void(float)> progress_{};
+};
+
+namespace detail {
+
+/// @brief how a reconstruction is split to fit the threads and the memory cap
+struct MeshPlan {
+    size_t tiles_;
+    size_t concurrency_;
+    float resolution_;
+};
+
+/// @brief the fewest tiles, at least one per thread, for n points whose tiles are at least
+/// min_thickness thick along extent. The reconstructions run one at a time, so the estimate of
+/// a single tile has to fit the cap. When even the thinnest tiles overflow it, the resolution
+/// is coarsened by two until the points left after a voxel grid of that resolution fit,
+/// surface points dropping by about four each time
+[[nodiscard]] inline MeshPlan plan_mesh(size_t n, float extent, float min_thickness,
+                                        const ParallelMeshSettings &set) {
+    const size_t threads{thread_count(set.threads_)};
+    const auto max_tiles{static_cast<size_t>(
+        std::max(1.0f, min_thickness > 0.0f ? extent / min_thickness : 1.0f))};
+    MeshPlan plan{std::min(threads, max_tiles), std::min(threads, max_tiles),
+                  set.mesh_.resolution_};
+
+    if(not set.max_memory_) {
+        return plan;
+    }
+
+    const double cap{static_cast<double>(*set.max_memory_)};
+    double points{static_cast<double>(n)};
+    const auto memory{[&](size_t tiles) {
+        return points / static_cast<double>(tiles) *
+               static_cast<double>(set.estimated_memory_per_point_);
+    }};
+
+    while(true) {
+        // more tiles first, a coarser resolution when even the thinnest tiles do not fit
+        plan.tiles_ = std::min(
+            max_tiles, std::max(plan.tiles_, static_cast<size_t>(std::ceil(memory(1) / cap))));
+
+        if(memory(plan.tiles_) <= cap or points < 1.0) {
+            plan.concurrency_ = std::min(threads, plan.tiles_);
+            return plan;
+        }
+
+        plan.resolution_ *= 2.0f;
+        points /= 4.0;
+    }
+}
+
+/// @brief serializes the calls of create_mesh(): the prebuilt library does not state that it
+/// is reentrant
+[[nodiscard]] inline std::mutex &create_mesh_mutex() noexcept {
+    static std::mutex mutex;
+    return mutex;
+}
+
+/// @brief joins the slab meshes of create_mesh_parallel(), parts[t] lying between borders[t] and
+/// borders[t + 1] along axis. The slabs are reconstructed apart, so their vertices along a
+/// common border are neither shared nor equal. Every vertex within weld of an inner border is
+/// welded into the first such vertex within weld, faces collapsing by the weld and vertices no
+/// face uses any more are dropped; weld 0 only concatenates the slabs.
+[[nodiscard]] inline Mesh3f stitch_slabs(std::span<const Mesh3f> parts,
+                                         std::span<const float> borders, size_t axis, float weld,
+                                         size_t threads = 0) {
+    assert_true([&]() { return borders.size() == parts.size() + 1; }, "wrong slab borders");
+
+    size_t vertices{0};
+    size_t faces{0};
+
+    for(const auto &part : parts) {
+        vertices += part.size();
+        faces += part.n_faces();
+    }
+
+    assert_true([&]() { return vertices < size_t{std::numeric_limits<int>::max()}; },
+                "too many vertices");
+
+    Mesh3f mesh;
+    mesh.create(Mesh3f::vector_type(vertices), {});
+
+    for(const auto &part : parts) {
+        mesh.add_properties_of(part);
+    }
+
+    Mesh3f::vector_face_type all_faces;
+    all_faces.reserve(faces);
+    std::vector<uint32_t> band;
+    size_t offset{0};
+
+    for(size_t t{0}; t < parts.size(); ++t) {
+        const auto &part{parts[t]};
+        mesh.copy_range(part, 0, part.size(), offset);
+        const auto shift{static_cast<int>(offset)};
+
+        for(const auto &f : part.faces()) {
+            all_faces.push_back(Point3i{f.x() + shift, f.y() + shift, f.z() + shift});
+        }
+
+        const auto at_border{[&](float x, size_t b) {
+            return b > 0 and b < parts.size() and std::abs(x - borders[b]) <= weld;
+        }};
+        const auto pts{part.points()};
+
+        for(size_t i{0}; weld > 0.0f and i < pts.size(); ++i) {
+            if(at_border(pts[i][axis], t) or at_border(pts[i][axis], t + 1)) {
+                band.push_back(static_cast<uint32_t>(offset + i));
+            }
+        }
+
+        offset += part.size();
+    }
+
+    if(band.empty()) {
+        mesh.set_faces(std::move(all_faces));
+        return mesh;
+    }
+
+    std::vector<Point3f> band_pts(band.size());
+    const auto pts{mesh.points()};
+    std::ranges::transform(band, band_pts.begin(), [&](uint32_t v) { return pts[v]; });
+
+    const auto weld_of{weld_vertices(band_pts, weld)};
+    std::vector<int> vertex_of(vertices);
+    std::iota(vertex_of.begin(), vertex_of.end(), 0);
+
+    for(size_t k{0}; k < band.size(); ++k) {
+        vertex_of[band[k]] = static_cast<int>(band[weld_of[k]]);
+    }
+
+    std::vector<uint8_t> used(vertices, 0);
+    Mesh3f::vector_face_type kept;
+    kept.reserve(all_faces.size());
+
+    for(const auto &f : all_faces) {
+        const Point3i w{vertex_of[static_cast<size_t>(f[0])], vertex_of[static_cast<size_t>(f[1])],
+                        vertex_of[static_cast<size_t>(f[2])]};
+
+        if(w[0] != w[1] and w[1] != w[2] and w[2] != w[0]) {
+            kept.push_back(w);
+
+            for(size_t k{0}; k < 3; ++k) {
+                used[static_cast<size_t>(w[k])] = 1;
+            }
+        }
+    }
+
+    // vertex indices after dropping the unused vertices
+    int vertex{0};
+
+    for(size_t i{0}; i < vertices; ++i) {
+        vertex_of[i] = vertex;
+        vertex += used[i];
+    }
+
+    for(auto &f : kept) {
+        for(size_t k{0}; k < 3; ++k) {
+            f[k] = vertex_of[static_cast<size_t>(f[k])];
+        }
+    }
+
+    Mesh3f stitched;
+    stitched.assign_compacted(mesh, used, threads);
+    stitched.set_faces(std::move(kept));
+    return stitched;
+}
+
+} // namespace detail
+
+/// @brief create_mesh() in slabs within a memory cap. The cloud is cut into slabs along
+/// the longest axis of its bounding box holding the same number of points, every slab is
+/// reconstructed with set.overlap_ of the points around it and keeps the faces whose centroid
+/// falls into it. Points with a nan or inf coordinate are left out. Slabs run on a pool of
+/// threads taking the next slab when done, which cut the slab and trim its faces in parallel.
+/// The reconstructions themselves run one at a time, see detail::create_mesh_mutex(). The
+/// number of slabs follows set.max_memory_, and a cap too small for the thinnest slabs
+/// coarsens the resolution, with the cloud reduced by a voxel grid to it.
+/// The slabs meet in seams: their surfaces come from different reconstructions and their border
+/// vertices do not coincide. Vertices within set.weld_distance_ of each other near a border are
+/// welded, see detail::stitch_slabs(); that closes the seam where the two surfaces agree to
+/// within the distance, elsewhere a crack narrower than about one resolution_ may remain.
+/// set.progress_ is called after every slab; a stop request is honoured between slabs, the
+/// result then is std::nullopt.
+/// @example
+/// const auto mesh{create_mesh_parallel(
+///     merged, ParallelMeshSettings{.mesh_ = MeshRecSettings{.resolution_ = 1.0f,
+///                                                           .samples_per_node_ = 1.5f},
+///                                  .max_memory_ = size_t{8} << 30})};
+[[nodiscard]] inline std::optional<Mesh3f>
+create_mesh_parallel(const PointCloud3f &pcd, const ParallelMeshSettings &set,
+                     std::stop_token stop = {}) {
+    const auto pts{pcd.points()};
+    const auto finite{[](const Point3f &p) {
+        return std::isfinite(p.x()) and std::isfinite(p.y()) and std::isfinite(p.z());
+    }};
+
+    // the longest axis and equal count borders of the slabs along it
+    std::array<float, 3> low{};
+    std::array<float, 3> high{};
+    low.fill(std::numeric_limits<float>::max());
+    high.fill(std::numeric_limits<float>::lowest());
+    size_t points{0};
+
+    for(const auto &p : pts) {
+        if(finite(p)) {
+            ++points;
+
+            for(size_t c{0}; c < 3; ++c) {
+                low[c] = std::min(low[c], p[c]);
+                high[c] = std::max(high[c], p[c]);
+            }
+        }
+    }
+
+    if(points == 0) {
+        return Mesh3f{};
+    }
+
+    size_t axis{0};
+
+    for(size_t c{1}; c < 3; ++c) {
+        if(high[c] - low[c] > high[axis] - low[axis]) {
+            axis = c;
+        }
+    }
+
+    const float overlap{set.overlap_.value_or(10.0f * set.mesh_.resolution_)};
+    const auto plan{
+        detail::plan_mesh(points, high[axis] - low[axis], 4.0f * overlap, set)};
+    auto mesh_set{set.mesh_};
+    mesh_set.resolution_ = plan.resolution_;
+
+    // a coarser resolution can not use the full density
+    const PointCloud3f reduced{plan.resolution_ > set.mesh_.resolution_
+                                   ? VoxelGrid{VoxelGridSettings{.leaf_size_ = plan.resolution_,
+                                                                 .threads_ = set.threads_}}
+                                         .apply(pcd)
+                                   : PointCloud3f{}};
+    const PointCloud3f &cloud{reduced.empty() ? pcd : reduced};
+    const auto cloud_pts{cloud.points()};
+
+    std::vector<float> coords;
+    coords.reserve(cloud_pts.size());
+
+    for(const auto &p : cloud_pts) {
+        if(finite(p)) {
+            coords.push_back(p[axis]);
+        }
+    }
+
+    std::vector<float> borders(plan.tiles_ + 1);
+    borders.front() = std::numeric_limits<float>::lowest();
+    borders.back() = std::numeric_limits<float>::max();
+
+    for(size_t t{1}; t < plan.tiles_; ++t) {
+        const auto nth{coords.begin() +
+                       static_cast<std::ptrdiff_t>(t * coords.size() / plan.tiles_)};
+        std::nth_element(coords.begin(), nth, coords.end());
+        borders[t] = *nth;
+    }
+
+    std::vector<Mesh3f> parts(plan.tiles_);
+    std::atomic<size_t> next{0};
+    size_t done{0};
+    std::mutex progress_mutex;
+
+    parallel_for_bands(plan.concurrency_, plan.concurrency_, [&](size_t, size_t, size_t) {
+        for(size_t t{next++}; t < plan.tiles_ and not stop.stop_requested(); t = next++) {
+            const float first{borders[t]};
+            const float last{borders[t + 1]};
+            std::vector<uint8_t> inside(cloud_pts.size());
+
+            for(size_t i{0}; i < cloud_pts.size(); ++i) {
+                const float x{cloud_pts[i][axis]};
+                inside[i] =
+                    finite(cloud_pts[i]) and x >= first - overlap and x < last + overlap ? 1 : 0;
+            }
+
+            PointCloud3f tile;
+            tile.assign_compacted(cloud, inside, 1);
+
+            if(not tile.empty()) {
+                auto part{[&]() {
+                    std::scoped_lock lock{detail::create_mesh_mutex()};
+                    return create_mesh(tile, mesh_set);
+                }()};
+                const auto vertices{part.points()};
+                const auto faces{part.faces()};
+                std::vector<uint8_t> used(vertices.size());
+                Mesh3f::vector_face_type kept;
+
+                for(const auto &f : faces) {
+                    const float centroid{(vertices[static_cast<size_t>(f.x())][axis] +
+                                          vertices[static_cast<size_t>(f.y())][axis] +
+                                          vertices[static_cast<size_t>(f.z())][axis]) /
+                                         3.0f};
+
+                    if(centroid >= first and centroid < last) {
+                        kept.push_back(f);
+
+                        for(size_t k{0}; k < 3; ++k) {
+                            used[static_cast<size_t>(f[k])] = 1;
+                        }
+                    }
+                }
+
+                // vertex indices after dropping the unused vertices
+                std::vector<int> vertex_of(vertices.size());
+                int vertex{0};
+
+                for(size_t i{0}; i < vertices.size(); ++i) {
+                    vertex_of[i] = vertex;
+                    vertex += used[i];
+                }
+
+                for(auto &f : kept) {
+                    for(size_t k{0}; k < 3; ++k) {
+                        f[k] = vertex_of[static_cast<size_t>(f[k])];
+                    }
+                }
+
+                parts[t].assign_compacted(part, used, 1);
+                parts[t].set_faces(std::move(kept));
+            }
+
+            if(set.progress_) {
+                std::scoped_lock lock{progress_mutex};
+                set.progress_(static_cast<float>(++done) / static_cast<float>(plan.tiles_));
+            }
+        }
+    });
+
+    if(stop.stop_requested()) {
+        return std::nullopt;
+    }
+
+    return detail::stitch_slabs(parts, borders, axis,
+                                set.weld_distance_.value_or(0.5f * plan.resolution_),
+                                set.threads_);
+}
+
+} // namespace we
@@ -2,7 +2,9 @@
 #include "we_assert.h"
 #include <algorithm>
 #include <array>
+#include <cmath>
 #include <cstdint>
+#include <functional>
 #include <span>
 #include <type_traits>
 
@@ -105,11 +107,11 @@ struct Matrix {
 
     constexpr scalar_type &operator()(int i, int j) {
         assert_true([&]() { return i >= 0 and j >= 0 and i < nRows and j < nCols; });
-        return d_[i * nRows + j];
+        return d_[i * nCols + j];
     }
     constexpr const scalar_type &operator()(int i, int j) const {
         assert_true([&]() { return i >= 0 and j >= 0 and i < nRows and j < nCols; });
-        return d_[i * nRows + j];
+        return d_[i * nCols + j];
     }
 
     bool operator==(const matrix_type &rhs) const { return std::ranges::equal(rhs.d_, d_); }
@@ -127,14 +129,137 @@ struct Matrix {
         return pt;
     }
 
+    [[nodiscard]] constexpr static matrix_type zero() { return matrix_type{}; }
+
+    [[nodiscard]] constexpr static matrix_type identity()
+        requires(Rows == Cols)
+    {
+        matrix_type res;
+        for(int i{0}; i < Rows; ++i) {
+            res.d_[i * Cols + i] = static_cast<scalar_type>(1);
+        }
+        return res;
+    }
+
+    constexpr matrix_type &operator+=(const matrix_type &rhs) {
+        std::ranges::transform(d_, rhs.d_, d_.begin(), std::plus<>{});
+        return *this;
+    }
+
     constexpr matrix_type &operator-=(const matrix_type &rhs) {
-        std::ranges::transform(rhs.d_, d_.begin(), [](auto &&val) { return -val; });
+        std::ranges::transform(d_, rhs.d_, d_.begin(), std::minus<>{});
+        return *this;
+    }
+
+    constexpr matrix_type &operator*=(const scalar_type rhs) {
+        std::ranges::transform(d_, d_.begin(), [rhs](auto &&val) { return val * rhs; });
         return *this;
     }
 
+    constexpr matrix_type &operator/=(const scalar_type rhs) {
+        std::ranges::transform(d_, d_.begin(), [rhs](auto &&val) { return val / rhs; });
+        return *this;
+    }
+
+    [[nodiscard]] friend constexpr matrix_type operator+(matrix_type lhs, const matrix_type &rhs) {
+        return lhs += rhs;
+    }
+
+    [[nodiscard]] friend constexpr matrix_type operator-(matrix_type lhs, const matrix_type &rhs) {
+        return lhs -= rhs;
+    }
+
+    [[nodiscard]] friend constexpr matrix_type operator-(matrix_type rhs) {
+        std::ranges::transform(rhs.d_, rhs.d_.begin(), [](auto &&val) { return -val; });
+        return rhs;
+    }
+
+    [[nodiscard]] friend constexpr matrix_type operator*(matrix_type lhs, const scalar_type rhs) {
+        return lhs *= rhs;
+    }
+
+    [[nodiscard]] friend constexpr matrix_type operator*(const scalar_type lhs, matrix_type rhs) {
+        return rhs *= lhs;
+    }
+
+    [[nodiscard]] friend constexpr matrix_type operator/(matrix_type lhs, const scalar_type rhs) {
+        return lhs /= rhs;
+    }
+
+    /// @brief sum of the element-wise products, the dot product for vectors
+    [[nodiscard]] constexpr scalar_type dot(const matrix_type &rhs) const {
+        scalar_type res{0};
+        for(int i{0}; i < Size; ++i) {
+            res += d_[i] * rhs.d_[i];
+        }
+        return res;
+    }
+
+    [[nodiscard]] constexpr matrix_type cross(const matrix_type &rhs) const
+        requires(Size == 3 and (Rows == 1 or Cols == 1))
+    {
+        return matrix_type{d_[1] * rhs.d_[2] - d_[2] * rhs.d_[1],
+                           d_[2] * rhs.d_[0] - d_[0] * rhs.d_[2],
+                           d_[0] * rhs.d_[1] - d_[1] * rhs.d_[0]};
+    }
+
+    [[nodiscard]] constexpr scalar_type squared_norm() const { return dot(*this); }
+
+    /// @brief Euclidean norm of a vector, Frobenius norm of a matrix
+    [[nodiscard]] scalar_type norm() const
+        requires std::is_floating_point_v<scalar_type>
+    {
+        return std::sqrt(squared_norm());
+    }
+
+    /// @brief unit vector of the same direction, the zero vector stays zero
+    [[nodiscard]] matrix_type normalized() const
+        requires std::is_floating_point_v<scalar_type>
+    {
+        const scalar_type len{norm()};
+        return len > static_cast<scalar_type>(0) ? *this / len : *this;
+    }
+
+    [[nodiscard]] constexpr Matrix<scalar_type, Cols, Rows> transpose() const {
+        Matrix<scalar_type, Cols, Rows> res;
+        for(int i{0}; i < Rows; ++i) {
+            for(int j{0}; j < Cols; ++j) {
+                res.d_[j * Rows + i] = d_[i * Cols + j];
+            }
+        }
+        return res;
+    }
+
     std::array<scalar_type, Size> d_{static_cast<scalar_type>(0)};
 };
 
+/// @brief matrix product, matrix-vector for Cols == 1
+template <typename T, int Rows, int Inner, int Cols>
+[[nodiscard]] constexpr Matrix<T, Rows, Cols> operator*(const Matrix<T, Rows, Inner> &lhs,
+                                                        const Matrix<T, Inner, Cols> &rhs) {
+    Matrix<T, Rows, Cols> res;
+    for(int i{0}; i < Rows; ++i) {
+        for(int j{0}; j < Cols; ++j) {
+            T val{0};
+            for(int k{0}; k < Inner; ++k) {
+                val += lhs.d_[i * Inner + k] * rhs.d_[k * Cols + j];
+            }
+            res.d_[i * Cols + j] = val;
+        }
+    }
+    return res;
+}
+
+/// @brief rotation and translation of a 4x4 rigid transform applied to a 3D point
+template <typename T>
+[[nodiscard]] constexpr Matrix<T, 3, 1> transform_point(const Matrix<T, 4, 4> &m,
+                                                        const Matrix<T, 3, 1> &pt) {
+    return Matrix<T, 3, 1>{m.d_[0] * pt.d_[0] + m.d_[1] * pt.d_[1] + m.d_[2] * pt.d_[2] + m.d_[3],
+                           m.d_[4] * pt.d_[0] + m.d_[5] * pt.d_[1] + m.d_[6] * pt.d_[2] + m.d_[7],
+                           m.d_[8] * pt.d_[0] + m.d_[9] * pt.d_[1] + m.d_[10] * pt.d_[2] +
+                               m.d_[11]};
+}
+
 using Point3f = Matrix<float, 3, 1>;
 using Point3d = Matrix<double, 3, 1>;
 using Point3i = Matrix<int, 3, 1>;
@@ -0,0 +1,409 @@
+#pragma once
+#include "point.h"
+#include "we_assert.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <span>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define WELIB3D_X86_SIMD
+#include <immintrin.h>
+#if defined(_MSC_VER) && not defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+namespace we {
+
+/// @brief instruction set used by the batch point kernels
+enum class SimdLevel { SCALAR, AVX2, AVX512 };
+
+namespace detail {
+
+[[nodiscard]] inline SimdLevel detect_simd_level() noexcept {
+#if defined(WELIB3D_X86_SIMD)
+#if defined(_MSC_VER) && not defined(__clang__)
+    int info[4]{};
+    __cpuid(info, 0);
+    const int max_leaf{info[0]};
+    __cpuid(info, 1);
+
+    // AVX state has to be enabled by the OS as well
+    if(max_leaf < 7 or (info[2] & (1 << 27)) == 0 or (info[2] & (1 << 28)) == 0) {
+        return SimdLevel::SCALAR;
+    }
+
+    const auto xcr0{_xgetbv(0)};
+    __cpuidex(info, 7, 0);
+
+    if((xcr0 & 0x6) != 0x6 or (info[1] & (1 << 5)) == 0) {
+        return SimdLevel::SCALAR;
+    }
+
+    if((xcr0 & 0xe6) == 0xe6 and (info[1] & (1 << 16)) != 0) {
+        return SimdLevel::AVX512;
+    }
+
+    return SimdLevel::AVX2;
+#else
+    __builtin_cpu_init();
+
+    if(__builtin_cpu_supports("avx512f")) {
+        return SimdLevel::AVX512;
+    }
+
+    if(__builtin_cpu_supports("avx2")) {
+        return SimdLevel::AVX2;
+    }
+#endif
+#endif
+    return SimdLevel::SCALAR;
+}
+
+[[nodiscard]] inline std::atomic<SimdLevel> &simd_level_state() noexcept {
+    static std::atomic<SimdLevel> level{detect_simd_level()};
+    return level;
+}
+
+[[nodiscard]] inline const float *floats(std::span<const Point3f> pts) noexcept {
+    return reinterpret_cast<const float *>(pts.data());
+}
+
+[[nodiscard]] inline float *floats(std::span<Point3f> pts) noexcept {
+    return reinterpret_cast<float *>(pts.data());
+}
+
+} // namespace detail
+
+/// @brief best instruction set of the CPU
+[[nodiscard]] inline SimdLevel supported_simd_level() noexcept {
+    static const SimdLevel level{detail::detect_simd_level()};
+    return level;
+}
+
+/// @brief instruction set the batch kernels currently run with
+[[nodiscard]] inline SimdLevel simd_level() noexcept {
+    return detail::simd_level_state().load(std::memory_order_relaxed);
+}
+
+/// @brief restricts the batch kernels to level, e.g. to compare with the scalar path.
+/// All levels give identical results unless the scalar code is built with multiply-adds
+/// contracted to FMA (e.g. GCC with FMA enabled and the default -ffp-contract=fast).
+/// A level the CPU does not support is lowered to supported_simd_level().
+inline void set_simd_level(SimdLevel level) noexcept {
+    detail::simd_level_state().store(std::min(level, supported_simd_level()),
+                                     std::memory_order_relaxed);
+}
+
+} // namespace we
+
+#if defined(WELIB3D_X86_SIMD)
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+namespace we::detail {
+
+struct Avx2 {
+    using vec = __m256;
+    constexpr static size_t lanes{8};
+
+    static vec set1(float val) { return _mm256_set1_ps(val); }
+    static vec loadu(const float *src) { return _mm256_loadu_ps(src); }
+    static void storeu(float *dst, vec val) { _mm256_storeu_ps(dst, val); }
+    static vec add(vec a, vec b) { return _mm256_add_ps(a, b); }
+    static vec sub(vec a, vec b) { return _mm256_sub_ps(a, b); }
+    static vec mul(vec a, vec b) { return _mm256_mul_ps(a, b); }
+    static vec sqrt(vec a) { return _mm256_sqrt_ps(a); }
+
+    /// @brief a / b where b > 0, a elsewhere
+    static vec div_positive(vec a, vec b) {
+        const vec mask{_mm256_cmp_ps(b, _mm256_setzero_ps(), _CMP_GT_OQ)};
+        return _mm256_blendv_ps(a, _mm256_div_ps(a, b), mask);
+    }
+
+    /// @brief splits 8 xyz points into x, y and z lanes
+    static void load3(const float *src, vec &x, vec &y, vec &z) {
+        const vec m03{_mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(src)),
+                                           _mm_loadu_ps(src + 12), 1)};
+        const vec m14{_mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(src + 4)),
+                                           _mm_loadu_ps(src + 16), 1)};
+        const vec m25{_mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(src + 8)),
+                                           _mm_loadu_ps(src + 20), 1)};
+
+        const vec xy{_mm256_shuffle_ps(m14, m25, _MM_SHUFFLE(2, 1, 3, 2))};
+        const vec yz{_mm256_shuffle_ps(m03, m14, _MM_SHUFFLE(1, 0, 2, 1))};
+        x = _mm256_shuffle_ps(m03, xy, _MM_SHUFFLE(2, 0, 3, 0));
+        y = _mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+        z = _mm256_shuffle_ps(yz, m25, _MM_SHUFFLE(3, 0, 3, 1));
+    }
+
+    /// @brief interleaves x, y and z lanes into 8 xyz points
+    static void store3(float *dst, vec x, vec y, vec z) {
+        const vec rxy{_mm256_shuffle_ps(x, y, _MM_SHUFFLE(2, 0, 2, 0))};
+        const vec ryz{_mm256_shuffle_ps(y, z, _MM_SHUFFLE(3, 1, 3, 1))};
+        const vec rzx{_mm256_shuffle_ps(z, x, _MM_SHUFFLE(3, 1, 2, 0))};
+        const vec r03{_mm256_shuffle_ps(rxy, rzx, _MM_SHUFFLE(2, 0, 2, 0))};
+        const vec r14{_mm256_shuffle_ps(ryz, rxy, _MM_SHUFFLE(3, 1, 2, 0))};
+        const vec r25{_mm256_shuffle_ps(rzx, ryz, _MM_SHUFFLE(3, 1, 3, 1))};
+
+        _mm_storeu_ps(dst, _mm256_castps256_ps128(r03));
+        _mm_storeu_ps(dst + 4, _mm256_castps256_ps128(r14));
+        _mm_storeu_ps(dst + 8, _mm256_castps256_ps128(r25));
+        _mm_storeu_ps(dst + 12, _mm256_extractf128_ps(r03, 1));
+        _mm_storeu_ps(dst + 16, _mm256_extractf128_ps(r14, 1));
+        _mm_storeu_ps(dst + 20, _mm256_extractf128_ps(r25, 1));
+    }
+};
+
+} // namespace we::detail
+
+#define WELIB3D_SIMD_ISA Avx2
+#include "point_kernels_simd.h"
+#undef WELIB3D_SIMD_ISA
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx512f"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#endif
+
+namespace we::detail {
+
+/// @brief permutation indices gathering component c of 16 xyz points (pass 0: from the first
+/// two registers, pass 1: the rest from the third one) or scattering them back (store)
+template <int c, int pass> constexpr std::array<int, 16> load3_index() {
+    std::array<int, 16> idx{};
+    for(int i{0}; i < 16; ++i) {
+        const int k{3 * i + c};
+        idx[i] = pass == 0 ? (k < 32 ? k : 0) : (k < 32 ? i : 16 + k - 32);
+    }
+    return idx;
+}
+
+template <int r, int pass> constexpr std::array<int, 16> store3_index() {
+    std::array<int, 16> idx{};
+    for(int l{0}; l < 16; ++l) {
+        const int k{16 * r + l};
+        const int p{k / 3};
+        const int c{k % 3};
+        idx[l] = pass == 0 ? (c == 0 ? p : (c == 1 ? 16 + p : 0)) : (c == 2 ? 16 + p : l);
+    }
+    return idx;
+}
+
+// AVX-512 implies FMA: the masked forms keep GCC from contracting mul and add
+struct Avx512 {
+    using vec = __m512;
+    constexpr static size_t lanes{16};
+    constexpr static __mmask16 all{0xffff};
+
+    static vec set1(float val) { return _mm512_set1_ps(val); }
+    static vec loadu(const float *src) { return _mm512_loadu_ps(src); }
+    static void storeu(float *dst, vec val) { _mm512_storeu_ps(dst, val); }
+    static vec add(vec a, vec b) { return _mm512_maskz_add_ps(all, a, b); }
+    static vec sub(vec a, vec b) { return _mm512_maskz_sub_ps(all, a, b); }
+    static vec mul(vec a, vec b) { return _mm512_maskz_mul_ps(all, a, b); }
+    static vec sqrt(vec a) { return _mm512_maskz_sqrt_ps(all, a); }
+
+    static vec div_positive(vec a, vec b) {
+        return _mm512_mask_div_ps(a, _mm512_cmp_ps_mask(b, _mm512_setzero_ps(), _CMP_GT_OQ), a,
+                                  b);
+    }
+
+    template <const std::array<int, 16> &idx> static __m512i index() {
+        return _mm512_loadu_si512(idx.data());
+    }
+
+    template <int c> static vec gather3(vec a, vec b, vec d) {
+        constexpr static auto first{load3_index<c, 0>()};
+        constexpr static auto second{load3_index<c, 1>()};
+        return _mm512_permutex2var_ps(_mm512_permutex2var_ps(a, index<first>(), b),
+                                      index<second>(), d);
+    }
+
+    template <int r> static vec scatter3(vec x, vec y, vec z) {
+        constexpr static auto first{store3_index<r, 0>()};
+        constexpr static auto second{store3_index<r, 1>()};
+        return _mm512_permutex2var_ps(_mm512_permutex2var_ps(x, index<first>(), y),
+                                      index<second>(), z);
+    }
+
+    static void load3(const float *src, vec &x, vec &y, vec &z) {
+        const vec a{_mm512_loadu_ps(src)};
+        const vec b{_mm512_loadu_ps(src + 16)};
+        const vec d{_mm512_loadu_ps(src + 32)};
+        x = gather3<0>(a, b, d);
+        y = gather3<1>(a, b, d);
+        z = gather3<2>(a, b, d);
+    }
+
+    static void store3(float *dst, vec x, vec y, vec z) {
+        _mm512_storeu_ps(dst, scatter3<0>(x, y, z));
+        _mm512_storeu_ps(dst + 16, scatter3<1>(x, y, z));
+        _mm512_storeu_ps(dst + 32, scatter3<2>(x, y, z));
+    }
+};
+
+} // namespace we::detail
+
+#define WELIB3D_SIMD_ISA Avx512
+#include "point_kernels_simd.h"
+#undef WELIB3D_SIMD_ISA
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+#endif
+
+namespace we {
+
+namespace detail {
+
+/// @brief runs f(isa) with the instruction set of simd_level(), returns the number of points
+/// it processed; the caller finishes the rest with scalar code. f finds the kernels of isa by
+/// argument-dependent lookup, so it compiles where they do not exist.
+template <typename F> [[nodiscard]] size_t simd_dispatch(F &&f) {
+#if defined(WELIB3D_X86_SIMD)
+    switch(simd_level()) {
+    case SimdLevel::AVX512:
+        return f(Avx512{});
+    case SimdLevel::AVX2:
+        return f(Avx2{});
+    default:
+        break;
+    }
+#endif
+    static_cast<void>(f);
+    return 0;
+}
+
+inline void assert_sizes(size_t a, size_t b) {
+    assert_true([&]() { return a == b; }, "batch sizes differ");
+}
+
+} // namespace detail
+
+/// @brief dst[i] = m * src[i] for the rotation and translation of a rigid transform m,
+/// dst may be src
+inline void transform_points(std::span<const Point3f> src, std::span<Point3f> dst,
+                             const Matrix4f &m) {
+    detail::assert_sizes(src.size(), dst.size());
+
+    const size_t done{detail::simd_dispatch([&](auto isa) {
+        return transform_kernel(isa, detail::floats(src), detail::floats(dst), src.size(),
+                                m.d_.data(), true);
+    })};
+
+    for(size_t i{done}; i < src.size(); ++i) {
+        dst[i] = transform_point(m, src[i]);
+    }
+}
+
+/// @brief dst[i] = r * src[i], e.g. to rotate normals; dst may be src
+inline void rotate_points(std::span<const Point3f> src, std::span<Point3f> dst,
+                          const Matrix3f &r) {
+    detail::assert_sizes(src.size(), dst.size());
+
+    // the rotation of a 3x4 affine matrix without translation
+    const std::array<float, 12> m{r.d_[0], r.d_[1], r.d_[2], 0.0f, r.d_[3], r.d_[4],
+                                  r.d_[5], 0.0f,    r.d_[6], r.d_[7], r.d_[8], 0.0f};
+
+    const size_t done{detail::simd_dispatch([&](auto isa) {
+        return transform_kernel(isa, detail::floats(src), detail::floats(dst), src.size(),
+                                m.data(), false);
+    })};
+
+    for(size_t i{done}; i < src.size(); ++i) {
+        dst[i] = r * src[i];
+    }
+}
+
+/// @brief out[i] = a[i].dot(b[i])
+inline void dot(std::span<const Point3f> a, std::span<const Point3f> b, std::span<float> out) {
+    detail::assert_sizes(a.size(), b.size());
+    detail::assert_sizes(a.size(), out.size());
+
+    const size_t done{detail::simd_dispatch([&](auto isa) {
+        return dot_kernel(isa, detail::floats(a), detail::floats(b), out.data(), a.size());
+    })};
+
+    for(size_t i{done}; i < a.size(); ++i) {
+        out[i] = a[i].dot(b[i]);
+    }
+}
+
+/// @brief out[i] = src[i].norm()
+inline void norms(std::span<const Point3f> src, std::span<float> out) {
+    detail::assert_sizes(src.size(), out.size());
+
+    const size_t done{detail::simd_dispatch([&](auto isa) {
+        return norm_kernel(isa, detail::floats(src), out.data(), src.size());
+    })};
+
+    for(size_t i{done}; i < src.size(); ++i) {
+        out[i] = src[i].norm();
+    }
+}
+
+/// @brief dst[i] = src[i].normalized(), dst may be src
+inline void normalize(std::span<const Point3f> src, std::span<Point3f> dst) {
+    detail::assert_sizes(src.size(), dst.size());
+
+    const size_t done{detail::simd_dispatch([&](auto isa) {
+        return normalize_kernel(isa, detail::floats(src), detail::floats(dst), src.size());
+    })};
+
+    for(size_t i{done}; i < src.size(); ++i) {
+        dst[i] = src[i].normalized();
+    }
+}
+
+/// @brief dst[i] = a[i].cross(b[i]), dst may be a or b
+inline void cross(std::span<const Point3f> a, std::span<const Point3f> b,
+                  std::span<Point3f> dst) {
+    detail::assert_sizes(a.size(), b.size());
+    detail::assert_sizes(a.size(), dst.size());
+
+    const size_t done{detail::simd_dispatch([&](auto isa) {
+        return cross_kernel(isa, detail::floats(a), detail::floats(b),
+                            detail::floats(dst), a.size());
+    })};
+
+    for(size_t i{done}; i < a.size(); ++i) {
+        dst[i] = a[i].cross(b[i]);
+    }
+}
+
+/// @brief out[i] = (src[i] - q).squared_norm()
+inline void squared_distances(std::span<const Point3f> src, const Point3f &q,
+                              std::span<float> out) {
+    detail::assert_sizes(src.size(), out.size());
+
+    const size_t done{detail::simd_dispatch([&](auto isa) {
+        return squared_distance_kernel(isa, detail::floats(src), q.d_.data(), out.data(),
+                                       src.size());
+    })};
+
+    for(size_t i{done}; i < src.size(); ++i) {
+        out[i] = (src[i] - q).squared_norm();
+    }
+}
+
+} // namespace we
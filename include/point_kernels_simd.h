@@ -0,0 +1,144 @@
+// Batch kernel bodies, included by point_kernels.h once per instruction set with
+// WELIB3D_SIMD_ISA naming its struct, inside the matching target region. No include guard.
+// Every kernel processes whole blocks of Isa::lanes points, returns how many points it did
+// and evaluates the same expressions in the same order as the scalar code.
+// Included on its own, without WELIB3D_SIMD_ISA, it declares nothing.
+
+#include <cstddef>
+
+#if defined(WELIB3D_SIMD_ISA)
+
+namespace we::detail {
+
+inline size_t transform_kernel(WELIB3D_SIMD_ISA, const float *src, float *dst, size_t n,
+                               const float *m, bool translate) {
+    using Isa = WELIB3D_SIMD_ISA;
+    using vec = Isa::vec;
+
+    const vec m0{Isa::set1(m[0])};
+    const vec m1{Isa::set1(m[1])};
+    const vec m2{Isa::set1(m[2])};
+    const vec m3{Isa::set1(m[3])};
+    const vec m4{Isa::set1(m[4])};
+    const vec m5{Isa::set1(m[5])};
+    const vec m6{Isa::set1(m[6])};
+    const vec m7{Isa::set1(m[7])};
+    const vec m8{Isa::set1(m[8])};
+    const vec m9{Isa::set1(m[9])};
+    const vec m10{Isa::set1(m[10])};
+    const vec m11{Isa::set1(m[11])};
+    size_t i{0};
+
+    for(; i + Isa::lanes <= n; i += Isa::lanes) {
+        vec x, y, z;
+        Isa::load3(src + 3 * i, x, y, z);
+
+        vec rx{Isa::add(Isa::add(Isa::mul(m0, x), Isa::mul(m1, y)), Isa::mul(m2, z))};
+        vec ry{Isa::add(Isa::add(Isa::mul(m4, x), Isa::mul(m5, y)), Isa::mul(m6, z))};
+        vec rz{Isa::add(Isa::add(Isa::mul(m8, x), Isa::mul(m9, y)), Isa::mul(m10, z))};
+
+        if(translate) {
+            rx = Isa::add(rx, m3);
+            ry = Isa::add(ry, m7);
+            rz = Isa::add(rz, m11);
+        }
+
+        Isa::store3(dst + 3 * i, rx, ry, rz);
+    }
+
+    return i;
+}
+
+inline size_t dot_kernel(WELIB3D_SIMD_ISA, const float *a, const float *b, float *out,
+                         size_t n) {
+    using Isa = WELIB3D_SIMD_ISA;
+    using vec = Isa::vec;
+    size_t i{0};
+
+    for(; i + Isa::lanes <= n; i += Isa::lanes) {
+        vec ax, ay, az, bx, by, bz;
+        Isa::load3(a + 3 * i, ax, ay, az);
+        Isa::load3(b + 3 * i, bx, by, bz);
+        Isa::storeu(out + i, Isa::add(Isa::add(Isa::mul(ax, bx), Isa::mul(ay, by)),
+                                      Isa::mul(az, bz)));
+    }
+
+    return i;
+}
+
+inline size_t norm_kernel(WELIB3D_SIMD_ISA, const float *src, float *out, size_t n) {
+    using Isa = WELIB3D_SIMD_ISA;
+    using vec = Isa::vec;
+    size_t i{0};
+
+    for(; i + Isa::lanes <= n; i += Isa::lanes) {
+        vec x, y, z;
+        Isa::load3(src + 3 * i, x, y, z);
+        Isa::storeu(out + i, Isa::sqrt(Isa::add(Isa::add(Isa::mul(x, x), Isa::mul(y, y)),
+                                                Isa::mul(z, z))));
+    }
+
+    return i;
+}
+
+inline size_t normalize_kernel(WELIB3D_SIMD_ISA, const float *src, float *dst, size_t n) {
+    using Isa = WELIB3D_SIMD_ISA;
+    using vec = Isa::vec;
+    size_t i{0};
+
+    for(; i + Isa::lanes <= n; i += Isa::lanes) {
+        vec x, y, z;
+        Isa::load3(src + 3 * i, x, y, z);
+        const vec len{Isa::sqrt(
+            Isa::add(Isa::add(Isa::mul(x, x), Isa::mul(y, y)), Isa::mul(z, z)))};
+        Isa::store3(dst + 3 * i, Isa::div_positive(x, len), Isa::div_positive(y, len),
+                    Isa::div_positive(z, len));
+    }
+
+    return i;
+}
+
+inline size_t cross_kernel(WELIB3D_SIMD_ISA, const float *a, const float *b, float *dst,
+                           size_t n) {
+    using Isa = WELIB3D_SIMD_ISA;
+    using vec = Isa::vec;
+    size_t i{0};
+
+    for(; i + Isa::lanes <= n; i += Isa::lanes) {
+        vec ax, ay, az, bx, by, bz;
+        Isa::load3(a + 3 * i, ax, ay, az);
+        Isa::load3(b + 3 * i, bx, by, bz);
+        Isa::store3(dst + 3 * i, Isa::sub(Isa::mul(ay, bz), Isa::mul(az, by)),
+                    Isa::sub(Isa::mul(az, bx), Isa::mul(ax, bz)),
+                    Isa::sub(Isa::mul(ax, by), Isa::mul(ay, bx)));
+    }
+
+    return i;
+}
+
+inline size_t squared_distance_kernel(WELIB3D_SIMD_ISA, const float *src, const float *q,
+                                      float *out, size_t n) {
+    using Isa = WELIB3D_SIMD_ISA;
+    using vec = Isa::vec;
+
+    const vec qx{Isa::set1(q[0])};
+    const vec qy{Isa::set1(q[1])};
+    const vec qz{Isa::set1(q[2])};
+    size_t i{0};
+
+    for(; i + Isa::lanes <= n; i += Isa::lanes) {
+        vec x, y, z;
+        Isa::load3(src + 3 * i, x, y, z);
+        x = Isa::sub(x, qx);
+        y = Isa::sub(y, qy);
+        z = Isa::sub(z, qz);
+        Isa::storeu(out + i, Isa::add(Isa::add(Isa::mul(x, x), Isa::mul(y, y)),
+                                      Isa::mul(z, z)));
+    }
+
+    return i;
+}
+
+} // namespace we::detail
+
+#endif
@@ -0,0 +1,297 @@
+#pragma once
+#include "point.h"
+#include "we_assert.h"
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <ranges>
+#include <span>
+#include <vector>
+
+namespace we {
+
+/// @brief allocator returning storage aligned to Alignment bytes (cache line / AVX-512 register)
+template <typename T, size_t Alignment = 64> struct AlignedAllocator {
+    using value_type = T;
+
+    template <typename U> struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() noexcept = default;
+
+    template <typename U> AlignedAllocator(const AlignedAllocator<U, Alignment> &) noexcept {}
+
+    [[nodiscard]] T *allocate(size_t n) {
+        return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t{Alignment}));
+    }
+
+    void deallocate(T *p, size_t) noexcept { ::operator delete(p, std::align_val_t{Alignment}); }
+
+    template <typename U> bool operator==(const AlignedAllocator<U, Alignment> &) const noexcept {
+        return true;
+    }
+};
+
+template <typename T> using aligned_vector = std::vector<T, AlignedAllocator<T>>;
+
+/// @brief non-owning view on every stride-th element of a buffer,
+/// e.g. the x coordinates of an array of points
+template <typename T> class StridedSpan {
+  public:
+    using value_type = std::remove_cv_t<T>;
+    using element_type = T;
+
+    class iterator {
+      public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = std::remove_cv_t<T>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T *;
+        using reference = T &;
+
+        iterator() = default;
+        iterator(T *ptr, difference_type stride)
+            : ptr_{ptr}
+            , stride_{stride} {}
+
+        reference operator*() const { return *ptr_; }
+        reference operator[](difference_type n) const { return ptr_[n * stride_]; }
+
+        iterator &operator++() {
+            ptr_ += stride_;
+            return *this;
+        }
+        iterator operator++(int) {
+            auto it{*this};
+            ptr_ += stride_;
+            return it;
+        }
+        iterator &operator--() {
+            ptr_ -= stride_;
+            return *this;
+        }
+        iterator operator--(int) {
+            auto it{*this};
+            ptr_ -= stride_;
+            return it;
+        }
+        iterator &operator+=(difference_type n) {
+            ptr_ += n * stride_;
+            return *this;
+        }
+        iterator &operator-=(difference_type n) {
+            ptr_ -= n * stride_;
+            return *this;
+        }
+
+        friend iterator operator+(iterator it, difference_type n) { return it += n; }
+        friend iterator operator+(difference_type n, iterator it) { return it += n; }
+        friend iterator operator-(iterator it, difference_type n) { return it -= n; }
+        friend difference_type operator-(const iterator &lhs, const iterator &rhs) {
+            return (lhs.ptr_ - rhs.ptr_) / lhs.stride_;
+        }
+
+        friend bool operator==(const iterator &lhs, const iterator &rhs) {
+            return lhs.ptr_ == rhs.ptr_;
+        }
+        friend auto operator<=>(const iterator &lhs, const iterator &rhs) {
+            return lhs.ptr_ <=> rhs.ptr_;
+        }
+
+      private:
+        T *ptr_{nullptr};
+        difference_type stride_{1};
+    };
+
+    StridedSpan() = default;
+
+    StridedSpan(T *data, size_t size, size_t stride)
+        : data_{data}
+        , size_{size}
+        , stride_{stride} {}
+
+    [[nodiscard]] T &operator[](size_t i) const { return data_[i * stride_]; }
+    [[nodiscard]] size_t size() const noexcept { return size_; }
+    [[nodiscard]] size_t stride() const noexcept { return stride_; }
+    [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+    [[nodiscard]] T *data() const noexcept { return data_; }
+
+    [[nodiscard]] iterator begin() const {
+        return {data_, static_cast<std::ptrdiff_t>(stride_)};
+    }
+    [[nodiscard]] iterator end() const {
+        return {data_ + size_ * stride_, static_cast<std::ptrdiff_t>(stride_)};
+    }
+
+  private:
+    T *data_{nullptr};
+    size_t size_{0};
+    size_t stride_{1};
+};
+
+/// @brief view on the I-th coordinate of an array of points, without a copy. The coordinates
+/// are strided in memory, sizeof(T) apart, so the view does not vectorize like a contiguous
+/// plane; kernels that want one copy the points into PointPlanes.
+/// @example
+/// auto xs{we::strided_lane<0>(pcd.points())}; // xs[i] == pcd[i].x()
+template <int I, typename T>
+    requires(I < std::remove_cv_t<T>::Size)
+[[nodiscard]] auto strided_lane(std::span<T> pts) {
+    using scalar_t = std::conditional_t<std::is_const_v<T>,
+                                        const typename std::remove_cv_t<T>::scalar_type,
+                                        typename std::remove_cv_t<T>::scalar_type>;
+    constexpr size_t stride{sizeof(T) / sizeof(scalar_t)};
+    static_assert(stride * sizeof(scalar_t) == sizeof(T), "point type must be tightly packed");
+
+    if(pts.empty()) {
+        return StridedSpan<scalar_t>{};
+    }
+
+    return StridedSpan<scalar_t>{&pts.front().d_[I], pts.size(), stride};
+}
+
+/// @brief structure-of-arrays point storage: one aligned plane per coordinate.
+/// Each plane is padded with zeros up to a multiple of the SIMD lane count,
+/// so kernels may process whole registers without a scalar tail.
+/// Point clouds keep their points as an array of points; the planes are a copy of them, made by
+/// assign() and written back by store(), one pass over the points each.
+/// @example
+/// PointPlanes<Point3f> planes{pcd.points()}; // AoS -> SoA, copies the points
+/// for(auto &&z : planes.z()) { z += 1.0f; }
+/// planes.store(pcd.points());                // SoA -> AoS
+template <typename T>
+    requires(T::nCols == 1)
+class PointPlanes {
+  public:
+    using point_type = T;
+    using scalar_type = typename T::scalar_type;
+    using plane_type = aligned_vector<scalar_type>;
+    using span_type = std::span<scalar_type>;
+    using const_span_type = std::span<const scalar_type>;
+
+    constexpr static int nPlanes{T::nRows};
+    constexpr static size_t Alignment{64};
+    constexpr static size_t Lanes{Alignment / sizeof(scalar_type)};
+
+    PointPlanes() = default;
+
+    explicit PointPlanes(size_t size) { resize(size); }
+
+    explicit PointPlanes(std::span<const point_type> pts) { assign(pts); }
+
+    PointPlanes(const PointPlanes &) = default;
+    PointPlanes(PointPlanes &&) noexcept = default;
+
+    PointPlanes &operator=(const PointPlanes &) = default;
+    PointPlanes &operator=(PointPlanes &&) noexcept = default;
+
+    void resize(size_t size) {
+        const size_t padded{(size + Lanes - 1) / Lanes * Lanes};
+
+        for(auto &&plane : planes_) {
+            plane.resize(padded);
+            std::fill(plane.begin() + static_cast<std::ptrdiff_t>(std::min(size, size_)),
+                      plane.end(), scalar_type{0});
+        }
+
+        size_ = size;
+    }
+
+    void clear() noexcept {
+        for(auto &&plane : planes_) {
+            plane.clear();
+        }
+        size_ = 0;
+    }
+
+    [[nodiscard]] size_t size() const noexcept { return size_; }
+    [[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+
+    /// @brief size of the planes including the zero padding, a multiple of Lanes
+    [[nodiscard]] size_t padded_size() const noexcept { return planes_[0].size(); }
+
+    template <int I> [[nodiscard]] span_type plane() noexcept {
+        static_assert(I < nPlanes);
+        return {planes_[I].data(), size_};
+    }
+
+    template <int I> [[nodiscard]] const_span_type plane() const noexcept {
+        static_assert(I < nPlanes);
+        return {planes_[I].data(), size_};
+    }
+
+    [[nodiscard]] span_type plane(int i) {
+        assert_true([&]() { return i >= 0 and i < nPlanes; }, "wrong plane index");
+        return {planes_[i].data(), size_};
+    }
+
+    [[nodiscard]] const_span_type plane(int i) const {
+        assert_true([&]() { return i >= 0 and i < nPlanes; }, "wrong plane index");
+        return {planes_[i].data(), size_};
+    }
+
+    [[nodiscard]] span_type x() noexcept { return plane<0>(); }
+    [[nodiscard]] const_span_type x() const noexcept { return plane<0>(); }
+    [[nodiscard]] span_type y() noexcept { return plane<1>(); }
+    [[nodiscard]] const_span_type y() const noexcept { return plane<1>(); }
+    [[nodiscard]] span_type z() noexcept { return plane<2>(); }
+    [[nodiscard]] const_span_type z() const noexcept { return plane<2>(); }
+
+    [[nodiscard]] point_type point(size_t i) const {
+        point_type pt;
+
+        for(int k{0}; k < nPlanes; ++k) {
+            pt.d_[k] = planes_[k][i];
+        }
+
+        return pt;
+    }
+
+    void set_point(size_t i, const point_type &pt) {
+        for(int k{0}; k < nPlanes; ++k) {
+            planes_[k][i] = pt.d_[k];
+        }
+    }
+
+    /// @brief AoS-like read view on the planes, points are gathered from them on access
+    [[nodiscard]] auto points() const {
+        return std::views::iota(size_t{0}, size_) |
+               std::views::transform([this](size_t i) { return point(i); });
+    }
+
+    /// @brief AoS -> SoA, one sequential pass per plane
+    void assign(std::span<const point_type> pts) {
+        resize(pts.size());
+
+        for(int k{0}; k < nPlanes; ++k) {
+            scalar_type *dst{planes_[k].data()};
+
+            for(size_t i{0}; i < size_; ++i) {
+                dst[i] = pts[i].d_[k];
+            }
+        }
+    }
+
+    /// @brief SoA -> AoS
+    void store(std::span<point_type> pts) const {
+        assert_true([&]() { return pts.size() == size_; }, "wrong point cloud size");
+
+        for(int k{0}; k < nPlanes; ++k) {
+            const scalar_type *src{planes_[k].data()};
+
+            for(size_t i{0}; i < size_; ++i) {
+                pts[i].d_[k] = src[i];
+            }
+        }
+    }
+
+  private:
+    std::array<plane_type, nPlanes> planes_;
+    size_t size_{0};
+};
+
+using PointPlanes3f = PointPlanes<Point3f>;
+
+} // namespace we
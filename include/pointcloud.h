@@ -1,19 +1,24 @@
 #pragma once
+#include "parallel.h"
 #include "point.h"
+#include "point_planes.h"
 #include "we_assert.h"
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <cstdio>
 #include <fstream>
 #include <iterator>
 #include <limits>
 #include <memory>
+#include <numeric>
 #include <optional>
 #include <ranges>
 #include <span>
 #include <string>
 #include <string_view>
 #include <type_traits>
+#include <typeinfo>
 #include <vector>
 
 namespace we {
@@ -52,6 +57,15 @@ using prop_opt_vector_t = std::optional<std::vector<typename prop_traits<name>::
 
 template <we::Prop name> constexpr inline std::string_view prop_traits_v = prop_traits<name>::tag;
 
+/// @brief type name a property of T is tagged with, as the prebuilt library spells it
+template <typename T> [[nodiscard]] inline const char *property_type_name() noexcept {
+#if defined(_MSC_VER)
+    return typeid(T).raw_name();
+#else
+    return typeid(T).name();
+#endif
+}
+
 } // namespace detail
 
 struct BaseProperty {
@@ -109,6 +123,84 @@ template <typename T> class Property : public BaseProperty {
     vector_type data_;
 };
 
+// The operations below are not virtual: properties made by the prebuilt library only have the
+// vtable of BaseProperty it was built with. They find the value type by its name instead.
+namespace detail {
+
+/// @brief calls f(prop) with p cast to the Property<T> of the first of Types it holds,
+/// false if it holds none of them
+template <typename... Types, typename F>
+[[nodiscard]] bool visit_property_as(const BaseProperty &p, F &&f) {
+    return ((p.type_name_ == property_type_name<Types>() and
+             (f(static_cast<const Property<Types> &>(p)), true)) or
+            ...);
+}
+
+/// @brief visit_property_as() over the value types of the typed properties, the arithmetic
+/// types and the point types
+template <typename F> [[nodiscard]] bool visit_property(const BaseProperty &p, F &&f) {
+    return visit_property_as<uint8_t, int8_t, uint16_t, int16_t, uint32_t, int32_t, uint64_t,
+                             int64_t, float, double, Point3f, Point3d, Point3i, Point3ub>(
+        p, std::forward<F>(f));
+}
+
+/// @brief property of the same name and type as p holding n default values, nullptr if
+/// visit_property() does not know its type
+[[nodiscard]] inline std::unique_ptr<BaseProperty> clone_empty(const BaseProperty &p, size_t n) {
+    std::unique_ptr<BaseProperty> res;
+
+    static_cast<void>(visit_property(p, [&]<typename T>(const Property<T> &src) {
+        res = std::make_unique<Property<T>>(src.name_, src.type_name_, std::vector<T>(n));
+    }));
+
+    return res;
+}
+
+/// @brief copies the elements i of [first, last) of src with mask[i] != 0 to dst, starting at
+/// dst_first. dst has to be made by clone_empty(src)
+inline void compact_to(const BaseProperty &src, BaseProperty &dst, std::span<const uint8_t> mask,
+                       size_t first, size_t last, size_t dst_first) {
+    static_cast<void>(visit_property(src, [&]<typename T>(const Property<T> &from) {
+        const auto in{from.data()};
+        const auto out{static_cast<Property<T> &>(dst).data()};
+
+        for(size_t i{first}; i < last; ++i) {
+            if(mask[i] != 0) {
+                out[dst_first++] = in[i];
+            }
+        }
+    }));
+}
+
+/// @brief copies the elements [first, last) of src to dst, starting at dst_first. dst has to be
+/// of the same type
+inline void copy_to(const BaseProperty &src, BaseProperty &dst, size_t first, size_t last,
+                    size_t dst_first) {
+    static_cast<void>(visit_property(src, [&]<typename T>(const Property<T> &from) {
+        const auto in{from.data()};
+        std::copy(in.begin() + static_cast<std::ptrdiff_t>(first),
+                  in.begin() + static_cast<std::ptrdiff_t>(last),
+                  static_cast<Property<T> &>(dst).data().begin() +
+                      static_cast<std::ptrdiff_t>(dst_first));
+    }));
+}
+
+/// @brief copies the elements order[i] of src to dst[i] for i of [first, last). dst has to be
+/// made by clone_empty(src)
+inline void gather_to(const BaseProperty &src, BaseProperty &dst, std::span<const uint32_t> order,
+                      size_t first, size_t last) {
+    static_cast<void>(visit_property(src, [&]<typename T>(const Property<T> &from) {
+        const auto in{from.data()};
+        const auto out{static_cast<Property<T> &>(dst).data()};
+
+        for(size_t i{first}; i < last; ++i) {
+            out[i] = in[order[i]];
+        }
+    }));
+}
+
+} // namespace detail
+
 template <typename T> class PropertyHandle {
   public:
     using value_type = T;
@@ -144,7 +236,7 @@ class PropertyContainer {
         properties_.resize(rhs.properties_.size());
 
         std::transform(rhs.properties_.cbegin(), rhs.properties_.cend(), properties_.begin(),
-                       [](auto &&val) { return val->clone(); });
+                       [](auto &&val) { return val ? val->clone() : nullptr; });
 
         return *this;
     }
@@ -153,24 +245,19 @@ class PropertyContainer {
         return add<T>(name, {});
     }
 
+    /// @brief adds a property, a property with the same name and type is replaced in its slot
     template <typename T>
     [[nodiscard]] PropertyHandle<T> add(const std::string_view name,
                                         PropertyHandle<T>::vector_type &&data) {
-        const auto it{std::find_if(properties_.begin(), properties_.end(),
-                                   [](auto &&val) { return not val; })};
-        int ind{0};
+        auto prop{std::make_unique<Property<T>>(name, detail::property_type_name<T>(),
+                                                std::move(data))};
 
-        if(it != properties_.end()) {
-            ind = static_cast<int>(std::distance(properties_.begin(), properties_.end()));
-            properties_[ind] =
-                std::make_unique<Property<T>>(name, typeid(T).raw_name(), std::move(data));
-        } else {
-            ind = static_cast<int>(properties_.size());
-            properties_.emplace_back(
-                std::make_unique<Property<T>>(name, typeid(T).raw_name(), std::move(data)));
+        if(const int found{find(prop->name_, prop->type_name_)}; found != -1) {
+            properties_[found] = std::move(prop);
+            return PropertyHandle<T>{found};
         }
 
-        return PropertyHandle<T>{ind};
+        return PropertyHandle<T>{insert(std::move(prop))};
     }
 
     template <typename T> [[nodiscard]] Property<T> &property(PropertyHandle<T> ph) {
@@ -179,7 +266,7 @@ class PropertyContainer {
             [&ph, this]() {
                 return ph.indx() >= 0 and ph.indx() < static_cast<int>(properties_.size()) and
                        properties_[ph.indx()] != nullptr and
-                       properties_[ph.indx()]->type_name_ == typeid(T).raw_name();
+                       properties_[ph.indx()]->type_name_ == detail::property_type_name<T>();
             },
             "invalid property handle");
 
@@ -192,7 +279,7 @@ class PropertyContainer {
             [&ph, this]() {
                 return ph.indx() >= 0 and ph.indx() < static_cast<int>(properties_.size()) and
                        properties_[ph.indx()] != nullptr and
-                       properties_[ph.indx()]->type_name_ == typeid(T).raw_name();
+                       properties_[ph.indx()]->type_name_ == detail::property_type_name<T>();
             },
             "invalid property handle");
 
@@ -201,20 +288,7 @@ class PropertyContainer {
 
     template <typename T>
     [[nodiscard]] PropertyHandle<T> handle(const std::string_view name) const noexcept {
-        const auto it{std::find_if(properties_.begin(), properties_.end(),
-                                   [&name](const std::unique_ptr<BaseProperty> &p) {
-                                       if(p and p->name_ == std::string{name} and
-                                          p->type_name_ == typeid(T).raw_name()) {
-                                           return true;
-                                       }
-                                       return false;
-                                   })};
-
-        if(it != properties_.end()) {
-            return PropertyHandle<T>{static_cast<int>(std::distance(properties_.begin(), it))};
-        }
-
-        return PropertyHandle<T>{};
+        return PropertyHandle<T>{find(name, detail::property_type_name<T>())};
     }
 
     template <typename T> void remove(PropertyHandle<T> ph) {
@@ -238,7 +312,127 @@ class PropertyContainer {
 
     void clear() { properties_.clear(); }
 
+    /// @brief container with the same properties in the same slots, each holding n values.
+    /// Properties of types detail::visit_property() does not know are left out
+    [[nodiscard]] PropertyContainer clone_empty(size_t n) const {
+        PropertyContainer res;
+        res.properties_.resize(properties_.size());
+
+        std::transform(properties_.cbegin(), properties_.cend(), res.properties_.begin(),
+                       [n](auto &&val) { return val ? detail::clone_empty(*val, n) : nullptr; });
+
+        return res;
+    }
+
+    /// @brief whether detail::visit_property() knows the types of all properties, only then
+    /// clone_empty() leaves none of them out
+    [[nodiscard]] bool known_types() const {
+        return std::ranges::all_of(properties_, [](auto &&p) {
+            return not p or detail::visit_property(*p, [](auto &&) {});
+        });
+    }
+
+    /// @brief detail::compact_to() for every property, dst must come from clone_empty()
+    void compact_to(PropertyContainer &dst, std::span<const uint8_t> mask, size_t first,
+                    size_t last, size_t dst_first) const {
+
+        for(size_t i{0}; i < properties_.size(); ++i) {
+            if(properties_[i] and dst.properties_[i]) {
+                detail::compact_to(*properties_[i], *dst.properties_[i], mask, first, last,
+                                   dst_first);
+            }
+        }
+    }
+
+    /// @brief detail::gather_to() for every property, dst must come from clone_empty()
+    void gather_to(PropertyContainer &dst, std::span<const uint32_t> order, size_t first,
+                   size_t last) const {
+        for(size_t i{0}; i < properties_.size(); ++i) {
+            if(properties_[i] and dst.properties_[i]) {
+                detail::gather_to(*properties_[i], *dst.properties_[i], order, first, last);
+            }
+        }
+    }
+
+    /// @brief calls f(const BaseProperty &) for every property in slot order
+    template <typename F> void for_each(F &&f) const {
+        for(auto &&p : properties_) {
+            if(p) {
+                f(static_cast<const BaseProperty &>(*p));
+            }
+        }
+    }
+
+    /// @brief adds the properties of src missing here, each holding n default values. As in
+    /// clone_empty(), properties of unknown types are left out
+    void add_missing(const PropertyContainer &src, size_t n) {
+        for(auto &&p : src.properties_) {
+            if(p and find(p->name_, p->type_name_) == -1) {
+                if(auto prop{detail::clone_empty(*p, n)}; prop) {
+                    static_cast<void>(insert(std::move(prop)));
+                }
+            }
+        }
+    }
+
+    /// @brief detail::copy_to() for every property of a known type into the property of dst
+    /// with the same name and type, which has to exist, e.g. added by add_missing(). The
+    /// properties named except are left out.
+    void copy_to(PropertyContainer &dst, size_t first, size_t last, size_t dst_first,
+                 const std::string_view except = {}) const {
+        for(auto &&p : properties_) {
+            if(not p or (not except.empty() and p->name_ == except) or
+               not detail::visit_property(*p, [](auto &&) {})) {
+                continue;
+            }
+
+            const int found{dst.find(p->name_, p->type_name_)};
+            assert_true([&]() { return found != -1; }, "missing property");
+            detail::copy_to(*p, *dst.properties_[found], first, last, dst_first);
+        }
+    }
+
+    /// @brief whether both containers hold properties of the same names and types, in any slots
+    [[nodiscard]] bool same_properties(const PropertyContainer &other) const noexcept {
+        const auto contains{[](const PropertyContainer &a, const PropertyContainer &b) {
+            return std::ranges::all_of(a.properties_, [&](auto &&p) {
+                return not p or b.find(p->name_, p->type_name_) != -1;
+            });
+        }};
+
+        return contains(*this, other) and contains(other, *this);
+    }
+
   private:
+    /// @brief slot of the property name of type type_name, -1 if there is none. A cloud holds a
+    /// handful of properties, the scan compares views and allocates nothing
+    [[nodiscard]] int find(const std::string_view name,
+                           const std::string_view type_name) const noexcept {
+        for(size_t i{0}; i < properties_.size(); ++i) {
+            const auto &p{properties_[i]};
+
+            if(p and p->type_name_ == type_name and p->name_ == name) {
+                return static_cast<int>(i);
+            }
+        }
+
+        return -1;
+    }
+
+    /// @brief puts prop into the first free slot or appends it, returns the slot
+    [[nodiscard]] int insert(std::unique_ptr<BaseProperty> prop) {
+        const auto it{std::find_if(properties_.begin(), properties_.end(),
+                                   [](auto &&val) { return not val; })};
+
+        if(it != properties_.end()) {
+            *it = std::move(prop);
+            return static_cast<int>(std::distance(properties_.begin(), it));
+        }
+
+        properties_.emplace_back(std::move(prop));
+        return static_cast<int>(properties_.size()) - 1;
+    }
+
     std::vector<std::unique_ptr<BaseProperty>> properties_;
 };
 
@@ -303,6 +497,129 @@ template <typename T> class PointCloudBase {
         return data_owned_.empty() and data_not_owned_.empty();
     }
 
+    /// @brief strided view on the I-th coordinate of the points, see we::strided_lane()
+    template <int I> [[nodiscard]] auto strided_lane() noexcept {
+        return we::strided_lane<I>(points());
+    }
+
+    template <int I> [[nodiscard]] auto strided_lane() const noexcept {
+        return we::strided_lane<I>(points());
+    }
+
+    /// @brief copies the points into structure-of-arrays planes
+    [[nodiscard]] PointPlanes<point_type> planes() const {
+        return PointPlanes<point_type>{points()};
+    }
+
+    /// @brief writes the planes back into the points, sizes must match
+    void store(const PointPlanes<point_type> &planes) { planes.store(points()); }
+
+    /// @brief replaces this cloud by the points of src with mask[i] != 0 together with all
+    /// their properties, typed and custom, keeping the order. src may be *this.
+    /// The values are copied by type, so every property has to hold one of the arithmetic or
+    /// point types of detail::visit_property(); a property of another type throws instead of
+    /// being dropped. Runs a count pass over the mask, a prefix sum over the bands and a single
+    /// parallel scatter pass over points and properties.
+    void assign_compacted(const PointCloudBase &src, std::span<const uint8_t> mask,
+                          size_t threads = 0) {
+        assert_true([&]() { return mask.size() == src.size(); }, "wrong mask size");
+        assert_true([&]() { return src.prop_container_.known_types(); },
+                    "property of an unknown type");
+
+        const auto src_pts{src.points()};
+        const size_t n{src_pts.size()};
+        const size_t bands{band_count(n, threads)};
+        std::vector<size_t> offsets(bands + 1, 0);
+
+        parallel_for_bands(n, bands, [&](size_t band, size_t first, size_t last) {
+            offsets[band + 1] = static_cast<size_t>(
+                std::count_if(mask.begin() + first, mask.begin() + last,
+                              [](uint8_t val) { return val != 0; }));
+        });
+
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+        vector_type pts(offsets.back());
+        PropertyContainer props{src.prop_container_.clone_empty(offsets.back())};
+
+        parallel_for_bands(n, bands, [&](size_t band, size_t first, size_t last) {
+            size_t out{offsets[band]};
+
+            for(size_t i{first}; i < last; ++i) {
+                if(mask[i] != 0) {
+                    pts[out++] = src_pts[i];
+                }
+            }
+
+            src.prop_container_.compact_to(props, mask, first, last, offsets[band]);
+        });
+
+        data_owned_ = std::move(pts);
+        data_not_owned_ = {};
+        prop_container_ = std::move(props);
+    }
+
+    /// @brief replaces this cloud by the points order[i] of src together with all their
+    /// properties, typed and custom. order may repeat or leave out points; src must not be
+    /// *this. As in assign_compacted(), a property of a type detail::visit_property() does not
+    /// know throws. Runs a single parallel gather pass over points and properties.
+    void assign_gathered(const PointCloudBase &src, std::span<const uint32_t> order,
+                         size_t threads = 0) {
+        assert_true([&, this]() { return &src != this; }, "gather into the source");
+        assert_true([&]() { return src.prop_container_.known_types(); },
+                    "property of an unknown type");
+
+        const auto src_pts{src.points()};
+        vector_type pts(order.size());
+        PropertyContainer props{src.prop_container_.clone_empty(order.size())};
+
+        parallel_for(
+            order.size(),
+            [&](size_t first, size_t last) {
+                for(size_t i{first}; i < last; ++i) {
+                    pts[i] = src_pts[order[i]];
+                }
+
+                src.prop_container_.gather_to(props, order, first, last);
+            },
+            threads);
+
+        data_owned_ = std::move(pts);
+        data_not_owned_ = {};
+        prop_container_ = std::move(props);
+    }
+
+    /// @brief the typed and custom properties of the points
+    [[nodiscard]] const PropertyContainer &properties() const noexcept { return prop_container_; }
+
+    /// @brief adds the properties of src this cloud does not have yet, default initialized
+    void add_properties_of(const PointCloudBase &src) {
+        prop_container_.add_missing(src.prop_container_, size());
+    }
+
+    /// @brief copies points [first, last) of src with their properties into this cloud,
+    /// starting at dst_first. This cloud needs all properties of src, see add_properties_of();
+    /// disjoint ranges may be copied concurrently.
+    void copy_range(const PointCloudBase &src, size_t first, size_t last, size_t dst_first) {
+        assert_true(
+            [&, this]() {
+                return first <= last and last <= src.size() and dst_first + last - first <= size();
+            },
+            "wrong copy range");
+
+        const auto src_pts{src.points()};
+        std::copy(src_pts.begin() + static_cast<std::ptrdiff_t>(first),
+                  src_pts.begin() + static_cast<std::ptrdiff_t>(last),
+                  points().begin() + static_cast<std::ptrdiff_t>(dst_first));
+        copy_properties(src, first, last, dst_first);
+    }
+
+    /// @brief as copy_range() for the properties only, the properties named except are left out
+    void copy_properties(const PointCloudBase &src, size_t first, size_t last, size_t dst_first,
+                         const std::string_view except = {}) {
+        src.prop_container_.copy_to(prop_container_, first, last, dst_first, except);
+    }
+
     template <we::Prop name> PropertyHandle<detail::prop_traits_t<name>> add_property() {
         auto ph{prop_container_.add<detail::prop_traits_t<name>>(detail::prop_traits_v<name>)};
         prop_container_.resize(size());
@@ -561,44 +878,23 @@ template <typename T> class StructuredPointCloud : public PointCloudBase<T> {
         Base::create(std::move(vec));
     }
 
-    PointCloud<T> pointcloud() const {
-        std::vector<T> pts;
-        pts.reserve(this->size());
-
+    /// @brief unstructured cloud of the valid points with all their properties
+    /// @param threads number of threads, 0 - all hardware threads
+    PointCloud<T> pointcloud(size_t threads = 0) const {
         const auto _points{this->points()};
+        std::vector<uint8_t> mask(_points.size());
 
-        for(auto &&p :
-            _points | std::views::filter([this](auto &&val) { return val != empty_value_; })) {
-            pts.push_back(p);
-        }
-
-        pts.shrink_to_fit();
-        PointCloud<T> ret{std::move(pts)};
-
-        auto copy_property{[this, &_points, &ret]<we::Prop name>() {
-            if(auto vals{this->template property<name>()}; vals) {
-                using val_t = detail::prop_traits_t<name>;
-                std::vector<val_t> _vals;
-                _vals.reserve(this->size());
-
-                for(auto &&i : std::views::iota(0ull, this->size())) {
-
-                    if(_points[i] == empty_value_) {
-                        continue;
-                    }
-
-                    _vals.push_back((*vals)[i]);
+        parallel_for(
+            _points.size(),
+            [&](size_t first, size_t last) {
+                for(size_t i{first}; i < last; ++i) {
+                    mask[i] = _points[i] != empty_value_ ? 1 : 0;
                 }
+            },
+            threads);
 
-                _vals.shrink_to_fit();
-                ret.add_property<name>(std::move(_vals));
-            }
-        }};
-
-        [&copy_property]<int... I>(std::integer_sequence<int, I...>) {
-            ((copy_property.template operator()<static_cast<we::Prop>(I)>()), ...);
-        }(std::make_integer_sequence<int, static_cast<int>(we::Prop::LAST_PROP)>{});
-
+        PointCloud<T> ret;
+        ret.assign_compacted(*this, mask, threads);
         return ret;
     }
 
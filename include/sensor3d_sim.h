@@ -0,0 +1,446 @@
+#pragma once
+#include "point.h"
+#include "pointcloud.h"
+#include "roi.h"
+#include "sensor3d_connector.h"
+#include "we_assert.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <format>
+#include <future>
+#include <map>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace we {
+
+/// @brief how a 3D sensor is reached: string commands as sent by Sensor3d
+/// ("SetExposureTime=70000\r" writes, "GetPixelXMax" queries) and point cloud frames
+class SensorTransport {
+  public:
+    SensorTransport() = default;
+    SensorTransport(const SensorTransport &) = delete;
+    SensorTransport &operator=(const SensorTransport &) = delete;
+    virtual ~SensorTransport() = default;
+
+    virtual void write(const std::string_view command) = 0;
+    [[nodiscard]] virtual std::string read(const std::string_view query) = 0;
+
+    /// @brief waits for the next frame and copies its roi (whole frame if empty) into pcd,
+    /// reusing the buffers of pcd when the size does not change
+    virtual void grab(StructuredPointCloud3f &pcd, Roi2ui roi) = 0;
+};
+
+/// @brief Sensor3d command interface on top of any SensorTransport
+/// @example
+/// LoopbackSensorServer server{SimulatedSensorSettings{}};
+/// LoopbackTransport transport{server};
+/// SensorClient sensor{transport};
+/// sensor.set<cmd::TRIGGER_SOURCE>(TriggerSource::SOFTWRARE);
+/// sensor.set<cmd::ACQUISITION_START>();
+/// sensor.set<cmd::SET_TRIGGER_SOFTWARE>();
+/// auto pcd{sensor.get_pointcloud()};
+class SensorClient {
+  public:
+    explicit SensorClient(SensorTransport &transport)
+        : transport_{transport} {}
+
+    template <typename T> [[nodiscard]] T get(const std::string_view param_str) const {
+        return detail::string_to_val<T>(transport_.read(param_str));
+    }
+
+    template <we::cmd name> [[nodiscard]] auto get() const {
+        return get<typename detail::param_traits<name>::param_type>(
+            detail::param_traits<name>::param_str);
+    }
+
+    template <typename T> void set(T param, const std::string_view param_str) const {
+        transport_.write(std::format("{}={}\r", param_str.data(), detail::val_to_string(param)));
+    }
+
+    template <we::cmd name>
+        requires(not std::is_void_v<typename detail::param_traits<name>::param_type>)
+    void set(typename detail::param_traits<name>::param_type param) const {
+        set(param, detail::param_traits<name>::param_str);
+    }
+
+    template <we::cmd name>
+        requires(std::is_void_v<typename detail::param_traits<name>::param_type>)
+    void set() const {
+        transport_.write(detail::param_traits<name>::param_str);
+    }
+
+    [[nodiscard]] StructuredPointCloud3f get_pointcloud(Roi2ui roi = Roi2ui{}) {
+        StructuredPointCloud3f pcd;
+        transport_.grab(pcd, roi);
+        return pcd;
+    }
+
+    /// @brief fills pcd in place, no allocation if the frame size does not change
+    void get_pointcloud(StructuredPointCloud3f &pcd, Roi2ui roi = Roi2ui{}) {
+        transport_.grab(pcd, roi);
+    }
+
+  private:
+    SensorTransport &transport_;
+};
+
+/// @brief FrameSource for AcquisitionStream triggering a SensorClient by software
+class SensorClientSource {
+  public:
+    explicit SensorClientSource(SensorClient &sensor, Roi2ui roi = Roi2ui{},
+                                bool software_trigger = true)
+        : sensor_{sensor}
+        , roi_{roi}
+        , software_trigger_{software_trigger} {}
+
+    void grab(StructuredPointCloud3f &pcd) {
+        if(software_trigger_) {
+            sensor_.set<cmd::SET_TRIGGER_SOFTWARE>();
+        }
+
+        sensor_.get_pointcloud(pcd, roi_);
+    }
+
+  private:
+    SensorClient &sensor_;
+    Roi2ui roi_;
+    bool software_trigger_;
+};
+
+struct SimulatedSensorSettings {
+    size_t width_{2448};
+    size_t height_{2048};
+    /// frames per second delivered while acquiring
+    double frame_rate_{10.0};
+    /// share of synthetic pixels without a measurement
+    float hole_fraction_{0.05f};
+    /// standard deviation of the synthetic depth noise, mm
+    float noise_{0.05f};
+    Point3f empty_value_{0.0f, 0.0f, 0.0f};
+    /// frames replayed in a loop instead of the synthetic scene
+    std::vector<StructuredPointCloud3f> recorded_;
+    /// artificial processing time of every command
+    std::chrono::microseconds command_delay_{0};
+};
+
+/// @brief in-process stand-in for a sensor. Commands are answered by a server thread and
+/// frames are released by a streaming thread at the configured rate: free-running after
+/// SetAcquisitionStart with the internal trigger, one per SetTriggerSoftware otherwise.
+/// Only commands of PARAM_NAME_INFO are accepted. Set values are stored and returned by the
+/// matching queries; GetPixelXMax/GetPixelYMax report the frame size and the camera parameter
+/// queries answer with placeholders unless set_response() provides recorded device answers.
+class LoopbackSensorServer {
+  public:
+    struct FrameToken {
+        size_t index_;
+        uint64_t sequence_;
+        std::chrono::steady_clock::time_point time_;
+    };
+
+    explicit LoopbackSensorServer(SimulatedSensorSettings set)
+        : set_{std::move(set)} {
+        assert_true([this]() { return set_.frame_rate_ > 0.0; }, "wrong frame rate");
+
+        if(set_.recorded_.empty()) {
+            set_.recorded_.push_back(synthetic_frame());
+        }
+
+        const auto &frame{set_.recorded_.front()};
+        responses_[std::string{detail::param_traits<cmd::PIXEL_X_MAX>::param_str}] =
+            std::to_string(frame.width());
+        responses_[std::string{detail::param_traits<cmd::PIXEL_Y_MAX>::param_str}] =
+            std::to_string(frame.height());
+        responses_[std::string{detail::param_traits<cmd::EXTRINSIC_MATRIX>::param_str}] =
+            "1 0 0 0 0 1 0 0 0 0 1 0 0 0 0 1";
+        responses_[std::string{detail::param_traits<cmd::INTRINSIC_MATRIX>::param_str}] =
+            std::format("2000 0 {} 0 2000 {} 0 0 1 0 0 0 0 0", frame.width() / 2,
+                        frame.height() / 2);
+
+        server_ = std::jthread{[this](std::stop_token st) { serve(st); }};
+        streamer_ = std::jthread{[this](std::stop_token st) { stream(st); }};
+    }
+
+    LoopbackSensorServer(const LoopbackSensorServer &) = delete;
+    LoopbackSensorServer(LoopbackSensorServer &&) = delete;
+    LoopbackSensorServer &operator=(const LoopbackSensorServer &) = delete;
+    LoopbackSensorServer &operator=(LoopbackSensorServer &&) = delete;
+
+    ~LoopbackSensorServer() {
+        server_.request_stop();
+        streamer_.request_stop();
+        {
+            std::scoped_lock lock{mutex_};
+        }
+        cv_.notify_all();
+    }
+
+    /// @brief answer of a query, e.g. a recorded GetIntrinsicCameraParameters reply
+    void set_response(const std::string_view name, std::string value) {
+        std::scoped_lock lock{mutex_};
+        responses_[std::string{name}] = std::move(value);
+    }
+
+    /// @brief sends a command to the server thread and waits for the reply.
+    /// Throws std::runtime_error for commands the sensor does not know.
+    [[nodiscard]] std::string request(const std::string_view command) {
+        std::promise<std::string> reply;
+        auto result{reply.get_future()};
+
+        {
+            std::scoped_lock lock{mutex_};
+            requests_.emplace_back(std::string{command}, std::move(reply));
+        }
+        cv_.notify_all();
+
+        auto answer{result.get()};
+
+        if(answer.starts_with("ERROR")) {
+            throw std::runtime_error{answer};
+        }
+
+        return answer;
+    }
+
+    /// @brief waits for the next released frame, throws if none arrives within timeout
+    [[nodiscard]] FrameToken next_frame(
+        std::chrono::milliseconds timeout = std::chrono::milliseconds{5000}) {
+        std::unique_lock lock{mutex_};
+
+        if(not cv_.wait_for(lock, timeout, [this]() { return not frames_.empty(); })) {
+            throw std::runtime_error{"frame timeout"};
+        }
+
+        const auto token{frames_.front()};
+        frames_.pop_front();
+        return token;
+    }
+
+    [[nodiscard]] const StructuredPointCloud3f &frame(size_t index) const {
+        return set_.recorded_[index];
+    }
+
+  private:
+    [[nodiscard]] StructuredPointCloud3f synthetic_frame() const {
+        StructuredPointCloud3f pcd;
+        pcd.create(set_.width_, set_.height_, set_.empty_value_);
+
+        std::mt19937 rng{42};
+        std::normal_distribution<float> noise{0.0f, std::max(set_.noise_, 1e-9f)};
+        std::uniform_real_distribution<float> uniform{0.0f, 1.0f};
+        const float cx{0.5f * static_cast<float>(set_.width_)};
+        const float cy{0.5f * static_cast<float>(set_.height_)};
+
+        for(size_t i{0}; i < set_.height_; ++i) {
+            for(size_t j{0}; j < set_.width_; ++j) {
+                if(uniform(rng) < set_.hole_fraction_) {
+                    pcd(i, j) = set_.empty_value_;
+                    continue;
+                }
+
+                const float x{0.1f * (static_cast<float>(j) - cx)};
+                const float y{0.1f * (static_cast<float>(i) - cy)};
+                const float bump{20.0f * std::exp(-(x * x + y * y) / 2000.0f)};
+                pcd(i, j) = Point3f{x, y, 500.0f + 0.1f * x + bump + noise(rng)};
+            }
+        }
+
+        return pcd;
+    }
+
+    [[nodiscard]] static bool is_known(const std::string_view name) {
+#define PARAM_STR_(param_name, T, str) str,
+        constexpr std::array names{PARAM_NAME_INFO(PARAM_STR_)};
+#undef PARAM_STR_
+        return std::ranges::find(names, name) != names.end();
+    }
+
+    [[nodiscard]] static bool is_action(const std::string_view name) {
+#define PARAM_ACTION_(param_name, T, str) std::pair{std::string_view{str}, std::is_void_v<T>},
+        constexpr std::array names{PARAM_NAME_INFO(PARAM_ACTION_)};
+#undef PARAM_ACTION_
+        const auto it{std::ranges::find(names, name, [](auto &&val) { return val.first; })};
+        return it != names.end() and it->second;
+    }
+
+    /// @brief executes a command, called with mutex_ held
+    [[nodiscard]] std::string execute(std::string_view command) {
+        while(not command.empty() and (command.back() == '\r' or command.back() == '\n')) {
+            command.remove_suffix(1);
+        }
+
+        const size_t eq{command.find('=')};
+        const auto name{command.substr(0, eq)};
+
+        if(not is_known(name)) {
+            return std::format("ERROR: unknown command {}", name);
+        }
+
+        if(eq != std::string_view::npos) {
+            const std::string value{command.substr(eq + 1)};
+
+            if(name == detail::param_traits<cmd::TRIGGER_SOURCE>::param_str) {
+                software_trigger_ = value != "0";
+            }
+
+            responses_[std::string{name}] = value;
+            return "OK";
+        }
+
+        if(is_action(name)) {
+            if(name == detail::param_traits<cmd::ACQUISITION_START>::param_str) {
+                acquiring_ = true;
+            } else if(name == detail::param_traits<cmd::ACQUISITION_STOP>::param_str) {
+                acquiring_ = false;
+                pending_triggers_ = 0;
+            } else if(acquiring_) {
+                ++pending_triggers_;
+            }
+            return "OK";
+        }
+
+        const auto it{responses_.find(std::string{name})};
+        return it == responses_.end() ? std::string{"0"} : it->second;
+    }
+
+    void serve(std::stop_token st) {
+        std::unique_lock lock{mutex_};
+
+        while(true) {
+            cv_.wait(lock, st, [this]() { return not requests_.empty(); });
+
+            if(requests_.empty()) {
+                return;
+            }
+
+            auto [command, reply]{std::move(requests_.front())};
+            requests_.pop_front();
+
+            if(set_.command_delay_.count() > 0) {
+                lock.unlock();
+                std::this_thread::sleep_for(set_.command_delay_);
+                lock.lock();
+            }
+
+            reply.set_value(execute(command));
+            cv_.notify_all();
+        }
+    }
+
+    void stream(std::stop_token st) {
+        constexpr size_t max_queued{8};
+        const auto interval{std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>{1.0 / set_.frame_rate_})};
+        auto next_release{std::chrono::steady_clock::now()};
+        uint64_t sequence{0};
+
+        std::unique_lock lock{mutex_};
+
+        while(not st.stop_requested()) {
+            cv_.wait(lock, st, [this]() {
+                return acquiring_ and (not software_trigger_ or pending_triggers_ > 0);
+            });
+
+            if(st.stop_requested()) {
+                return;
+            }
+
+            const auto now{std::chrono::steady_clock::now()};
+
+            if(now < next_release) {
+                cv_.wait_until(lock, st, next_release, []() { return false; });
+                continue;
+            }
+
+            next_release = std::max(next_release + interval, now);
+
+            if(software_trigger_) {
+                --pending_triggers_;
+            }
+
+            if(frames_.size() == max_queued) {
+                frames_.pop_front();
+            }
+
+            frames_.push_back({static_cast<size_t>(sequence % set_.recorded_.size()), sequence,
+                               std::chrono::steady_clock::now()});
+            ++sequence;
+            cv_.notify_all();
+        }
+    }
+
+    SimulatedSensorSettings set_;
+    std::map<std::string, std::string, std::less<>> responses_;
+    std::deque<std::pair<std::string, std::promise<std::string>>> requests_;
+    std::deque<FrameToken> frames_;
+    bool acquiring_{false};
+    bool software_trigger_{false};
+    size_t pending_triggers_{0};
+
+    std::mutex mutex_;
+    std::condition_variable_any cv_;
+    std::jthread server_;
+    std::jthread streamer_;
+};
+
+/// @brief SensorTransport talking to a LoopbackSensorServer in the same process
+class LoopbackTransport : public SensorTransport {
+  public:
+    explicit LoopbackTransport(LoopbackSensorServer &server)
+        : server_{server} {}
+
+    void write(const std::string_view command) override {
+        static_cast<void>(server_.request(command));
+    }
+
+    [[nodiscard]] std::string read(const std::string_view query) override {
+        return server_.request(query);
+    }
+
+    void grab(StructuredPointCloud3f &pcd, Roi2ui roi) override {
+        const auto token{server_.next_frame()};
+        const auto &frame{server_.frame(token.index_)};
+
+        if(roi.width() == 0 or roi.height() == 0) {
+            roi = Roi2ui{0, 0, static_cast<uint32_t>(frame.width()),
+                         static_cast<uint32_t>(frame.height())};
+        }
+
+        assert_true(
+            [&]() {
+                return roi.x() + roi.width() <= frame.width() and
+                       roi.y() + roi.height() <= frame.height();
+            },
+            "roi is out of the frame");
+
+        if(pcd.width() != roi.width() or pcd.height() != roi.height() or
+           pcd.size() != static_cast<size_t>(roi.width()) * roi.height()) {
+            pcd.create(roi.width(), roi.height(), frame.empty_value());
+        }
+
+        pcd.empty_value() = frame.empty_value();
+        const auto src{frame.points()};
+        const auto dst{pcd.points()};
+
+        for(size_t i{0}; i < roi.height(); ++i) {
+            const auto row{src.subspan((roi.y() + i) * frame.width() + roi.x(), roi.width())};
+            std::ranges::copy(row, dst.begin() + static_cast<std::ptrdiff_t>(i * roi.width()));
+        }
+    }
+
+  private:
+    LoopbackSensorServer &server_;
+};
+
+} // namespace we
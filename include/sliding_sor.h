@@ -0,0 +1,219 @@
+#pragma once
+#include "parallel.h"
+#include "point.h"
+#include "pointcloud.h"
+#include "we_assert.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace we {
+
+struct SlidingSORFilterSettings {
+    size_t image_width_;
+    size_t image_height_;
+    uint8_t minimum_neighbours_;
+    float sigma_multiplier_;
+    /// side of the pixel window around a point its neighbours are taken from
+    uint8_t window_size_{5};
+    /// number of threads, 0 - all hardware threads
+    size_t threads_{0};
+};
+
+/// @brief Statistical Outliers Removal over row bands processed in parallel. The neighbours of
+/// a point are the valid points of the window around it, its score is their root mean square
+/// distance to it. Points with fewer than minimum_neighbours_ neighbours or with a score above
+/// mean + sigma_multiplier_ * standard deviation of all scores are removed. Points with a
+/// non-finite coordinate are no neighbours of any point and are removed as well.
+/// Squared distances expand into sums of the neighbour coordinates and squared norms, which are
+/// kept as running window sums: a column sum per pixel slides down the band and a row sum
+/// slides along every row, so a score costs the same for any window size.
+/// @example
+/// SlidingSORFilter{SlidingSORFilterSettings{.image_width_ = pcd.width(),
+///                                           .image_height_ = pcd.height(),
+///                                           .minimum_neighbours_ = 5,
+///                                           .sigma_multiplier_ = 1.0f,
+///                                           .window_size_ = 7}}
+///     .apply(pcd);
+class SlidingSORFilter {
+  public:
+    explicit SlidingSORFilter(const SlidingSORFilterSettings &set)
+        : set_{set} {}
+
+    void apply(StructuredPointCloud<Point3f> &pcd) const {
+        assert_true(
+            [&, this]() {
+                return pcd.width() == set_.image_width_ and pcd.height() == set_.image_height_;
+            },
+            "wrong image size");
+
+        const auto pts{pcd.points()};
+        const size_t height{pcd.height()};
+        const size_t half{size_t{set_.window_size_} / 2};
+        const size_t bands{band_count(height, set_.threads_, std::max(4 * half, size_t{16}))};
+
+        // score of every point, negative - empty or too few neighbours
+        std::vector<float> scores(pts.size());
+        std::vector<std::array<double, 3>> band_stats(bands);
+
+        parallel_for_bands(height, bands, [&](size_t band, size_t first, size_t last) {
+            band_stats[band] = score_rows(pcd, scores, first, last);
+        });
+
+        std::array<double, 3> stats{};
+
+        for(const auto &s : band_stats) {
+            for(size_t k{0}; k < s.size(); ++k) {
+                stats[k] += s[k];
+            }
+        }
+
+        const double count{std::max(stats[0], 1.0)};
+        const double mean{stats[1] / count};
+        const double sigma{std::sqrt(std::max(stats[2] / count - mean * mean, 0.0))};
+        const auto max_score{static_cast<float>(mean + set_.sigma_multiplier_ * sigma)};
+        const auto empty{pcd.empty_value()};
+
+        parallel_for(
+            pts.size(),
+            [&](size_t first, size_t last) {
+                for(size_t i{first}; i < last; ++i) {
+                    if(scores[i] < 0.0f or scores[i] > max_score) {
+                        pts[i] = empty;
+                    }
+                }
+            },
+            set_.threads_);
+    }
+
+  private:
+    /// count, x, y, z and squared norm sums of a window
+    using Sums = std::array<double, 5>;
+
+    /// @brief scores of rows [first, last), returns the count, sum and sum of squares of them
+    std::array<double, 3> score_rows(const StructuredPointCloud<Point3f> &pcd,
+                                     std::span<float> scores, size_t first,
+                                     size_t last) const {
+        const auto pts{pcd.points()};
+        const auto empty{pcd.empty_value()};
+        const size_t width{pcd.width()};
+        const size_t height{pcd.height()};
+        const size_t half{size_t{set_.window_size_} / 2};
+        const size_t read_first{first - std::min(first, half)};
+        const size_t read_last{std::min(last + half, height)};
+
+        // coordinates are taken relative to a point of the band, which keeps the sums small
+        Point3d origin{};
+
+        for(size_t i{read_first * width}; i < read_last * width; ++i) {
+            if(pts[i] != empty and std::isfinite(pts[i].x()) and std::isfinite(pts[i].y()) and
+               std::isfinite(pts[i].z())) {
+                origin = Point3d{pts[i].x(), pts[i].y(), pts[i].z()};
+                break;
+            }
+        }
+
+        const auto add_row{[&](std::vector<Sums> &columns, size_t row, double sign) {
+            const Point3f *src{pts.data() + row * width};
+
+            // invalid points add zeros instead of being skipped, which keeps the loop free of
+            // branches for the compiler to vectorize. x is zeroed as well as w: w * x with w = 0
+            // would still be NaN for a non-finite x
+            for(size_t j{0}; j < width; ++j) {
+                const Point3f &p{src[j]};
+                const auto valid{static_cast<bool>(
+                    ((p.x() != empty.x()) | (p.y() != empty.y()) | (p.z() != empty.z())) &
+                    std::isfinite(p.x()) & std::isfinite(p.y()) & std::isfinite(p.z()))};
+                const double w{valid ? sign : 0.0};
+                const double x{valid ? p.x() - origin.x() : 0.0};
+                const double y{valid ? p.y() - origin.y() : 0.0};
+                const double z{valid ? p.z() - origin.z() : 0.0};
+                auto &c{columns[j]};
+                c[0] += w;
+                c[1] += w * x;
+                c[2] += w * y;
+                c[3] += w * z;
+                c[4] += w * (x * x + y * y + z * z);
+            }
+        }};
+
+        // columns[j] sums column j over the window rows of the current row
+        std::vector<Sums> columns(width);
+
+        for(size_t row{read_first}; row < std::min(first + half + 1, height); ++row) {
+            add_row(columns, row, 1.0);
+        }
+
+        std::array<double, 3> stats{};
+        const auto min_neighbours{static_cast<double>(set_.minimum_neighbours_)};
+
+        for(size_t i{first}; i < last; ++i) {
+            if(i > first) {
+                if(i + half < height) {
+                    add_row(columns, i + half, 1.0);
+                }
+
+                if(i > half) {
+                    add_row(columns, i - half - 1, -1.0);
+                }
+            }
+
+            Sums window{};
+
+            for(size_t j{0}; j < std::min(half, width); ++j) {
+                for(size_t k{0}; k < window.size(); ++k) {
+                    window[k] += columns[j][k];
+                }
+            }
+
+            for(size_t j{0}; j < width; ++j) {
+                if(j + half < width) {
+                    for(size_t k{0}; k < window.size(); ++k) {
+                        window[k] += columns[j + half][k];
+                    }
+                }
+
+                if(j > half) {
+                    for(size_t k{0}; k < window.size(); ++k) {
+                        window[k] -= columns[j - half - 1][k];
+                    }
+                }
+
+                const size_t idx{i * width + j};
+                const Point3f &p{pts[idx]};
+                scores[idx] = -1.0f;
+
+                // the point itself is in the window and adds nothing to the distances
+                const double neighbours{window[0] - 1.0};
+
+                if(p == empty or not std::isfinite(p.x()) or not std::isfinite(p.y()) or
+                   not std::isfinite(p.z()) or neighbours < std::max(min_neighbours, 1.0)) {
+                    continue;
+                }
+
+                // sum over q of |q - p|^2 = sum |q|^2 - 2 p . sum q + n |p|^2
+                const double x{p.x() - origin.x()};
+                const double y{p.y() - origin.y()};
+                const double z{p.z() - origin.z()};
+                const double squared{window[4] - 2.0 * (x * window[1] + y * window[2] +
+                                                        z * window[3]) +
+                                     window[0] * (x * x + y * y + z * z)};
+                const double score{std::sqrt(std::max(squared, 0.0) / neighbours)};
+
+                scores[idx] = static_cast<float>(score);
+                stats[0] += 1.0;
+                stats[1] += score;
+                stats[2] += score * score;
+            }
+        }
+
+        return stats;
+    }
+
+    SlidingSORFilterSettings set_;
+};
+
+} // namespace we
@@ -0,0 +1,179 @@
+#pragma once
+#include "parallel.h"
+#include "point.h"
+#include "point_kernels.h"
+#include "pointcloud.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+
+namespace we {
+
+namespace detail {
+
+/// points checked for empty values and transformed at once, a block stays in L1
+inline constexpr size_t transform_block{1024};
+
+[[nodiscard]] inline Matrix3f rotation_of(const Matrix4f &m) noexcept {
+    return Matrix3f{m.d_[0], m.d_[1], m.d_[2], m.d_[4], m.d_[5],
+                    m.d_[6], m.d_[8], m.d_[9], m.d_[10]};
+}
+
+/// @brief dst[i] = m * src[i] and dst_normals[i] = r * src_normals[i] for i in [first, last),
+/// points equal to empty keep their value and normal. dst may be src, the normal spans are
+/// empty when the cloud has no normals.
+inline void transform_range(std::span<const Point3f> src, std::span<Point3f> dst,
+                            std::span<const Point3f> src_normals, std::span<Point3f> dst_normals,
+                            const Matrix4f &m, const Matrix3f &r, std::optional<Point3f> empty,
+                            size_t first, size_t last) {
+    // holes are transformed along with the block by the batch kernels and restored afterwards,
+    // this keeps the kernels running over whole blocks however the holes are scattered
+    std::array<uint32_t, transform_block> holes;
+    std::array<Point3f, transform_block> hole_normals;
+    const bool normals{not src_normals.empty()};
+
+    for(size_t b{first}; b < last; b += transform_block) {
+        const size_t n{std::min(transform_block, last - b)};
+        size_t n_holes{0};
+
+        if(empty) {
+            // branchless, holes are scattered and would defeat the branch predictor
+            const auto [ex, ey, ez]{empty->d_};
+
+            for(size_t i{0}; i < n; ++i) {
+                const auto &p{src[b + i]};
+                holes[n_holes] = static_cast<uint32_t>(i);
+                n_holes += static_cast<size_t>((p.x() == ex) & (p.y() == ey) & (p.z() == ez));
+            }
+        }
+
+        if(normals) {
+            for(size_t k{0}; k < n_holes; ++k) {
+                hole_normals[k] = src_normals[b + holes[k]];
+            }
+        }
+
+        transform_points(src.subspan(b, n), dst.subspan(b, n), m);
+
+        if(normals) {
+            rotate_points(src_normals.subspan(b, n), dst_normals.subspan(b, n), r);
+        }
+
+        for(size_t k{0}; k < n_holes; ++k) {
+            dst[b + holes[k]] = *empty;
+
+            if(normals) {
+                dst_normals[b + holes[k]] = hole_normals[k];
+            }
+        }
+    }
+}
+
+template <typename Cloud>
+void transform_in_place(Cloud &pcd, const Matrix4f &m, std::optional<Point3f> empty,
+                        size_t threads) {
+    const auto pts{pcd.points()};
+    const auto normals{pcd.template property<Prop::NORMALS>()};
+    const std::span<Point3f> nrm{normals ? *normals : std::span<Point3f>{}};
+    const Matrix3f r{rotation_of(m)};
+
+    parallel_for(
+        pts.size(),
+        [&](size_t first, size_t last) {
+            transform_range(pts, pts, nrm, nrm, m, r, empty, first, last);
+        },
+        threads);
+}
+
+template <typename Cloud>
+void transform_into(const Cloud &src, Cloud &dst, const Matrix4f &m,
+                    std::optional<Point3f> empty, size_t threads) {
+    const auto src_pts{src.points()};
+    const auto dst_pts{dst.points()};
+    const auto src_normals{src.template property<Prop::NORMALS>()};
+    const auto dst_normals{dst.template property<Prop::NORMALS>()};
+    const std::span<const Point3f> src_nrm{src_normals ? *src_normals
+                                                       : std::span<const Point3f>{}};
+    const std::span<Point3f> dst_nrm{dst_normals ? *dst_normals : std::span<Point3f>{}};
+    const Matrix3f r{rotation_of(m)};
+    // the normals are written by transform_range()
+    const std::string_view rotated{src_normals ? prop_traits_v<Prop::NORMALS> : std::string_view{}};
+
+    parallel_for(
+        src_pts.size(),
+        [&](size_t first, size_t last) {
+            for(size_t b{first}; b < last; b += transform_block) {
+                const size_t e{std::min(b + transform_block, last)};
+                // the other properties are copied block by block while the block is in cache
+                dst.copy_properties(src, b, e, b, rotated);
+                transform_range(src_pts, dst_pts, src_nrm, dst_nrm, m, r, empty, b, e);
+            }
+        },
+        threads);
+}
+
+/// @brief whether dst has the size and the properties of src, so its buffers can be written as
+/// they are
+template <typename Cloud> [[nodiscard]] bool same_layout(const Cloud &src, const Cloud &dst) {
+    return dst.size() == src.size() and dst.properties().same_properties(src.properties());
+}
+
+} // namespace detail
+
+/// @brief applies the rigid transform m, e.g. Sensor3d::get<cmd::EXTRINSIC_MATRIX>(), to the
+/// points of a cloud or the vertices of a mesh in place, normals are rotated with it
+/// @param threads number of threads, 0 - all hardware threads
+/// @example
+/// we::transform(pcd, sensor.get<we::cmd::EXTRINSIC_MATRIX>());
+inline void transform(PointCloudBase<Point3f> &pcd, const Matrix4f &m, size_t threads = 0) {
+    detail::transform_in_place(pcd, m, std::nullopt, threads);
+}
+
+/// @brief as above, empty_value() points stay empty
+inline void transform(StructuredPointCloud3f &pcd, const Matrix4f &m, size_t threads = 0) {
+    detail::transform_in_place(pcd, m, pcd.empty_value(), threads);
+}
+
+/// @brief dst = m * src without a copy of src: the transformed points and normals are written
+/// straight into dst, which takes the size and all other properties of src. The buffers of dst
+/// are reused when it already has the size and the properties of src, e.g. from the previous
+/// frame, otherwise they are made anew.
+/// @param threads number of threads, 0 - all hardware threads
+inline void transform(const PointCloud3f &src, PointCloud3f &dst, const Matrix4f &m,
+                      size_t threads = 0) {
+    if(&src == &dst) {
+        transform(dst, m, threads);
+        return;
+    }
+
+    if(not detail::same_layout(src, dst)) {
+        dst.create(src.size());
+        dst.add_properties_of(src);
+    }
+
+    detail::transform_into(src, dst, m, std::nullopt, threads);
+}
+
+/// @brief as above, dst gets the layout of src and its empty_value() points stay empty
+inline void transform(const StructuredPointCloud3f &src, StructuredPointCloud3f &dst,
+                      const Matrix4f &m, size_t threads = 0) {
+    if(&src == &dst) {
+        transform(dst, m, threads);
+        return;
+    }
+
+    if(dst.width() == src.width() and dst.height() == src.height() and
+       detail::same_layout(src, dst)) {
+        dst.empty_value() = src.empty_value();
+    } else {
+        dst.create(src.width(), src.height(), src.empty_value());
+        dst.add_properties_of(src);
+    }
+
+    detail::transform_into(src, dst, m, src.empty_value(), threads);
+}
+
+} // namespace we
@@ -0,0 +1,312 @@
+#pragma once
+#include "parallel.h"
+#include "point.h"
+#include "pointcloud.h"
+#include "we_assert.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <vector>
+
+namespace we {
+
+enum class VoxelMode {
+    /// the mean of the points of a voxel, typed properties averaged
+    CENTROID,
+    /// the point of a voxel that comes first in the cloud, with its properties
+    FIRST_POINT
+};
+
+struct VoxelGridSettings {
+    /// edge length of the cubic voxels
+    float leaf_size_;
+    VoxelMode mode_{VoxelMode::CENTROID};
+    /// number of threads, 0 - all hardware threads
+    size_t threads_{0};
+};
+
+namespace detail {
+
+/// bits of a voxel coordinate in a Morton key
+inline constexpr uint32_t morton_bits{21};
+
+/// @brief spreads the lower 21 bits of v to every third bit
+[[nodiscard]] constexpr uint64_t morton_spread(uint64_t v) noexcept {
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffff;
+    v = (v | v << 16) & 0x1f0000ff0000ff;
+    v = (v | v << 8) & 0x100f00f00f00f00f;
+    v = (v | v << 4) & 0x10c30c30c30c30c3;
+    v = (v | v << 2) & 0x1249249249249249;
+    return v;
+}
+
+[[nodiscard]] constexpr uint64_t morton_key(uint32_t x, uint32_t y, uint32_t z) noexcept {
+    return morton_spread(x) | morton_spread(y) << 1 | morton_spread(z) << 2;
+}
+
+struct VoxelEntry {
+    uint64_t key_;
+    uint32_t index_;
+
+    [[nodiscard]] bool operator<(const VoxelEntry &rhs) const noexcept {
+        return key_ < rhs.key_ or (key_ == rhs.key_ and index_ < rhs.index_);
+    }
+};
+
+} // namespace detail
+
+/// @brief voxel grid downsampling of an unstructured point cloud, one point per occupied voxel.
+/// Points are keyed by the Morton code of their voxel and sorted in parallel, so the points of
+/// a voxel become a contiguous run; runs are reduced in parallel. The output keeps the order of
+/// the first point of every voxel and all properties of the cloud: in CENTROID mode normals,
+/// intensity, confidence and colour are averaged (normals renormalized), custom properties are
+/// those of the first point. Points with non-finite coordinates are dropped.
+/// @example
+/// const auto sparse{VoxelGrid{VoxelGridSettings{.leaf_size_ = 2.0f}}.apply(pcd.pointcloud())};
+class VoxelGrid {
+  public:
+    explicit VoxelGrid(const VoxelGridSettings &set)
+        : set_{set} {
+        assert_true([this]() { return set_.leaf_size_ > 0.0f; }, "wrong voxel leaf size");
+    }
+
+    [[nodiscard]] PointCloud3f apply(const PointCloud3f &pcd) const {
+        const auto pts{pcd.points()};
+        const size_t n{pts.size()};
+
+        assert_true([&]() { return n < std::numeric_limits<uint32_t>::max(); },
+                    "too many points");
+
+        const auto entries{sorted_entries(pts)};
+
+        // runs of equal keys, invalid points sort last with the maximal key
+        const size_t bands{band_count(n, set_.threads_)};
+        std::vector<size_t> offsets(bands + 1, 0);
+        const auto run_start{[&](size_t k) {
+            return entries[k].key_ != invalid_key and
+                   (k == 0 or entries[k].key_ != entries[k - 1].key_);
+        }};
+
+        parallel_for_bands(n, bands, [&](size_t band, size_t first, size_t last) {
+            for(size_t k{first}; k < last; ++k) {
+                offsets[band + 1] += run_start(k) ? 1 : 0;
+            }
+        });
+
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+        std::vector<uint32_t> runs(offsets.back() + 1);
+        std::vector<uint8_t> mask(n);
+
+        parallel_for_bands(n, bands, [&](size_t band, size_t first, size_t last) {
+            size_t out{offsets[band]};
+
+            for(size_t k{first}; k < last; ++k) {
+                if(run_start(k)) {
+                    runs[out++] = static_cast<uint32_t>(k);
+                    // entries of a run are sorted by index, the first one comes first
+                    mask[entries[k].index_] = 1;
+                }
+            }
+        });
+
+        runs.back() = static_cast<uint32_t>(std::ranges::find(entries, invalid_key,
+                                                              &detail::VoxelEntry::key_) -
+                                            entries.begin());
+
+        PointCloud3f out;
+        out.assign_compacted(pcd, mask, set_.threads_);
+
+        if(set_.mode_ == VoxelMode::CENTROID) {
+            average(pcd, out, entries, runs, mask);
+        }
+
+        return out;
+    }
+
+  private:
+    static constexpr uint64_t invalid_key{std::numeric_limits<uint64_t>::max()};
+
+    [[nodiscard]] std::vector<detail::VoxelEntry>
+    sorted_entries(std::span<const Point3f> pts) const {
+        const size_t n{pts.size()};
+        const size_t bands{band_count(n, set_.threads_)};
+        std::vector<std::array<float, 3>> lows(bands, {std::numeric_limits<float>::max(),
+                                                       std::numeric_limits<float>::max(),
+                                                       std::numeric_limits<float>::max()});
+        std::vector<std::array<float, 3>> highs(
+            bands, {std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(),
+                    std::numeric_limits<float>::lowest()});
+        const auto finite{[](const Point3f &p) {
+            return std::isfinite(p.x()) and std::isfinite(p.y()) and std::isfinite(p.z());
+        }};
+
+        parallel_for_bands(n, bands, [&](size_t band, size_t first, size_t last) {
+            for(size_t i{first}; i < last; ++i) {
+                if(finite(pts[i])) {
+                    for(int c{0}; c < 3; ++c) {
+                        lows[band][c] = std::min(lows[band][c], pts[i][c]);
+                        highs[band][c] = std::max(highs[band][c], pts[i][c]);
+                    }
+                }
+            }
+        });
+
+        std::array<double, 3> low{};
+        double extent{0.0};
+
+        for(int c{0}; c < 3; ++c) {
+            float lo{std::numeric_limits<float>::max()};
+            float hi{std::numeric_limits<float>::lowest()};
+
+            for(size_t band{0}; band < bands; ++band) {
+                lo = std::min(lo, lows[band][c]);
+                hi = std::max(hi, highs[band][c]);
+            }
+
+            low[c] = lo;
+            extent = std::max(extent, static_cast<double>(hi) - lo);
+        }
+
+        const double inv_leaf{1.0 / set_.leaf_size_};
+
+        assert_true([&]() { return extent * inv_leaf < double{1 << detail::morton_bits} - 1; },
+                    "voxel leaf size too small for the extent of the cloud");
+
+        std::vector<detail::VoxelEntry> entries(n);
+
+        parallel_for(
+            n,
+            [&](size_t first, size_t last) {
+                for(size_t i{first}; i < last; ++i) {
+                    const auto &p{pts[i]};
+                    entries[i].index_ = static_cast<uint32_t>(i);
+                    entries[i].key_ =
+                        finite(p)
+                            ? detail::morton_key(
+                                  static_cast<uint32_t>((p.x() - low[0]) * inv_leaf),
+                                  static_cast<uint32_t>((p.y() - low[1]) * inv_leaf),
+                                  static_cast<uint32_t>((p.z() - low[2]) * inv_leaf))
+                            : invalid_key;
+                }
+            },
+            set_.threads_);
+
+        parallel_sort(entries.begin(), entries.end(), std::less<>{}, set_.threads_);
+        return entries;
+    }
+
+    /// @brief the points and typed properties of out become the means of their voxels
+    void average(const PointCloud3f &pcd, PointCloud3f &out,
+                 std::span<const detail::VoxelEntry> entries, std::span<const uint32_t> runs,
+                 std::span<const uint8_t> mask) const {
+        // output slot of every first point, the rank among the first points
+        std::vector<uint32_t> slots(mask.size());
+        const size_t bands{band_count(mask.size(), set_.threads_)};
+        std::vector<size_t> offsets(bands + 1, 0);
+
+        parallel_for_bands(mask.size(), bands, [&](size_t band, size_t first, size_t last) {
+            offsets[band + 1] = static_cast<size_t>(std::count(
+                mask.begin() + static_cast<std::ptrdiff_t>(first),
+                mask.begin() + static_cast<std::ptrdiff_t>(last), uint8_t{1}));
+        });
+
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+        parallel_for_bands(mask.size(), bands, [&](size_t band, size_t first, size_t last) {
+            auto slot{static_cast<uint32_t>(offsets[band])};
+
+            for(size_t i{first}; i < last; ++i) {
+                if(mask[i] != 0) {
+                    slots[i] = slot++;
+                }
+            }
+        });
+
+        const auto src_pts{pcd.points()};
+        const auto src_normals{pcd.property<Prop::NORMALS>()};
+        const auto src_intensity{pcd.property<Prop::INTENSITY>()};
+        const auto src_confidence{pcd.property<Prop::CONFIDENCE>()};
+        const auto src_rgb{pcd.property<Prop::RGB>()};
+        const auto pts{out.points()};
+        const auto normals{out.property<Prop::NORMALS>()};
+        const auto intensity{out.property<Prop::INTENSITY>()};
+        const auto confidence{out.property<Prop::CONFIDENCE>()};
+        const auto rgb{out.property<Prop::RGB>()};
+
+        parallel_for(
+            runs.size() - 1,
+            [&](size_t first, size_t last) {
+                for(size_t r{first}; r < last; ++r) {
+                    const auto voxel{entries.subspan(runs[r], runs[r + 1] - runs[r])};
+                    const uint32_t slot{slots[voxel.front().index_]};
+                    const auto count{static_cast<double>(voxel.size())};
+                    std::array<double, 3> p{};
+                    Point3f normal{0.0f, 0.0f, 0.0f};
+                    uint64_t intensity_sum{0};
+                    uint64_t confidence_sum{0};
+                    std::array<uint32_t, 3> rgb_sum{};
+
+                    for(const auto &e : voxel) {
+                        for(int c{0}; c < 3; ++c) {
+                            p[c] += src_pts[e.index_][c];
+                        }
+
+                        if(normals) {
+                            normal += (*src_normals)[e.index_];
+                        }
+
+                        if(intensity) {
+                            intensity_sum += (*src_intensity)[e.index_];
+                        }
+
+                        if(confidence) {
+                            confidence_sum += (*src_confidence)[e.index_];
+                        }
+
+                        if(rgb) {
+                            for(int c{0}; c < 3; ++c) {
+                                rgb_sum[c] += (*src_rgb)[e.index_][c];
+                            }
+                        }
+                    }
+
+                    pts[slot] = Point3f{static_cast<float>(p[0] / count),
+                                        static_cast<float>(p[1] / count),
+                                        static_cast<float>(p[2] / count)};
+
+                    // integer properties are rounded to the nearest
+                    const auto mean{
+                        [&](uint64_t sum) { return (sum + voxel.size() / 2) / voxel.size(); }};
+
+                    if(normals) {
+                        (*normals)[slot] = normal.normalized();
+                    }
+
+                    if(intensity) {
+                        (*intensity)[slot] = static_cast<uint16_t>(mean(intensity_sum));
+                    }
+
+                    if(confidence) {
+                        (*confidence)[slot] = static_cast<uint16_t>(mean(confidence_sum));
+                    }
+
+                    if(rgb) {
+                        for(int c{0}; c < 3; ++c) {
+                            (*rgb)[slot][c] = static_cast<uint8_t>(mean(rgb_sum[c]));
+                        }
+                    }
+                }
+            },
+            set_.threads_, default_grain / 8);
+    }
+
+    VoxelGridSettings set_;
+};
+
+} // namespace we
@@ -1,10 +1,23 @@
 #pragma once
+#include "acquisition.h"
 #include "algs.h"
+#include "decimation.h"
 #include "io_e57.h"
+#include "io_e57_stream.h"
 #include "io_ply.h"
+#include "io_ply_mapped.h"
+#include "io_ply_stream.h"
 #include "io_txt.h"
+#include "io_txt_mapped.h"
+#include "io_we3d.h"
+#include "kdtree.h"
+#include "mesh_optimize.h"
+#include "organized_mesh.h"
 #include "point.h"
+#include "point_kernels.h"
 #include "pointcloud.h"
 #include "roi.h"
 #include "sensor3d_connector.h"
+#include "sensor3d_sim.h"
+#include "transform.h"
 #include "welib3d_export.h"
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdio>
+#include <cstdlib>
+
+namespace we::test {
+
+inline int failures{0};
+
+/// @brief reports a failed condition, the test fails at the end of main()
+inline void check(bool condition, const char *what, const char *file, int line) {
+  if (not condition) {
+    std::printf("%s:%d: check failed: %s\n", file, line, what);
+    ++failures;
+  }
+}
+
+inline int result() {
+  std::puts(failures == 0 ? "passed" : "FAILED");
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+} // namespace we::test
+
+#define WE_CHECK(condition) ::we::test::check((condition), #condition, __FILE__, __LINE__)
@@ -0,0 +1,113 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <utility>
+#include <vector>
+#include <welib3d/mesh.h>
+#include <welib3d/pointcloud.h>
+
+namespace we::test {
+
+/// @brief width x height frame of the points (x, y, z(x, y)), x the column and y the row
+template <typename F> StructuredPointCloud3f make_plane(size_t width, size_t height, F &&z) {
+  StructuredPointCloud3f pcd;
+  pcd.create(width, height, Point3f{0.0f, 0.0f, 0.0f});
+
+  for (size_t i{0}; i < pcd.size(); ++i) {
+    const auto x{static_cast<float>(i % width)};
+    const auto y{static_cast<float>(i / width)};
+    pcd[i] = Point3f{x, y, z(x, y)};
+  }
+
+  return pcd;
+}
+
+/// @brief triangulated grid of columns x rows unit cells over [0, columns] x [0, rows], vertex
+/// (x, y) at z = height(x, y), faces counter-clockwise seen from +z
+template <typename F> Mesh3f make_grid_mesh(int columns, int rows, F &&height) {
+  Mesh3f::vector_type vertices;
+  Mesh3f::vector_face_type faces;
+
+  for (int i{0}; i <= rows; ++i) {
+    for (int j{0}; j <= columns; ++j) {
+      const auto x{static_cast<float>(j)};
+      const auto y{static_cast<float>(i)};
+      vertices.push_back(Point3f{x, y, height(x, y)});
+    }
+  }
+
+  for (int i{0}; i < rows; ++i) {
+    for (int j{0}; j < columns; ++j) {
+      const int v{i * (columns + 1) + j};
+      faces.push_back(Point3i{v, v + 1, v + columns + 2});
+      faces.push_back(Point3i{v, v + columns + 2, v + columns + 1});
+    }
+  }
+
+  return Mesh3f{std::move(vertices), std::move(faces)};
+}
+
+/// @brief edge and vertex counts of a mesh
+struct Topology {
+  /// vertices used by a face
+  size_t vertices_{0};
+  size_t edges_{0};
+  size_t faces_{0};
+  /// edges of a single face
+  size_t open_edges_{0};
+  /// edges of more than two faces
+  size_t non_manifold_edges_{0};
+  /// edges two faces run through in the same direction, i.e. one of them is flipped
+  size_t misoriented_edges_{0};
+  /// faces with a repeated vertex or a vertex out of range
+  size_t bad_faces_{0};
+
+  [[nodiscard]] long euler() const {
+    return static_cast<long>(vertices_) - static_cast<long>(edges_) + static_cast<long>(faces_);
+  }
+
+  /// @brief a manifold with consistently oriented faces
+  [[nodiscard]] bool valid() const {
+    return non_manifold_edges_ == 0 and misoriented_edges_ == 0 and bad_faces_ == 0;
+  }
+};
+
+inline Topology topology(const Mesh3f &mesh) {
+  Topology t;
+  std::map<std::pair<int, int>, std::pair<int, int>> uses;
+  std::vector<bool> used(mesh.size(), false);
+  const auto n{static_cast<int>(mesh.size())};
+
+  for (const auto &f : mesh.faces()) {
+    ++t.faces_;
+
+    if (f[0] == f[1] or f[1] == f[2] or f[2] == f[0] or
+        std::ranges::any_of(f.d_, [n](int v) { return v < 0 or v >= n; })) {
+      ++t.bad_faces_;
+      continue;
+    }
+
+    for (size_t k{0}; k < 3; ++k) {
+      const int a{f[k]};
+      const int b{f[(k + 1) % 3]};
+      auto &[forward, backward]{uses[{std::min(a, b), std::max(a, b)}]};
+      ++(a < b ? forward : backward);
+      used[static_cast<size_t>(a)] = true;
+    }
+  }
+
+  t.vertices_ = static_cast<size_t>(std::ranges::count(used, true));
+  t.edges_ = uses.size();
+
+  for (const auto &[edge, count] : uses) {
+    const auto [forward, backward]{count};
+    t.open_edges_ += forward + backward == 1 ? 1 : 0;
+    t.non_manifold_edges_ += forward + backward > 2 ? 1 : 0;
+    t.misoriented_edges_ += forward > 1 or backward > 1 ? 1 : 0;
+  }
+
+  return t;
+}
+
+} // namespace we::test
@@ -0,0 +1,114 @@
+#include "check.h"
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include <welib3d/pointcloud.h>
+
+namespace {
+
+using namespace we;
+
+struct Tag {
+  int value_;
+};
+
+// cloud of n points along x with intensities, normals and two custom properties holding i
+PointCloud3f make_cloud(size_t n) {
+  PointCloud3f pcd;
+  pcd.create(n);
+  pcd.add_property<Prop::INTENSITY>();
+  pcd.add_property<Prop::NORMALS>();
+
+  std::vector<double> weights(n);
+  std::vector<Point3ub> labels(n);
+
+  for (size_t i{0}; i < n; ++i) {
+    const auto v{static_cast<float>(i)};
+    pcd[i] = Point3f{v, 0.0f, 0.0f};
+    (*pcd.property<Prop::INTENSITY>())[i] = static_cast<uint16_t>(i);
+    (*pcd.property<Prop::NORMALS>())[i] = Point3f{0.0f, 0.0f, v};
+    weights[i] = 0.5 * static_cast<double>(i);
+    labels[i] = Point3ub{static_cast<uint8_t>(i), uint8_t{0}, uint8_t{0}};
+  }
+
+  static_cast<void>(pcd.add_property(std::move(weights), "weight"));
+  static_cast<void>(pcd.add_property(std::move(labels), "label"));
+  return pcd;
+}
+
+// whether point k of pcd carries all properties of point i of make_cloud()
+bool holds(const PointCloud3f &pcd, size_t k, size_t i) {
+  const auto v{static_cast<float>(i)};
+  return pcd[k] == Point3f{v, 0.0f, 0.0f} and (*pcd.property<Prop::INTENSITY>())[k] == i and
+         (*pcd.property<Prop::NORMALS>())[k] == Point3f{0.0f, 0.0f, v} and
+         pcd.property(pcd.get_property_handle<double>("weight"))[k] == 0.5 * v and
+         pcd.property(pcd.get_property_handle<Point3ub>("label"))[k].x() == static_cast<uint8_t>(i);
+}
+
+} // namespace
+
+int main(int, char **) {
+  const size_t n{1000};
+  std::vector<uint8_t> mask(n);
+
+  for (size_t i{0}; i < n; ++i) {
+    mask[i] = i % 3 == 1 ? 1 : 0;
+  }
+
+  // into another cloud and in place, on several threads
+  for (const bool in_place : {false, true}) {
+    auto src{make_cloud(n)};
+    PointCloud3f dst;
+    auto &out{in_place ? src : dst};
+    out.assign_compacted(src, mask, 4);
+
+    bool kept{out.size() == n / 3};
+
+    for (size_t k{0}; k < out.size() and kept; ++k) {
+      kept = holds(out, k, 3 * k + 1);
+    }
+
+    WE_CHECK(kept);
+  }
+
+  // gathered in reverse with every point twice
+  const auto src{make_cloud(n)};
+  std::vector<uint32_t> order(2 * n);
+
+  for (size_t k{0}; k < order.size(); ++k) {
+    order[k] = static_cast<uint32_t>(n - 1 - k / 2);
+  }
+
+  PointCloud3f gathered;
+  gathered.assign_gathered(src, order, 4);
+  bool moved{gathered.size() == 2 * n};
+
+  for (size_t k{0}; k < gathered.size() and moved; ++k) {
+    moved = holds(gathered, k, order[k]);
+  }
+
+  WE_CHECK(moved);
+
+  // a property of a type the copy does not know throws instead of being dropped
+  auto tagged{make_cloud(n)};
+  static_cast<void>(tagged.add_property(std::vector<Tag>(n), "tag"));
+  bool compact_thrown{false};
+  bool gather_thrown{false};
+
+  try {
+    tagged.assign_compacted(tagged, mask);
+  } catch (const std::runtime_error &) {
+    compact_thrown = true;
+  }
+
+  try {
+    gathered.assign_gathered(tagged, order);
+  } catch (const std::runtime_error &) {
+    gather_thrown = true;
+  }
+
+  WE_CHECK(compact_thrown and tagged.size() == n);
+  WE_CHECK(gather_thrown and gathered.size() == 2 * n);
+
+  return test::result();
+}
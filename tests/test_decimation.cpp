@@ -0,0 +1,68 @@
+#include "check.h"
+#include "fixtures.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <utility>
+#include <welib3d/decimation.h>
+
+int main(int, char **) {
+  using namespace we;
+
+  // a gently curved disc: one border loop, Euler characteristic 1
+  const auto mesh{test::make_grid_mesh(60, 40, [](float x, float y) {
+    return 2.0f * std::sin(0.1f * x) + 0.01f * x * y;
+  })};
+  const auto before{test::topology(mesh)};
+  WE_CHECK(before.valid() and before.euler() == 1 and before.faces_ == 4800);
+
+  for (const size_t threads : {size_t{1}, size_t{4}}) {
+    const DecimationSettings set{.target_faces_ = 600, .threads_ = threads};
+    const auto coarse{QuadricDecimator{set}.apply(mesh)};
+    const auto after{test::topology(coarse)};
+
+    // still a disc of consistently oriented faces, no vertex is left unused
+    WE_CHECK(after.valid());
+    WE_CHECK(after.euler() == 1);
+    WE_CHECK(after.vertices_ == coarse.size());
+    WE_CHECK(after.faces_ < before.faces_ / 2 and after.faces_ >= 600);
+
+    // vertices of the open edges stay on the outline of the grid, the planes holding the border
+    // keep them within a small fraction of an edge
+    const auto pts{coarse.points()};
+    std::map<std::pair<int, int>, int> uses;
+
+    for (const auto &f : coarse.faces()) {
+      for (size_t k{0}; k < 3; ++k) {
+        ++uses[{std::min(f[k], f[(k + 1) % 3]), std::max(f[k], f[(k + 1) % 3])}];
+      }
+    }
+
+    const auto outline{[](const Point3f &p) {
+      return p.x() < 0.01f or p.x() > 59.99f or p.y() < 0.01f or p.y() > 39.99f;
+    }};
+    bool on_outline{true};
+
+    for (const auto &[edge, count] : uses) {
+      const auto &a{pts[static_cast<size_t>(edge.first)]};
+      const auto &b{pts[static_cast<size_t>(edge.second)]};
+      on_outline = on_outline and (count != 1 or (outline(a) and outline(b)));
+    }
+
+    WE_CHECK(on_outline);
+
+    // no face is folded over: all normals still point up
+    bool up{true};
+
+    for (const auto &f : coarse.faces()) {
+      const auto a{pts[static_cast<size_t>(f[0])]};
+      const auto ab{pts[static_cast<size_t>(f[1])] - a};
+      const auto ac{pts[static_cast<size_t>(f[2])] - a};
+      up = up and ab.x() * ac.y() - ab.y() * ac.x() > 0.0f;
+    }
+
+    WE_CHECK(up);
+  }
+
+  return test::result();
+}
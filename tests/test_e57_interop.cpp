@@ -0,0 +1,77 @@
+#include "check.h"
+#include <filesystem>
+#include <welib3d/io_e57.h>
+#include <welib3d/io_e57_stream.h>
+
+namespace {
+
+// a grid with holes and an intensity for every point
+we::StructuredPointCloud3f make_scan(size_t width, size_t height) {
+  we::StructuredPointCloud3f pcd;
+  pcd.create(width, height, we::Point3f{0.0f, 0.0f, 0.0f});
+  const auto intensity{pcd.property(pcd.add_property<we::Prop::INTENSITY>())};
+
+  for (size_t i{0}; i < pcd.size(); ++i) {
+    if (i % 7 != 3) {
+      pcd[i] = we::Point3f{static_cast<float>(i % width) * 0.5f,
+                           static_cast<float>(i / width) * 0.25f, 100.0f + static_cast<float>(i)};
+      intensity[i] = static_cast<uint16_t>(i);
+    }
+  }
+
+  return pcd;
+}
+
+// the same valid points on the same pixels, whatever empty value each side uses
+bool same_points(const we::StructuredPointCloud3f &a, const we::StructuredPointCloud3f &b) {
+  if (a.width() != b.width() or a.height() != b.height()) {
+    return false;
+  }
+
+  for (size_t i{0}; i < a.height(); ++i) {
+    for (size_t j{0}; j < a.width(); ++j) {
+      if (a.point_valid(i, j) != b.point_valid(i, j) or
+          (a.point_valid(i, j) and a(i, j) != b(i, j))) {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+} // namespace
+
+// the streaming writer and reader against load_e57 and save_e57 of the prebuilt library,
+// which read and write E57 through libE57
+int main(int, char **) {
+  using namespace we;
+
+  const auto dir{std::filesystem::temp_directory_path()};
+  const auto streamed{(dir / "welib3d_test_interop_stream.e57").string()};
+  const auto saved{(dir / "welib3d_test_interop_save.e57").string()};
+  const auto scan{make_scan(37, 23)};
+
+  {
+    E57StreamWriter writer{streamed};
+    writer.write_scan(scan, "interop");
+    WE_CHECK(writer.finish());
+  }
+
+  StructuredPointCloud3f loaded;
+  WE_CHECK(load_e57(loaded, streamed));
+  WE_CHECK(same_points(scan, loaded));
+
+  WE_CHECK(save_e57(scan, saved));
+  E57StreamReader reader{saved};
+  WE_CHECK(reader.is_open() and reader.scans().size() == 1);
+
+  StructuredPointCloud3f read;
+  WE_CHECK(reader.read_scan(0, read));
+  WE_CHECK(same_points(scan, read));
+
+  std::error_code ec;
+  std::filesystem::remove(streamed, ec);
+  std::filesystem::remove(saved, ec);
+  return test::result();
+}
@@ -0,0 +1,55 @@
+#include "check.h"
+#include <algorithm>
+#include <filesystem>
+#include <welib3d/io_e57_stream.h>
+
+namespace {
+
+we::StructuredPointCloud3f make_scan(size_t width, size_t height, float z) {
+  we::StructuredPointCloud3f pcd;
+  pcd.create(width, height, we::Point3f{0.0f, 0.0f, 0.0f});
+
+  for (size_t i{0}; i < pcd.size(); ++i) {
+    pcd[i] = we::Point3f{static_cast<float>(i % width), static_cast<float>(i / width), z};
+  }
+
+  return pcd;
+}
+
+bool equal(const we::StructuredPointCloud3f &a, const we::StructuredPointCloud3f &b) {
+  return a.width() == b.width() and a.height() == b.height() and
+         std::ranges::equal(a.points(), b.points());
+}
+
+} // namespace
+
+int main(int, char **) {
+  using namespace we;
+
+  const auto path{(std::filesystem::temp_directory_path() / "welib3d_test_stream.e57").string()};
+
+  // the section header of the second scan crosses a page boundary for some of the heights
+  for (const size_t height : {73918, 73919, 73920, 73921, 146550}) {
+    const auto first{make_scan(1, height, 1.0f)};
+    const auto second{make_scan(3, 5, 2.0f)};
+
+    {
+      E57StreamWriter writer{path};
+      writer.write_scan(first, "first");
+      writer.write_scan(second, "second");
+      WE_CHECK(writer.finish());
+    }
+
+    E57StreamReader reader{path};
+    WE_CHECK(reader.is_open());
+    WE_CHECK(reader.scans().size() == 2);
+
+    StructuredPointCloud3f pcd;
+    WE_CHECK(reader.read_scan(0, pcd) and equal(pcd, first));
+    WE_CHECK(reader.read_scan(1, pcd) and equal(pcd, second));
+  }
+
+  std::error_code ec;
+  std::filesystem::remove(path, ec);
+  return test::result();
+}
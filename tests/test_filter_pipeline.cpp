@@ -0,0 +1,227 @@
+#include "check.h"
+#include "fixtures.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include <welib3d/filter_pipeline.h>
+
+namespace {
+
+using namespace we;
+
+StructuredPointCloud3f make_surface(size_t width, size_t height) {
+  return test::make_plane(width, height, [](float x, float y) {
+    return 100.0f + 0.5f * x + 3.0f * std::sin(0.3f * y);
+  });
+}
+
+// mean z of the 3 x 3 window, reads one row and column around a pixel
+FilterStage box_stage() {
+  return {size_t{1}, [](StructuredPointCloud3f &pcd) {
+            const auto in{std::vector<Point3f>(pcd.points().begin(), pcd.points().end())};
+            const size_t width{pcd.width()};
+            const size_t height{pcd.height()};
+
+            for (size_t i{0}; i < height; ++i) {
+              for (size_t j{0}; j < width; ++j) {
+                float sum{0.0f};
+                float n{0.0f};
+
+                for (size_t r{i == 0 ? 0 : i - 1}; r < std::min(i + 2, height); ++r) {
+                  for (size_t c{j == 0 ? 0 : j - 1}; c < std::min(j + 2, width); ++c) {
+                    sum += in[r * width + c].z();
+                    n += 1.0f;
+                  }
+                }
+
+                pcd(i, j).z() = sum / n;
+              }
+            }
+          }};
+}
+
+// clamps z to one above the mean z of the frame, a barrier
+FilterStage clamp_stage() {
+  return {std::nullopt, [](StructuredPointCloud3f &pcd) {
+            double sum{0.0};
+
+            for (const auto &p : pcd.points()) {
+              sum += p.z();
+            }
+
+            const auto limit{static_cast<float>(sum / static_cast<double>(pcd.size())) + 1.0f};
+
+            for (auto &p : pcd.points()) {
+              p.z() = std::min(p.z(), limit);
+            }
+          }};
+}
+
+// adds intensities to the rows from first_row on only, so the first tile does not have them
+FilterStage late_intensity_stage(size_t first_row) {
+  const auto run{[first_row](StructuredPointCloud3f &pcd, size_t, size_t y) {
+    if (y + pcd.height() <= first_row) {
+      return;
+    }
+
+    if (not pcd.property<Prop::INTENSITY>()) {
+      pcd.add_property<Prop::INTENSITY>();
+    }
+
+    const auto intensity{*pcd.property<Prop::INTENSITY>()};
+
+    for (size_t i{0}; i < pcd.height(); ++i) {
+      for (size_t j{0}; j < pcd.width(); ++j) {
+        intensity[i * pcd.width() + j] = static_cast<uint16_t>(y + i);
+      }
+    }
+  }};
+
+  return {size_t{0}, [run](StructuredPointCloud3f &pcd) { run(pcd, 0, 0); }, run};
+}
+
+} // namespace
+
+int main(int, char **) {
+  const size_t width{96};
+  const size_t height{130};
+  const NormalsEstimatorSettings normals{.image_width_ = width,
+                                         .image_height_ = height,
+                                         .window_size_ = 7,
+                                         .max_angle_ = 80.0f,
+                                         .filter_by_angle_ = false};
+
+  // a handful of rows per tile, the last tile shorter than the others
+  FilterPipeline tiled{FilterPipelineSettings{.tile_bytes_ = 9 * width * sizeof(Point3f),
+                                              .threads_ = 4}};
+  tiled.add(box_stage()).add(box_stage()).add(integral_normals_stage(normals));
+
+  auto whole{make_surface(width, height)};
+  box_stage()(whole);
+  box_stage()(whole);
+  integral_normals_stage(normals)(whole);
+
+  auto pcd{make_surface(width, height)};
+  tiled.apply(pcd);
+
+  bool same_points{true};
+  bool same_normals{pcd.property<Prop::NORMALS>().has_value()};
+
+  for (size_t i{0}; i < pcd.size() and same_normals; ++i) {
+    same_points = same_points and pcd[i] == whole[i];
+
+    const auto a{(*pcd.property<Prop::NORMALS>())[i]};
+    const auto b{(*whole.property<Prop::NORMALS>())[i]};
+    same_normals = std::abs(a.x() - b.x()) < 1e-4f and std::abs(a.y() - b.y()) < 1e-4f and
+                   std::abs(a.z() - b.z()) < 1e-4f;
+  }
+
+  WE_CHECK(same_points);
+  WE_CHECK(same_normals);
+
+  // a barrier between bounded stages splits them into two fused runs around it
+  FilterPipeline split{FilterPipelineSettings{.tile_bytes_ = 9 * width * sizeof(Point3f),
+                                              .threads_ = 4}};
+  split.add(box_stage()).add(box_stage()).add(clamp_stage()).add(box_stage());
+
+  auto sequential{make_surface(width, height)};
+  box_stage()(sequential);
+  box_stage()(sequential);
+  clamp_stage()(sequential);
+  box_stage()(sequential);
+
+  auto fused{make_surface(width, height)};
+  split.apply(fused);
+
+  bool same_split{true};
+
+  for (size_t i{0}; i < fused.size(); ++i) {
+    same_split = same_split and fused[i] == sequential[i];
+  }
+
+  WE_CHECK(same_split);
+
+  // a ROI: pixels outside it keep their input, inside it the barrier sees the crop of the ROI
+  // and the halo of both box stages as its frame
+  const Roi2ui roi{20, 30, 40, 50};
+  const size_t halo{2};
+  const auto input{make_surface(width, height)};
+
+  StructuredPointCloud3f crop;
+  crop.create(roi.width() + 2 * halo, roi.height() + 2 * halo, input.empty_value());
+
+  for (size_t i{0}; i < crop.height(); ++i) {
+    for (size_t j{0}; j < crop.width(); ++j) {
+      crop(i, j) = input(roi.y() - halo + i, roi.x() - halo + j);
+    }
+  }
+
+  box_stage()(crop);
+  clamp_stage()(crop);
+  box_stage()(crop);
+
+  FilterPipeline bounded_barrier{FilterPipelineSettings{.threads_ = 4}};
+  bounded_barrier.add(box_stage()).add(clamp_stage()).add(box_stage());
+
+  auto in_roi{input};
+  bounded_barrier.apply(in_roi, roi);
+
+  bool outside_untouched{true};
+  bool inside_from_crop{true};
+
+  for (size_t i{0}; i < height; ++i) {
+    for (size_t j{0}; j < width; ++j) {
+      if (roi.contains(static_cast<uint32_t>(j), static_cast<uint32_t>(i))) {
+        inside_from_crop = inside_from_crop and
+                           in_roi(i, j) == crop(i + halo - roi.y(), j + halo - roi.x());
+      } else {
+        outside_untouched = outside_untouched and in_roi(i, j) == input(i, j);
+      }
+    }
+  }
+
+  WE_CHECK(outside_untouched);
+  WE_CHECK(inside_from_crop);
+
+  // a mask: unmasked pixels keep their input, also those within the blocks the mask touches
+  std::vector<uint8_t> mask(input.size(), 0);
+
+  for (size_t i{10}; i < 90; ++i) {
+    for (size_t j{(i % 3) + 5}; j < 80; j += 3) {
+      mask[i * width + j] = 1;
+    }
+  }
+
+  auto masked{input};
+  bounded_barrier.apply(masked, mask);
+
+  bool unmasked_untouched{true};
+  size_t changed{0};
+
+  for (size_t k{0}; k < input.size(); ++k) {
+    if (mask[k] == 0) {
+      unmasked_untouched = unmasked_untouched and masked[k] == input[k];
+    } else {
+      changed += masked[k] == input[k] ? 0 : 1;
+    }
+  }
+
+  WE_CHECK(unmasked_untouched);
+  WE_CHECK(changed > 0);
+
+  // a property only later tiles produce still reaches the frame
+  FilterPipeline late{FilterPipelineSettings{.tile_bytes_ = 9 * width * sizeof(Point3f),
+                                             .threads_ = 4}};
+  late.add(late_intensity_stage(100));
+
+  auto frame{make_surface(width, height)};
+  late.apply(frame);
+
+  const auto intensity{frame.property<Prop::INTENSITY>()};
+  WE_CHECK(intensity.has_value());
+  WE_CHECK(intensity and (*intensity)[120 * width + 5] == 120 and (*intensity)[5] == 0);
+
+  return test::result();
+}
@@ -0,0 +1,53 @@
+#include "check.h"
+#include "fixtures.h"
+#include <cmath>
+#include <limits>
+#include <welib3d/integral_normals.h>
+
+namespace {
+
+bool finite(const we::Point3f &p) {
+  return std::isfinite(p.x()) and std::isfinite(p.y()) and std::isfinite(p.z());
+}
+
+} // namespace
+
+int main(int, char **) {
+  using namespace we;
+
+  const size_t width{64};
+  const size_t height{64};
+  const auto tilted{[](float x, float) { return 100.0f + 0.5f * x; }};
+  const IntegralNormalsEstimator estimator{IntegralNormalsEstimatorSettings{
+      .normals_ = NormalsEstimatorSettings{.image_width_ = width,
+                                           .image_height_ = height,
+                                           .window_size_ = 7,
+                                           .max_angle_ = 80.0f,
+                                           .filter_by_angle_ = false},
+      .threads_ = 2}};
+
+  auto clean{test::make_plane(width, height, tilted)};
+  estimator.estimate(clean);
+
+  // a NaN pixel gets a zero normal and leaves the normals of the other points alone
+  auto noisy{test::make_plane(width, height, tilted)};
+  noisy(20, 30) = Point3f{std::numeric_limits<float>::quiet_NaN(), 20.0f, 100.0f};
+  estimator.estimate(noisy);
+
+  const auto expected{*clean.property<Prop::NORMALS>()};
+  const auto normals{*noisy.property<Prop::NORMALS>()};
+  size_t differ{0};
+
+  for (size_t i{0}; i < normals.size(); ++i) {
+    WE_CHECK(finite(normals[i]));
+
+    if (i != 20 * width + 30 and (normals[i] - expected[i]).norm() > 1e-4f) {
+      ++differ;
+    }
+  }
+
+  WE_CHECK(normals[20 * width + 30] == Point3f(0.0f, 0.0f, 0.0f));
+  WE_CHECK(differ == 0);
+  WE_CHECK(std::abs(expected[10 * width + 10].norm() - 1.0f) < 1e-4f);
+  return test::result();
+}
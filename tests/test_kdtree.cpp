@@ -0,0 +1,27 @@
+#include "check.h"
+#include <limits>
+#include <welib3d/kdtree.h>
+
+int main(int, char **) {
+  using namespace we;
+
+  const std::vector<Point3f> pts{Point3f{0.0f, 0.0f, 0.0f}, Point3f{5.0f, 0.0f, 0.0f}};
+  const std::vector<Point3f> appended{
+      Point3f{std::numeric_limits<float>::quiet_NaN(), 0.0f, 0.0f}, Point3f{2.0f, 0.0f, 0.0f}};
+
+  KdTree tree{pts};
+  tree.append(appended);
+
+  // appended points are found, non-finite ones never
+  std::vector<Neighbour> neighbours;
+  tree.knn(Point3f{1.5f, 0.0f, 0.0f}, 4, neighbours);
+
+  WE_CHECK(neighbours.size() == 3);
+  WE_CHECK(not neighbours.empty() and neighbours.front().index_ == 3);
+
+  for (const auto &nb : neighbours) {
+    WE_CHECK(nb.index_ != 2 and nb.squared_distance_ == nb.squared_distance_);
+  }
+
+  return test::result();
+}
@@ -0,0 +1,43 @@
+#include "check.h"
+#include <cmath>
+#include <limits>
+#include <welib3d/knn_normals.h>
+
+int main(int, char **) {
+  using namespace we;
+
+  // a tilted plane seen from above, z = 0.5 x - 50
+  std::vector<Point3f> pts;
+
+  for (size_t i{0}; i < 10000; ++i) {
+    const auto x{static_cast<float>(i % 100)};
+    pts.push_back(Point3f{x, static_cast<float>(i / 100), 0.5f * x - 50.0f});
+  }
+
+  pts[17] = Point3f{std::numeric_limits<float>::quiet_NaN(), 1.0f, 1.0f};
+  pts[4321] = Point3f{20.0f, std::numeric_limits<float>::infinity(), 1.0f};
+
+  PointCloud3f pcd{std::move(pts)};
+  KnnNormalsEstimator{KnnNormalsEstimatorSettings{.neighbours_ = 9, .threads_ = 4}}.estimate(pcd);
+
+  const auto normals{*pcd.property<Prop::NORMALS>()};
+  const Point3f zero{0.0f, 0.0f, 0.0f};
+
+  // non-finite points get a zero normal like in the organized estimators and are no neighbours
+  // of the other points, whose normals look up to the origin
+  WE_CHECK(normals[17] == zero and normals[4321] == zero);
+
+  const float scale{1.0f / std::sqrt(1.25f)};
+  bool plane{true};
+
+  for (size_t i{0}; i < normals.size(); ++i) {
+    if (i != 17 and i != 4321) {
+      const auto &n{normals[i]};
+      plane = plane and std::abs(n.x() + 0.5f * scale) < 1e-4f and std::abs(n.y()) < 1e-4f and
+              std::abs(n.z() - scale) < 1e-4f;
+    }
+  }
+
+  WE_CHECK(plane);
+  return test::result();
+}
@@ -0,0 +1,27 @@
+#include "check.h"
+#include <limits>
+#include <welib3d/knn_sor.h>
+
+int main(int, char **) {
+  using namespace we;
+
+  std::vector<Point3f> pts;
+
+  for (size_t i{0}; i < 20000; ++i) {
+    pts.push_back(Point3f{static_cast<float>(i % 200), static_cast<float>(i / 200), 0.0f});
+  }
+
+  const KnnSORFilter filter{KnnSORFilterSettings{.neighbours_ = 8, .sigma_multiplier_ = 1.0f}};
+
+  PointCloud3f clean{std::vector<Point3f>{pts}};
+  filter.apply(clean);
+
+  // a non-finite point is removed and leaves the scores of the other points alone
+  pts.push_back(Point3f{std::numeric_limits<float>::quiet_NaN(), 1.0f, 1.0f});
+  PointCloud3f noisy{std::move(pts)};
+  filter.apply(noisy);
+
+  WE_CHECK(clean.size() > 0);
+  WE_CHECK(noisy.size() == clean.size());
+  return test::result();
+}
@@ -0,0 +1,100 @@
+#include "check.h"
+#include "fixtures.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <welib3d/mesh_optimize.h>
+
+namespace {
+
+using namespace we;
+
+using Triangle = std::array<std::array<long, 2>, 3>;
+
+// the grid cells of the corners of every face, starting at its smallest corner, which keeps
+// the orientation
+std::vector<Triangle> triangles(const Mesh3f &mesh) {
+  const auto pts{mesh.points()};
+  std::vector<Triangle> res;
+
+  for (const auto &f : mesh.faces()) {
+    Triangle t{};
+
+    for (size_t k{0}; k < 3; ++k) {
+      const auto &p{pts[static_cast<size_t>(f[k])]};
+      t[k] = {std::lround(p.x()), std::lround(p.y())};
+    }
+
+    std::ranges::rotate(t, std::ranges::min_element(t));
+    res.push_back(t);
+  }
+
+  std::ranges::sort(res);
+  return res;
+}
+
+uint16_t intensity_at(const Point3f &p) {
+  return static_cast<uint16_t>(std::lround(p.x() * 100.0f + p.y()));
+}
+
+} // namespace
+
+int main(int, char **) {
+  const auto grid{test::make_grid_mesh(30, 20, [](float x, float y) { return 0.1f * x * y; })};
+
+  // the grid as a triangle soup: every face with vertices of its own, each copy slightly off,
+  // an unused vertex and a sliver face that the weld collapses
+  Mesh3f::vector_type vertices;
+  Mesh3f::vector_face_type faces;
+  const auto grid_pts{grid.points()};
+
+  for (const auto &f : grid.faces()) {
+    const auto v{static_cast<int>(vertices.size())};
+
+    for (size_t k{0}; k < 3; ++k) {
+      const auto jitter{0.001f * static_cast<float>((vertices.size() * 7) % 5)};
+      vertices.push_back(grid_pts[static_cast<size_t>(f[k])] + Point3f{jitter, 0.0f, 0.0f});
+    }
+
+    faces.push_back(Point3i{v, v + 1, v + 2});
+  }
+
+  const auto sliver{static_cast<int>(vertices.size())};
+  vertices.push_back(Point3f{5.0f, 5.0f, 2.5f});
+  vertices.push_back(Point3f{5.002f, 5.0f, 2.5f});
+  vertices.push_back(Point3f{6.0f, 5.0f, 3.0f});
+  faces.push_back(Point3i{sliver, sliver + 1, sliver + 2});
+  vertices.push_back(Point3f{100.0f, 100.0f, 100.0f});
+
+  std::vector<uint16_t> intensity(vertices.size());
+  std::ranges::transform(vertices, intensity.begin(), intensity_at);
+
+  Mesh3f soup{std::move(vertices), std::move(faces)};
+  soup.add_property<Prop::INTENSITY>(std::move(intensity));
+
+  const auto mesh{optimize_mesh(soup, MeshOptimizeSettings{.weld_distance_ = 0.01f})};
+  const auto before{test::topology(grid)};
+  const auto after{test::topology(mesh)};
+
+  // the soup is welded back into the grid: the same vertices, faces and orientation
+  WE_CHECK(after.valid() and after.euler() == before.euler());
+  WE_CHECK(mesh.size() == grid.size() and after.vertices_ == grid.size());
+  WE_CHECK(mesh.n_faces() == grid.n_faces() and after.open_edges_ == before.open_edges_);
+
+  WE_CHECK(triangles(mesh) == triangles(grid));
+
+  // a kept vertex keeps its own properties
+  const auto pts{mesh.points()};
+  const auto kept{*mesh.property<Prop::INTENSITY>()};
+  bool same_intensity{true};
+
+  for (size_t v{0}; v < mesh.size(); ++v) {
+    same_intensity = same_intensity and kept[v] == intensity_at(pts[v]);
+  }
+
+  WE_CHECK(same_intensity);
+
+  return test::result();
+}
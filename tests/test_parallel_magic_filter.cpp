@@ -0,0 +1,101 @@
+#include "check.h"
+#include <cmath>
+#include <limits>
+#include <welib3d/magic_filter.h>
+#include <welib3d/parallel_magic_filter.h>
+
+namespace {
+
+using namespace we;
+
+constexpr size_t width{64};
+constexpr size_t height{48};
+
+// plane at z = 100 with a few small islands floating above it and holes in the plane
+StructuredPointCloud3f make_scene() {
+  StructuredPointCloud3f pcd;
+  pcd.create(width, height, Point3f{0.0f, 0.0f, 0.0f});
+
+  for (size_t i{0}; i < height; ++i) {
+    for (size_t j{0}; j < width; ++j) {
+      auto z{100.0f + 0.01f * static_cast<float>(j)};
+
+      if ((i / 4 == 2 or i / 4 == 8) and (j / 4 == 3 or j / 4 == 11)) {
+        z = 180.0f + static_cast<float>(i);
+      }
+
+      pcd(i, j) = Point3f{static_cast<float>(j), static_cast<float>(i), z};
+    }
+  }
+
+  for (size_t i{20}; i < 26; ++i) {
+    for (size_t j{30}; j < 37; ++j) {
+      pcd(i, j) = pcd.empty_value();
+    }
+  }
+
+  return pcd;
+}
+
+// pixels that hold a nan or inf coordinate in the noisy scene
+bool broken(size_t i, size_t j) { return (i * 7 + j * 3) % 23 == 0 or (i == 9 and j == 45); }
+
+bool finite(const Point3f &p) {
+  return std::isfinite(p.x()) and std::isfinite(p.y()) and std::isfinite(p.z());
+}
+
+} // namespace
+
+int main(int, char **) {
+  const auto set{MagicFilterSetting{}
+                     .set_width(static_cast<int>(width))
+                     .set_height(static_cast<int>(height))
+                     .set_min_area(40)
+                     .set_num_bins(50)};
+  const auto nan{std::numeric_limits<float>::quiet_NaN()};
+  const auto inf{std::numeric_limits<float>::infinity()};
+
+  auto holes{make_scene()};
+  auto noisy{make_scene()};
+
+  for (size_t i{0}; i < height; ++i) {
+    for (size_t j{0}; j < width; ++j) {
+      if (broken(i, j) and holes.point_valid(i, j)) {
+        holes(i, j) = holes.empty_value();
+        noisy(i, j) = i == 9 ? Point3f{1.0f, 2.0f, inf} : Point3f{nan, nan, nan};
+      }
+    }
+  }
+
+  auto serial{holes};
+  MagicFilter{set}.apply(serial);
+
+  // nan and inf points change neither the cells nor the slices, whatever the number of threads
+  for (const size_t threads : {size_t{1}, size_t{3}, size_t{0}}) {
+    auto parallel{holes};
+    const ParallelMagicFilter filter{
+        ParallelMagicFilterSettings{.magic_ = set, .threads_ = threads}};
+    filter.apply(parallel);
+
+    auto parallel_noisy{noisy};
+    filter.apply(parallel_noisy);
+
+    size_t differ{0};
+
+    for (size_t i{0}; i < height; ++i) {
+      for (size_t j{0}; j < width; ++j) {
+        const bool kept{serial.point_valid(i, j)};
+        differ += parallel.point_valid(i, j) != kept ? 1 : 0;
+
+        if (finite(noisy(i, j))) {
+          differ += parallel_noisy.point_valid(i, j) != kept ? 1 : 0;
+        }
+      }
+    }
+
+    WE_CHECK(differ == 0);
+    WE_CHECK(parallel.point_valid(40, 5) and not parallel.point_valid(10, 14));
+  }
+
+  return test::result();
+}
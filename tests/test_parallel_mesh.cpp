@@ -0,0 +1,158 @@
+#include "check.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <utility>
+#include <vector>
+#include <welib3d/kdtree.h>
+#include <welib3d/parallel_mesh.h>
+
+namespace {
+
+using namespace we;
+
+// triangulated grid of the plane z = 0 over [x_first, x_first + columns] x [0, rows], the
+// vertices at x = seam moved by jitter as a reconstruction of their own would place them
+Mesh3f make_slab(int x_first, int columns, int rows, int seam, const Point3f &jitter) {
+  Mesh3f::vector_type vertices;
+  Mesh3f::vector_face_type faces;
+
+  for (int i{0}; i <= rows; ++i) {
+    for (int j{0}; j <= columns; ++j) {
+      const auto x{static_cast<float>(x_first + j)};
+      Point3f p{x, static_cast<float>(i), 0.0f};
+
+      if (x_first + j == seam) {
+        p = p + jitter;
+      }
+
+      vertices.push_back(p);
+    }
+  }
+
+  for (int i{0}; i < rows; ++i) {
+    for (int j{0}; j < columns; ++j) {
+      const int v{i * (columns + 1) + j};
+      faces.push_back(Point3i{v, v + 1, v + columns + 1});
+      faces.push_back(Point3i{v + 1, v + columns + 2, v + columns + 1});
+    }
+  }
+
+  return Mesh3f{std::move(vertices), std::move(faces)};
+}
+
+// edges used by a single face
+size_t open_edges(const Mesh3f &mesh) {
+  std::map<std::pair<int, int>, int> uses;
+
+  for (const auto &f : mesh.faces()) {
+    for (size_t k{0}; k < 3; ++k) {
+      const int a{f[k]};
+      const int b{f[(k + 1) % 3]};
+      ++uses[{std::min(a, b), std::max(a, b)}];
+    }
+  }
+
+  return static_cast<size_t>(
+      std::ranges::count_if(uses, [](const auto &edge) { return edge.second == 1; }));
+}
+
+// n points spread evenly over the sphere of the given radius, with their outward normals,
+// followed by a nan and an inf point when broken
+PointCloud3f make_sphere(size_t n, float radius, bool broken = false) {
+  std::vector<Point3f> pts(n);
+  std::vector<Point3f> normals(n);
+  const float golden{3.14159265f * (3.0f - std::sqrt(5.0f))};
+
+  for (size_t i{0}; i < n; ++i) {
+    const float z{1.0f - 2.0f * (static_cast<float>(i) + 0.5f) / static_cast<float>(n)};
+    const float r{std::sqrt(1.0f - z * z)};
+    const float phi{golden * static_cast<float>(i)};
+    normals[i] = Point3f{r * std::cos(phi), r * std::sin(phi), z};
+    pts[i] = normals[i] * radius;
+  }
+
+  if (broken) {
+    pts.push_back(Point3f{std::numeric_limits<float>::quiet_NaN(), 0.0f, 0.0f});
+    pts.push_back(Point3f{0.0f, std::numeric_limits<float>::infinity(), 0.0f});
+    normals.resize(pts.size(), Point3f{0.0f, 0.0f, 1.0f});
+  }
+
+  PointCloud3f pcd{std::move(pts)};
+  pcd.add_property<Prop::NORMALS>(std::move(normals));
+  return pcd;
+}
+
+double area(const Mesh3f &mesh) {
+  const auto pts{mesh.points()};
+  double sum{0.0};
+
+  for (const auto &f : mesh.faces()) {
+    const auto &a{pts[static_cast<size_t>(f.x())]};
+    const auto ab{pts[static_cast<size_t>(f.y())] - a};
+    const auto ac{pts[static_cast<size_t>(f.z())] - a};
+    const Point3f cross{ab.y() * ac.z() - ab.z() * ac.y(), ab.z() * ac.x() - ab.x() * ac.z(),
+                        ab.x() * ac.y() - ab.y() * ac.x()};
+    sum += 0.5 * cross.norm();
+  }
+
+  return sum;
+}
+
+} // namespace
+
+int main(int, char **) {
+  // two slabs of a 10 x 4 plane meeting at x = 5, the second one with its seam vertices off
+  const std::vector<Mesh3f> parts{make_slab(0, 5, 4, 5, Point3f{0.0f, 0.0f, 0.0f}),
+                                  make_slab(5, 5, 4, 5, Point3f{0.1f, 0.0f, 0.05f})};
+  const std::vector<float> borders{std::numeric_limits<float>::lowest(), 5.0f,
+                                   std::numeric_limits<float>::max()};
+
+  const auto apart{detail::stitch_slabs(parts, borders, 0, 0.0f)};
+  WE_CHECK(apart.size() == 60 and apart.n_faces() == 80);
+  WE_CHECK(open_edges(apart) == 36);
+
+  // the seam is closed, only the outline of the plane stays open
+  const auto stitched{detail::stitch_slabs(parts, borders, 0, 0.5f)};
+  WE_CHECK(stitched.size() == 55 and stitched.n_faces() == 80);
+  WE_CHECK(open_edges(stitched) == 28);
+
+  // a weld distance below the offset of the seam vertices leaves the seam open
+  const auto narrow{detail::stitch_slabs(parts, borders, 0, 0.05f)};
+  WE_CHECK(narrow.size() == 60 and open_edges(narrow) == 36);
+
+  // the whole pipeline in slabs against a single slab, a closed surface so that the
+  // reconstruction has no open borders of its own
+  const MeshRecSettings mesh{
+      .resolution_ = 1.0f, .samples_per_node_ = 1.5f, .max_hole_radius_ = std::nullopt};
+  const auto sphere{make_sphere(20000, 20.0f)};
+  const auto whole{
+      create_mesh_parallel(sphere, ParallelMeshSettings{.mesh_ = mesh, .threads_ = 1})};
+  const ParallelMeshSettings sliced_set{.mesh_ = mesh, .threads_ = 4, .overlap_ = 2.0f};
+  const auto sliced{create_mesh_parallel(sphere, sliced_set)};
+
+  WE_CHECK(whole and whole->n_faces() > 0 and sliced and sliced->n_faces() > 0);
+
+  if (whole and sliced and whole->n_faces() > 0) {
+    WE_CHECK(std::abs(area(*sliced) / area(*whole) - 1.0) < 0.02);
+
+    // every vertex of the slabs lies on the surface of the single slab
+    const KdTree tree{whole->points()};
+    const auto nearest{tree.knn(sliced->points(), 1)};
+    size_t off{0};
+
+    for (size_t i{0}; i < nearest.size(); ++i) {
+      off += nearest[i].empty() or nearest[i].front().squared_distance_ > 1.0f ? 1 : 0;
+    }
+
+    WE_CHECK(off == 0);
+  }
+
+  // nan and inf points are left out, the slabs and the result stay the same
+  const auto noisy{create_mesh_parallel(make_sphere(20000, 20.0f, true), sliced_set)};
+  WE_CHECK(noisy and sliced and noisy->size() == sliced->size() and
+           std::ranges::equal(noisy->faces(), sliced->faces()));
+
+  return test::result();
+}
@@ -0,0 +1,169 @@
+#include "check.h"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <welib3d/io_ply_mapped.h>
+#include <welib3d/io_ply_stream.h>
+
+namespace {
+
+// a sink that takes every byte but can not tell or seek its position, it counts the attempts
+struct UnseekableBuffer : std::streambuf {
+  size_t seeks_{0};
+
+  int_type overflow(int_type c) override { return traits_type::not_eof(c); }
+  std::streamsize xsputn(const char *, std::streamsize n) override { return n; }
+
+  pos_type seekoff(off_type, std::ios_base::seekdir, std::ios_base::openmode) override {
+    ++seeks_;
+    return pos_type(off_type(-1));
+  }
+
+  pos_type seekpos(pos_type, std::ios_base::openmode) override {
+    ++seeks_;
+    return pos_type(off_type(-1));
+  }
+};
+
+void write_file(const std::string &path, const std::string &header, size_t data_bytes) {
+  std::ofstream out{path, std::ios_base::binary};
+  out << header;
+  out << std::string(data_bytes, '\0');
+}
+
+} // namespace
+
+int main(int, char **) {
+  using namespace we;
+
+  const auto path{(std::filesystem::temp_directory_path() / "welib3d_test_mapped.ply").string()};
+  const std::string vertex{"element vertex 4\n"
+                           "property float x\nproperty float y\nproperty float z\n"};
+
+  // a valid file
+  write_file(path, "ply\nformat binary_little_endian 1.0\n" + vertex + "end_header\n", 48);
+  const auto valid{map_ply(path)};
+  WE_CHECK(valid and valid->pointcloud().size() == 4);
+
+  // a vertex count whose size wraps around 2^64
+  write_file(path,
+             "ply\nformat binary_little_endian 1.0\nelement vertex 1537228672809129302\n"
+             "property float x\nproperty float y\nproperty float z\nend_header\n",
+             48);
+  WE_CHECK(not map_ply(path));
+
+  // a fixed-size element before the vertices whose size wraps
+  write_file(path,
+             "ply\nformat binary_little_endian 1.0\nelement extra 4611686018427387905\n"
+             "property float w\n" +
+                 vertex + "end_header\n",
+             52);
+  WE_CHECK(not map_ply(path));
+
+  // a negative list count, read as a size it wraps when multiplied by the type size
+  std::string list{"ply\nformat binary_little_endian 1.0\nelement face 1\n"
+                   "property list int double vertex_indices\n" +
+                   vertex + "end_header\n"};
+  list += std::string{"\xff\xff\xff\xff", 4};
+  write_file(path, list, 48);
+  WE_CHECK(not map_ply(path));
+
+  // streamed rows are read back by map_ply, a cloud missing a layout property is refused
+  StructuredPointCloud3f grid;
+  grid.create(4, 3, Point3f{0.0f, 0.0f, 0.0f});
+  grid(1, 2) = Point3f{1.0f, 2.0f, 3.0f};
+  grid(2, 0) = Point3f{4.0f, 5.0f, 6.0f};
+
+  {
+    PlyStreamWriter writer{path, PlyStreamLayout::of(grid)};
+    writer.write_rows(grid, 0, 2);
+    writer.write_rows(grid, 2, 3);
+    WE_CHECK(writer.finish() and writer.vertex_count() == 2);
+  }
+
+  const auto streamed{map_ply(path)};
+  WE_CHECK(streamed and streamed->pointcloud().size() == 2);
+
+  std::stringstream out;
+  PlyStreamWriter writer{out, PlyStreamLayout{.normals_ = true}};
+  bool refused{false};
+
+  try {
+    writer.write_rows(grid, 0, 3);
+  } catch (const std::runtime_error &) {
+    refused = true;
+  }
+
+  WE_CHECK(refused and writer.finish() and writer.vertex_count() == 0);
+
+  // bands of a frame with holes and all properties, through a buffer of a few vertices so that
+  // both buffers are flushed many times
+  StructuredPointCloud3f frame;
+  frame.create(16, 10, Point3f{0.0f, 0.0f, 0.0f});
+  frame.add_property<Prop::NORMALS>();
+  frame.add_property<Prop::INTENSITY>();
+  frame.add_property<Prop::RGB>();
+  std::vector<size_t> valid_pixels;
+
+  for (size_t i{0}; i < frame.size(); ++i) {
+    const auto v{static_cast<float>(i)};
+    (*frame.property<Prop::NORMALS>())[i] = Point3f{0.0f, v, 1.0f};
+    (*frame.property<Prop::INTENSITY>())[i] = static_cast<uint16_t>(1000 + i);
+    (*frame.property<Prop::RGB>())[i] =
+        Point3ub{static_cast<uint8_t>(i), static_cast<uint8_t>(2 * i), uint8_t{7}};
+
+    if (i % 5 != 2) {
+      frame[i] = Point3f{v, -v, 0.5f * v + 1.0f};
+      valid_pixels.push_back(i);
+    }
+  }
+
+  const auto layout{PlyStreamLayout::of(frame)};
+
+  {
+    PlyStreamWriter banded{path, layout, 5 * layout.vertex_size()};
+
+    for (size_t row{0}; row < frame.height(); row += 3) {
+      banded.write_rows(frame, row, std::min(row + 3, frame.height()));
+    }
+
+    WE_CHECK(banded.finish() and banded.vertex_count() == valid_pixels.size());
+  }
+
+  const auto bands{map_ply(path)};
+  WE_CHECK(bands and bands->pointcloud().size() == valid_pixels.size());
+
+  if (bands and bands->pointcloud().size() == valid_pixels.size()) {
+    const auto &pcd{bands->pointcloud()};
+    bool same{pcd.property<Prop::NORMALS>() and pcd.property<Prop::INTENSITY>() and
+              pcd.property<Prop::RGB>()};
+
+    for (size_t k{0}; k < valid_pixels.size() and same; ++k) {
+      const size_t i{valid_pixels[k]};
+      same = pcd[k] == frame[i] and
+             (*pcd.property<Prop::NORMALS>())[k] == (*frame.property<Prop::NORMALS>())[i] and
+             (*pcd.property<Prop::INTENSITY>())[k] == (*frame.property<Prop::INTENSITY>())[i] and
+             (*pcd.property<Prop::RGB>())[k] == (*frame.property<Prop::RGB>())[i];
+    }
+
+    WE_CHECK(same);
+  }
+
+  // a stream that can not tell its position has no place for the vertex count: finish() fails
+  // without seeking, the only attempt is the tellp() before the header
+  UnseekableBuffer sink;
+  std::ostream unseekable{&sink};
+  PlyStreamWriter blind{unseekable, layout};
+  blind.write_rows(frame, 0, frame.height());
+  WE_CHECK(not blind.finish() and sink.seeks_ == 1);
+
+  std::error_code ec;
+  std::filesystem::remove(path, ec);
+  return test::result();
+}
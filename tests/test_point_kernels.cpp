@@ -0,0 +1,125 @@
+#include "check.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <welib3d/point_kernels.h>
+
+namespace {
+
+using namespace we;
+
+// the scalar and the SIMD paths may differ by a multiply-add contracted to FMA, see
+// set_simd_level()
+bool close(float a, float b) { return std::abs(a - b) <= 1e-5f * std::max(1.0f, std::abs(a)); }
+
+bool close(const Point3f &a, const Point3f &b) {
+  return close(a.x(), b.x()) and close(a.y(), b.y()) and close(a.z(), b.z());
+}
+
+template <typename T> bool close(const std::vector<T> &a, const std::vector<T> &b) {
+  return a.size() == b.size() and std::ranges::equal(a, b, [](const T &x, const T &y) {
+           return close(x, y);
+         });
+}
+
+std::vector<Point3f> make_points(size_t n, std::mt19937 &gen) {
+  std::uniform_real_distribution<float> coord{-100.0f, 100.0f};
+  std::vector<Point3f> pts(n);
+
+  for (auto &p : pts) {
+    p = Point3f{coord(gen), coord(gen), coord(gen)};
+  }
+
+  // a zero point, which normalize() leaves as it is
+  if (n > 3) {
+    pts[3] = Point3f{0.0f, 0.0f, 0.0f};
+  }
+
+  return pts;
+}
+
+// every kernel at level, out of place and where it may be in place
+struct Results {
+  std::vector<Point3f> transformed_;
+  std::vector<Point3f> transformed_in_place_;
+  std::vector<Point3f> rotated_;
+  std::vector<Point3f> normalized_;
+  std::vector<Point3f> normalized_in_place_;
+  std::vector<Point3f> crossed_;
+  std::vector<Point3f> crossed_in_place_;
+  std::vector<float> dots_;
+  std::vector<float> norms_;
+  std::vector<float> distances_;
+};
+
+Results run(SimdLevel level, const std::vector<Point3f> &a, const std::vector<Point3f> &b) {
+  const Matrix4f m{0.36f, -0.48f, 0.8f, 10.0f, 0.8f, 0.6f, 0.0f,  -20.0f,
+                   -0.48f, 0.64f, 0.6f, 30.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+  const Matrix3f r{0.36f, -0.48f, 0.8f, 0.8f, 0.6f, 0.0f, -0.48f, 0.64f, 0.6f};
+  const size_t n{a.size()};
+
+  set_simd_level(level);
+  Results res{std::vector<Point3f>(n), a, std::vector<Point3f>(n), std::vector<Point3f>(n), a,
+              std::vector<Point3f>(n), a, std::vector<float>(n), std::vector<float>(n),
+              std::vector<float>(n)};
+
+  transform_points(a, res.transformed_, m);
+  transform_points(res.transformed_in_place_, res.transformed_in_place_, m);
+  rotate_points(a, res.rotated_, r);
+  normalize(a, res.normalized_);
+  normalize(res.normalized_in_place_, res.normalized_in_place_);
+  cross(a, b, res.crossed_);
+  cross(res.crossed_in_place_, b, res.crossed_in_place_);
+  dot(a, b, res.dots_);
+  norms(a, res.norms_);
+  squared_distances(a, Point3f{1.0f, -2.0f, 3.0f}, res.distances_);
+  return res;
+}
+
+} // namespace
+
+int main(int, char **) {
+  std::mt19937 gen{5};
+  std::vector<size_t> sizes(40);
+
+  // every tail length of the 8 and 16 point SIMD blocks and a longer run
+  for (size_t i{0}; i < sizes.size(); ++i) {
+    sizes[i] = i;
+  }
+
+  sizes.push_back(1001);
+
+  for (const size_t n : sizes) {
+    const auto a{make_points(n, gen)};
+    const auto b{make_points(n, gen)};
+    const auto scalar{run(SimdLevel::SCALAR, a, b)};
+
+    WE_CHECK(close(scalar.transformed_, scalar.transformed_in_place_));
+    WE_CHECK(close(scalar.normalized_, scalar.normalized_in_place_));
+    WE_CHECK(close(scalar.crossed_, scalar.crossed_in_place_));
+    WE_CHECK(n <= 3 or scalar.normalized_[3] == Point3f(0.0f, 0.0f, 0.0f));
+
+    for (const auto level : {SimdLevel::AVX2, SimdLevel::AVX512}) {
+      if (level > supported_simd_level()) {
+        continue;
+      }
+
+      const auto simd{run(level, a, b)};
+      WE_CHECK(close(simd.transformed_, scalar.transformed_));
+      WE_CHECK(close(simd.transformed_in_place_, scalar.transformed_));
+      WE_CHECK(close(simd.rotated_, scalar.rotated_));
+      WE_CHECK(close(simd.normalized_, scalar.normalized_));
+      WE_CHECK(close(simd.normalized_in_place_, scalar.normalized_));
+      WE_CHECK(close(simd.crossed_, scalar.crossed_));
+      WE_CHECK(close(simd.crossed_in_place_, scalar.crossed_));
+      WE_CHECK(close(simd.dots_, scalar.dots_));
+      WE_CHECK(close(simd.norms_, scalar.norms_));
+      WE_CHECK(close(simd.distances_, scalar.distances_));
+    }
+  }
+
+  set_simd_level(supported_simd_level());
+
+  return test::result();
+}
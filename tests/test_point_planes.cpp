@@ -0,0 +1,76 @@
+#include "check.h"
+#include <algorithm>
+#include <cstdint>
+#include <welib3d/point_planes.h>
+#include <welib3d/pointcloud.h>
+
+int main(int, char **) {
+  using namespace we;
+
+  // a size that is no multiple of the lane count, so the planes carry padding
+  const size_t n{37};
+  PointCloud3f pcd;
+  pcd.create(n);
+
+  for (size_t i{0}; i < n; ++i) {
+    const auto v{static_cast<float>(i)};
+    pcd[i] = Point3f{v, 100.0f + v, -v};
+  }
+
+  // AoS -> SoA: contiguous, aligned planes padded with zeros
+  auto planes{pcd.planes()};
+  WE_CHECK(planes.size() == n);
+  WE_CHECK(planes.padded_size() % PointPlanes3f::Lanes == 0 and planes.padded_size() >= n);
+
+  bool same{true};
+  bool aligned{true};
+  bool padded{true};
+
+  for (int k{0}; k < PointPlanes3f::nPlanes; ++k) {
+    const auto plane{planes.plane(k)};
+    const auto address{reinterpret_cast<uintptr_t>(plane.data())};
+    aligned = aligned and address % PointPlanes3f::Alignment == 0;
+
+    for (size_t i{0}; i < n; ++i) {
+      same = same and plane[i] == pcd[i][k];
+    }
+
+    for (size_t i{n}; i < planes.padded_size(); ++i) {
+      padded = padded and plane.data()[i] == 0.0f;
+    }
+  }
+
+  WE_CHECK(same and aligned and padded);
+  WE_CHECK(std::ranges::equal(planes.points(), pcd.points()));
+
+  // SoA -> AoS
+  for (auto &&z : planes.z()) {
+    z += 1.0f;
+  }
+
+  pcd.store(planes);
+  const Point3f moved{5.0f, 105.0f, -4.0f};
+  WE_CHECK(pcd[5] == moved and pcd[n - 1].z() == -35.0f);
+
+  // shrinking and growing again zeroes the points past the old size, padding included
+  planes.resize(10);
+  planes.resize(n);
+  const Point3f zero{0.0f, 0.0f, 0.0f};
+  WE_CHECK(planes.point(9) == pcd[9] and planes.point(10) == zero);
+  WE_CHECK(planes.plane<1>().data()[planes.padded_size() - 1] == 0.0f);
+
+  // the strided lane reads and writes the points themselves, without a copy
+  auto ys{pcd.strided_lane<1>()};
+  WE_CHECK(ys.size() == n and ys.stride() == 3 and ys.data() == &pcd[0].y());
+  WE_CHECK(std::ranges::equal(ys, pcd.points(), {}, {}, [](const Point3f &p) { return p.y(); }));
+
+  ys[7] = -1.0f;
+  WE_CHECK(pcd[7].y() == -1.0f);
+  WE_CHECK(ys.end() - ys.begin() == static_cast<std::ptrdiff_t>(n));
+
+  const auto &view{pcd};
+  WE_CHECK(view.strided_lane<2>()[3] == pcd[3].z());
+  WE_CHECK(strided_lane<0>(std::span<const Point3f>{}).empty());
+
+  return test::result();
+}
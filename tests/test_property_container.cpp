@@ -0,0 +1,46 @@
+#include "check.h"
+#include <cstdint>
+#include <vector>
+#include <welib3d/pointcloud.h>
+
+int main(int, char **) {
+  using namespace we;
+
+  PropertyContainer props;
+  const auto a{props.add<float>("a", {1.0f, 2.0f})};
+  const auto b{props.add<int32_t>("b", {3, 4})};
+  const auto c{props.add<double>("c", {5.0, 6.0})};
+  WE_CHECK(a.indx() == 0 and b.indx() == 1 and c.indx() == 2);
+
+  // a removed property frees its slot, the next property goes into it
+  props.remove(b);
+  WE_CHECK(not props.handle<int32_t>("b").is_valid());
+
+  const auto d{props.add<uint16_t>("d", {7, 8})};
+  WE_CHECK(d.indx() == 1);
+  WE_CHECK(props.handle<uint16_t>("d").indx() == 1 and props.handle<double>("c").indx() == 2);
+  WE_CHECK(props.property(c).data()[1] == 6.0);
+
+  // the same name and type is replaced in its slot, no duplicate is added
+  const auto a2{props.add<float>("a", {9.0f, 10.0f, 11.0f})};
+  WE_CHECK(a2.indx() == 0 and props.handle<float>("a").indx() == 0);
+  WE_CHECK(props.property(a2).data().size() == 3 and props.property(a2).data()[2] == 11.0f);
+
+  // the same name of another type is a property of its own
+  const auto a3{props.add<int32_t>("a", {12, 13})};
+  WE_CHECK(a3.indx() == 3 and props.handle<float>("a").indx() == 0);
+
+  // through a cloud: adding a typed property twice keeps one property of the cloud size
+  PointCloud3f pcd{std::vector<Point3f>(4, Point3f{0.0f, 0.0f, 0.0f})};
+  pcd.add_property<Prop::INTENSITY>();
+  (*pcd.property<Prop::INTENSITY>())[3] = 5;
+  pcd.add_property<Prop::INTENSITY>(std::vector<uint16_t>(4, 9));
+  WE_CHECK(pcd.get_property_handle<Prop::INTENSITY>().indx() == 0);
+  WE_CHECK((*pcd.property<Prop::INTENSITY>())[3] == 9);
+
+  pcd.remove_property<Prop::INTENSITY>();
+  const auto normals{pcd.add_property<Prop::NORMALS>()};
+  WE_CHECK(normals.indx() == 0 and pcd.property<Prop::NORMALS>()->size() == 4);
+
+  return test::result();
+}
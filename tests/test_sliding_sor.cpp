@@ -0,0 +1,37 @@
+#include "check.h"
+#include "fixtures.h"
+#include <limits>
+#include <welib3d/sliding_sor.h>
+
+int main(int, char **) {
+  using namespace we;
+
+  const size_t width{64};
+  const size_t height{64};
+  const auto flat{[](float, float) { return 10.0f; }};
+  const SlidingSORFilter filter{SlidingSORFilterSettings{.image_width_ = width,
+                                                         .image_height_ = height,
+                                                         .minimum_neighbours_ = 3,
+                                                         .sigma_multiplier_ = 1.0f,
+                                                         .window_size_ = 5,
+                                                         .threads_ = 2}};
+
+  // a planted outlier is removed, with or without a non-finite point elsewhere in the frame
+  for (const bool with_nan : {false, true}) {
+    auto pcd{test::make_plane(width, height, flat)};
+    pcd(20, 20) = Point3f{20.0f, 20.0f, 50.0f};
+
+    if (with_nan) {
+      pcd(40, 40) = Point3f{std::numeric_limits<float>::quiet_NaN(), 40.0f, 10.0f};
+      pcd(50, 10) = Point3f{10.0f, std::numeric_limits<float>::infinity(), 10.0f};
+    }
+
+    filter.apply(pcd);
+
+    WE_CHECK(not pcd.point_valid(20, 20));
+    WE_CHECK(pcd.point_valid(30, 30));
+    WE_CHECK(not with_nan or (not pcd.point_valid(40, 40) and not pcd.point_valid(50, 10)));
+  }
+
+  return test::result();
+}
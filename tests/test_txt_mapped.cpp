@@ -0,0 +1,50 @@
+#include "check.h"
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <welib3d/io_txt_mapped.h>
+
+int main(int, char **) {
+  using namespace we;
+
+  const auto path{(std::filesystem::temp_directory_path() / "welib3d_test_txt.txt").string()};
+
+  {
+    std::ofstream out{path, std::ios_base::binary};
+    out << "# 2 x 2 scan\r\n"
+           "0 0 1 10\r\n"
+           "nan nan nan 0\r\n"
+           "\r\n"
+           "-inf +2 NaN 0\r\n"
+           "1 1 +4 40\r\n";
+  }
+
+  // rows of empty pixels keep their place in the grid
+  StructuredPointCloud3f pcd;
+  const Point3f empty{0.0f, 0.0f, 0.0f};
+  WE_CHECK(load_txt_mapped(pcd, 2, 2, empty, TxtFileFormat::XYZI, TxtSeparator::SPACE, path, 2));
+  WE_CHECK(pcd.size() == 4);
+  WE_CHECK(pcd(0, 0) == Point3f(0.0f, 0.0f, 1.0f));
+  WE_CHECK(std::isnan(pcd(0, 1).x()) and std::isnan(pcd(0, 1).z()));
+  WE_CHECK(std::isinf(pcd(1, 0).x()) and pcd(1, 0).y() == 2.0f);
+  WE_CHECK(pcd(1, 1) == Point3f(1.0f, 1.0f, 4.0f));
+  WE_CHECK(pcd.property<Prop::INTENSITY>() and (*pcd.property<Prop::INTENSITY>())[3] == 40);
+
+  // nan or inf intensity and colour on a line of an empty pixel become 0
+  {
+    std::ofstream out{path, std::ios_base::binary};
+    out << "0 0 1 10 1 2 3\n"
+           "nan nan nan nan nan inf -nan\n";
+  }
+
+  WE_CHECK(load_txt_mapped(pcd, 2, 1, empty, TxtFileFormat::XYZIRGB, TxtSeparator::SPACE, path,
+                           1));
+  const auto intensity{pcd.property<Prop::INTENSITY>()};
+  const auto rgb{pcd.property<Prop::RGB>()};
+  WE_CHECK(intensity and (*intensity)[0] == 10 and (*intensity)[1] == 0);
+  WE_CHECK(rgb and (*rgb)[0] == Point3ub(1, 2, 3) and (*rgb)[1] == Point3ub(0, 0, 0));
+
+  std::error_code ec;
+  std::filesystem::remove(path, ec);
+  return test::result();
+}
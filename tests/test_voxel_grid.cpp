@@ -0,0 +1,127 @@
+#include "check.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <random>
+#include <vector>
+#include <welib3d/voxel_grid.h>
+
+namespace {
+
+using namespace we;
+
+struct Voxel {
+  size_t first_;
+  std::array<double, 3> sum_{};
+  uint64_t intensity_{0};
+  size_t count_{0};
+};
+
+// the voxels of the finite points in the order of their first point, found one point at a time
+std::vector<Voxel> brute_force(const PointCloud3f &pcd, float leaf) {
+  const auto pts{pcd.points()};
+  const auto finite{[](const Point3f &p) {
+    return std::isfinite(p.x()) and std::isfinite(p.y()) and std::isfinite(p.z());
+  }};
+  std::array<double, 3> low{std::numeric_limits<double>::max(), std::numeric_limits<double>::max(),
+                            std::numeric_limits<double>::max()};
+
+  for (const auto &p : pts) {
+    for (int c{0}; c < 3 and finite(p); ++c) {
+      low[c] = std::min(low[c], static_cast<double>(p[c]));
+    }
+  }
+
+  std::map<std::array<int64_t, 3>, size_t> index;
+  std::vector<Voxel> voxels;
+
+  for (size_t i{0}; i < pts.size(); ++i) {
+    if (not finite(pts[i])) {
+      continue;
+    }
+
+    std::array<int64_t, 3> key{};
+
+    for (int c{0}; c < 3; ++c) {
+      key[c] = static_cast<int64_t>((pts[i][c] - low[c]) * (1.0 / leaf));
+    }
+
+    const auto [it, added]{index.try_emplace(key, voxels.size())};
+
+    if (added) {
+      voxels.push_back({i});
+    }
+
+    auto &v{voxels[it->second]};
+
+    for (int c{0}; c < 3; ++c) {
+      v.sum_[c] += pts[i][c];
+    }
+
+    v.intensity_ += (*pcd.property<Prop::INTENSITY>())[i];
+    ++v.count_;
+  }
+
+  return voxels;
+}
+
+} // namespace
+
+int main(int, char **) {
+  std::mt19937 gen{9};
+  std::uniform_real_distribution<float> coord{-20.0f, 20.0f};
+  const size_t n{20000};
+
+  PointCloud3f pcd;
+  pcd.create(n);
+  pcd.add_property<Prop::INTENSITY>();
+
+  for (size_t i{0}; i < n; ++i) {
+    pcd[i] = Point3f{coord(gen), coord(gen), 0.25f * coord(gen)};
+    (*pcd.property<Prop::INTENSITY>())[i] = static_cast<uint16_t>(gen() % 1000);
+  }
+
+  // non-finite points are dropped
+  pcd[17] = Point3f{std::numeric_limits<float>::quiet_NaN(), 0.0f, 0.0f};
+  pcd[18] = Point3f{0.0f, std::numeric_limits<float>::infinity(), 0.0f};
+
+  const float leaf{2.5f};
+  const auto voxels{brute_force(pcd, leaf)};
+
+  const auto centroids{VoxelGrid{VoxelGridSettings{.leaf_size_ = leaf, .threads_ = 4}}.apply(pcd)};
+  WE_CHECK(centroids.size() == voxels.size());
+
+  bool same_centroids{centroids.size() == voxels.size()};
+
+  for (size_t k{0}; k < voxels.size() and same_centroids; ++k) {
+    const auto &v{voxels[k]};
+    const auto count{static_cast<double>(v.count_)};
+
+    for (int c{0}; c < 3; ++c) {
+      same_centroids = same_centroids and
+                       std::abs(centroids[k][c] - static_cast<float>(v.sum_[c] / count)) < 1e-4f;
+    }
+
+    same_centroids = same_centroids and (*centroids.property<Prop::INTENSITY>())[k] ==
+                                            (v.intensity_ + v.count_ / 2) / v.count_;
+  }
+
+  WE_CHECK(same_centroids);
+
+  const VoxelGridSettings first_point{
+      .leaf_size_ = leaf, .mode_ = VoxelMode::FIRST_POINT, .threads_ = 4};
+  const auto firsts{VoxelGrid{first_point}.apply(pcd)};
+  bool same_firsts{firsts.size() == voxels.size()};
+
+  for (size_t k{0}; k < voxels.size() and same_firsts; ++k) {
+    same_firsts = firsts[k] == pcd[voxels[k].first_] and
+                  (*firsts.property<Prop::INTENSITY>())[k] ==
+                      (*pcd.property<Prop::INTENSITY>())[voxels[k].first_];
+  }
+
+  WE_CHECK(same_firsts);
+
+  return test::result();
+}
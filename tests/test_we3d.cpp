@@ -0,0 +1,204 @@
+#include "check.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <welib3d/io_we3d.h>
+
+namespace {
+
+using namespace we;
+
+constexpr size_t width{40};
+constexpr size_t height{30};
+
+// n values of T, compressible ones counting up slowly, incompressible ones of random bytes
+template <typename T> std::vector<T> make_values(size_t n, bool random, std::mt19937 &gen) {
+  std::vector<T> values(n);
+
+  if (random) {
+    std::vector<uint8_t> bytes(n * sizeof(T));
+
+    for (auto &b : bytes) {
+      b = static_cast<uint8_t>(gen());
+    }
+
+    std::memcpy(values.data(), bytes.data(), bytes.size());
+    return values;
+  }
+
+  for (size_t i{0}; i < n; ++i) {
+    if constexpr (std::is_arithmetic_v<T>) {
+      values[i] = static_cast<T>(i / 16 % 100);
+    } else {
+      using Scalar = std::remove_cvref_t<decltype(values[i][0])>;
+      values[i] = T{static_cast<Scalar>(i / 16 % 100), static_cast<Scalar>(i / width % 100),
+                    Scalar{1}};
+    }
+  }
+
+  return values;
+}
+
+// bitwise, random floats may be nan
+template <typename T> bool same_bytes(std::span<const T> a, std::span<const T> b) {
+  return a.size() == b.size() and std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0;
+}
+
+std::vector<char> read_file(const std::string &path) {
+  std::ifstream in{path, std::ios_base::binary};
+  return {std::istreambuf_iterator<char>{in}, std::istreambuf_iterator<char>{}};
+}
+
+void write_file(const std::string &path, const std::vector<char> &bytes) {
+  std::ofstream out{path, std::ios_base::binary};
+  out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+// a property of every type the reader knows survives the round trip, stored compressed when
+// its values repeat and as they are when they are random
+template <typename... Types> void check_round_trip(const std::string &path) {
+  for (const bool shuffle : {false, true}) {
+    for (const bool random : {false, true}) {
+      std::mt19937 gen{7};
+      StructuredPointCloud3f pcd;
+      pcd.create(make_values<Point3f>(width * height, random, gen), width, height,
+                 Point3f{0.0f, 0.0f, 0.0f});
+
+      size_t index{0};
+      (static_cast<void>(pcd.add_property(make_values<Types>(pcd.size(), random, gen),
+                                          "p" + std::to_string(index++))),
+       ...);
+
+      // small blocks, so that every chunk has several of them and a shorter last one
+      const We3dSettings set{.block_bytes_ = 1000, .shuffle_ = shuffle, .threads_ = 3};
+      WE_CHECK(save_we3d(pcd, path, set));
+
+      We3dReader reader{path, set};
+      StructuredPointCloud3f loaded;
+      WE_CHECK(reader.is_open() and reader.read(loaded));
+      WE_CHECK(loaded.width() == width and loaded.height() == height);
+      WE_CHECK(reader.skipped().empty());
+      WE_CHECK(same_bytes<Point3f>(pcd.points(), loaded.points()));
+
+      index = 0;
+      const auto check_property{[&]<typename T>() {
+        const auto name{"p" + std::to_string(index++)};
+        const auto handle{loaded.get_property_handle<T>(name)};
+        WE_CHECK(handle.is_valid() and
+                 same_bytes<T>(pcd.property(pcd.get_property_handle<T>(name)),
+                               loaded.property(handle)));
+
+        const auto info{std::ranges::find(reader.chunks(), name, &We3dChunkInfo::name_)};
+        const size_t raw{pcd.size() * sizeof(T)};
+        WE_CHECK(info != reader.chunks().end() and
+                 (random ? info->stored_bytes_ == raw : info->stored_bytes_ < raw));
+      }};
+
+      (check_property.template operator()<Types>(), ...);
+    }
+  }
+}
+
+} // namespace
+
+int main(int, char **) {
+  const auto path{(std::filesystem::temp_directory_path() / "welib3d_test.we3d").string()};
+
+  check_round_trip<uint8_t, int8_t, uint16_t, int16_t, uint32_t, int32_t, uint64_t, int64_t, float,
+                   double, Point3f, Point3d, Point3i, Point3ub>(path);
+
+  // LZ4 blocks of every short length, around the margins at the end of a block, and of the
+  // lengths around the largest offset and the default block: random bytes, which take the
+  // bound, and runs, which end in matches reaching up to the last literals
+  std::vector<size_t> lengths(300);
+  std::iota(lengths.begin(), lengths.end(), size_t{0});
+  lengths.insert(lengths.end(), {65535, 65536, 65537, size_t{1} << 20});
+
+  std::mt19937 gen{11};
+  std::vector<uint32_t> table(size_t{1} << detail::lz4_hash_log);
+  bool lz4_ok{true};
+
+  for (const size_t n : lengths) {
+    for (const bool random : {false, true}) {
+      std::vector<std::byte> src(n);
+
+      for (size_t i{0}; i < n; ++i) {
+        src[i] = static_cast<std::byte>(random ? gen() : i % 3);
+      }
+
+      // guard bytes behind the bound catch a write past it
+      std::vector<std::byte> packed(detail::lz4_bound(n) + 16, std::byte{0xa5});
+      const size_t size{detail::lz4_compress(src, packed.data(), table)};
+      std::vector<std::byte> out(n);
+
+      lz4_ok = lz4_ok and size <= detail::lz4_bound(n) and
+               std::ranges::all_of(std::span{packed}.subspan(detail::lz4_bound(n)),
+                                   [](std::byte b) { return b == std::byte{0xa5}; }) and
+               detail::lz4_decompress(std::span{packed}.first(size), out) and out == src;
+
+      // a block is only valid for exactly the size it was made of
+      std::vector<std::byte> longer(n + 1);
+      lz4_ok = lz4_ok and not detail::lz4_decompress(std::span{packed}.first(size), longer);
+    }
+  }
+
+  WE_CHECK(lz4_ok);
+
+  // truncated and corrupted files are refused, not read past their end
+  std::mt19937 values_gen{3};
+  StructuredPointCloud3f pcd;
+  pcd.create(make_values<Point3f>(width * height, false, values_gen), width, height,
+             Point3f{0.0f, 0.0f, 0.0f});
+  static_cast<void>(pcd.add_property(make_values<uint16_t>(pcd.size(), false, values_gen), "i"));
+
+  const We3dSettings set{.block_bytes_ = 1000};
+  WE_CHECK(save_we3d(pcd, path, set));
+  const auto bytes{read_file(path)};
+  bool truncated_refused{true};
+
+  for (size_t size{0}; size < bytes.size(); size += size < 128 ? 1 : 37) {
+    write_file(path, std::vector<char>(bytes.begin(), bytes.begin() + static_cast<long>(size)));
+    StructuredPointCloud3f loaded;
+    truncated_refused = truncated_refused and not load_we3d(loaded, path);
+  }
+
+  WE_CHECK(truncated_refused);
+
+  // a flipped byte in a block fails its checksum; without the checks the LZ4 decoder still
+  // stays within the block. A flipped byte in the table fails its bounds or the trailer
+  bool corrupt_refused{true};
+  bool unchecked_safe{true};
+
+  for (size_t at{detail::we3d_header_size}; at < bytes.size(); at += 13) {
+    auto corrupt{bytes};
+    corrupt[at] = static_cast<char>(corrupt[at] ^ 0x5a);
+    write_file(path, corrupt);
+
+    StructuredPointCloud3f loaded;
+    const bool read{load_we3d(loaded, path)};
+    corrupt_refused = corrupt_refused and
+                      (not read or (loaded.size() == pcd.size() and
+                                    std::ranges::equal(loaded.points(), pcd.points())));
+
+    StructuredPointCloud3f unchecked;
+    const bool read_unchecked{
+        load_we3d(unchecked, path, We3dSettings{.verify_checksums_ = false})};
+    unchecked_safe = unchecked_safe and (not read_unchecked or unchecked.size() == pcd.size());
+  }
+
+  WE_CHECK(corrupt_refused);
+  WE_CHECK(unchecked_safe);
+
+  std::error_code ec;
+  std::filesystem::remove(path, ec);
+
+  return test::result();
+}